@@ -17,6 +17,9 @@ enum settings_tags_t {
 	SET_PEER_FINGERPRINT, // char const*
 	SET_DHT_BOOTSTRAP_NODES, // char const*
 	SET_WEBTORRENT_STUN_SERVER, // char const*
+	SET_NETWORK_THREAD_AFFINITY, // char const*
+	SET_DISK_THREAD_AFFINITY, // char const*
+	SET_HASHING_THREAD_AFFINITY, // char const*
 	SET_ALLOW_MULTIPLE_CONNECTIONS_PER_IP, // int (0 or 1)
 	SET_SEND_REDUNDANT_HAVE, // int (0 or 1)
 	SET_USE_DHT_AS_FALLBACK, // int (0 or 1)
@@ -78,6 +81,11 @@ enum settings_tags_t {
 	SET_ALLOW_IDNA, // int (0 or 1)
 	SET_ENABLE_SET_FILE_VALID_DATA, // int (0 or 1)
 	SET_SOCKS5_UDP_SEND_LOCAL_EP, // int (0 or 1)
+	SET_UTP_PACING, // int (0 or 1)
+	SET_UTP_COALESCE_ACKS, // int (0 or 1)
+	SET_UTP_IO_THREAD, // int (0 or 1)
+	SET_NUMA_DISK_BUFFERS, // int (0 or 1)
+	SET_MMAP_HUGE_PAGES, // int (0 or 1)
 	SET_TRACKER_COMPLETION_TIMEOUT, // int
 	SET_TRACKER_RECEIVE_TIMEOUT, // int
 	SET_STOP_TRACKER_TIMEOUT, // int
@@ -222,6 +230,9 @@ enum settings_tags_t {
 	SET_I2P_OUTBOUND_LENGTH_VARIANCE, // int
 	SET_MIN_WEBSOCKET_ANNOUNCE_INTERVAL, // int
 	SET_WEBTORRENT_CONNECTION_TIMEOUT, // int
+	SET_UTP_MAX_WINDOW, // int
+	SET_CHECKING_QUEUE_DEPTH, // int
+	SET_DEADLINE_READ_AHEAD, // int
 };
 
 #endif // LIBTORRENT_SETTINGS_H
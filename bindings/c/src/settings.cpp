@@ -22,6 +22,9 @@ int settings_key(int const tag)
 		case SET_PEER_FINGERPRINT: return sp::peer_fingerprint;
 		case SET_DHT_BOOTSTRAP_NODES: return sp::dht_bootstrap_nodes;
 		case SET_WEBTORRENT_STUN_SERVER: return sp::webtorrent_stun_server;
+		case SET_NETWORK_THREAD_AFFINITY: return sp::network_thread_affinity;
+		case SET_DISK_THREAD_AFFINITY: return sp::disk_thread_affinity;
+		case SET_HASHING_THREAD_AFFINITY: return sp::hashing_thread_affinity;
 		case SET_ALLOW_MULTIPLE_CONNECTIONS_PER_IP: return sp::allow_multiple_connections_per_ip;
 		case SET_SEND_REDUNDANT_HAVE: return sp::send_redundant_have;
 		case SET_USE_DHT_AS_FALLBACK: return sp::use_dht_as_fallback;
@@ -83,6 +86,11 @@ int settings_key(int const tag)
 		case SET_ALLOW_IDNA: return sp::allow_idna;
 		case SET_ENABLE_SET_FILE_VALID_DATA: return sp::enable_set_file_valid_data;
 		case SET_SOCKS5_UDP_SEND_LOCAL_EP: return sp::socks5_udp_send_local_ep;
+		case SET_UTP_PACING: return sp::utp_pacing;
+		case SET_UTP_COALESCE_ACKS: return sp::utp_coalesce_acks;
+		case SET_UTP_IO_THREAD: return sp::utp_io_thread;
+		case SET_NUMA_DISK_BUFFERS: return sp::numa_disk_buffers;
+		case SET_MMAP_HUGE_PAGES: return sp::mmap_huge_pages;
 		case SET_TRACKER_COMPLETION_TIMEOUT: return sp::tracker_completion_timeout;
 		case SET_TRACKER_RECEIVE_TIMEOUT: return sp::tracker_receive_timeout;
 		case SET_STOP_TRACKER_TIMEOUT: return sp::stop_tracker_timeout;
@@ -227,6 +235,9 @@ int settings_key(int const tag)
 		case SET_I2P_OUTBOUND_LENGTH_VARIANCE: return sp::i2p_outbound_length_variance;
 		case SET_MIN_WEBSOCKET_ANNOUNCE_INTERVAL: return sp::min_websocket_announce_interval;
 		case SET_WEBTORRENT_CONNECTION_TIMEOUT: return sp::webtorrent_connection_timeout;
+		case SET_UTP_MAX_WINDOW: return sp::utp_max_window;
+		case SET_CHECKING_QUEUE_DEPTH: return sp::checking_queue_depth;
+		case SET_DEADLINE_READ_AHEAD: return sp::deadline_read_ahead;
 		default:
 			// ignore unknown tags
 			return -1;
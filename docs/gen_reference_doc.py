@@ -108,6 +108,7 @@ category_mapping = {
     'performance_counters.hpp': 'Stats',
     'read_resume_data.hpp': 'Resume Data',
     'write_resume_data.hpp': 'Resume Data',
+    'resume_journal.hpp': 'Resume Data',
     'add_torrent_params.hpp': 'Add Torrent',
     'client_data.hpp': 'Add Torrent',
     'session_status.hpp': 'Session',
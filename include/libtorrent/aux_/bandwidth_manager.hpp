@@ -56,6 +56,11 @@ private:
 
 	// these are the consumers that want bandwidth
 	std::vector<bw_request> m_queue;
+
+	// scratch space used by update_quotas(). These are kept across calls to
+	// not allocate memory every tick
+	std::vector<bw_request> m_done;
+	std::vector<bandwidth_channel*> m_channels;
 	// the number of bytes all the requests in queue are for
 	std::int64_t m_queued_bytes;
 
@@ -19,12 +19,19 @@ namespace libtorrent::aux::bencode {
 
 	using buffer = std::vector<char>;
 
-	inline void write_string(buffer& out, string_view val)
+	// writes the length prefix of a string. It's the caller's responsibility
+	// to follow it by exactly ``len`` bytes
+	inline void write_string_length(buffer& out, std::int64_t const len)
 	{
 		std::array<char, 21> buf;
-		auto const str = integer_to_str(buf, std::int64_t(val.size()));
+		auto const str = integer_to_str(buf, len);
 		out.insert(out.end(), str.begin(), str.end());
 		out.push_back(':');
+	}
+
+	inline void write_string(buffer& out, string_view val)
+	{
+		write_string_length(out, std::int64_t(val.size()));
 		out.insert(out.end(), val.begin(), val.end());
 	}
 
@@ -161,6 +161,7 @@ namespace libtorrent::aux {
 		void on_receive(error_code const& error
 			, std::size_t bytes_transferred) override;
 		void on_receive_impl(std::size_t bytes_transferred);
+		void on_receive_done() override;
 
 #if !defined TORRENT_DISABLE_ENCRYPTION
 		// next_barrier, buffers-to-prepend
@@ -169,6 +170,7 @@ namespace libtorrent::aux {
 #endif
 
 		void get_specific_peer_info(peer_info& p) const override;
+		void memory_usage(connection_memory& m) const override;
 		bool in_handshake() const override;
 		bool packet_finished() const { return m_recv_buffer.packet_finished(); }
 
@@ -258,6 +260,7 @@ namespace libtorrent::aux {
 
 		void on_connected() override;
 		void on_metadata() override;
+		void release_idle_memory() override;
 
 #if TORRENT_USE_INVARIANT_CHECKS
 		void check_invariant() const;
@@ -290,6 +293,10 @@ namespace libtorrent::aux {
 		void write_dht_port();
 
 		bool dispatch_message(int received);
+
+		// hands all HAVE messages deferred in m_have_batch to the
+		// peer_connection in one call
+		void flush_have_batch();
 		// returns the block currently being
 		// downloaded. And the progress of that
 		// block. If the peer isn't downloading
@@ -443,6 +450,13 @@ namespace libtorrent::aux {
 
 		std::vector<hash_request> m_hash_requests;
 
+		// HAVE messages received back-to-back are not handled one at a time,
+		// but collected here and handled as a batch once a different message
+		// arrives or we're done with the bytes read from the socket. This
+		// saves updating the piece picker for each one, when peers announce
+		// many pieces at once
+		std::vector<piece_index_t> m_have_batch;
+
 #if !defined TORRENT_DISABLE_ENCRYPTION
 		// initialized during write_pe1_2_dhkey, and destroyed on
 		// creation of m_enc_handler. Cannot reinitialize once
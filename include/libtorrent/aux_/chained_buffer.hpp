@@ -16,6 +16,7 @@ see LICENSE file.
 #include "libtorrent/aux_/buffer.hpp"
 
 #include <deque>
+#include <optional>
 #include <vector>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
@@ -108,8 +109,9 @@ namespace libtorrent::aux {
 		{
 			TORRENT_ASSERT(is_single_thread());
 			TORRENT_ASSERT(int(buffer.size()) >= used_size);
-			m_vec.emplace_back();
-			buffer_t& b = m_vec.back();
+			if (!m_vec) m_vec.emplace();
+			m_vec->emplace_back();
+			buffer_t& b = m_vec->back();
 			init_buffer_entry<Holder>(b, std::move(buffer), used_size);
 		}
 
@@ -118,8 +120,9 @@ namespace libtorrent::aux {
 		{
 			TORRENT_ASSERT(is_single_thread());
 			TORRENT_ASSERT(int(buffer.size()) >= used_size);
-			m_vec.emplace_front();
-			buffer_t& b = m_vec.front();
+			if (!m_vec) m_vec.emplace();
+			m_vec->emplace_front();
+			buffer_t& b = m_vec->front();
 			init_buffer_entry<Holder>(b, std::move(buffer), used_size);
 		}
 
@@ -141,6 +144,15 @@ namespace libtorrent::aux {
 
 		void clear();
 
+		// if the buffer is empty, free the memory used to keep track of
+		// buffers. It is allocated again the next time a buffer is added.
+		// This is used for idle connections
+		void release_memory();
+
+		// the number of bytes allocated on the heap for the bookkeeping of
+		// the buffer chain, not including the buffers themselves
+		std::size_t overhead_bytes() const;
+
 		void build_mutable_iovec(int bytes, std::vector<span<char>>& vec);
 
 		~chained_buffer();
@@ -185,8 +197,9 @@ namespace libtorrent::aux {
 		void build_vec(int bytes, std::vector<Buffer>& vec);
 
 		// this is the list of all the buffers we want to
-		// send
-		std::deque<buffer_t> m_vec;
+		// send. A std::deque allocates memory as soon as it's constructed,
+		// so it's only constructed once there's something to send
+		std::optional<std::deque<buffer_t>> m_vec;
 
 		// this is the number of bytes in the send buf.
 		// this will always be equal to the sum of the
@@ -0,0 +1,208 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_CHECKING_SCHEDULER_HPP_INCLUDED
+#define TORRENT_CHECKING_SCHEDULER_HPP_INCLUDED
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "libtorrent/assert.hpp"
+#include "libtorrent/aux_/drive_info.hpp" // for device_id
+
+namespace libtorrent::aux {
+
+	// Torrents checking their files draw their outstanding hash jobs from a
+	// budget per storage device, shared with every other torrent checking
+	// files on the same device. This keeps each device busy at its configured
+	// queue depth, regardless of how many torrents are checking.
+	//
+	// On sequential devices (spinning disks) only one torrent reads at a time,
+	// the others wait for it to complete or stop. This keeps reads sequential,
+	// rather than having the disk seek back and forth between torrents. Other
+	// devices are shared evenly between the torrents checking files on them.
+	//
+	// ``Client`` is notified by a call to ``checking_slots_available()`` when
+	// it's been waiting for a hash job slot and one frees up.
+	template <typename Client>
+	struct checking_scheduler
+	{
+		// ``depth`` is the number of hash jobs allowed to be outstanding per
+		// device. Lowering it takes effect as outstanding jobs complete
+		void set_depth(int const depth)
+		{
+			TORRENT_ASSERT(depth > 0);
+			m_depth = std::max(1, depth);
+			for (auto& d : m_devices) d.second.depth = m_depth;
+			for (auto& d : m_devices) wake(d.second);
+		}
+
+		void add_device(device_id const dev, bool const sequential)
+		{
+			device& d = m_devices[dev];
+			d.depth = m_depth;
+			d.sequential = sequential;
+		}
+
+		bool has_device(device_id const dev) const
+		{ return m_devices.count(dev) > 0; }
+
+		// returns the number of hash jobs, at most ``want``, ``c`` may issue
+		// on ``dev`` right now. If it's granted fewer than it wants, it's
+		// queued, and notified once more jobs can be issued.
+		int acquire(device_id const dev, std::shared_ptr<Client> const& c, int const want)
+		{
+			TORRENT_ASSERT(want > 0);
+			TORRENT_ASSERT(m_devices.count(dev) > 0);
+			device& d = m_devices[dev];
+
+			int granted = 0;
+			if (!d.sequential)
+			{
+				auto const i = d.held.find(c.get());
+				int const held = i == d.held.end() ? 0 : i->second;
+				granted = std::min({want, d.depth - d.in_use, fair_share(d, c.get()) - held});
+			}
+			else if (d.owner == nullptr || d.owner == c.get())
+			{
+				granted = std::min(want, d.depth - d.in_use);
+				if (granted > 0) d.owner = c.get();
+			}
+			granted = std::max(0, granted);
+
+			if (granted > 0)
+			{
+				d.held[c.get()] += granted;
+				d.in_use += granted;
+			}
+			if (granted < want) enqueue(d, c);
+			return granted;
+		}
+
+		// called when a hash job issued by ``c`` completes, and ``c`` has
+		// more pieces to check. Returns true if ``c`` may issue its next job
+		// in its place. Otherwise the slot is released, and ``c`` is queued
+		// behind the torrents waiting for one.
+		bool keep(device_id const dev, std::shared_ptr<Client> const& c)
+		{
+			TORRENT_ASSERT(m_devices.count(dev) > 0);
+			device& d = m_devices[dev];
+			TORRENT_ASSERT(d.held.count(c.get()) > 0);
+
+			if (d.in_use <= d.depth)
+			{
+				if (d.sequential || d.waiting.empty()) return true;
+				if (d.held[c.get()] <= fair_share(d, c.get())) return true;
+			}
+			enqueue(d, c);
+			release(dev, c.get(), 1);
+			return false;
+		}
+
+		// returns ``n`` job slots held by ``c``. Every slot acquired has to be
+		// released, once the job using it completes and isn't replaced by a
+		// new one
+		void release(device_id const dev, Client const* c, int const n)
+		{
+			TORRENT_ASSERT(n > 0);
+			TORRENT_ASSERT(m_devices.count(dev) > 0);
+			device& d = m_devices[dev];
+			auto const i = d.held.find(c);
+			TORRENT_ASSERT(i != d.held.end());
+			if (i == d.held.end()) return;
+			TORRENT_ASSERT(i->second >= n);
+			i->second -= n;
+			d.in_use -= n;
+			TORRENT_ASSERT(d.in_use >= 0);
+			if (i->second <= 0)
+			{
+				d.held.erase(i);
+				if (d.owner == c) d.owner = nullptr;
+			}
+			wake(d);
+		}
+
+		// the number of devices with hash jobs outstanding
+		int num_active_devices() const
+		{
+			return int(std::count_if(m_devices.begin(), m_devices.end()
+				, [](auto const& d) { return d.second.in_use > 0; }));
+		}
+
+		// the number of torrents waiting for a hash job slot
+		int num_queued() const
+		{
+			int ret = 0;
+			for (auto const& d : m_devices) ret += int(d.second.waiting.size());
+			return ret;
+		}
+
+	private:
+
+		struct device
+		{
+			int depth = 1;
+			bool sequential = false;
+
+			// the number of jobs outstanding on this device
+			int in_use = 0;
+
+			// on sequential devices, the torrent currently checking
+			Client const* owner = nullptr;
+
+			// the number of slots held by each torrent
+			std::map<Client const*, int> held;
+
+			// torrents waiting for a slot, in the order they asked for one
+			std::deque<std::pair<Client const*, std::weak_ptr<Client>>> waiting;
+		};
+
+		// the number of jobs each torrent using a shared device is entitled to
+		static int fair_share(device const& d, Client const* c)
+		{
+			int clients = int(d.held.size());
+			for (auto const& w : d.waiting)
+				if (w.first != c && d.held.count(w.first) == 0) ++clients;
+			if (d.held.count(c) == 0) ++clients;
+			return std::max(1, d.depth / std::max(1, clients));
+		}
+
+		static void enqueue(device& d, std::shared_ptr<Client> const& c)
+		{
+			if (std::any_of(d.waiting.begin(), d.waiting.end()
+				, [&](auto const& w) { return w.first == c.get(); }))
+				return;
+			d.waiting.emplace_back(c.get(), c);
+		}
+
+		// notify waiting torrents, in order, while there are slots to hand out.
+		// Each one is given one chance, a torrent that's still not granted
+		// anything is queued again
+		void wake(device& d)
+		{
+			auto n = d.waiting.size();
+			while (n-- > 0 && !d.waiting.empty() && d.in_use < d.depth
+				&& (!d.sequential || d.owner == nullptr))
+			{
+				std::shared_ptr<Client> c = d.waiting.front().second.lock();
+				d.waiting.pop_front();
+				if (!c) continue;
+				c->checking_slots_available();
+			}
+		}
+
+		std::map<device_id, device> m_devices;
+		int m_depth = 1;
+	};
+}
+
+#endif
@@ -13,6 +13,7 @@ see LICENSE file.
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/time.hpp" // for time_duration
+#include <cstdint>
 #include <vector>
 
 namespace libtorrent::aux {
@@ -20,6 +21,60 @@ namespace libtorrent::aux {
 	struct session_settings;
 	struct peer_connection;
 
+	// the properties of a peer (and its torrent) that determine its rank when
+	// picking peers to unchoke
+	struct unchoke_state
+	{
+		// the peer's priority on the upload channel
+		int priority = 0;
+		std::int64_t downloaded_in_last_round = 0;
+		std::int64_t uploaded_in_last_round = 0;
+		std::int64_t uploaded_since_unchoked = 0;
+		std::int64_t total_payload_upload = 0;
+		int num_have_pieces = 0;
+		bool choked = true;
+		time_point last_unchoke;
+
+		int piece_length = 0;
+		std::int64_t total_size = 0;
+	};
+
+	// the sort keys of a peer that's a candidate for unchoking. These are
+	// computed once per peer, up-front, rather than in every comparison. The
+	// comparisons are invoked O(n log n) times and computing the keys involves
+	// locking the torrent's weak_ptr and reading the clock
+	struct unchoke_candidate
+	{
+		peer_connection* peer = nullptr;
+
+		// the peer's priority on the upload channel
+		int priority = 0;
+
+		// the number of bytes they've sent us in the last round
+		std::int64_t downloaded = 0;
+
+		// round-robin only. Set if the peer has been unchoked long enough
+		// and received its quota. Such peers are de-prioritized
+		bool quota_complete = false;
+
+		// the algorithm specific score. Higher is better. For round-robin and
+		// fastest-upload, this is the number of bytes uploaded in the last
+		// round. For anti-leech, it's the anti-leech score
+		std::int64_t score = 0;
+
+		time_point last_unchoke;
+	};
+
+	// computes the sort keys for a peer, for the given
+	// settings_pack::seed_choking_algorithm
+	TORRENT_EXTRA_EXPORT unchoke_candidate make_unchoke_candidate(
+		unchoke_state const& s, int algorithm, int seeding_piece_quota
+		, time_point now);
+
+	// return true if 'lhs' peer should be preferred to be unchoked over 'rhs'
+	TORRENT_EXTRA_EXPORT bool unchoke_compare(unchoke_candidate const& lhs
+		, unchoke_candidate const& rhs);
+
 	// sorts the vector of peers in-place. When returning, the top unchoke slots
 	// elements are the peers we should unchoke. This is similar to a partial
 	// sort. Only the unchoke slots first elements are sorted.
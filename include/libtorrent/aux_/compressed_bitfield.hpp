@@ -0,0 +1,162 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_COMPRESSED_BITFIELD_HPP_INCLUDED
+#define TORRENT_COMPRESSED_BITFIELD_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/index_range.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace libtorrent::aux {
+
+	// a set of pieces, with the same interface as
+	// typed_bitfield<piece_index_t>, used to keep track of which pieces a peer
+	// has. Most peers are seeds, have almost every piece, or have almost
+	// none. Those are not stored as a full bitfield (which is 500 kiB for a
+	// torrent with 4 million pieces) but as a sorted list of the exceptions to
+	// an all-clear or all-set bitfield. A seed or a peer without any pieces
+	// has an empty list and no heap allocation at all.
+	//
+	// As long as the list is smaller than the plain bitfield would be, and
+	// holds at most max_list_size entries, it's kept. When it grows beyond
+	// that, it's turned into a bitfield. A bitfield is turned back into a list
+	// once the list would be half that size, to avoid flip-flopping between
+	// the two. The cap bounds the cost of the sorted insert for a HAVE
+	// message and of the binary search for every piece the picker considers,
+	// regardless of the number of pieces in the torrent.
+	struct TORRENT_EXTRA_EXPORT compressed_bitfield
+	{
+		enum class storage : std::uint8_t
+		{
+			// m_list holds the pieces that are set, all others are clear
+			sparse,
+			// m_list holds the pieces that are clear, all others are set
+			inverted,
+			// m_bits holds every piece
+			dense
+		};
+
+		compressed_bitfield() noexcept = default;
+		compressed_bitfield(int bits, bool val);
+		compressed_bitfield(typed_bitfield<piece_index_t> const& bits); // NOLINT
+		compressed_bitfield(compressed_bitfield const&) = default;
+		compressed_bitfield(compressed_bitfield&&) noexcept = default;
+		compressed_bitfield& operator=(compressed_bitfield const&) & = default;
+		compressed_bitfield& operator=(compressed_bitfield&&) & noexcept = default;
+		compressed_bitfield& operator=(typed_bitfield<piece_index_t> const& bits) &;
+
+		bool operator[](piece_index_t const index) const { return get_bit(index); }
+		bool get_bit(piece_index_t index) const;
+
+		void set_bit(piece_index_t index);
+		void clear_bit(piece_index_t index);
+
+		void set_all();
+		void clear_all();
+
+		// make the bitfield empty, of zero size
+		void clear();
+
+		// set the size of the bitfield to ``bits``. If it's extended, the new
+		// bits are initialized to ``val``
+		void resize(int bits, bool val);
+		void resize(int const bits) { resize(bits, false); }
+
+		int size() const noexcept { return m_size; }
+		int count() const noexcept { return m_count; }
+		bool empty() const noexcept { return m_size == 0; }
+		bool all_set() const noexcept { return m_count == m_size; }
+		bool none_set() const noexcept { return m_count == 0; }
+
+		piece_index_t end_index() const noexcept { return piece_index_t(m_size); }
+		index_range<piece_index_t> range() const noexcept
+		{ return {piece_index_t{0}, end_index()}; }
+
+		// returns the first set piece at or after ``start``, or end_index() if
+		// there is none
+		piece_index_t find_next_set(piece_index_t start) const;
+
+		// calls ``f`` with the index of every set piece, in ascending order.
+		// This is O(count()) for a sparse bitfield, which is what makes it
+		// cheap to account for a peer that has just a few pieces
+		template <typename Fun>
+		void for_each_set(Fun f) const
+		{
+			switch (m_storage)
+			{
+				case storage::sparse:
+					for (piece_index_t const i : m_list) f(i);
+					break;
+				case storage::inverted:
+				{
+					auto it = m_list.begin();
+					for (piece_index_t i(0); i != end_index(); ++i)
+					{
+						if (it != m_list.end() && *it == i)
+						{
+							++it;
+							continue;
+						}
+						f(i);
+					}
+					break;
+				}
+				case storage::dense:
+					for (piece_index_t const i : m_bits.range())
+						if (m_bits[i]) f(i);
+					break;
+			}
+		}
+
+		storage storage_type() const noexcept { return m_storage; }
+
+		// returns a plain bitfield with the same bits set
+		typed_bitfield<piece_index_t> to_bitfield() const;
+
+		// the number of bytes of heap memory used by this bitfield
+		std::size_t heap_size() const noexcept;
+
+	private:
+
+		// the list is never allowed to grow beyond this (4 kiB)
+		static constexpr int max_list_size = 1024;
+
+		// the max number of entries in m_list before it's larger than the
+		// plain bitfield, or larger than max_list_size
+		int list_limit() const noexcept
+		{ return std::min(m_size / (8 * int(sizeof(piece_index_t))), max_list_size); }
+
+		// whether ``index`` is in m_list
+		bool in_list(piece_index_t index) const;
+
+		void make_dense();
+
+		// turn a dense bitfield into a list if the list would have at most
+		// ``limit`` entries
+		void compact(int limit);
+
+		void release_list();
+
+		std::vector<piece_index_t> m_list;
+		typed_bitfield<piece_index_t> m_bits;
+		int m_size = 0;
+		int m_count = 0;
+		storage m_storage = storage::sparse;
+	};
+}
+
+#endif // TORRENT_COMPRESSED_BITFIELD_HPP_INCLUDED
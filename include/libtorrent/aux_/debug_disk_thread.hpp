@@ -93,6 +93,10 @@ inline std::string print_job(aux::disk_job const& j)
 				<< " buf-offset: " << j.buffer_offset << " size: " << j.buffer_size << " )";
 		}
 
+		void operator()(job::storage_device const&) const {
+			m_ss << "storage-device( )";
+		}
+
 	private:
 		std::stringstream& m_ss;
 	};
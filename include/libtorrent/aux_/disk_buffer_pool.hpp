@@ -23,8 +23,14 @@ see LICENSE file.
 #endif
 #include <vector>
 #include <mutex>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <cstdint>
+
+#if TORRENT_USE_NUMA
+#include <unordered_map>
+#endif
 
 #include "libtorrent/io_context.hpp"
 #include "libtorrent/span.hpp"
@@ -60,13 +66,34 @@ namespace aux {
 
 		void set_settings(settings_interface const& sett);
 
+		// the number of buffers allocated from a NUMA node slab, that were
+		// freed by a thread on the same node, and on a different node. See
+		// settings_pack::numa_disk_buffers
+		std::int64_t local_node_frees() const
+		{
+			std::unique_lock<std::mutex> l(m_pool_mutex);
+			return m_local_node_frees;
+		}
+
+		std::int64_t remote_node_frees() const
+		{
+			std::unique_lock<std::mutex> l(m_pool_mutex);
+			return m_remote_node_frees;
+		}
+
 #if TORRENT_DEBUG_BUFFER_POOL
 		void rename_buffer(char* buf, char const* category) override;
 #endif
 	private:
 
-		void free_buffer_impl(char* buf, std::unique_lock<std::mutex>& l);
-		char* allocate_buffer_impl(std::unique_lock<std::mutex>& l, char const* category);
+		// the NUMA node of the calling thread, or -1 if disk buffers aren't
+		// bound to NUMA nodes. This is determined before taking
+		// m_pool_mutex, and passed in to the _impl functions
+		int numa_node() const;
+
+		void free_buffer_impl(char* buf, std::unique_lock<std::mutex>& l, int node);
+		char* allocate_buffer_impl(std::unique_lock<std::mutex>& l, char const* category
+			, int node);
 
 		// number of disk buffers currently allocated
 		int m_in_use;
@@ -98,6 +125,41 @@ namespace aux {
 
 		mutable std::mutex m_pool_mutex;
 
+		std::int64_t m_local_node_frees = 0;
+		std::int64_t m_remote_node_frees = 0;
+
+#if TORRENT_USE_NUMA
+		// a 2 MiB block of memory, bound to a NUMA node, that disk buffers
+		// are carved out of. Slabs are aligned to their size, to allow them
+		// to be backed by huge pages, and to find the slab of a buffer
+		struct buffer_slab
+		{
+			char* base;
+			int node;
+
+			// the indices of the blocks in this slab that are not in use
+			std::vector<std::uint8_t> free_blocks;
+		};
+
+		char* allocate_slab_buffer(int node);
+		buffer_slab* new_slab(int node);
+
+		// returns false if buf was not allocated from a slab. ``node`` is the
+		// node of the freeing thread, used for the local/remote counters
+		bool free_slab_buffer(char* buf, int node);
+
+		// all slabs, indexed by their base address
+		std::unordered_map<std::uintptr_t, buffer_slab> m_slabs;
+
+		// for each NUMA node, the slabs that have free blocks. New buffers
+		// are allocated from the last one
+		std::vector<std::vector<buffer_slab*>> m_partial_slabs;
+
+		// settings_pack::numa_disk_buffers. This is read without holding
+		// m_pool_mutex
+		std::atomic<bool> m_numa{false};
+#endif
+
 		// this is specifically exempt from release_asserts
 		// since it's a quite costly check. Only for debug
 		// builds.
@@ -17,6 +17,7 @@ see LICENSE file.
 #include "libtorrent/aux_/deadline_timer.hpp"
 
 #include "libtorrent/aux_/disk_job.hpp"
+#include "libtorrent/aux_/disk_job_queue.hpp"
 #include "libtorrent/aux_/debug.hpp"
 #include "libtorrent/io_context.hpp"
 #include "libtorrent/error_code.hpp"
@@ -133,6 +134,12 @@ namespace libtorrent::aux {
 			return m_queued_jobs.size();
 		}
 
+		// TODO: the job mutex must be held when this is called
+		int num_deadline_jobs() const
+		{
+			return m_queued_jobs.num_deadline_jobs();
+		}
+
 		// TODO: the job mutex must be held when this is called
 		void submit_jobs()
 		{
@@ -150,8 +157,7 @@ namespace libtorrent::aux {
 		template<typename Fun>
 		void visit_jobs(Fun f)
 		{
-			for (auto i = m_queued_jobs.iterate(); i.get(); i.next())
-				f(i.get());
+			m_queued_jobs.visit_jobs(std::move(f));
 		}
 
 	private:
@@ -195,7 +201,7 @@ namespace libtorrent::aux {
 		std::condition_variable m_job_cond;
 
 		// jobs queued for servicing
-		jobqueue_t m_queued_jobs;
+		disk_job_queue m_queued_jobs;
 
 		// when this is set, one thread is interrupted and wait_for_job() will
 		// return even if the queue is empty (with the interrupt result)
@@ -19,6 +19,7 @@ see LICENSE file.
 #include "libtorrent/units.hpp"
 #include "libtorrent/session_types.hpp"
 #include "libtorrent/flags.hpp"
+#include "libtorrent/time.hpp"
 
 #include <variant>
 #include <string>
@@ -44,6 +45,7 @@ namespace libtorrent::aux {
 		, file_priority
 		, clear_piece
 		, partial_read
+		, storage_device
 		, num_job_ids
 	};
 
@@ -234,6 +236,16 @@ namespace job {
 		// the piece to clear
 		piece_index_t piece;
 	};
+
+	// looks up the storage device the torrent's save path is on
+	struct storage_device
+	{
+		std::function<void(std::uint64_t, bool)> handler;
+		// passed out
+		std::uint64_t device = 0;
+		// passed out
+		bool spinning = false;
+	};
 }
 
 	// disk_job is a generic base class to disk io subsystem-specifit jobs (e.g.
@@ -263,6 +275,11 @@ namespace job {
 		// flags controlling this job
 		disk_job_flags_t flags;
 
+		// the time this job should complete by, or max_time() if it doesn't
+		// have a deadline. Jobs with a deadline are executed ahead of other
+		// jobs, earliest deadline first
+		time_point deadline = max_time();
+
 		// passed out
 		// return value of operation
 		status_t ret{};
@@ -285,6 +302,7 @@ namespace job {
 			, job::file_priority
 			, job::clear_piece
 			, job::partial_read
+			, job::storage_device
 		> action;
 
 		// the type of job this is
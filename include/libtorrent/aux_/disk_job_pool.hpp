@@ -37,6 +37,7 @@ namespace aux {
 				disk_job{
 				tailqueue_node<disk_job>{},
 				flags,
+				max_time(), // deadline
 				status_t{},
 				storage_error{},
 				JobType{std::forward<Args>(args)...},
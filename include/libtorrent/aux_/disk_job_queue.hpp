@@ -0,0 +1,111 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_DISK_JOB_QUEUE_HPP_INCLUDED
+#define TORRENT_DISK_JOB_QUEUE_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "libtorrent/assert.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/aux_/disk_job.hpp"
+#include "libtorrent/aux_/tailqueue.hpp"
+
+namespace libtorrent::aux {
+
+	// the queue of disk jobs waiting for a disk thread. Jobs with a deadline
+	// are executed earliest deadline first, ahead of other jobs, which are
+	// executed in the order they were queued. To not starve jobs without a
+	// deadline, every ``deadline_burst`` deadline jobs in a row, one of the
+	// other jobs is let through.
+	struct disk_job_queue
+	{
+		static constexpr int deadline_burst = 8;
+
+		void push_back(disk_job* j)
+		{
+			TORRENT_ASSERT(j->next == nullptr);
+			if (j->deadline == max_time())
+			{
+				m_jobs.push_back(j);
+				return;
+			}
+			m_deadline_jobs.push_back({j->deadline, m_sequence++, j});
+			std::push_heap(m_deadline_jobs.begin(), m_deadline_jobs.end(), later);
+		}
+
+		void append(tailqueue<disk_job> jobs)
+		{
+			while (!jobs.empty()) push_back(jobs.pop_front());
+		}
+
+		disk_job* pop_front()
+		{
+			TORRENT_ASSERT(!empty());
+			if (!m_deadline_jobs.empty()
+				&& (m_jobs.empty() || m_burst < deadline_burst))
+			{
+				++m_burst;
+				std::pop_heap(m_deadline_jobs.begin(), m_deadline_jobs.end(), later);
+				disk_job* j = m_deadline_jobs.back().job;
+				m_deadline_jobs.pop_back();
+				return j;
+			}
+			m_burst = 0;
+			return m_jobs.pop_front();
+		}
+
+		bool empty() const
+		{ return m_jobs.empty() && m_deadline_jobs.empty(); }
+
+		int size() const
+		{ return m_jobs.size() + int(m_deadline_jobs.size()); }
+
+		// the number of queued jobs with a deadline
+		int num_deadline_jobs() const { return int(m_deadline_jobs.size()); }
+
+		// visits the jobs with a deadline first, in no particular order,
+		// followed by the other jobs in queue order
+		template <typename Fun>
+		void visit_jobs(Fun f)
+		{
+			for (auto const& e : m_deadline_jobs) f(e.job);
+			for (auto i = m_jobs.iterate(); i.get(); i.next()) f(i.get());
+		}
+
+	private:
+
+		struct deadline_job
+		{
+			time_point deadline;
+			// jobs with the same deadline are executed in the order they
+			// were queued
+			std::uint64_t sequence;
+			disk_job* job;
+		};
+
+		// the heap order, puts the earliest deadline at the front
+		static bool later(deadline_job const& lhs, deadline_job const& rhs)
+		{
+			if (lhs.deadline != rhs.deadline) return lhs.deadline > rhs.deadline;
+			return lhs.sequence > rhs.sequence;
+		}
+
+		tailqueue<disk_job> m_jobs;
+		std::vector<deadline_job> m_deadline_jobs;
+		std::uint64_t m_sequence = 0;
+
+		// the number of deadline jobs popped since the last job without one
+		int m_burst = 0;
+	};
+}
+
+#endif
@@ -30,7 +30,11 @@ POSSIBILITY OF SUCH DAMAGE.
 
 */
 
+#ifndef TORRENT_DRIVE_INFO_HPP_INCLUDED
+#define TORRENT_DRIVE_INFO_HPP_INCLUDED
+
 #include <string>
+#include <cstdint>
 
 namespace libtorrent {
 namespace aux {
@@ -45,5 +49,13 @@ enum class drive_info
 
 drive_info get_drive_info(std::string const& path);
 
+// identifies the storage device (or volume) a file is stored on. Two paths on
+// the same device have the same ID. 0 means the device could not be determined
+using device_id = std::uint64_t;
+
+device_id get_device_id(std::string const& path);
+
 }
 }
+
+#endif
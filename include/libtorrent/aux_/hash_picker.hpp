@@ -18,7 +18,7 @@ see LICENSE file.
 #include "libtorrent/aux_/merkle_tree.hpp"
 #include "libtorrent/sha1_hash.hpp"
 #include "libtorrent/file_storage.hpp"
-#include "libtorrent/bitfield.hpp"
+#include "libtorrent/aux_/compressed_bitfield.hpp"
 #include "libtorrent/time.hpp"
 #include "libtorrent/index_range.hpp"
 #include <deque>
@@ -127,7 +127,7 @@ namespace libtorrent::aux
 		hash_picker(file_storage const& files
 			, aux::vector<aux::merkle_tree, file_index_t>& trees);
 
-		hash_request pick_hashes(typed_bitfield<piece_index_t> const& pieces);
+		hash_request pick_hashes(compressed_bitfield const& pieces);
 
 		add_hashes_result add_hashes(hash_request const& req, span<sha256_hash const> hashes);
 		// TODO: support batched adding of block hashes for reduced overhead?
@@ -0,0 +1,49 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_IO_THREAD_HPP_INCLUDED
+#define TORRENT_IO_THREAD_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/io_context.hpp"
+
+#include <optional>
+#include <thread>
+
+namespace libtorrent::aux {
+
+	// an io_context with a thread of its own running it. The thread keeps
+	// running, even when there's nothing to do, until stop() is called.
+	struct TORRENT_EXTRA_EXPORT io_thread
+	{
+		explicit io_thread(char const* name);
+		~io_thread();
+
+		io_thread(io_thread const&) = delete;
+		io_thread& operator=(io_thread const&) = delete;
+
+		io_context& get_context() { return m_ioc; }
+
+		// lets the thread exit once it runs out of work, and waits for it.
+		// Anything keeping the io_context busy (sockets, timers) must be closed
+		// first, by posting to it. Handlers posted after this has returned are
+		// never run.
+		void stop();
+
+		bool is_running() const { return m_thread.joinable(); }
+
+	private:
+		io_context m_ioc;
+		std::optional<executor_work_guard<io_context::executor_type>> m_work;
+		std::thread m_thread;
+	};
+}
+
+#endif
@@ -75,6 +75,24 @@ namespace libtorrent {
 	sha256_hash merkle_root_scratch(span<sha256_hash const> leaves, int num_leafs
 		, sha256_hash pad, std::vector<sha256_hash>& scratch_space);
 
+	// computes the root of a subtree with ``num_leafs`` leafs (a power of 2),
+	// the first ones being ``leafs`` and the remaining ones zero padding.
+	// Unlike merkle_root(), this does not allocate memory.
+	TORRENT_EXTRA_EXPORT
+	sha256_hash merkle_subtree_root(span<sha256_hash const> leafs, int num_leafs);
+
+	// validates consecutive subtrees of ``leafs_per_root`` leafs each against
+	// the corresponding hash in ``roots``. The bits in ``verified`` are set for
+	// the leafs of subtrees that validate, and the leafs of subtrees that fail
+	// are cleared. Subtrees with leafs missing (i.e. all zeros) are left
+	// unchanged. The number of leafs may end in the middle of the last
+	// subtree, the rest of it is zero padding.
+	// This function only touches its arguments, so it's safe to run on any
+	// thread, with the tree the leafs belong to being updated afterwards.
+	TORRENT_EXTRA_EXPORT
+	void merkle_verify_subtrees(span<sha256_hash> leafs
+		, span<sha256_hash const> roots, int leafs_per_root, bitfield& verified);
+
 	// given a flat index, return which layer the node is in
 	TORRENT_EXTRA_EXPORT int merkle_get_layer(int idx);
 	// given a flat index, return the offset in the layer
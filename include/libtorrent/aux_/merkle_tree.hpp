@@ -49,14 +49,12 @@ struct add_hashes_result_t
 // metadata, we have files on disk but no hashes. We won't know whether the data
 // on disk is valid or not, until we've downloaded the hashes to validate them.
 
-// Idea for future space optimization:
-// while downloading, we need to store interior nodes of this tree. However, we
-// don't need to store the padding. a SHA-256 is 32 bytes. Instead of storing
-// the full (padded) tree of SHA-256 hashes, store the full tree of 32 bit
-// signed integers, being indices into the actual storage for the tree. We could
-// even grow the storage lazily. Instead of storing the padding hashes, use
-// negative indices to refer to fixed SHA-256(0), and SHA-256(SHA-256(0)) and so
-// on
+// When the piece layer is known up-front, the tree is never fully allocated.
+// Block hashes are stored next to the piece layer as they arrive, and each
+// piece is verified on its own once all of its block hashes are in. The
+// interior nodes between the two layers, and the padding, are computed on
+// demand. A full tree is only allocated when the piece layer is not known, or
+// when hashes are added that can't be validated against a single piece.
 struct TORRENT_EXTRA_EXPORT merkle_tree
 {
 	// TODO: remove this constructor. Don't support "uninitialized" trees. This
@@ -143,6 +141,21 @@ private:
 	void optimize_storage();
 	void optimize_storage_piece_layer();
 	void allocate_full();
+	void allocate_partial();
+
+	// returns true if the blocks in the specified piece have been verified
+	// against the piece hash. Only valid in the partial_block_layer mode
+	bool piece_verified(int piece) const;
+
+	// returns nodes below the piece layer, in partial_block_layer mode
+	sha256_hash get_partial_node(int idx) const;
+
+	// the partial_block_layer counterparts of set_block() and add_hashes()
+	std::tuple<set_block_result, int, int> set_block_partial(int block_index
+		, sha256_hash const& h);
+	add_hashes_result_t add_piece_blocks(int piece
+		, piece_index_t::diff_type file_piece_offset
+		, span<sha256_hash const> hashes);
 
 	// a pointer to the root hash for this file.
 	char const* m_root = nullptr;
@@ -152,7 +165,13 @@ private:
 	// TODO: make this a std::unique_ptr<sha256_hash[]>
 	aux::vector<sha256_hash> m_tree;
 
-	// when the full tree is allocated, this has one bit for each block hash. a
+	// in partial_block_layer mode, this holds one hash per block, all zeros
+	// for the ones we don't have yet. It's allocated once the first block
+	// hash is set, and is empty in all other modes
+	aux::vector<sha256_hash> m_blocks;
+
+	// when the full tree or the block hashes are allocated, this has one bit
+	// for each block hash. a
 	// 1 means we have verified the block hash to be correct, otherwise the block
 	// hash may represent what's on disk, but we haven't been able to verify it
 	// yet
@@ -187,7 +206,13 @@ private:
 
 		// in this mode, m_tree represents the block (leaf) layer only, no padding
 		// and all block layer hashes are stored and valid
-		block_layer
+		block_layer,
+
+		// in this mode, m_tree represents the piece layer, just like
+		// piece_layer mode, and m_blocks holds the block hashes we have so
+		// far. The bits in m_block_verified are set for the blocks of pieces
+		// that have been verified against the piece layer
+		partial_block_layer
 	};
 	mode_t m_mode = mode_t::uninitialized_tree;
 
@@ -94,8 +94,14 @@ namespace libtorrent::aux {
 			, piece_index_t piece, int offset, aux::open_mode_t mode
 			, disk_job_flags_t flags, storage_error&);
 
+		// hint the operating system that ``piece`` will be read soon, so it
+		// can start reading it in the background
+		void read_ahead(settings_interface const&, piece_index_t piece
+			, storage_error&);
+
 		file_storage const& files() const { return m_files; }
 		filenames names() const;
+		std::string const& save_path() const { return m_save_path; }
 
 		bool set_need_tick()
 		{
@@ -30,6 +30,7 @@ see LICENSE file.
 #include <list>
 #include <array>
 #include <cstdint>
+#include <memory>
 
 namespace libtorrent::aux {
 
@@ -39,12 +40,9 @@ namespace libtorrent::aux {
 
 	TORRENT_EXTRA_EXPORT std::array<char, 96> export_key(key_t const& k);
 
-	// RC4 state from libtomcrypt
-	struct rc4 {
-		int x;
-		int y;
-		aux::array<std::uint8_t, 256> buf;
-	};
+	// the RC4 cipher state. It's defined in pe_crypto.cpp, since it depends
+	// on which crypto library is used
+	struct rc4;
 
 	// TODO: 3 dh_key_exchange should probably move into its own file
 	class TORRENT_EXTRA_EXPORT dh_key_exchange
@@ -113,6 +111,7 @@ namespace libtorrent::aux {
 	{
 	public:
 		rc4_handler();
+		~rc4_handler() override;
 
 		// Input keys must be 20 bytes
 		void set_incoming_key(span<char const> key) override;
@@ -123,9 +122,12 @@ namespace libtorrent::aux {
 
 		std::tuple<int, int, int> decrypt(span<span<char>> buf) override;
 
+		// the number of bytes allocated for the cipher states
+		std::size_t heap_size() const;
+
 	private:
-		rc4 m_rc4_incoming;
-		rc4 m_rc4_outgoing;
+		std::unique_ptr<rc4> m_rc4_incoming;
+		std::unique_ptr<rc4> m_rc4_outgoing;
 
 		// determines whether or not encryption and decryption is enabled
 		bool m_encrypt;
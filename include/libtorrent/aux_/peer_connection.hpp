@@ -26,6 +26,7 @@ see LICENSE file.
 #include "libtorrent/aux_/chained_buffer.hpp"
 #include "libtorrent/disk_buffer_holder.hpp"
 #include "libtorrent/bitfield.hpp"
+#include "libtorrent/aux_/compressed_bitfield.hpp"
 #include "libtorrent/aux_/bandwidth_socket.hpp"
 #include "libtorrent/error_code.hpp"
 #include "libtorrent/aux_/sliding_average.hpp"
@@ -159,6 +160,22 @@ namespace libtorrent::aux {
 		peer_id our_peer_id;
 	};
 
+	// the memory used by peer connections, broken down by component. This is
+	// filled in by peer_connection::memory_usage(), to report in the session
+	// stats counters
+	struct connection_memory
+	{
+		// the connection objects themselves
+		std::int64_t objects = 0;
+		std::int64_t recv_buffers = 0;
+		// the buffers holding data to be sent, and the bookkeeping of them
+		std::int64_t send_buffers = 0;
+		// request queues, piece lists and other containers
+		std::int64_t queues = 0;
+		// the have-bitfields of the peers
+		std::int64_t bitfields = 0;
+	};
+
 	struct TORRENT_EXTRA_EXPORT peer_connection_hot_members
 	{
 		// if tor is set, this is an outgoing connection
@@ -183,8 +200,9 @@ namespace libtorrent::aux {
 
 	protected:
 
-		// the pieces the other end have
-		typed_bitfield<piece_index_t> m_have_piece;
+		// the pieces the other end have. Seeds and peers that have almost all
+		// or almost none of the pieces don't need a full bitfield
+		compressed_bitfield m_have_piece;
 
 		// this is the torrent this connection is
 		// associated with. If the connection is an
@@ -471,7 +489,7 @@ namespace libtorrent::aux {
 		std::string const& local_i2p_endpoint() const override;
 #endif
 
-		typed_bitfield<piece_index_t> const& get_bitfield() const;
+		compressed_bitfield const& get_bitfield() const;
 		std::vector<piece_index_t> const& allowed_fast();
 		std::vector<piece_index_t> const& suggested_pieces() const { return m_suggested_pieces; }
 
@@ -559,6 +577,12 @@ namespace libtorrent::aux {
 		void incoming_interested();
 		void incoming_not_interested();
 		void incoming_have(piece_index_t piece_index);
+
+		// handles a run of HAVE messages received back-to-back. The piece
+		// picker's refcounts are updated in a single call for all pieces the
+		// peer didn't already have. ``pieces`` is used as scratch space and is
+		// clobbered.
+		void incoming_haves(span<piece_index_t> pieces);
 		void incoming_dont_have(piece_index_t piece_index);
 		void incoming_bitfield(typed_bitfield<piece_index_t> const& bits);
 		void incoming_request(peer_request const& r);
@@ -695,8 +719,17 @@ namespace libtorrent::aux {
 
 		int get_priority(int channel) const;
 
+		// adds the memory used by this connection to ``m``. Derived classes
+		// add their own members
+		virtual void memory_usage(connection_memory& m) const;
+
 	protected:
 
+		// called when the connection hasn't sent or received anything for
+		// idle_memory_timeout. Frees the capacity of empty containers and
+		// buffers. Derived classes release their own members
+		virtual void release_idle_memory();
+
 		virtual void get_specific_peer_info(peer_info& p) const = 0;
 
 		virtual void write_choke() = 0;
@@ -722,6 +755,11 @@ namespace libtorrent::aux {
 		// implemented by concrete connection classes
 		virtual void on_receive(error_code const& error
 			, std::size_t bytes_transferred) = 0;
+
+		// called once all bytes read from the socket in one go have been
+		// passed to on_receive(). Messages that are deferred and handled
+		// in batches are flushed here
+		virtual void on_receive_done() {}
 		virtual void on_sent(error_code const& error
 			, std::size_t bytes_transferred) = 0;
 
@@ -17,6 +17,7 @@ see LICENSE file.
 #define TORRENT_POLICY_HPP_INCLUDED
 
 #include <algorithm>
+#include <vector>
 
 #include "libtorrent/fwd.hpp"
 #include "libtorrent/aux_/string_util.hpp" // for allocate_string_copy
@@ -30,10 +31,11 @@ see LICENSE file.
 #include "libtorrent/config.hpp"
 #include "libtorrent/aux_/debug.hpp"
 #include "libtorrent/peer_connection_interface.hpp"
-#include "libtorrent/aux_/deque.hpp"
+#include "libtorrent/aux_/vector.hpp"
 #include "libtorrent/peer_info.hpp" // for peer_source_flags_t
 #include "libtorrent/string_view.hpp"
 #include "libtorrent/pex_flags.hpp"
+#include "libtorrent/span.hpp"
 
 namespace libtorrent::aux {
 
@@ -74,6 +76,19 @@ namespace libtorrent::aux {
 		std::vector<torrent_peer*> erased;
 	};
 
+	// the outcome of adding one of the peers passed to peer_list::add_peers()
+	enum class add_peer_result : std::uint8_t
+	{
+		// the peer was invalid, or did not fit in the peer list
+		rejected,
+
+		// the peer was not in the peer list before
+		added,
+
+		// the peer was already in the peer list, and was updated
+		updated
+	};
+
 	struct erase_peer_flags_tag;
 	using erase_peer_flags_t = flags::bitfield_flag<std::uint8_t, erase_peer_flags_tag>;
 
@@ -105,6 +120,16 @@ namespace libtorrent::aux {
 		torrent_peer* add_peer(tcp::endpoint const& remote
 			, peer_source_flags_t, pex_flags_t, torrent_state*);
 
+		// adds a batch of peers from the same source. This has the same
+		// effect as calling add_peer() for each of them, in order, but the
+		// peer list and its index only grow once for the whole batch. If
+		// peer_flags is not empty, it holds additional flags for each peer in
+		// remotes. result is set to one entry per peer in remotes.
+		void add_peers(span<tcp::endpoint const> remotes
+			, peer_source_flags_t, pex_flags_t
+			, span<pex_flags_t const> peer_flags
+			, torrent_state*, std::vector<add_peer_result>& result);
+
 		// false means duplicate connection
 		bool update_peer_port(int port, torrent_peer* p
 			, peer_source_flags_t src
@@ -144,7 +169,13 @@ namespace libtorrent::aux {
 		int num_peers() const { return int(m_peers.size()); }
 		int num_candidate_cache() const { return int(m_candidate_cache.size()); }
 
-		using peers_t = aux::deque<torrent_peer*>;
+		// the position in the peer list where the next search for connect
+		// candidates starts
+		int round_robin() const { return m_round_robin; }
+
+		// the peers are not kept in any particular order. Erasing a peer moves
+		// other peers into its place, see erase_peer()
+		using peers_t = aux::vector<torrent_peer*>;
 		using iterator = peers_t::iterator;
 		using const_iterator = peers_t::const_iterator;
 		iterator begin() { return m_peers.begin(); }
@@ -152,21 +183,8 @@ namespace libtorrent::aux {
 		const_iterator begin() const { return m_peers.begin(); }
 		const_iterator end() const { return m_peers.end(); }
 
-		std::pair<iterator, iterator> find_peers(address const& a)
-		{
-#if TORRENT_USE_I2P
-			if (a == address())
-				return std::pair<iterator, iterator>(m_peers.end(), m_peers.end());
-#endif
-			return std::equal_range(
-				m_peers.begin(), m_peers.end(), a, peer_address_compare());
-		}
-
-		std::pair<const_iterator, const_iterator> find_peers(address const& a) const
-		{
-			return std::equal_range(
-				m_peers.begin(), m_peers.end(), a, peer_address_compare());
-		}
+		// returns all peers with the IP address a
+		std::vector<torrent_peer*> find_peers(address const& a) const;
 
 		torrent_peer* connect_one_peer(int session_time, torrent_state* state);
 
@@ -188,8 +206,46 @@ namespace libtorrent::aux {
 
 		void update_peer(torrent_peer* p, peer_source_flags_t src
 			, pex_flags_t flags, tcp::endpoint const& remote);
-		bool insert_peer(torrent_peer* p, iterator iter
-			, pex_flags_t flags, torrent_state* state);
+		bool insert_peer(torrent_peer* p, pex_flags_t flags, torrent_state* state);
+
+		// the implementation of add_peer(), without the invariant check
+		torrent_peer* add_peer_impl(tcp::endpoint const& remote
+			, peer_source_flags_t, pex_flags_t, torrent_state*);
+
+		// adds p to the end of m_peers and to the index
+		void append_peer(torrent_peer* p);
+
+		// returns the slot in m_peer_index where a search for a peer whose
+		// index key is hash starts
+		std::size_t index_slot(std::size_t hash) const;
+
+		// adds the peer at position pos in m_peers to m_peer_index. There must
+		// be room for it
+		void index_insert(int pos);
+
+		// makes m_peer_index large enough to hold num_peers peers, and
+		// re-inserts all peers
+		void reserve_index(std::size_t num_peers);
+
+		// returns the position in m_peers of the first peer whose index key is
+		// hash, and that satisfies pred. Returns -1 if there is no such peer
+		template <typename Pred>
+		int find_peer_index(std::size_t hash, Pred pred) const;
+
+		// returns a peer with the address a (in no particular order), or
+		// nullptr if there is none
+		torrent_peer* find_peer(address const& a) const;
+
+		// returns the peer with the endpoint ep, or nullptr if there is none
+		torrent_peer* find_peer(tcp::endpoint const& ep) const;
+
+#if TORRENT_USE_I2P
+		torrent_peer* find_i2p_peer(string_view dest) const;
+#endif
+
+		// update the index entry for the peer p, currently at position from in
+		// m_peers, to refer to position to. If to is -1, the entry is removed
+		void update_index(torrent_peer const* p, int from, int to);
 
 		void find_connect_candidates(std::vector<torrent_peer*>& peers
 			, int session_time, torrent_state* state);
@@ -204,6 +260,18 @@ namespace libtorrent::aux {
 
 		peers_t m_peers;
 
+		// the positions in m_peers, in an open addressing hash table keyed on
+		// the hash of each peer's address (or i2p destination). Collisions are
+		// resolved by linear probing, and empty slots are -1. The size is a
+		// power of two, and it's kept at most half full. This makes finding a
+		// peer by address independent of the size of the peer list. Multiple
+		// peers may share an address, and hashes may collide, so lookups must
+		// compare the actual address of the peers
+		std::vector<int> m_peer_index;
+
+		// log2 of the size of m_peer_index
+		int m_index_bits = 0;
+
 		// this should be nullptr for the most part. It's set
 		// to point to a valid torrent_peer object if that
 		// object needs to be kept alive. If we ever feel
@@ -230,7 +298,9 @@ namespace libtorrent::aux {
 		std::uint32_t m_finished:1;
 
 		// since the torrent_peer list can grow too large
-		// to scan all of it, start at this index
+		// to scan all of it, start at this index. The peers before it have
+		// been visited in the current lap through the list, the ones at and
+		// after it have not. erase_peer() keeps it that way
 		int m_round_robin = 0;
 
 		// a list of good connect candidates
@@ -0,0 +1,68 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_PEX_ENCODER_HPP_INCLUDED
+#define TORRENT_PEX_ENCODER_HPP_INCLUDED
+
+#include <memory>
+#include <vector>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/span.hpp"
+#include "libtorrent/pex_flags.hpp"
+
+namespace libtorrent::aux {
+
+	// a peer to include in a ut_pex message
+	struct pex_peer
+	{
+		tcp::endpoint ep;
+		pex_flags_t flags;
+	};
+
+	// builds the bencoded body of ut_pex messages. It remembers which peers
+	// were included in the previous message, to only send the differences.
+	// The encoded messages are immutable and shared, so the same buffer can be
+	// queued in the send buffer of every peer connection, without copying it
+	struct TORRENT_EXTRA_EXPORT pex_encoder
+	{
+		using message = std::shared_ptr<std::vector<char> const>;
+
+		// encodes the difference between ``peers`` and the peers included in
+		// the previous call. At most ``max_added`` new peers are included,
+		// the ones left out are added by later calls. Peers are included in
+		// the order they appear in ``peers``
+		void update(span<pex_peer const> peers, int max_added);
+
+		// the message built by the last call to update()
+		message const& msg() const { return m_msg; }
+		int num_added() const { return m_num_added; }
+		int num_dropped() const { return m_num_dropped; }
+
+		// encodes a message with the first ``max_added`` of ``peers``, and
+		// nothing dropped. This is the first message sent to a peer
+		static message full_message(span<pex_peer const> peers, int max_added);
+
+	private:
+
+		// the peers included in the last message, sorted
+		std::vector<tcp::endpoint> m_peers;
+
+		// scratch space, kept to not reallocate it on every update
+		std::vector<tcp::endpoint> m_current;
+		std::vector<tcp::endpoint> m_next;
+
+		message m_msg;
+		int m_num_added = 0;
+		int m_num_dropped = 0;
+	};
+}
+
+#endif
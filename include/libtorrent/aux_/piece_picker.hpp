@@ -40,10 +40,9 @@ see LICENSE file.
 #include "libtorrent/flags.hpp"
 #include "libtorrent/units.hpp"
 #include "libtorrent/index_range.hpp"
+#include "libtorrent/aux_/compressed_bitfield.hpp"
 
 namespace libtorrent {
-	template <typename Index>
-	struct typed_bitfield;
 	struct counters;
 }
 
@@ -223,13 +222,20 @@ namespace libtorrent::aux {
 		void inc_refcount(piece_index_t, aux::torrent_peer const*);
 		void dec_refcount(piece_index_t, aux::torrent_peer const*);
 
-		// increases the peer count for the given piece
-		// (is used when a BITFIELD message is received)
-		void inc_refcount(typed_bitfield<piece_index_t> const& bitmask
+		// increases the peer count for all the given pieces
+		// (is used when a batch of HAVE messages is received)
+		void inc_refcount(span<piece_index_t const> pieces
+			, aux::torrent_peer const* peer);
+
+		// increases the peer count for the given pieces
+		// (is used when a BITFIELD message is received). This is
+		// proportional to the number of pieces set in bitmask, peers with
+		// just a few pieces are cheap to add
+		void inc_refcount(compressed_bitfield const& bitmask
 			, const aux::torrent_peer* peer);
-		// decreases the peer count for the given piece
+		// decreases the peer count for the given pieces
 		// (used when a peer disconnects)
-		void dec_refcount(typed_bitfield<piece_index_t> const& bitmask
+		void dec_refcount(compressed_bitfield const& bitmask
 			, const aux::torrent_peer* peer);
 
 		// these will increase and decrease the peer count
@@ -311,7 +317,7 @@ namespace libtorrent::aux {
 		// used by web_peer_connection to request larger blocks at a time to
 		// mitigate limited pipelining and lack of keep-alive (i.e. higher
 		// overhead per request).
-		picker_flags_t pick_pieces(typed_bitfield<piece_index_t> const& pieces
+		picker_flags_t pick_pieces(compressed_bitfield const& pieces
 			, std::vector<piece_block>& interesting_blocks, int num_blocks
 			, int prefer_contiguous_blocks, aux::torrent_peer* peer
 			, picker_options_t options, std::vector<piece_index_t> const& suggested_pieces
@@ -325,7 +331,7 @@ namespace libtorrent::aux {
 		// added to backup_blocks. num blocks is the number of
 		// blocks to be picked. Blocks are not picked from pieces
 		// that are being downloaded
-		int add_blocks(piece_index_t piece, typed_bitfield<piece_index_t> const& pieces
+		int add_blocks(piece_index_t piece, compressed_bitfield const& pieces
 			, std::vector<piece_block>& interesting_blocks
 			, std::vector<piece_block>& backup_blocks2
 			, int num_blocks, int prefer_contiguous_blocks
@@ -488,9 +494,9 @@ namespace libtorrent::aux {
 		// used in debug mode
 		void verify_priority(prio_index_t start, prio_index_t end, int prio) const;
 		void verify_pick(span<piece_block const> picked
-			, typed_bitfield<piece_index_t> const& bits) const;
+			, compressed_bitfield const& bits) const;
 
-		void check_peer_invariant(typed_bitfield<piece_index_t> const& have
+		void check_peer_invariant(compressed_bitfield const& have
 			, aux::torrent_peer const* p) const;
 		void check_invariant(const aux::torrent* t = nullptr) const;
 #endif
@@ -518,7 +524,7 @@ namespace libtorrent::aux {
 
 		// picks blocks only from downloading pieces
 		int add_blocks_downloading(downloading_piece const& dp
-			, typed_bitfield<piece_index_t> const& pieces
+			, compressed_bitfield const& pieces
 			, std::vector<piece_block>& interesting_blocks
 			, std::vector<piece_block>& backup_blocks
 			, int num_blocks, int prefer_contiguous_blocks
@@ -550,11 +556,11 @@ namespace libtorrent::aux {
 			piece_picker::downloading_piece const& p
 			, int num_blocks_in_piece, aux::torrent_peer* peer) const;
 
-		bool can_pick(piece_index_t piece, typed_bitfield<piece_index_t> const& bitmask) const;
-		bool is_piece_free(piece_index_t piece, typed_bitfield<piece_index_t> const& bitmask) const;
+		bool can_pick(piece_index_t piece, compressed_bitfield const& bitmask) const;
+		bool is_piece_free(piece_index_t piece, compressed_bitfield const& bitmask) const;
 		index_range<piece_index_t>
 		expand_piece(piece_index_t piece, int contiguous_blocks
-			, typed_bitfield<piece_index_t> const& have
+			, compressed_bitfield const& have
 			, picker_options_t options) const;
 
 		struct piece_pos
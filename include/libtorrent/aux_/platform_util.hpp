@@ -2,8 +2,10 @@
 #define TORRENT_PLATFORM_UTIL_HPP
 
 #include "libtorrent/aux_/export.hpp"
+#include "libtorrent/string_view.hpp"
 
 #include <cstdint>
+#include <vector>
 
 namespace libtorrent::aux {
 
@@ -11,6 +13,21 @@ namespace libtorrent::aux {
 
 	void set_thread_name(char const* name);
 
+	// parses a list of CPU numbers and ranges, like "0-3,8,10-11", into
+	// ``cpus``. Returns false if the list is malformed
+	TORRENT_EXTRA_EXPORT bool parse_cpu_list(string_view list, std::vector<int>& cpus);
+
+	// pins the calling thread to the CPUs in ``cpus``, in the format accepted
+	// by parse_cpu_list(). An empty list lets the thread run on the same CPUs
+	// as the process' main thread.
+	// Returns false if the list is malformed, or if setting the affinity
+	// failed or isn't supported on this platform
+	bool set_thread_affinity(string_view cpus);
+
+	// the NUMA node of the CPU the calling thread is running on. This is 0
+	// on systems that aren't NUMA, or where it can't be determined
+	TORRENT_EXTRA_EXPORT int current_numa_node();
+
 }
 
 #endif // TORRENT_PLATFORM_UTIL_HPP
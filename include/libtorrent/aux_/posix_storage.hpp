@@ -33,6 +33,7 @@ namespace aux {
 		explicit posix_storage(storage_params const& p);
 		file_storage const& files() const { return m_files; }
 		filenames names() const;
+		std::string const& save_path() const { return m_save_path; }
 		~posix_storage();
 
 		int read(settings_interface const& sett
@@ -54,6 +54,7 @@ see LICENSE file.
 #include "libtorrent/aux_/socket_io.hpp" // for print_address
 #include "libtorrent/address.hpp"
 #include "libtorrent/aux_/utp_socket_manager.hpp"
+#include "libtorrent/aux_/io_thread.hpp"
 #include "libtorrent/aux_/bloom_filter.hpp"
 #include "libtorrent/peer_class.hpp"
 #include "libtorrent/peer_class_type_filter.hpp"
@@ -74,6 +75,8 @@ see LICENSE file.
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <optional>
 #include <vector>
 #include <set>
 #include <list>
@@ -167,8 +170,7 @@ namespace aux {
 
 		udp::endpoint get_local_endpoint() override
 		{
-			error_code ec;
-			if (udp_sock) return udp_sock->sock.local_endpoint(ec);
+			if (udp_sock) return udp_sock->local_endpoint();
 			return {local_endpoint.address(), local_endpoint.port()};
 		}
 
@@ -413,6 +415,11 @@ namespace aux {
 
 			void incoming_connection(socket_type);
 
+			// the io_context the uTP socket managers and the UDP sockets run on.
+			// This is m_io_context unless the utp_io_thread setting is enabled
+			io_context& utp_context()
+			{ return m_utp_thread ? m_utp_thread->get_context() : m_io_context; }
+
 			std::weak_ptr<torrent> find_torrent(info_hash_t const&) const override;
 #if TORRENT_ABI_VERSION == 1
 			//deprecated in 1.2
@@ -735,6 +742,10 @@ namespace aux {
 
 			void deferred_submit_jobs() override;
 
+			void add_checking_device(device_id dev, bool spinning) override;
+			aux::checking_scheduler<torrent>& checking_scheduler() override
+			{ return m_checking_scheduler; }
+
 			// implements dht_observer
 			void set_external_address(aux::listen_socket_handle const& iface
 				, address const& ip, address const& source) override;
@@ -815,6 +826,8 @@ namespace aux {
 			void update_connection_speed();
 			void update_alert_queue_size();
 			void update_disk_threads();
+			void update_network_thread_affinity();
+			void update_checking_queue_depth();
 			void update_report_web_seed_downloads();
 			void update_outgoing_interfaces();
 			void update_listen_interfaces();
@@ -880,6 +893,11 @@ namespace aux {
 
 			io_context& m_io_context;
 
+			// when the utp_io_thread setting is enabled, the uTP socket managers
+			// and the UDP sockets run on this thread. The objects using its
+			// io_context are declared after it, to be destructed before it
+			std::unique_ptr<io_thread> m_utp_thread;
+
 #if TORRENT_USE_SSL
 			// this is a generic SSL context used when talking to HTTPS servers
 			ssl::context m_ssl_ctx;
@@ -943,6 +961,10 @@ namespace aux {
 
 			tracker_manager m_tracker_manager;
 
+			// hands out hash jobs to torrents checking their files, per
+			// storage device
+			aux::checking_scheduler<torrent> m_checking_scheduler;
+
 			// the torrents must be destructed after the torrent_peer_allocator,
 			// since the torrents hold the peer lists that own the torrent_peers
 			// (which are allocated in the torrent_peer_allocator)
@@ -1159,6 +1181,9 @@ namespace aux {
 			int m_outstanding_router_lookups = 0;
 #endif
 
+			// these may be called from the network thread. When uTP runs on
+			// m_utp_thread, the packet is copied and sent from there, and send
+			// errors are not reported back
 			void send_udp_packet_hostname(std::weak_ptr<utp_socket_interface> sock
 				, char const* hostname
 				, int port
@@ -1166,6 +1191,19 @@ namespace aux {
 				, error_code& ec
 				, udp_send_flags_t flags);
 
+			// these may only be called on the thread running utp_context()
+			void send_udp_packet_hostname_direct(std::weak_ptr<utp_socket_interface> sock
+				, char const* hostname
+				, int port
+				, span<char const> p
+				, error_code& ec
+				, udp_send_flags_t flags);
+			void send_udp_packet_direct(std::weak_ptr<utp_socket_interface> sock
+				, udp::endpoint const& ep
+				, span<char const> p
+				, error_code& ec
+				, udp_send_flags_t flags);
+
 			void send_udp_packet_hostname_listen(aux::listen_socket_handle const& sock
 				, char const* hostname
 				, int port
@@ -1203,12 +1241,41 @@ namespace aux {
 				send_udp_packet(sock.get_ptr(), ep, p, ec, flags);
 			}
 
-			void on_udp_writeable(std::weak_ptr<session_udp_socket> s, error_code const& ec);
+			void on_udp_writeable(std::weak_ptr<session_udp_socket> s
+				, transport ssl, error_code const& ec);
 
 			void on_udp_packet(std::weak_ptr<session_udp_socket> s
 				, std::weak_ptr<listen_socket_t> ls
 				, transport ssl, error_code const& ec);
 
+			// passes a packet that isn't a uTP packet on to the DHT or the
+			// tracker manager, on the network thread
+			void dispatch_udp_packet(std::weak_ptr<listen_socket_t> const& ls
+				, udp_socket::packet const& packet);
+			void handle_udp_packet(std::weak_ptr<listen_socket_t> const& ls
+				, udp_socket::packet const& packet);
+
+			// calls ``f`` on the thread running utp_context(). This is used for
+			// operations on the UDP sockets initiated by the network thread
+			template <typename Fun>
+			void udp_call(Fun f)
+			{
+				if (m_utp_thread) post(m_utp_thread->get_context(), std::move(f));
+				else f();
+			}
+
+			resolver_interface& udp_resolver()
+			{ return m_utp_resolver ? *m_utp_resolver : m_host_resolver; }
+
+			error_handler_interface& udp_error_handler();
+
+			// the uTP sockets of both managers, as of the last tick
+			int num_utp_sockets() const;
+
+			void on_utp_thread_incoming(socket_type s, transport ssl);
+			void on_utp_tick(error_code const& e);
+			void stop_utp_thread();
+
 			libtorrent::aux::utp_socket_manager m_utp_socket_manager;
 
 #ifdef TORRENT_SSL_PEERS
@@ -1216,6 +1283,25 @@ namespace aux {
 			libtorrent::aux::utp_socket_manager m_ssl_utp_socket_manager;
 #endif
 
+			// the members below are only used when uTP runs on m_utp_thread.
+			// The timer ticks the socket managers and the resolver is used for
+			// the SOCKS5 connections of the UDP sockets
+			std::optional<deadline_timer> m_utp_tick_timer;
+			std::optional<resolver> m_utp_resolver;
+			time_point m_last_utp_decay;
+			std::atomic<int> m_utp_num_sockets{0};
+
+			// the handlers on m_utp_thread can't call abort() directly, this
+			// posts fatal errors to the network thread instead
+			struct utp_error_handler_t final : error_handler_interface
+			{
+				explicit utp_error_handler_t(session_impl& s) : m_ses(s) {}
+				void on_exception(std::exception const& e) override;
+				void on_error(error_code const& ec) override;
+				session_impl& m_ses;
+			};
+			utp_error_handler_t m_utp_error_handler{*this};
+
 			// the number of torrent connection boosts
 			// connections that have been made this second
 			// this is deducted from the connect speed
@@ -30,6 +30,7 @@ see LICENSE file.
 #include "libtorrent/info_hash.hpp"
 #include "libtorrent/aux_/socket_type.hpp"
 #include "libtorrent/aux_/ssl.hpp"
+#include "libtorrent/aux_/checking_scheduler.hpp"
 
 #include <functional>
 #include <memory>
@@ -167,6 +168,11 @@ namespace libtorrent::aux {
 
 		virtual void deferred_submit_jobs() = 0;
 
+		// makes the checking scheduler aware of a storage device, unless it
+		// already is. Spinning disks are checked one torrent at a time
+		virtual void add_checking_device(device_id dev, bool spinning) = 0;
+		virtual aux::checking_scheduler<torrent>& checking_scheduler() = 0;
+
 		virtual std::uint16_t listen_port() const = 0;
 		virtual std::uint16_t ssl_listen_port() const = 0;
 
@@ -35,7 +35,10 @@ namespace aux {
 		explicit session_udp_socket(io_context& ios, listen_socket_handle ls)
 			: sock(ios, std::move(ls)) {}
 
-		udp::endpoint local_endpoint() { return sock.local_endpoint(); }
+		// the socket may be owned by a different thread than the network
+		// thread, which is why its local endpoint is cached once it's bound
+		udp::endpoint local_endpoint() const { return m_local_endpoint; }
+		void cache_local_endpoint() { m_local_endpoint = sock.local_endpoint(); }
 
 		udp_socket sock;
 
@@ -48,6 +51,9 @@ namespace aux {
 		// writeable again. Once it is, we'll set it to false and notify the utp
 		// socket manager
 		bool write_blocked = false;
+
+	private:
+		udp::endpoint m_local_endpoint;
 	};
 
 } }
@@ -0,0 +1,82 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_SPSC_RING_HPP_INCLUDED
+#define TORRENT_SPSC_RING_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/span.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace libtorrent::aux {
+
+	// a fixed size byte queue with a single producer and a single consumer,
+	// which may be different threads. Neither side takes a lock. The
+	// producer's functions are write(), write_regions() and commit_write(),
+	// the consumer's are read(), read_regions() and commit_read(). size() and
+	// space() may be called by either side, but the value may be stale by the
+	// time it's returned, in the direction of the other side's operations.
+	struct TORRENT_EXTRA_EXPORT spsc_ring
+	{
+		// the capacity is rounded up to a power of two
+		explicit spsc_ring(int capacity);
+
+		spsc_ring(spsc_ring const&) = delete;
+		spsc_ring& operator=(spsc_ring const&) = delete;
+
+		int capacity() const { return int(m_mask + 1); }
+
+		// the number of bytes that can be read
+		int size() const
+		{ return int(m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire)); }
+
+		// the number of bytes that can be written
+		int space() const { return capacity() - size(); }
+
+		// copies as much of ``buf`` as fits into the queue. Returns the number of
+		// bytes written
+		int write(span<char const> buf);
+
+		// copies as many bytes as are available, up to the size of ``buf``.
+		// Returns the number of bytes read
+		int read(span<char> buf);
+
+		// the free space of the queue, as up to two contiguous buffers. The
+		// producer may fill them in place (for instance by receiving into them)
+		// and then publish the bytes by calling commit_write()
+		std::array<span<char>, 2> write_regions();
+		void commit_write(int bytes);
+
+		// the bytes in the queue, as up to two contiguous buffers. Once the
+		// consumer is done with some of them, it releases them by calling
+		// commit_read()
+		std::array<span<char const>, 2> read_regions() const;
+		void commit_read(int bytes);
+
+	private:
+
+		std::unique_ptr<char[]> m_buf;
+		std::uint32_t m_mask;
+
+		// these are free running counters, they are only masked when used as an
+		// offset into m_buf. m_head is the number of bytes ever read, only
+		// written to by the consumer. m_tail is the number of bytes ever
+		// written, only written to by the producer. They are kept on separate
+		// cache lines, since they are written by different threads.
+		alignas(64) std::atomic<std::uint32_t> m_head{0};
+		alignas(64) std::atomic<std::uint32_t> m_tail{0};
+	};
+}
+
+#endif
@@ -14,7 +14,7 @@ see LICENSE file.
 #include <vector>
 #include <algorithm>
 
-#include "libtorrent/bitfield.hpp"
+#include "libtorrent/aux_/compressed_bitfield.hpp"
 #include "libtorrent/aux_/sliding_average.hpp"
 #include "libtorrent/aux_/vector.hpp"
 
@@ -26,7 +26,7 @@ struct suggest_piece
 	// pieces the peer has already sent a suggest for) nor in bits (which are
 	// pieces the peer already has, and should not be suggested)
 	int get_pieces(std::vector<piece_index_t>& p
-		, typed_bitfield<piece_index_t> const& bits
+		, compressed_bitfield const& bits
 		, int n)
 	{
 		if (m_priority_pieces.empty()) return 0;
@@ -399,6 +399,11 @@ namespace libtorrent::aux {
 		// it will initialize the storage and the piece-picker
 		void init();
 
+		// loads a dormant torrent, i.e. initializes it as if it had just been
+		// added. This is a no-op for torrents that aren't dormant
+		void leave_dormant();
+		bool is_dormant() const { return m_dormant; }
+
 		void load_merkle_trees(aux::vector<std::vector<sha256_hash>, file_index_t> t
 			, aux::vector<bitfield, file_index_t> mask
 			, aux::vector<bitfield, file_index_t> verified);
@@ -425,6 +430,16 @@ namespace libtorrent::aux {
 		void files_checked();
 		void start_checking();
 
+		// looks up the storage device of the save path on the disk thread, and
+		// resumes checking once it's known
+		void resolve_checking_device();
+		void on_checking_device(aux::device_id device, bool spinning);
+
+		// called by the checking scheduler when this torrent has been waiting
+		// for a hash job slot on its storage device, and one is available
+		void checking_slots_available();
+		void release_checking_slots(int n);
+
 		void start_announcing();
 		void stop_announcing();
 
@@ -590,6 +605,11 @@ namespace libtorrent::aux {
 		bool delete_files(remove_flags_t options);
 		void peers_erased(std::vector<torrent_peer*> const& peers);
 
+		// returns true if the IP filter, port filter or settings reject adr as
+		// a peer. In that case, the peer_blocked_alert is posted and extensions
+		// are notified
+		bool reject_peer(tcp::endpoint const& adr, peer_source_flags_t source);
+
 #if TORRENT_ABI_VERSION == 1
 #if !TORRENT_NO_FPU
 		void file_progress_float(aux::vector<float, file_index_t>& fp);
@@ -726,11 +746,21 @@ namespace libtorrent::aux {
 		bool try_connect_peer();
 		torrent_peer* add_peer(tcp::endpoint const& adr
 			, peer_source_flags_t source, pex_flags_t flags = {});
+
+		// adds a batch of peers from the same source, e.g. a tracker response.
+		// This has the same effect as calling add_peer() for each of them, but
+		// the peer list state is captured, and the want-peers and status
+		// updates are done, once for the whole batch. If peer_flags
+		// is not empty, it holds additional flags for each peer. Returns the
+		// number of peers that were added or updated.
+		int add_peers(span<tcp::endpoint const> peers
+			, peer_source_flags_t source, pex_flags_t flags = {}
+			, span<pex_flags_t const> peer_flags = {});
 		bool ban_peer(torrent_peer* tp);
 		void update_peer_port(int port, torrent_peer* p, peer_source_flags_t src);
 		void set_seed(torrent_peer* p, bool s);
 		void clear_failcount(torrent_peer* p);
-		std::pair<aux::peer_list::iterator, aux::peer_list::iterator> find_peers(address const& a);
+		std::vector<torrent_peer*> find_peers(address const& a);
 
 		// the number of peers that belong to this torrent
 		int num_peers() const { return int(m_connections.size() - m_peers_to_disconnect.size()); }
@@ -840,7 +870,7 @@ namespace libtorrent::aux {
 		}
 
 		void set_super_seeding(bool on);
-		piece_index_t get_piece_to_super_seed(typed_bitfield<piece_index_t> const&);
+		piece_index_t get_piece_to_super_seed(compressed_bitfield const&);
 #endif
 
 		// returns true if we have downloaded the given piece
@@ -895,16 +925,23 @@ namespace libtorrent::aux {
 			return 0;
 		}
 
+		// the number of pieces a dormant torrent's resume data says we have
+		int dormant_num_have() const;
+
 		// when we get a have message, this is called for that piece
 		void peer_has(piece_index_t index, peer_connection const* peer);
 
+		// when we get a run of have messages, this is called once for all of
+		// them
+		void peer_has(span<piece_index_t const> pieces, peer_connection const* peer);
+
 		// when we get a bitfield message, this is called for that piece
-		void peer_has(typed_bitfield<piece_index_t> const& bits, peer_connection const* peer);
+		void peer_has(compressed_bitfield const& bits, peer_connection const* peer);
 
 		void peer_has_all(peer_connection const* peer);
 
 		void peer_lost(piece_index_t index, peer_connection const* peer);
-		void peer_lost(typed_bitfield<piece_index_t> const& bits
+		void peer_lost(compressed_bitfield const& bits
 			, peer_connection const* peer);
 
 		int block_size() const
@@ -1247,7 +1284,7 @@ namespace libtorrent::aux {
 		}
 
 		int get_suggest_pieces(std::vector<piece_index_t>& p
-			, typed_bitfield<piece_index_t> const& bits
+			, compressed_bitfield const& bits
 			, int const n)
 		{
 			return m_suggest_pieces.get_pieces(p, bits, n);
@@ -1312,6 +1349,10 @@ namespace libtorrent::aux {
 		void remove_time_critical_piece(piece_index_t piece, bool finished = false);
 		void remove_time_critical_pieces(aux::vector<download_priority_t, piece_index_t> const& priority);
 		void request_time_critical_pieces();
+
+		// tells the disk I/O subsystem about the deadline of a piece, to have
+		// it schedule disk jobs for it accordingly. max_time() clears it
+		void set_disk_deadline(piece_index_t piece, time_point deadline);
 #endif // TORRENT_DISABLE_STREAMING
 
 		void need_peer_list();
@@ -1507,6 +1548,18 @@ namespace libtorrent::aux {
 		// the number of pieces we completed the check of
 		piece_index_t m_num_checked_pieces{0};
 
+		// the storage device we're checking files on, and the number of hash
+		// job slots we hold from the session's checking scheduler. Every
+		// outstanding hash job while checking holds one slot
+		aux::device_id m_checking_device = 0;
+		int m_checking_slots = 0;
+
+		// whether m_checking_device has been looked up for the current save
+		// path, and whether that lookup is outstanding. It's looked up again
+		// after the storage is moved
+		bool m_checking_device_known = false;
+		bool m_resolving_checking_device = false;
+
 		// if the error occurred on a file, this is the index of that file
 		// there are a few special cases, when this is negative. See
 		// set_error()
@@ -1794,6 +1847,11 @@ namespace libtorrent::aux {
 		// prevent us from sending it again to anyone
 		bool m_complete_sent:1;
 
+		// set for torrents added with the dormant flag, until they're loaded.
+		// While dormant, init() has not been called and m_add_torrent_params
+		// holds the resume data the torrent was added with
+		bool m_dormant:1;
+
 #if TORRENT_USE_ASSERTS
 		// set to true when torrent is start()ed. It may only be started once
 		bool m_was_started = false;
@@ -37,6 +37,10 @@ namespace libtorrent::aux {
 	public:
 		udp_socket(io_context& ios, aux::listen_socket_handle ls);
 
+		// the socket is opened and bound by the session's network thread, but
+		// may then be handed over to the thread running its io_context
+		using single_threaded::thread_started;
+
 		// non-copyable
 		udp_socket(udp_socket const&) = delete;
 		udp_socket& operator=(udp_socket const&) = delete;
@@ -69,8 +73,23 @@ namespace libtorrent::aux {
 			error_code error;
 		};
 
+		// the max number of packets returned by a single call to read()
+		static constexpr int read_batch_size = 16;
+
+		// reads as many packets as are available, up to the size of ``pkts``
+		// (and read_batch_size). The packets' data point into buffers owned by
+		// this object, and are valid until the next call to read()
 		int read(span<packet> pkts, error_code& ec);
 
+		// the two implementations of read(). recvmmsg() receives the whole
+		// batch with a single system call, where it's available. The fallback
+		// calls receive_from() once per packet. They are only exposed to allow
+		// testing both
+#if TORRENT_HAS_RECVMMSG && !defined TORRENT_BUILD_SIMULATOR
+		int read_recvmmsg(span<packet> pkts, error_code& ec);
+#endif
+		int read_receive_from(span<packet> pkts, error_code& ec);
+
 		// this is only valid when using a socks5 proxy
 		void send_hostname(char const* hostname, int port, span<char const> p
 			, error_code& ec, udp_send_flags_t flags = {});
@@ -130,12 +149,15 @@ namespace libtorrent::aux {
 		void wrap(char const* hostname, int port, span<char const> p, error_code& ec, udp_send_flags_t flags);
 		bool unwrap(udp_socket::packet& pack);
 
+		// returns false if the packet should be dropped
+		bool filter_packet(packet& p);
+
 		udp::socket m_socket;
 
 		io_context& m_ioc;
 
 		using receive_buffer = std::array<char, 1500>;
-		std::unique_ptr<receive_buffer> m_buf;
+		std::unique_ptr<std::array<receive_buffer, read_batch_size>> m_buf;
 		aux::listen_socket_handle m_listen_socket;
 
 		std::uint16_t m_bind_port;
@@ -0,0 +1,199 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_UTP_CHANNEL_HPP_INCLUDED
+#define TORRENT_UTP_CHANNEL_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/aux_/spsc_ring.hpp"
+#include "libtorrent/aux_/utp_stream.hpp"
+#include "libtorrent/close_reason.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/io_context.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/span.hpp"
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace libtorrent::aux {
+
+	struct utp_socket_manager;
+	struct utp_socket_interface;
+
+	// when the utp_socket_manager runs on a thread of its own, the utp_stream
+	// used by a peer connection doesn't have a utp_socket_impl. Its operations
+	// are forwarded to a utp_channel instead. The channel owns a second
+	// utp_stream, which lives on the uTP thread and is attached to the
+	// socket manager. The payload is passed between the two threads through a
+	// pair of single-producer single-consumer queues, one per direction.
+	//
+	// A write completes as soon as the data is in the send queue, the way a
+	// write to a kernel socket completes once the data is in the socket
+	// buffer. When the receive queue is full, the uTP thread stops reading
+	// from its stream, which makes the uTP socket advertise a smaller receive
+	// window.
+	//
+	// The member functions are split by thread. The ones used by utp_stream
+	// may only be called on the thread running the user's io_context, the ones
+	// prefixed by net_ only run on the uTP thread.
+	struct TORRENT_EXTRA_EXPORT utp_channel : std::enable_shared_from_this<utp_channel>
+	{
+		utp_channel(io_context& ios, io_context& utp_ios);
+		~utp_channel();
+
+		utp_channel(utp_channel const&) = delete;
+		utp_channel& operator=(utp_channel const&) = delete;
+
+		// creates a channel for an outgoing connection. The uTP socket is
+		// created on the uTP thread
+		static std::shared_ptr<utp_channel> open(io_context& ios, utp_socket_manager& sm);
+
+		// creates a channel for the incoming connection ``s``, that was just
+		// accepted by ``sm``. This must be called on the uTP thread
+		static std::shared_ptr<utp_channel> accept(io_context& ios
+			, utp_socket_manager& sm, utp_stream s);
+
+		// the interface used by utp_stream, mirroring utp_socket_impl's
+		void set_user(utp_stream* s) { m_user = s; }
+		void detach();
+		void add_read_buffer(void* buf, int len);
+		void issue_read();
+		std::size_t read_some(bool clear_buffers, error_code& ec);
+		bool null_buffers() const { return m_null_buffers; }
+		int read_buffer_size() const { return m_rx.size(); }
+		std::size_t available() const { return std::size_t(m_rx.size()); }
+		void add_write_buffer(void const* buf, int len);
+		void issue_write();
+		std::size_t write_some(bool clear_buffers);
+		bool check_fin_sent() const { return m_closed; }
+		void subscribe_writeable();
+		void do_connect(tcp::endpoint const& ep);
+		void close();
+		void set_close_reason(close_reason_t code);
+		close_reason_t incoming_close_reason() const
+		{ return m_incoming_close_reason.load(std::memory_order_relaxed); }
+		void cancel_handlers(error_code const& ec);
+		tcp::endpoint remote_endpoint(error_code& ec) const;
+		tcp::endpoint local_endpoint(error_code& ec) const;
+		void set_udp_socket(std::weak_ptr<utp_socket_interface> sock);
+
+		// closes the uTP thread's stream right away, without flushing the send
+		// queue. This is used when the uTP thread is shutting down
+		void net_abort();
+
+	private:
+
+		// network thread
+		bool rx_eof(error_code& ec) const;
+		bool wait_writable();
+		void try_read();
+		void try_write();
+		void try_writeable();
+		void on_readable();
+		void on_writable();
+		void on_connected(error_code const& ec);
+		void wake_net_reader();
+		void wake_net_writer();
+
+		// uTP thread
+		void net_connect(tcp::endpoint const& ep);
+		void net_start();
+		void net_read();
+		void net_on_read(error_code const& ec, std::size_t bytes);
+		void net_write();
+		void net_on_write(error_code const& ec, std::size_t bytes);
+		void net_on_connect(error_code const& ec);
+		void net_close();
+		void net_detach();
+		void net_maybe_close();
+		void net_read_failed(error_code const& ec);
+		void net_write_failed(error_code const& ec);
+		void wake_reader();
+		void wake_writer();
+
+		// the io_context of the user's utp_stream and of the uTP thread
+		io_context& m_ios;
+		io_context& m_utp_ios;
+
+		// data received by the uTP thread, to be read by the user
+		spsc_ring m_rx;
+
+		// data written by the user, to be sent by the uTP thread
+		spsc_ring m_tx;
+
+		// each side sets its flag before going to sleep, waiting for the other
+		// side. Whichever side clears it (by exchanging it with false) is
+		// responsible for waking the sleeping side up. m_read_wanted and
+		// m_write_wanted mean the user is waiting for data, or for space in the
+		// send queue. m_net_read_stalled means the uTP thread stopped reading
+		// because the receive queue is full, m_net_write_idle means it stopped
+		// sending since the send queue is empty.
+		std::atomic<bool> m_read_wanted{false};
+		std::atomic<bool> m_write_wanted{false};
+		std::atomic<bool> m_net_read_stalled{false};
+		std::atomic<bool> m_net_write_idle{false};
+
+		// set by the uTP thread once it won't put any more data in m_rx, or
+		// take any more data out of m_tx. m_rx_error and m_tx_error are
+		// written before these are set, and not modified afterwards
+		std::atomic<bool> m_rx_done{false};
+		std::atomic<bool> m_tx_done{false};
+		error_code m_rx_error;
+		error_code m_tx_error;
+
+		std::atomic<close_reason_t> m_incoming_close_reason{close_reason_t::none};
+
+		// the members below are only used on the network thread
+
+		utp_stream* m_user = nullptr;
+
+		std::vector<span<char>> m_read_buffer;
+		std::vector<span<char const>> m_write_buffer;
+
+		// this is set for incoming connections before the channel is handed to
+		// the network thread, and for outgoing ones by do_connect()
+		tcp::endpoint m_remote;
+		std::weak_ptr<utp_socket_interface> m_sock;
+
+		// these mirror the outstanding operations of the utp_stream
+		bool m_read_handler = false;
+		bool m_write_handler = false;
+		bool m_writeable_handler = false;
+		bool m_connect_handler = false;
+
+		// the outstanding read doesn't have a buffer, it just waits for data
+		bool m_null_buffers = false;
+
+		// close() has been called
+		bool m_closed = false;
+
+		// the members below are only used on the uTP thread
+
+		std::optional<utp_stream> m_stream;
+
+		// there's an outstanding read or write on m_stream
+		bool m_net_reading = false;
+		bool m_net_writing = false;
+
+		// the user closed the stream. Close m_stream once the send queue has
+		// been flushed
+		bool m_net_closing = false;
+		bool m_net_closed = false;
+
+		// the user's utp_stream is gone. Destroy m_stream once the send queue
+		// has been flushed
+		bool m_net_detached = false;
+	};
+}
+
+#endif
@@ -13,8 +13,13 @@ see LICENSE file.
 #ifndef TORRENT_UTP_SOCKET_MANAGER_HPP_INCLUDED
 #define TORRENT_UTP_SOCKET_MANAGER_HPP_INCLUDED
 
-#include <map>
+#include <algorithm>
+#include <array>
 #include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "libtorrent/aux_/socket_type.hpp"
 #include "libtorrent/session_status.hpp"
@@ -22,6 +27,7 @@ see LICENSE file.
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/aux_/packet_pool.hpp"
+#include "libtorrent/aux_/deadline_timer.hpp"
 
 namespace libtorrent {
 
@@ -31,6 +37,8 @@ namespace aux {
 
 	struct utp_stream;
 	struct utp_socket_impl;
+	struct utp_header;
+	struct utp_channel;
 
 	// interface/handle to the underlying udp socket
 	struct TORRENT_EXTRA_EXPORT utp_socket_interface
@@ -40,7 +48,7 @@ namespace aux {
 		virtual ~utp_socket_interface() = default;
 	};
 
-	struct utp_socket_manager
+	struct TORRENT_EXTRA_EXPORT utp_socket_manager
 	{
 		using send_fun_t = std::function<void(std::weak_ptr<utp_socket_interface>
 			, udp::endpoint const&
@@ -69,7 +77,16 @@ namespace aux {
 		// least coalesce packets returned during the same wakeup
 		void socket_drained();
 
-		void tick(time_point now);
+		// ticks the sockets whose timeout has expired, and deletes the ones
+		// that are no longer needed. Returns the number of sockets visited
+		int tick(time_point now);
+
+		// makes sure ``s`` is ticked no later than the first call to tick()
+		// after ``at``. If the socket is already scheduled to be ticked
+		// earlier than that, this is a no-op. This is called by the socket
+		// whenever its timeout moves earlier, or when it may have become
+		// eligible for deletion (passing time_point::min())
+		void schedule_tick(utp_socket_impl* s, time_point at);
 
 		void send_packet(std::weak_ptr<utp_socket_interface> sock, udp::endpoint const& ep
 			, char const* p, int len
@@ -82,6 +99,18 @@ namespace aux {
 		void remove_socket(std::uint16_t id);
 
 		utp_socket_impl* new_utp_socket(utp_stream* str);
+
+		// the io_context the uTP sockets run on. When this isn't the
+		// io_context of a utp_stream, the stream is connected to its socket
+		// through a utp_channel
+		io_context& get_context() { return m_ios; }
+
+		// keeps track of the channels whose streams are attached to this
+		// manager, to be able to close them all by close_channels(), when the
+		// thread running the sockets is about to stop
+		void add_channel(std::weak_ptr<utp_channel> ch);
+		void close_channels();
+
 		int gain_factor() const { return m_sett.get_int(settings_pack::utp_gain_factor); }
 		int target_delay() const { return m_sett.get_int(settings_pack::utp_target_delay) * 1000; }
 		int syn_resends() const { return m_sett.get_int(settings_pack::utp_syn_resends); }
@@ -91,6 +120,14 @@ namespace aux {
 		int min_timeout() const { return m_sett.get_int(settings_pack::utp_min_timeout); }
 		int loss_multiplier() const { return m_sett.get_int(settings_pack::utp_loss_multiplier); }
 		int cwnd_reduce_timer() const { return m_sett.get_int(settings_pack::utp_cwnd_reduce_timer); }
+		bool pacing() const { return m_sett.get_bool(settings_pack::utp_pacing); }
+		int max_window() const
+		{
+			// the sequence number space is 16 bits, so the window must stay
+			// well below 32k full-sized packets
+			return std::clamp(m_sett.get_int(settings_pack::utp_max_window)
+				, 64 * 1024, 16 * 1024 * 1024);
+		}
 
 		int mtu_for_dest(address const& addr) const;
 		int num_sockets() const { return int(m_utp_sockets.size()); }
@@ -99,6 +136,11 @@ namespace aux {
 		void cancel_deferred_ack(utp_socket_impl* s);
 		void subscribe_drained(utp_socket_impl* s);
 
+		// the socket ``s`` has exhausted its pacing credit and wants to send
+		// again at ``at``. Once that time has passed, the socket's
+		// pacer_wakeup() is called
+		void subscribe_pacing(utp_socket_impl* s, time_point at);
+
 		void restrict_mtu(int const mtu)
 		{
 			m_restrict_mtu[std::size_t(m_mtu_idx)] = mtu;
@@ -126,12 +168,51 @@ namespace aux {
 		send_fun_t m_send_fun;
 		incoming_utp_callback_t m_cb;
 
-		// replace with a hash-map
-		using socket_map_t = std::multimap<std::uint16_t, std::unique_ptr<utp_socket_impl>>;
+		// sockets are keyed by their receive connection ID. Since the IDs
+		// are picked at random, this is a good enough hash. More than one
+		// socket may have the same ID (with different remote endpoints), so
+		// incoming packets also need to match() the endpoint
+		using socket_map_t = std::unordered_multimap<std::uint16_t, std::unique_ptr<utp_socket_impl>>;
 		socket_map_t m_utp_sockets;
 
 		using socket_vector_t = std::vector<utp_socket_impl*>;
 
+		void delete_socket(utp_socket_impl* s);
+		void unlink_timer(utp_socket_impl* s);
+		void file_timer(utp_socket_impl* s, std::int64_t slot);
+
+		// returns true if the packet was held back (to be coalesced with later
+		// ACKs for the same socket) instead of being passed on to ``s``
+		bool hold_ack(utp_socket_impl* s, utp_header const* ph, span<char const> p
+			, udp::endpoint const& ep, time_point receive_time);
+		void flush_held_ack();
+
+		void arm_pacing_timer(time_point at);
+		void on_pacing_timer(error_code const& ec);
+
+		// the resolution of the timer wheel, and the number of slots in it.
+		// One revolution of the wheel covers about 5 seconds, sockets with
+		// timeouts further out than that are just filed again when their slot
+		// comes around
+		static constexpr int timer_wheel_resolution = 10; // milliseconds
+		static constexpr int timer_wheel_size = 512;
+		static std::int64_t wheel_slot(time_point t);
+
+		// every socket with a timeout is filed in the slot for the time its
+		// timeout expires. tick() only visits the slots that have expired
+		// since the last call, which means sockets that aren't timing out
+		// don't cost anything. A socket's timeout is typically extended every
+		// time we receive a packet, in which case it's left in its current
+		// slot and filed again once that slot expires.
+		std::array<socket_vector_t, timer_wheel_size> m_timer_wheel;
+
+		// the absolute slot tick() will visit next. Sockets are never filed in
+		// a slot before this one
+		std::int64_t m_wheel_cursor;
+
+		// the sockets of the slot we're currently expiring, in tick()
+		socket_vector_t m_expired_sockets;
+
 		// if this is set, it means this socket still needs to send an ACK. Once
 		// we exit the loop processing packets, or switch to processing packets
 		// for a different socket, issue the ACK packet and clear this.
@@ -156,6 +237,23 @@ namespace aux {
 		// the last socket we received a packet on
 		utp_socket_impl* m_last_socket = nullptr;
 
+		// when utp_coalesce_acks is enabled, this is the last ACK we received,
+		// that has not been passed on to its socket yet. If the next packet is
+		// a newer ACK for the same socket, it replaces this one. Anything else
+		// causes this one to be delivered first. It's always delivered once
+		// the UDP socket is drained
+		utp_socket_impl* m_held_ack_socket = nullptr;
+		std::vector<char> m_held_ack;
+		udp::endpoint m_held_ack_ep;
+		time_point m_held_ack_time;
+
+		// sockets waiting for pacing credit, and the time they want to send
+		// again. The timer is set to expire at the earliest of those times
+		std::vector<std::pair<time_point, utp_socket_impl*>> m_paced_sockets;
+		std::vector<std::pair<time_point, utp_socket_impl*>> m_temp_paced;
+		aux::deadline_timer m_pacing_timer;
+		time_point m_pacing_expiry = time_point::max();
+
 		int m_new_connection = -1;
 
 		aux::session_settings const& m_sett;
@@ -173,6 +271,11 @@ namespace aux {
 		void* m_ssl_context;
 
 		aux::packet_pool m_packet_pool;
+
+		// channels that have been closed are only removed once the vector has
+		// doubled in size since it was last pruned
+		std::vector<std::weak_ptr<utp_channel>> m_channels;
+		std::size_t m_channels_prune_size = 64;
 	};
 }
 }
@@ -25,6 +25,7 @@ see LICENSE file.
 #include "libtorrent/aux_/invariant_check.hpp"
 
 #include <functional>
+#include <memory>
 
 #ifndef BOOST_NO_EXCEPTIONS
 #include "libtorrent/aux_/disable_warnings_push.hpp"
@@ -132,9 +133,55 @@ struct utp_header
 	int get_version() const { return type_ver & 0xf; }
 };
 
+// internal: the send pacing of a uTP socket (utp_pacing). This is a token
+// bucket, refilled at the pacing rate. Bursts are capped at about one
+// millisecond worth of data, but at least two packets, since the pacing timer
+// won't be much more accurate than that anyway
+struct TORRENT_EXTRA_EXPORT utp_pacer
+{
+	// the rate, in bytes per second, to pace a congestion window of ``cwnd``
+	// bytes at, with a round-trip time of ``rtt`` milliseconds. During
+	// slow-start the cwnd is expected to double every RTT, so this is twice
+	// the rate, to not hold that back
+	static std::int64_t rate(std::int64_t cwnd, int rtt, bool slow_start);
+
+	// returns how long to wait until ``bytes`` may be sent, at ``rate`` bytes
+	// per second. If it's zero, the bytes have been deducted from the credit
+	// and may be sent right away
+	time_duration delay(int bytes, time_point now, std::int64_t rate, int mtu);
+
+private:
+	// the number of bytes we may send right now, and the last time it was
+	// topped up
+	std::int64_t m_credit = 0;
+	time_point m_last{};
+};
+
+// internal: what the socket manager does with an incoming packet when
+// utp_coalesce_acks is enabled
+enum class utp_ack_action : std::uint8_t
+{
+	// deliver the held ACK, if any, and then this packet
+	deliver,
+	// deliver the held ACK, if any, and hold this packet instead
+	hold,
+	// this packet supersedes the held ACK, which is dropped. Hold this one
+	// instead
+	replace
+};
+
+// ``held`` is the ACK currently held back for the same socket as ``ph``, or
+// nullptr. Only pure ACKs are coalesced, any other packet needs the socket to
+// see the packets in the order they arrived. An ACK that doesn't acknowledge
+// anything new may be a duplicate ACK, which the socket counts to detect loss,
+// so it never replaces the held one
+TORRENT_EXTRA_EXPORT utp_ack_action coalesce_ack(utp_header const& ph
+	, utp_header const* held);
+
 struct utp_socket_impl;
 struct utp_socket_interface;
 struct utp_stream;
+struct utp_channel;
 
 // this is the user-level stream interface to utp sockets.
 // the reason why it's split up in a utp_stream class and
@@ -169,6 +216,17 @@ struct TORRENT_EXTRA_EXPORT utp_stream
 	void set_impl(utp_socket_impl*);
 	utp_socket_impl* get_impl();
 
+	// when the socket manager runs on a different io_context than this
+	// stream, the stream forwards its operations to a utp_channel instead of
+	// owning a utp_socket_impl
+	void set_channel(std::shared_ptr<utp_channel> ch);
+
+	// creates the socket for an outgoing connection, owned by ``sm``
+	void attach(utp_socket_manager& sm);
+
+	// the UDP socket the uTP packets are sent over
+	void set_udp_socket(std::weak_ptr<utp_socket_interface> sock);
+
 #ifndef BOOST_NO_EXCEPTIONS
 	template <class IO_Control_Command>
 	void io_control(IO_Control_Command&) {}
@@ -263,7 +321,7 @@ struct TORRENT_EXTRA_EXPORT utp_stream
 	template <class Handler>
 	void async_connect(endpoint_type const& endpoint, Handler handler)
 	{
-		if (m_impl == nullptr)
+		if (m_impl == nullptr && !m_channel)
 		{
 			post(m_io_service, std::bind<void>(std::move(handler), boost::asio::error::not_connected));
 			return;
@@ -276,7 +334,7 @@ struct TORRENT_EXTRA_EXPORT utp_stream
 	template <class Mutable_Buffers, class Handler>
 	void async_read_some(Mutable_Buffers const& buffers, Handler handler)
 	{
-		if (m_impl == nullptr)
+		if (m_impl == nullptr && !m_channel)
 		{
 			post(m_io_service, std::bind<void>(std::move(handler), boost::asio::error::not_connected, std::size_t(0)));
 			return;
@@ -311,7 +369,7 @@ struct TORRENT_EXTRA_EXPORT utp_stream
 	template <class Handler>
 	void async_wait_read(Handler handler)
 	{
-		if (m_impl == nullptr)
+		if (m_impl == nullptr && !m_channel)
 		{
 			post(m_io_service, std::bind<void>(std::move(handler), boost::asio::error::not_connected, std::size_t(0)));
 			return;
@@ -339,7 +397,7 @@ struct TORRENT_EXTRA_EXPORT utp_stream
 	std::size_t read_some(Mutable_Buffers const& buffers, error_code& ec)
 	{
 		TORRENT_ASSERT(!m_read_handler);
-		if (m_impl == nullptr)
+		if (m_impl == nullptr && !m_channel)
 		{
 			ec = boost::asio::error::not_connected;
 			return 0;
@@ -372,7 +430,7 @@ struct TORRENT_EXTRA_EXPORT utp_stream
 	std::size_t write_some(Const_Buffers const& buffers, error_code& ec)
 	{
 		TORRENT_ASSERT(!m_write_handler);
-		if (m_impl == nullptr)
+		if (m_impl == nullptr && !m_channel)
 		{
 			ec = boost::asio::error::not_connected;
 			return 0;
@@ -429,7 +487,7 @@ struct TORRENT_EXTRA_EXPORT utp_stream
 	template <class Const_Buffers, class Handler>
 	void async_write_some(Const_Buffers const& buffers, Handler handler)
 	{
-		if (m_impl == nullptr)
+		if (m_impl == nullptr && !m_channel)
 		{
 			post(m_io_service, std::bind<void>(std::move(handler)
 				, boost::asio::error::not_connected, std::size_t(0)));
@@ -474,7 +532,7 @@ struct TORRENT_EXTRA_EXPORT utp_stream
 	template <class Handler>
 	void async_wait_write(Handler handler)
 	{
-		if (m_impl == nullptr)
+		if (m_impl == nullptr && !m_channel)
 		{
 			post(m_io_service, std::bind<void>(std::move(handler)
 				, boost::asio::error::not_connected));
@@ -536,6 +594,7 @@ private:
 
 	io_context& m_io_service;
 	utp_socket_impl* m_impl;
+	std::shared_ptr<utp_channel> m_channel;
 
 	close_reason_t m_incoming_close_reason = close_reason_t::none;
 
@@ -640,6 +699,7 @@ struct utp_socket_impl
 	void do_ledbat(int acked_bytes, int delay, int in_flight);
 	int packet_timeout() const;
 	bool test_socket_state();
+	bool pace(int bytes);
 	void maybe_trigger_receive_callback(error_code const& ec);
 	void maybe_trigger_send_callback(error_code const& ec);
 	void maybe_trigger_writeable_callback(error_code const& ec);
@@ -652,6 +712,11 @@ struct utp_socket_impl
 	void send_deferred_ack();
 	void socket_drained();
 
+	// called by the socket manager once this socket has accrued enough
+	// pacing credit to send again
+	void pacer_wakeup();
+	bool paced() const { return m_paced; }
+
 	void set_userdata(utp_stream* s) { m_userdata = s; }
 	void abort();
 	udp::endpoint remote_endpoint() const;
@@ -659,6 +724,11 @@ struct utp_socket_impl
 	std::uint16_t receive_id() const { return m_recv_id; }
 	bool match(udp::endpoint const& ep, std::uint16_t id) const;
 
+	// the time at which tick() needs to be called next. Sockets that are
+	// only waiting for the client to pick up an error return
+	// time_point::max()
+	time_point next_tick() const;
+
 	// non-copyable
 	utp_socket_impl(utp_socket_impl const&) = delete;
 	utp_socket_impl const& operator=(utp_socket_impl const&) = delete;
@@ -667,6 +737,12 @@ struct utp_socket_impl
 	// TODO: it would be nice to make this private
 	std::weak_ptr<utp_socket_interface> m_sock;
 
+	// the absolute slot in the socket manager's timer wheel this socket is
+	// filed under, and its index within that slot. -1 means the socket is
+	// not in the timer wheel. These are owned by utp_socket_manager
+	std::int64_t m_wheel_slot = -1;
+	int m_wheel_pos = -1;
+
 	void add_write_buffer(void const* buf, int len);
 	void add_read_buffer(void* buf, int len);
 
@@ -892,6 +968,10 @@ private:
 	// average RTT
 	sliding_average<int, 16> m_rtt;
 
+	// when utp_pacing is enabled, this limits our send rate to one cwnd per
+	// RTT
+	utp_pacer m_pacer;
+
 	// if this is != 0, it means the upper layer provided a reason for why
 	// the connection is being closed. The reason is indicated by this
 	// non-zero value which is included in a packet header extension
@@ -1034,6 +1114,11 @@ private:
 	// other end is not spoofing its source IP
 	bool m_confirmed:1;
 
+	// this is true while the socket is waiting for pacing credit. The socket
+	// manager has a pointer to it in its list of paced sockets, which means
+	// we can't be deleted until the manager calls pacer_wakeup()
+	bool m_paced:1;
+
 	// packets that need to be resent. Points to packets in m_outbuf
 	std::vector<packet*> m_needs_resend;
 };
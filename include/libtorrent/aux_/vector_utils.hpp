@@ -13,6 +13,7 @@ see LICENSE file.
 
 #include <vector>
 #include <algorithm>
+#include <cstdint>
 
 namespace libtorrent::aux {
 
@@ -32,6 +33,21 @@ namespace libtorrent::aux {
 		auto i = std::lower_bound(container.begin(), container.end(), v);
 		container.insert(i, v);
 	}
+
+	// the number of bytes allocated by a vector for its elements
+	template <typename Container>
+	std::int64_t heap_size(Container const& container)
+	{
+		return std::int64_t(container.capacity() * sizeof(typename Container::value_type));
+	}
+
+	// frees the memory held by an empty vector
+	template <typename Container>
+	void release_if_empty(Container& container)
+	{
+		if (!container.empty() || container.capacity() == 0) return;
+		Container().swap(container);
+	}
 }
 
 #endif
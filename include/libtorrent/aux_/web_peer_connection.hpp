@@ -118,6 +118,10 @@ namespace libtorrent::aux {
 		// the number of responses we've received so far on
 		// this connection
 		int m_num_responses;
+
+		// set when the server has announced that it will close the
+		// connection after its current response
+		bool m_server_closing = false;
 	};
 }
 
@@ -164,9 +164,12 @@ see LICENSE file.
 #define TORRENT_HAS_COPY_FILE_RANGE 1
 #endif
 
+#define TORRENT_HAS_RECVMMSG 1
+
 #define TORRENT_HAS_PTHREAD_SET_NAME 1
 #define TORRENT_HAS_SYMLINK 1
 #define TORRENT_USE_MADVISE 1
+#define TORRENT_USE_NUMA 1
 #define TORRENT_USE_NETLINK 1
 #define TORRENT_USE_IFADDRS 0
 #define TORRENT_USE_IFCONF 1
@@ -478,6 +481,10 @@ see LICENSE file.
 #define TORRENT_USE_MADVISE 0
 #endif
 
+#ifndef TORRENT_USE_NUMA
+#define TORRENT_USE_NUMA 0
+#endif
+
 #ifndef TORRENT_USE_SYNC_FILE_RANGE
 #define TORRENT_USE_SYNC_FILE_RANGE 0
 #endif
@@ -546,6 +553,10 @@ see LICENSE file.
 #define TORRENT_HAS_COPY_FILE_RANGE 0
 #endif
 
+#ifndef TORRENT_HAS_RECVMMSG
+#define TORRENT_HAS_RECVMMSG 0
+#endif
+
 #ifndef TORRENT_HAS_COPYFILE
 #define TORRENT_HAS_COPYFILE 0
 #endif
@@ -314,6 +314,29 @@ namespace file_open_mode {
 		virtual void async_clear_piece(storage_index_t storage, piece_index_t index
 			, std::function<void(piece_index_t)> handler) = 0;
 
+		// This is called when a piece is given a deadline, via
+		// torrent_handle::set_piece_deadline(), and when the deadline is
+		// removed, in which case ``deadline`` is max_time(). The disk I/O
+		// object may use this to schedule jobs for the piece ahead of others,
+		// earliest deadline first, and to read ahead the pieces following it.
+		// The default implementation does nothing.
+		virtual void set_piece_deadline(storage_index_t, piece_index_t
+			, time_point) {}
+
+		// This is called before a torrent starts checking its files, to find
+		// out which storage device its save path is on. Torrents checking
+		// files on the same device share its bandwidth. ``handler`` is passed
+		// an identifier of the device, which is the same for all paths on the
+		// same device, or 0 if it's unknown, and whether the device is a
+		// spinning disk. Looking this up may block. A backend with its own
+		// threads should do it on one of them, but one that performs all its
+		// jobs in the calling thread (like posix_disk_io) may resolve it
+		// synchronously too. The default implementation calls ``handler``
+		// immediately, with an unknown device.
+		virtual void async_storage_device(storage_index_t
+			, std::function<void(std::uint64_t device, bool spinning)> handler)
+		{ handler(0, false); }
+
 		// update_stats_counters() is called to give the disk storage an
 		// opportunity to update gauges in the ``c`` stats counters, that aren't
 		// updated continuously as operations are performed. This is called
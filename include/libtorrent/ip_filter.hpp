@@ -15,12 +15,14 @@ see LICENSE file.
 #include "libtorrent/config.hpp"
 
 #include <set>
+#include <map>
 #include <vector>
 #include <cstdint>
 #include <tuple>
 #include <limits>
 
 #include "libtorrent/address.hpp"
+#include "libtorrent/span.hpp"
 
 namespace libtorrent {
 
@@ -70,13 +72,34 @@ namespace aux {
 	// a filter for a specific address type.
 	// it works with IPv4 and IPv6
 	template <typename Addr>
-	class filter_impl
+	class TORRENT_EXTRA_EXPORT filter_impl
 	{
 	public:
 
+		// a rule passed to add_rules()
+		struct rule
+		{
+			Addr first;
+			Addr last;
+			std::uint32_t flags;
+		};
+
 		filter_impl();
 		bool empty() const;
 		void add_rule(Addr first, Addr last, std::uint32_t flags);
+
+		// has the same effect as calling add_rule() for every rule, in order,
+		// but builds the resulting ranges in a single O(n log n) sweep. The
+		// filter is left compiled
+		void add_rules(std::vector<rule> const& rules);
+
+		// replace the tree with the flat lookup table. Adding a rule for a
+		// single address to a compiled filter keeps it compiled, the address
+		// is stored in m_single until the next compile(). Adding a range turns
+		// it back into a tree first
+		void compile();
+		bool compiled() const { return !m_flat_start.empty(); }
+
 		std::uint32_t access(Addr const& addr) const;
 		template <typename ExternalAddressType>
 		std::vector<ip_range<ExternalAddressType>> export_filter() const;
@@ -96,7 +119,32 @@ namespace aux {
 			{ return lhs.start == rhs.start && lhs.access == rhs.access; }
 		};
 
+		// all ranges, ordered by start address, regardless of whether the
+		// filter is compiled or not
+		std::vector<range> sorted_ranges() const;
+		void build_flat(std::vector<range> const& sorted);
+		void decompile();
+
+		// the body of add_rule(), applied to an arbitrary set
+		static void insert_rule(std::set<range>& list, Addr first, Addr last
+			, std::uint32_t flags);
+
 		std::set<range> m_access_list;
+
+		// rules for single addresses added while the filter is compiled. These
+		// take precedence over the flat arrays, and are folded into them by
+		// compile(). This lets the session ban individual peers without
+		// rebuilding a large filter
+		std::map<Addr, std::uint32_t> m_single;
+
+		// when the filter is compiled, m_access_list is empty and the ranges
+		// are stored in these arrays instead, in Eytzinger order. i.e. the
+		// binary search tree is laid out breadth-first, with the children of
+		// element k at 2k and 2k + 1. Element 0 is unused. This keeps the top
+		// levels of the search in a few cache lines, and lets the lookup
+		// prefetch the nodes a few levels down, as they are adjacent
+		std::vector<Addr> m_flat_start;
+		std::vector<std::uint32_t> m_flat_access;
 	};
 
 	extern template class filter_impl<address_v4::bytes_type>;
@@ -148,12 +196,34 @@ struct TORRENT_EXPORT ip_filter
 	//
 	// This means that in a case of overlapping ranges, the last one applied takes
 	// precedence.
+	//
+	// Adding a rule for a range of addresses to a compiled filter (see
+	// compile()) first converts it back into its modifiable form, which is
+	// linear in the size of the filter. A rule for a single address
+	// (``first == last``) keeps the filter compiled.
 	void add_rule(address const& first, address const& last, std::uint32_t flags);
 
+	// Adds all ``rules``, in order. The resulting filter is the same as if
+	// add_rule() had been called for each of them, but it is built in a single
+	// pass, in O(n ``log`` n), where n is the number of rules plus the number
+	// of ranges already in the filter. This is the preferred way to load large
+	// block lists. The filter is compiled afterwards.
+	void add_rules(span<ip_range<address_v4> const> rules);
+	void add_rules(span<ip_range<address_v6> const> rules);
+
+	// Converts the filter into a flat, read-only representation optimized for
+	// lookups. It uses a fraction of the memory of the modifiable form and
+	// access() touches fewer cache lines. The session compiles filters passed
+	// to session_handle::set_ip_filter(), so there is normally no need to
+	// call this explicitly. Compiling an already compiled filter only folds in
+	// the single address rules added since it was compiled.
+	void compile();
+
 	// Returns the access permissions for the given address (``addr``). The permission
 	// can currently be 0 or ``ip_filter::blocked``. The complexity of this operation
 	// is O(``log`` n), where n is the minimum number of non-overlapping ranges to describe
-	// the current filter.
+	// the current filter. A compiled filter has the same complexity, but with
+	// a much smaller constant factor.
 	std::uint32_t access(address const& addr) const;
 
 	using filter_tuple_t = std::tuple<std::vector<ip_range<address_v4>>
@@ -86,6 +86,7 @@
 #include "libtorrent/posix_disk_io.hpp"
 #include "libtorrent/random.hpp"
 #include "libtorrent/read_resume_data.hpp"
+#include "libtorrent/resume_journal.hpp"
 #include "libtorrent/session.hpp"
 #include "libtorrent/session_handle.hpp"
 #include "libtorrent/session_params.hpp"
@@ -179,12 +179,20 @@ namespace libtorrent {
 			num_write_ops,
 			num_read_ops,
 			num_read_back,
+			checking_bytes,
 
 			disk_read_time,
 			disk_write_time,
 			disk_hash_time,
 			disk_job_time,
 
+			num_deadline_disk_jobs,
+			num_deadline_disk_jobs_missed,
+			num_read_ahead_pieces,
+
+			disk_buffer_local_node,
+			disk_buffer_remote_node,
+
 			waste_piece_timed_out,
 			waste_piece_cancelled,
 			waste_piece_unknown,
@@ -325,6 +333,9 @@ namespace libtorrent {
 			// IP filter applied to them.
 			non_filter_torrents,
 
+			// the number of bytes of raw info-dictionaries held by torrents
+			torrent_metadata_bytes,
+
 			// these counter indices deliberately
 			// match the order of socket type IDs
 			// defined in socket_type.hpp.
@@ -379,6 +390,7 @@ namespace libtorrent {
 
 			disk_blocks_in_use,
 			queued_disk_jobs,
+			queued_deadline_disk_jobs,
 			num_running_disk_jobs,
 			num_read_jobs,
 			num_write_jobs,
@@ -407,6 +419,9 @@ namespace libtorrent {
 			num_fenced_clear_piece,
 			num_fenced_tick_storage,
 
+			num_checking_devices,
+			queued_checking_torrents,
+
 			dht_nodes,
 			dht_node_cache,
 			dht_torrents,
@@ -436,6 +451,14 @@ namespace libtorrent {
 
 			num_queued_tracker_announces,
 
+			// the memory used by peer connections, broken down by
+			// component. These are updated when session stats are posted
+			peer_object_bytes,
+			peer_recv_buffer_bytes,
+			peer_send_buffer_bytes,
+			peer_queue_bytes,
+			peer_bitfield_bytes,
+
 			num_counters,
 			num_gauges_counters = num_counters - static_cast<int>(num_stats_counters)
 		};
@@ -0,0 +1,148 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_RESUME_JOURNAL_HPP_INCLUDED
+#define TORRENT_RESUME_JOURNAL_HPP_INCLUDED
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/fwd.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/aux_/file_pointer.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/info_hash.hpp"
+#include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/units.hpp"
+
+namespace libtorrent {
+
+	// The resume journal is an alternative to saving one resume file per
+	// torrent. All torrents in a session share a single, append-only file.
+	// Every call to append() adds a record for one torrent. When only the
+	// download progress, counters and flags of a torrent changed since its
+	// last record, which is typically the case for save_resume_data() calls
+	// made with the ``if_download_progress`` and ``if_counters_changed``
+	// flags, the record only holds those fields. Otherwise it holds the full
+	// resume data.
+	//
+	// Records are protected by a checksum. If the journal is cut short, for
+	// instance because of a crash while writing it, the partial record at the
+	// end is ignored, and all torrents are restored to the state of their
+	// last complete record.
+	//
+	// Once the journal has grown to twice the size it had after it was last
+	// compacted, it's compacted in a background thread. Compacting rewrites
+	// it with a single full record per torrent.
+	//
+	// The peer list of a torrent is only saved as part of full records.
+	//
+	// The member functions of this class may be called from any thread, but
+	// not concurrently.
+	struct TORRENT_EXPORT resume_journal
+	{
+		// ``path`` is the file the journal is stored in. Nothing is read or
+		// written until open() is called.
+		explicit resume_journal(std::string path);
+
+		// waits for any compaction in progress to complete
+		~resume_journal();
+
+		resume_journal(resume_journal const&) = delete;
+		resume_journal& operator=(resume_journal const&) = delete;
+
+		// reads the journal and returns the last recorded state of every
+		// torrent in it, ready to be passed to add_torrent(). If the file
+		// doesn't exist, it's created. If it ends with a partial record, it's
+		// compacted before this function returns, to not append records after
+		// the corrupt one.
+		std::vector<add_torrent_params> open(error_code& ec);
+
+		// records the resume data in ``atp``, which is typically the
+		// ``params`` member of a save_resume_data_alert. The record is not
+		// necessarily on disk until flush() is called. If writing to the
+		// journal fails, it's closed and open() has to be called again before
+		// appending more records.
+		void append(add_torrent_params const& atp, error_code& ec);
+
+		// records that the torrent with the specified info-hashes was removed.
+		// It won't be returned by open() anymore.
+		void remove(info_hash_t const& ih, error_code& ec);
+
+		// flushes all records appended so far to disk. This is a single
+		// fsync() regardless of the number of records written since the last
+		// call. If a background compaction failed since the last call, its
+		// error is reported here.
+		void flush(error_code& ec);
+
+		// rewrites the journal to contain a single full record per torrent.
+		// This blocks until compaction is complete.
+		void compact(error_code& ec);
+
+		// the current size of the journal file, in bytes
+		std::int64_t size() const;
+
+	private:
+
+		struct torrent_state
+		{
+			// a hash of all the fields that aren't included in deltas. If any
+			// of them change, a full record is written
+			sha1_hash fields;
+			typed_bitfield<piece_index_t> have_pieces;
+		};
+
+		// writes m_buffer to the end of the journal. Must be called with
+		// m_mutex held
+		void write_buffer(error_code& ec);
+		void maybe_compact();
+		void compact_impl(error_code& ec);
+		void join_compaction();
+
+		std::string m_path;
+
+		// this protects the members below. It's held while appending records
+		// and while the compacting thread swaps in the new file
+		mutable std::mutex m_mutex;
+
+		// the journal file, opened for appending
+		aux::file_pointer m_file;
+
+		// the number of bytes in the journal
+		std::int64_t m_size = 0;
+
+		// the size of the journal after it was last compacted. Once it has
+		// grown to twice this size, it's compacted again
+		std::int64_t m_compacted_size = 0;
+
+		// the state of each torrent as of its last record, used to tell
+		// whether a delta record is enough
+		std::map<info_hash_t, torrent_state> m_torrents;
+
+		// scratch buffer to encode records into
+		std::vector<char> m_buffer;
+
+		// the background compaction thread. m_compacting is true while it's
+		// running
+		std::thread m_compaction;
+		bool m_compacting = false;
+
+		// if background compaction fails, the error is reported by the next
+		// call to flush()
+		error_code m_compaction_error;
+	};
+}
+
+#endif
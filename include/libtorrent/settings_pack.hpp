@@ -373,6 +373,20 @@ namespace aux {
 			// traversal for WebRTC. It must have the format ``hostname:port``.
 			webtorrent_stun_server,
 
+			// CPUs to pin the network thread, disk I/O threads and hashing
+			// threads to, respectively. Each is a comma-separated list of CPU
+			// numbers and ranges, e.g. ``0-7,16-23``. On machines with more
+			// than one NUMA node, placing these threads on the CPUs of the same
+			// node avoids touching buffers across nodes.
+			// An empty string (the default) lets the threads run on any CPU
+			// the process may run on.
+			// This is only supported on Linux. ``network_thread_affinity``
+			// applies to the thread running the session's io_context, which is
+			// the session's own network thread unless one was passed in.
+			network_thread_affinity,
+			disk_thread_affinity,
+			hashing_thread_affinity,
+
 			max_string_setting_internal
 		};
 
@@ -1000,6 +1014,46 @@ namespace aux {
 			// protocol may not be valid from the proxy's point of view.
 			socks5_udp_send_local_ep,
 
+			// when enabled, uTP sockets spread the packets of their congestion
+			// window over the round-trip time, rather than sending the whole
+			// window in one burst whenever an ACK opens it up. This mostly
+			// matters on links with a large bandwidth-delay product, where
+			// bursts may overflow buffers along the path and cause loss.
+			utp_pacing,
+
+			// when enabled, ACKs (ST_STATE packets) for the same uTP socket that
+			// are received in the same wakeup of the UDP socket are coalesced,
+			// only processing the last one. ACKs are cumulative, so this does
+			// not lose any information, but saves the per-ACK work of
+			// processing SACKs and updating the congestion window. Duplicate
+			// ACKs are never coalesced.
+			utp_coalesce_acks,
+
+			// when enabled, the uTP socket managers and the UDP sockets run on
+			// a thread of their own, instead of on the network thread. Stream
+			// data is passed between the uTP sockets and the peer connections
+			// through lock-free queues. This lets the uTP protocol (receiving,
+			// acknowledging and retransmitting packets) keep up at high
+			// transfer rates, when the network thread is busy. This setting is
+			// only read when the session is created.
+			utp_io_thread,
+
+			// when enabled, disk buffers are allocated from 2 MiB slabs, one
+			// set per NUMA node. A buffer is allocated from a slab on the node
+			// of the thread allocating it, i.e. the thread filling it with
+			// data. The slabs are also advised to be backed by transparent
+			// huge pages. The ``disk.disk_buffer_remote_node`` counter reports
+			// how many buffers were released by a thread on a different node.
+			// This is only supported on Linux.
+			numa_disk_buffers,
+
+			// when enabled, memory mapped files (of at least 2 MiB) are
+			// advised to be backed by transparent huge pages, to reduce TLB
+			// misses when reading and hashing large files. Whether the kernel
+			// honors this for file mappings depends on the file system and
+			// kernel configuration. This is only supported on Linux.
+			mmap_huge_pages,
+
 			max_bool_setting_internal
 		};
 
@@ -2082,6 +2136,30 @@ namespace aux {
 			// the WebRTC connection timeout used by WebTorrent (in seconds)
 			webtorrent_connection_timeout,
 
+			// the receive window advertised by uTP sockets, in bytes. This
+			// limits the number of bytes the other end may have in flight, and
+			// hence the throughput of a single uTP connection to this window
+			// divided by the round-trip time. On high-latency, high-bandwidth
+			// links, this may need to be raised. The value is clamped to the
+			// range [64 kiB, 16 MiB].
+			utp_max_window,
+
+			// the number of hash jobs allowed to be outstanding per storage
+			// device, across all torrents checking files stored on it. On
+			// spinning disks, only one torrent at a time reads from the disk,
+			// to keep reads sequential, and it's also limited by
+			// ``checking_mem_usage``. Other devices are shared evenly by the
+			// torrents checking files on them. To check torrents on separate
+			// devices in parallel, also raise ``active_checking``.
+			checking_queue_depth,
+
+			// the number of pieces following the last piece with a deadline
+			// (see torrent_handle::set_piece_deadline()) the disk I/O
+			// subsystem hints the operating system to read ahead, once reads
+			// for the pieces with a deadline start. Set to 0 to disable read
+			// ahead.
+			deadline_read_ahead,
+
 			max_int_setting_internal
 		};
 
@@ -294,6 +294,21 @@ namespace torrent_flags {
 	// URL.
 	constexpr torrent_flags_t i2p_torrent = 24_bit;
 
+	// when a torrent with metadata is added in paused state with this flag
+	// set, it's kept as a compact stub until it's started, instead of being
+	// fully loaded. A dormant torrent does not set up its storage, piece
+	// picker or merkle trees, and it does not validate its resume data.
+	// Its status is reported from the resume data it was added with, and
+	// saving resume data returns the same piece state.
+	// The torrent is loaded when it's resumed, either explicitly or by the
+	// auto-manager, or when an operation that needs its full state is
+	// invoked on it, such as force_recheck(), read_piece() or setting piece
+	// priorities. Clearing this flag also loads the torrent. Setting it on a
+	// torrent that's already loaded has no effect.
+	// This flag is saved in the resume data, so a dormant torrent remains
+	// dormant when the session is restored.
+	constexpr torrent_flags_t dormant = 25_bit;
+
 	// all torrent flags combined. Can conveniently be used when creating masks
 	// for flags
 	constexpr torrent_flags_t all = torrent_flags_t::all();
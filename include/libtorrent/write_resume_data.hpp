@@ -21,8 +21,15 @@ namespace libtorrent {
 
 	// this function turns the resume data in an ``add_torrent_params`` object
 	// into a bencoded structure
+	//
+	// The ``write_resume_data_buf()`` overloads encode the resume data
+	// directly into a buffer, without building the intermediate ``entry``
+	// structure, which makes them significantly cheaper. The overload taking
+	// a buffer appends to it, which allows reusing the same buffer for
+	// saving the resume data of many torrents.
 	TORRENT_EXPORT entry write_resume_data(add_torrent_params const& atp);
 	TORRENT_EXPORT std::vector<char> write_resume_data_buf(add_torrent_params const& atp);
+	TORRENT_EXPORT void write_resume_data_buf(add_torrent_params const& atp, std::vector<char>& buf);
 
 	// hidden
 	using write_torrent_flags_t = flags::bitfield_flag<std::uint32_t, struct write_torrent_flags_tag>;
@@ -50,7 +57,8 @@ namespace libtorrent {
 	// * The piece layers are not complete for all files that need them
 	//
 	// The ``write_torrent_file_buf()`` overload returns the torrent file in
-	// bencoded buffer form. This overload may be faster at the expense of lost
+	// bencoded buffer form. It's encoded directly, without building an
+	// ``entry`` structure, which makes it faster at the expense of lost
 	// flexibility to add custom fields.
 	TORRENT_EXPORT entry write_torrent_file(add_torrent_params const& atp);
 	TORRENT_EXPORT entry write_torrent_file(add_torrent_params const& atp, write_torrent_flags_t flags);
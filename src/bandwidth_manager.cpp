@@ -123,78 +123,94 @@ namespace libtorrent::aux {
 		std::int64_t dt_milliseconds = total_milliseconds(dt);
 		if (dt_milliseconds > 3000) dt_milliseconds = 3000;
 
-		// for each bandwidth channel, call update_quota(dt)
-
-		std::vector<bandwidth_channel*> channels;
-
-		std::vector<bw_request> queue;
-
-		for (auto i = m_queue.begin(); i != m_queue.end();)
+		// requests that are removed from the queue are collected in m_done,
+		// and their peers are notified once we're done with the queue. The
+		// queue is compacted in-place, preserving the order of requests.
+		// Erasing requests one at a time would make this loop quadratic in
+		// the number of queued peers
+		TORRENT_ASSERT(m_done.empty());
+		TORRENT_ASSERT(m_channels.empty());
+
+		std::size_t out = 0;
+		for (std::size_t i = 0; i < m_queue.size(); ++i)
 		{
-			if (i->peer->is_disconnecting())
+			bw_request& r = m_queue[i];
+			if (r.peer->is_disconnecting())
 			{
-				m_queued_bytes -= i->request_size - i->assigned;
+				m_queued_bytes -= r.request_size - r.assigned;
 
 				// return all assigned quota to all the
 				// bandwidth channels this peer belongs to
-				for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
+				for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
 				{
-					bandwidth_channel* bwc = i->channel[j];
-					bwc->return_quota(i->assigned);
+					bandwidth_channel* bwc = r.channel[j];
+					bwc->return_quota(r.assigned);
 				}
 
-				i->assigned = 0;
-				queue.push_back(std::move(*i));
-				i = m_queue.erase(i);
+				r.assigned = 0;
+				m_done.push_back(std::move(r));
 				continue;
 			}
-			for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
+			for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
 			{
-				bandwidth_channel* bwc = i->channel[j];
+				bandwidth_channel* bwc = r.channel[j];
 				bwc->tmp = 0;
 			}
-			++i;
+			if (out != i) m_queue[out] = std::move(r);
+			++out;
 		}
+		m_queue.erase(m_queue.begin() + std::ptrdiff_t(out), m_queue.end());
 
 		for (auto const& r : m_queue)
 		{
 			for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
 			{
 				bandwidth_channel* bwc = r.channel[j];
-				if (bwc->tmp == 0) channels.push_back(bwc);
+				if (bwc->tmp == 0) m_channels.push_back(bwc);
 				TORRENT_ASSERT(INT_MAX - bwc->tmp > r.priority);
 				bwc->tmp += r.priority;
 			}
 		}
 
-		for (auto const& ch : channels)
+		for (auto const& ch : m_channels)
 		{
 			ch->update_quota(int(dt_milliseconds));
 		}
+		m_channels.clear();
 
-		for (auto i = m_queue.begin(); i != m_queue.end();)
+		out = 0;
+		for (std::size_t i = 0; i < m_queue.size(); ++i)
 		{
-			int a = i->assign_bandwidth();
-			if (i->assigned == i->request_size
-				|| (i->ttl <= 0 && i->assigned > 0))
+			bw_request& r = m_queue[i];
+			int a = r.assign_bandwidth();
+			if (r.assigned == r.request_size
+				|| (r.ttl <= 0 && r.assigned > 0))
 			{
-				a += i->request_size - i->assigned;
-				TORRENT_ASSERT(i->assigned <= i->request_size);
-				queue.push_back(std::move(*i));
-				i = m_queue.erase(i);
+				a += r.request_size - r.assigned;
+				TORRENT_ASSERT(r.assigned <= r.request_size);
+				m_done.push_back(std::move(r));
 			}
 			else
 			{
-				++i;
+				if (out != i) m_queue[out] = std::move(r);
+				++out;
 			}
 			m_queued_bytes -= a;
 		}
-
-		while (!queue.empty())
+		m_queue.erase(m_queue.begin() + std::ptrdiff_t(out), m_queue.end());
+
+		// the peers may request more bandwidth from within the callback, so
+		// the queue must be consistent at this point. Swap the done-list out
+		// while notifying the peers, but hang on to its buffer for the next
+		// round
+		std::vector<bw_request> done;
+		done.swap(m_done);
+		while (!done.empty())
 		{
-			bw_request& bwr = queue.back();
+			bw_request& bwr = done.back();
 			bwr.peer->assign_bandwidth(m_channel, bwr.assigned);
-			queue.pop_back();
+			done.pop_back();
 		}
+		if (m_done.empty()) m_done.swap(done);
 	}
 }
@@ -49,6 +49,7 @@ see LICENSE file.
 #include "libtorrent/aux_/alert_manager.hpp" // for alert_manager
 #include "libtorrent/aux_/string_util.hpp" // for search
 #include "libtorrent/aux_/generate_peer_id.hpp"
+#include "libtorrent/aux_/vector_utils.hpp" // for heap_size
 
 #if !defined TORRENT_DISABLE_ENCRYPTION
 #include "libtorrent/aux_/pe_crypto.hpp"
@@ -57,6 +58,13 @@ see LICENSE file.
 
 namespace libtorrent::aux {
 
+namespace {
+
+	// the max number of HAVE messages to defer before handling them
+	constexpr std::size_t max_have_batch = 512;
+
+}
+
 #if !defined TORRENT_DISABLE_ENCRYPTION
 namespace {
 
@@ -512,6 +520,27 @@ namespace {
 		p.connection_type = peer_info::standard_bittorrent;
 	}
 
+	void bt_peer_connection::memory_usage(connection_memory& m) const
+	{
+		peer_connection::memory_usage(m);
+		m.objects += std::int64_t(sizeof(bt_peer_connection) - sizeof(peer_connection));
+#if !defined TORRENT_DISABLE_ENCRYPTION
+		if (m_rc4) m.objects += std::int64_t(sizeof(rc4_handler) + m_rc4->heap_size());
+		if (m_dh_key_exchange) m.objects += std::int64_t(sizeof(dh_key_exchange));
+#endif
+		m.queues += heap_size(m_payloads)
+			+ heap_size(m_hash_requests)
+			+ heap_size(m_have_batch);
+	}
+
+	void bt_peer_connection::release_idle_memory()
+	{
+		peer_connection::release_idle_memory();
+		release_if_empty(m_payloads);
+		release_if_empty(m_hash_requests);
+		release_if_empty(m_have_batch);
+	}
+
 	bool bt_peer_connection::in_handshake() const
 	{
 		// this returns true until we have received a handshake
@@ -975,10 +1004,30 @@ namespace {
 		const char* ptr = recv_buffer.data() + 1;
 		piece_index_t const index(aux::read_int32(ptr));
 
-		incoming_have(index);
+		// the batch is capped to bound the memory used by a peer flooding us
+		// with HAVE messages
+		if (m_have_batch.size() >= max_have_batch) flush_have_batch();
+		if (is_disconnecting()) return;
+		m_have_batch.push_back(index);
+	}
+
+	void bt_peer_connection::flush_have_batch()
+	{
+		if (m_have_batch.empty()) return;
+
+		// clearing the batch retains its capacity, so steady state HAVE
+		// traffic doesn't allocate
+		incoming_haves(m_have_batch);
+		m_have_batch.clear();
+		if (is_disconnecting()) return;
 		maybe_send_hash_request();
 	}
 
+	void bt_peer_connection::on_receive_done()
+	{
+		flush_have_batch();
+	}
+
 	// -----------------------------
 	// --------- BITFIELD ----------
 	// -----------------------------
@@ -2118,6 +2167,18 @@ namespace {
 		TORRENT_ASSERT(int(recv_buffer.size()) >= 1);
 		int const packet_type = static_cast<std::uint8_t>(recv_buffer[0]);
 
+		// any other message may depend on the pieces announced by the HAVE
+		// messages preceding it, so they have to be handled first
+		if (packet_type != msg_have)
+		{
+			flush_have_batch();
+			if (is_disconnecting())
+			{
+				received_bytes(0, received);
+				return m_recv_buffer.packet_finished();
+			}
+		}
+
 #if TORRENT_USE_ASSERTS
 		std::int64_t const cur_payload_dl = statistics().last_payload_downloaded();
 		std::int64_t const cur_protocol_dl = statistics().last_protocol_downloaded();
@@ -20,9 +20,10 @@ namespace libtorrent::aux {
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(!m_destructed);
 		TORRENT_ASSERT(bytes_to_pop <= m_bytes);
-		while (bytes_to_pop > 0 && !m_vec.empty())
+		if (!m_vec) return;
+		while (bytes_to_pop > 0 && !m_vec->empty())
 		{
-			buffer_t& b = m_vec.front();
+			buffer_t& b = m_vec->front();
 			if (b.used_size > bytes_to_pop)
 			{
 				b.buf += bytes_to_pop;
@@ -43,7 +44,7 @@ namespace libtorrent::aux {
 			TORRENT_ASSERT(m_bytes >= 0);
 			TORRENT_ASSERT(m_capacity >= 0);
 			TORRENT_ASSERT(m_bytes <= m_capacity);
-			m_vec.pop_front();
+			m_vec->pop_front();
 		}
 	}
 
@@ -53,8 +54,8 @@ namespace libtorrent::aux {
 	{
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(!m_destructed);
-		if (m_vec.empty()) return 0;
-		buffer_t& b = m_vec.back();
+		if (!m_vec || m_vec->empty()) return 0;
+		buffer_t& b = m_vec->back();
 		TORRENT_ASSERT(b.buf != nullptr);
 		return b.size - b.used_size;
 	}
@@ -79,8 +80,8 @@ namespace libtorrent::aux {
 	{
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(!m_destructed);
-		if (m_vec.empty()) return nullptr;
-		buffer_t& b = m_vec.back();
+		if (!m_vec || m_vec->empty()) return nullptr;
+		buffer_t& b = m_vec->back();
 		TORRENT_ASSERT(b.buf != nullptr);
 		char* const insert = b.buf + b.used_size;
 		if (insert + s > b.buf + b.size) return nullptr;
@@ -109,7 +110,8 @@ namespace libtorrent::aux {
 	void chained_buffer::build_vec(int bytes, std::vector<Buffer>& vec)
 	{
 		TORRENT_ASSERT(!m_destructed);
-		for (auto i = m_vec.begin(), end(m_vec.end()); bytes > 0 && i != end; ++i)
+		if (!m_vec) return;
+		for (auto i = m_vec->begin(), end(m_vec->end()); bytes > 0 && i != end; ++i)
 		{
 			TORRENT_ASSERT(i->buf != nullptr);
 			if (i->used_size > bytes)
@@ -127,11 +129,38 @@ namespace libtorrent::aux {
 	void chained_buffer::clear()
 	{
 		TORRENT_ASSERT(!m_destructed);
-		for (auto& b : m_vec)
-			b.destruct_holder(static_cast<void*>(&b.holder));
 		m_bytes = 0;
 		m_capacity = 0;
-		m_vec.clear();
+		if (!m_vec) return;
+		for (auto& b : *m_vec)
+			b.destruct_holder(static_cast<void*>(&b.holder));
+		m_vec->clear();
+	}
+
+	void chained_buffer::release_memory()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(!m_destructed);
+		// while there are bytes in the buffer, there may be an async write
+		// referring to m_tmp_vec
+		if (m_bytes > 0) return;
+		clear();
+		m_vec.reset();
+		m_tmp_vec.clear();
+		m_tmp_vec.shrink_to_fit();
+	}
+
+	std::size_t chained_buffer::overhead_bytes() const
+	{
+		std::size_t ret = m_tmp_vec.capacity() * sizeof(boost::asio::const_buffer);
+		if (!m_vec) return ret;
+		// std::deque allocates its elements in blocks, and keeps an array of
+		// pointers to the blocks. This is an estimate, since the block size
+		// is implementation defined
+		std::size_t const per_block = std::max(std::size_t(1), 512 / sizeof(buffer_t));
+		std::size_t const blocks = m_vec->size() / per_block + 1;
+		ret += blocks * per_block * sizeof(buffer_t) + (blocks + 8) * sizeof(void*);
+		return ret;
 	}
 
 	chained_buffer::~chained_buffer()
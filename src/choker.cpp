@@ -17,107 +17,15 @@ see LICENSE file.
 #include "libtorrent/aux_/time.hpp"
 #include "libtorrent/aux_/torrent.hpp"
 
-#include <functional>
-
-using namespace std::placeholders;
+#include <algorithm>
+#include <limits>
+#include <utility>
 
 namespace libtorrent::aux {
 
 namespace {
 
-	int compare_peers(peer_connection const* lhs, peer_connection const* rhs)
-	{
-		int const prio1 = lhs->get_priority(peer_connection::upload_channel);
-		int const prio2 = rhs->get_priority(peer_connection::upload_channel);
-
-		if (prio1 != prio2) return prio1 > prio2 ? 1 : -1;
-
-		// compare how many bytes they've sent us
-		std::int64_t const c1 = lhs->downloaded_in_last_round();
-		std::int64_t const c2 = rhs->downloaded_in_last_round();
-
-		if (c1 != c2) return c1 > c2 ? 1 : -1;
-		return 0;
-	}
-
-	// return true if 'lhs' peer should be preferred to be unchoke over 'rhs'
-	bool unchoke_compare_rr(peer_connection const* lhs
-		, peer_connection const* rhs, int pieces)
-	{
-		int const cmp = compare_peers(lhs, rhs);
-		if (cmp != 0) return cmp > 0;
-
-		// when seeding, rotate which peer is unchoked in a round-robin fashion
-
-		// the amount uploaded since unchoked (not just in the last round)
-		std::int64_t const u1 = lhs->uploaded_since_unchoked();
-		std::int64_t const u2 = rhs->uploaded_since_unchoked();
-
-		// the way the round-robin unchoker works is that it,
-		// by default, prioritizes any peer that is already unchoked.
-		// this maintain the status quo across unchoke rounds. However,
-		// peers that are unchoked, but have sent more than one quota
-		// since they were unchoked, they get de-prioritized.
-
-		auto const t1 = lhs->associated_torrent().lock();
-		auto const t2 = rhs->associated_torrent().lock();
-		TORRENT_ASSERT(t1);
-		TORRENT_ASSERT(t2);
-
-		// if a peer is already unchoked, the number of bytes sent since it was unchoked
-		// is greater than the send quanta, and it has been unchoked for at least one minute
-		// then it's done with its upload slot, and we can de-prioritize it
-		bool const c1_quota_complete = !lhs->is_choked()
-			&& u1 > std::int64_t(t1->torrent_file().piece_length()) * pieces
-			&& aux::time_now() - lhs->time_of_last_unchoke() > minutes(1);
-		bool const c2_quota_complete = !rhs->is_choked()
-			&& u2 > std::int64_t(t2->torrent_file().piece_length()) * pieces
-			&& aux::time_now() - rhs->time_of_last_unchoke() > minutes(1);
-
-		// if c2 has completed a quanta, it should be de-prioritized
-		// and vice versa
-		if (c1_quota_complete != c2_quota_complete)
-			return int(c1_quota_complete) < int(c2_quota_complete);
-
-		// when seeding, prefer the peer we're uploading the fastest to
-
-		// force the upload rate to zero for choked peers because
-		// if the peers just got choked the previous round
-		// there may have been a residual transfer which was already
-		// in-flight at the time and we don't want that to cause the peer
-		// to be ranked at the top of the choked peers
-		std::int64_t const c1 = lhs->is_choked() ? 0 : lhs->uploaded_in_last_round();
-		std::int64_t const c2 = rhs->is_choked() ? 0 : rhs->uploaded_in_last_round();
-
-		if (c1 != c2) return c1 > c2;
-
-		// if the peers are still identical (say, they're both waiting to be unchoked)
-		// prioritize the one that has waited the longest to be unchoked
-		// the round-robin unchoker relies on this logic. Don't change it
-		// without moving this into that unchoker logic
-		return lhs->time_of_last_unchoke() < rhs->time_of_last_unchoke();
-	}
-
-	// return true if 'lhs' peer should be preferred to be unchoke over 'rhs'
-	bool unchoke_compare_fastest_upload(peer_connection const* lhs
-		, peer_connection const* rhs)
-	{
-		int const cmp = compare_peers(lhs, rhs);
-		if (cmp != 0) return cmp > 0;
-
-		// when seeding, prefer the peer we're uploading the fastest to
-		std::int64_t const c1 = lhs->uploaded_in_last_round();
-		std::int64_t const c2 = rhs->uploaded_in_last_round();
-
-		if (c1 != c2) return c1 > c2;
-
-		// prioritize the one that has waited the longest to be unchoked
-		// the round-robin unchoker relies on this logic. Don't change it
-		// without moving this into that unchoker logic
-		return lhs->time_of_last_unchoke() < rhs->time_of_last_unchoke();
-	}
-
-	int anti_leech_score(peer_connection const* peer)
+	int anti_leech_score(unchoke_state const& s)
 	{
 		// the anti-leech seeding algorithm is based on the paper "Improving
 		// BitTorrent: A Simple Approach" from Chow et. al. and ranks peers based
@@ -139,49 +47,84 @@ namespace {
 		//   |             V             |
 		//   +---------------------------+
 		//   0%    num have pieces     100%
-		std::shared_ptr<torrent> const t = peer->associated_torrent().lock();
-		TORRENT_ASSERT(t);
-
-		std::int64_t const total_size = t->torrent_file().total_size();
+		std::int64_t const total_size = s.total_size;
 		if (total_size == 0) return 0;
 		// Cap the given_size so that it never causes the score to increase
-		std::int64_t const given_size = std::min(peer->statistics().total_payload_upload()
+		std::int64_t const given_size = std::min(s.total_payload_upload
 			, total_size / 2);
 		std::int64_t const have_size = std::max(given_size
-			, std::int64_t(t->torrent_file().piece_length()) * peer->num_have_pieces());
+			, std::int64_t(s.piece_length) * s.num_have_pieces);
 		return int(std::abs((have_size - total_size / 2) * 2000 / total_size));
 	}
 
-	// return true if 'lhs' peer should be preferred to be unchoke over 'rhs'
-	bool unchoke_compare_anti_leech(peer_connection const* lhs
-		, peer_connection const* rhs)
-	{
-		int const cmp = compare_peers(lhs, rhs);
-		if (cmp != 0) return cmp > 0;
+	} // anonymous namespace
 
-		int const score1 = anti_leech_score(lhs);
-		int const score2 = anti_leech_score(rhs);
-		if (score1 != score2) return score1 > score2;
+	unchoke_candidate make_unchoke_candidate(unchoke_state const& s
+		, int const algorithm, int const pieces, time_point const now)
+	{
+		unchoke_candidate c;
+		c.priority = s.priority;
+		c.downloaded = s.downloaded_in_last_round;
+		c.last_unchoke = s.last_unchoke;
 
-		// prioritize the one that has waited the longest to be unchoked
-		// the round-robin unchoker relies on this logic. Don't change it
-		// without moving this into that unchoker logic
-		return lhs->time_of_last_unchoke() < rhs->time_of_last_unchoke();
+		if (algorithm == settings_pack::fastest_upload)
+		{
+			// when seeding, prefer the peer we're uploading the fastest to
+			c.score = s.uploaded_in_last_round;
+		}
+		else if (algorithm == settings_pack::anti_leech)
+		{
+			c.score = anti_leech_score(s);
+		}
+		else
+		{
+			// when seeding, rotate which peer is unchoked in a round-robin fashion
+
+			// the way the round-robin unchoker works is that it,
+			// by default, prioritizes any peer that is already unchoked.
+			// this maintain the status quo across unchoke rounds. However,
+			// peers that are unchoked, but have sent more than one quota
+			// since they were unchoked, they get de-prioritized.
+
+			// if a peer is already unchoked, the number of bytes sent since it was unchoked
+			// is greater than the send quanta, and it has been unchoked for at least one minute
+			// then it's done with its upload slot, and we can de-prioritize it
+			c.quota_complete = !s.choked
+				&& s.uploaded_since_unchoked > std::int64_t(s.piece_length) * pieces
+				&& now - s.last_unchoke > minutes(1);
+
+			// when seeding, prefer the peer we're uploading the fastest to
+
+			// force the upload rate to zero for choked peers because
+			// if the peers just got choked the previous round
+			// there may have been a residual transfer which was already
+			// in-flight at the time and we don't want that to cause the peer
+			// to be ranked at the top of the choked peers
+			c.score = s.choked ? 0 : s.uploaded_in_last_round;
+		}
+		return c;
 	}
 
-	bool upload_rate_compare(peer_connection const* lhs
-		, peer_connection const* rhs)
+	bool unchoke_compare(unchoke_candidate const& lhs, unchoke_candidate const& rhs)
 	{
-		// take torrent priority into account
-		std::int64_t const c1 = lhs->uploaded_in_last_round()
-			* lhs->get_priority(peer_connection::upload_channel);
-		std::int64_t const c2 = rhs->uploaded_in_last_round()
-			* rhs->get_priority(peer_connection::upload_channel);
+		if (lhs.priority != rhs.priority) return lhs.priority > rhs.priority;
 
-		return c1 > c2;
-	}
+		// compare how many bytes they've sent us
+		if (lhs.downloaded != rhs.downloaded) return lhs.downloaded > rhs.downloaded;
 
-	} // anonymous namespace
+		// if one of the peers has completed a quanta, it should be
+		// de-prioritized
+		if (lhs.quota_complete != rhs.quota_complete)
+			return int(lhs.quota_complete) < int(rhs.quota_complete);
+
+		if (lhs.score != rhs.score) return lhs.score > rhs.score;
+
+		// if the peers are still identical (say, they're both waiting to be unchoked)
+		// prioritize the one that has waited the longest to be unchoked
+		// the round-robin unchoker relies on this logic. Don't change it
+		// without moving this into that unchoker logic
+		return lhs.last_unchoke < rhs.last_unchoke;
+	}
 
 	int unchoke_sort(std::vector<peer_connection*>& peers
 		, time_duration const unchoke_interval
@@ -218,13 +161,26 @@ namespace {
 
 			int rate_threshold = sett.get_int(settings_pack::rate_choker_initial_threshold);
 
-			std::sort(peers.begin(), peers.end()
-				, [](peer_connection const* lhs, peer_connection const* rhs)
-				{ return upload_rate_compare(lhs, rhs); });
-
+			// the peers sorted by upload rate, taking torrent priority into
+			// account. Only the rates are needed here, the peers are re-ordered
+			// below
+			std::vector<std::pair<std::int64_t, std::int64_t>> rates;
+			rates.reserve(peers.size());
 			for (auto const* p : peers)
 			{
-				int const rate = int(p->uploaded_in_last_round()
+				std::int64_t const uploaded = p->uploaded_in_last_round();
+				rates.emplace_back(uploaded * p->get_priority(peer_connection::upload_channel)
+					, uploaded);
+			}
+
+			std::sort(rates.begin(), rates.end()
+				, [](std::pair<std::int64_t, std::int64_t> const& lhs
+					, std::pair<std::int64_t, std::int64_t> const& rhs)
+				{ return lhs.first > rhs.first; });
+
+			for (auto const& r : rates)
+			{
+				int const rate = int(r.second
 					* 1000 / total_milliseconds(unchoke_interval));
 
 				// always have at least 1 unchoke slot
@@ -248,42 +204,43 @@ namespace {
 
 		int const slots = std::min(upload_slots, int(peers.size()));
 
-		if (sett.get_int(settings_pack::seed_choking_algorithm)
-			== settings_pack::round_robin)
-		{
-			int const pieces = sett.get_int(settings_pack::seeding_piece_quota);
+		int const algorithm = sett.get_int(settings_pack::seed_choking_algorithm);
+		TORRENT_ASSERT(algorithm == settings_pack::round_robin
+			|| algorithm == settings_pack::fastest_upload
+			|| algorithm == settings_pack::anti_leech);
 
-			std::nth_element(peers.begin(), peers.begin()
-				+ slots, peers.end()
-				, [pieces](peer_connection const* lhs, peer_connection const* rhs)
-				{ return unchoke_compare_rr(lhs, rhs, pieces); });
-		}
-		else if (sett.get_int(settings_pack::seed_choking_algorithm)
-			== settings_pack::fastest_upload)
-		{
-			std::nth_element(peers.begin(), peers.begin()
-				+ slots, peers.end()
-				, [](peer_connection const* lhs, peer_connection const* rhs)
-				{ return unchoke_compare_fastest_upload(lhs, rhs); });
-		}
-		else if (sett.get_int(settings_pack::seed_choking_algorithm)
-			== settings_pack::anti_leech)
+		int const pieces = sett.get_int(settings_pack::seeding_piece_quota);
+		time_point const now = aux::time_now();
+
+		std::vector<unchoke_candidate> candidates;
+		candidates.reserve(peers.size());
+		for (auto* p : peers)
 		{
-			std::nth_element(peers.begin(), peers.begin()
-				+ slots, peers.end()
-				, [](peer_connection const* lhs, peer_connection const* rhs)
-				{ return unchoke_compare_anti_leech(lhs, rhs); });
+			auto const t = p->associated_torrent().lock();
+			TORRENT_ASSERT(t);
+
+			unchoke_state st;
+			st.priority = p->get_priority(peer_connection::upload_channel);
+			st.downloaded_in_last_round = p->downloaded_in_last_round();
+			st.uploaded_in_last_round = p->uploaded_in_last_round();
+			st.uploaded_since_unchoked = p->uploaded_since_unchoked();
+			st.total_payload_upload = p->statistics().total_payload_upload();
+			st.num_have_pieces = p->num_have_pieces();
+			st.choked = p->is_choked();
+			st.last_unchoke = p->time_of_last_unchoke();
+			st.piece_length = t->torrent_file().piece_length();
+			st.total_size = t->torrent_file().total_size();
+
+			unchoke_candidate c = make_unchoke_candidate(st, algorithm, pieces, now);
+			c.peer = p;
+			candidates.push_back(c);
 		}
-		else
-		{
-			int const pieces = sett.get_int(settings_pack::seeding_piece_quota);
-			std::nth_element(peers.begin(), peers.begin()
-				+ slots, peers.end()
-				, [pieces](peer_connection const* lhs, peer_connection const* rhs)
-				{ return unchoke_compare_rr(lhs, rhs, pieces); } );
 
-			TORRENT_ASSERT_FAIL();
-		}
+		std::nth_element(candidates.begin(), candidates.begin()
+			+ slots, candidates.end(), &unchoke_compare);
+
+		for (std::size_t i = 0; i < candidates.size(); ++i)
+			peers[i] = candidates[i].peer;
 
 		return upload_slots;
 	}
@@ -0,0 +1,298 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/compressed_bitfield.hpp"
+
+#include <algorithm>
+
+namespace libtorrent::aux {
+
+	compressed_bitfield::compressed_bitfield(int const bits, bool const val)
+	{
+		resize(bits, val);
+	}
+
+	compressed_bitfield::compressed_bitfield(typed_bitfield<piece_index_t> const& bits)
+	{
+		*this = bits;
+	}
+
+	compressed_bitfield& compressed_bitfield::operator=(
+		typed_bitfield<piece_index_t> const& bits) &
+	{
+		release_list();
+		m_size = bits.size();
+		m_count = bits.count();
+		m_bits = bits;
+		m_storage = storage::dense;
+		compact(list_limit());
+		return *this;
+	}
+
+	bool compressed_bitfield::get_bit(piece_index_t const index) const
+	{
+		TORRENT_ASSERT(index >= piece_index_t(0));
+		TORRENT_ASSERT(index < end_index());
+		switch (m_storage)
+		{
+			case storage::sparse:
+				return in_list(index);
+			case storage::inverted:
+				return !in_list(index);
+			case storage::dense:
+				return m_bits.get_bit(index);
+		}
+		return false;
+	}
+
+	bool compressed_bitfield::in_list(piece_index_t const index) const
+	{
+		// seeds and peers without any pieces are the common case
+		if (m_list.empty()) return false;
+
+		// the piece picker asks for pieces in rarest-first order, which is
+		// random as far as the list is concerned. The branches of
+		// std::binary_search are mispredicted half the time, this search
+		// compiles to conditional moves instead
+		piece_index_t const* base = m_list.data();
+		std::size_t n = m_list.size();
+		while (n > 1)
+		{
+			std::size_t const half = n / 2;
+			base = base[half] <= index ? base + half : base;
+			n -= half;
+		}
+		return *base == index;
+	}
+
+	void compressed_bitfield::set_bit(piece_index_t const index)
+	{
+		TORRENT_ASSERT(index >= piece_index_t(0));
+		TORRENT_ASSERT(index < end_index());
+		switch (m_storage)
+		{
+			case storage::sparse:
+			{
+				auto const it = std::lower_bound(m_list.begin(), m_list.end(), index);
+				if (it != m_list.end() && *it == index) return;
+				++m_count;
+				if (m_count == m_size)
+				{
+					set_all();
+					return;
+				}
+				m_list.insert(it, index);
+				if (int(m_list.size()) > list_limit()) make_dense();
+				return;
+			}
+			case storage::inverted:
+			{
+				auto const it = std::lower_bound(m_list.begin(), m_list.end(), index);
+				if (it == m_list.end() || *it != index) return;
+				m_list.erase(it);
+				++m_count;
+				if (m_list.empty()) release_list();
+				return;
+			}
+			case storage::dense:
+				if (m_bits.get_bit(index)) return;
+				m_bits.set_bit(index);
+				++m_count;
+				if (m_size - m_count <= list_limit() / 2) compact(list_limit() / 2);
+				return;
+		}
+	}
+
+	void compressed_bitfield::clear_bit(piece_index_t const index)
+	{
+		TORRENT_ASSERT(index >= piece_index_t(0));
+		TORRENT_ASSERT(index < end_index());
+		switch (m_storage)
+		{
+			case storage::sparse:
+			{
+				auto const it = std::lower_bound(m_list.begin(), m_list.end(), index);
+				if (it == m_list.end() || *it != index) return;
+				m_list.erase(it);
+				--m_count;
+				if (m_list.empty()) release_list();
+				return;
+			}
+			case storage::inverted:
+			{
+				auto const it = std::lower_bound(m_list.begin(), m_list.end(), index);
+				if (it != m_list.end() && *it == index) return;
+				--m_count;
+				if (m_count == 0)
+				{
+					clear_all();
+					return;
+				}
+				m_list.insert(it, index);
+				if (int(m_list.size()) > list_limit()) make_dense();
+				return;
+			}
+			case storage::dense:
+				if (!m_bits.get_bit(index)) return;
+				m_bits.clear_bit(index);
+				--m_count;
+				if (m_count <= list_limit() / 2) compact(list_limit() / 2);
+				return;
+		}
+	}
+
+	void compressed_bitfield::set_all()
+	{
+		release_list();
+		m_bits.clear();
+		m_storage = storage::inverted;
+		m_count = m_size;
+	}
+
+	void compressed_bitfield::clear_all()
+	{
+		release_list();
+		m_bits.clear();
+		m_storage = storage::sparse;
+		m_count = 0;
+	}
+
+	void compressed_bitfield::clear()
+	{
+		m_size = 0;
+		clear_all();
+	}
+
+	void compressed_bitfield::resize(int const bits, bool const val)
+	{
+		TORRENT_ASSERT(bits >= 0);
+		if (bits == m_size) return;
+
+		// if the bitfield is uniform, and stays that way, there's no list to
+		// update
+		bool const grow = bits > m_size;
+		if (m_count == 0 && (!grow || !val))
+		{
+			m_size = bits;
+			clear_all();
+			return;
+		}
+
+		if (m_count == m_size && (!grow || val))
+		{
+			m_size = bits;
+			set_all();
+			return;
+		}
+
+		if (m_storage != storage::dense && (m_storage == storage::inverted) == val)
+		{
+			// the new bits have the same value as the ones implied by the list,
+			// only the exceptions past the new end need to be removed
+			m_list.erase(std::lower_bound(m_list.begin(), m_list.end(), piece_index_t(bits))
+				, m_list.end());
+			m_size = bits;
+			int const exceptions = int(m_list.size());
+			m_count = m_storage == storage::sparse ? exceptions : m_size - exceptions;
+			if (exceptions > list_limit()) make_dense();
+			return;
+		}
+
+		make_dense();
+		m_bits.resize(bits, val);
+		m_size = bits;
+		m_count = m_bits.count();
+		compact(list_limit());
+	}
+
+	piece_index_t compressed_bitfield::find_next_set(piece_index_t start) const
+	{
+		TORRENT_ASSERT(start >= piece_index_t(0));
+		if (start >= end_index()) return end_index();
+		switch (m_storage)
+		{
+			case storage::sparse:
+			{
+				auto const it = std::lower_bound(m_list.begin(), m_list.end(), start);
+				return it == m_list.end() ? end_index() : *it;
+			}
+			case storage::inverted:
+			{
+				// skip the run of clear pieces starting at start, if any
+				auto it = std::lower_bound(m_list.begin(), m_list.end(), start);
+				while (it != m_list.end() && *it == start)
+				{
+					++it;
+					++start;
+				}
+				return start;
+			}
+			case storage::dense:
+				for (; start != end_index(); ++start)
+					if (m_bits.get_bit(start)) return start;
+				return end_index();
+		}
+		return end_index();
+	}
+
+	typed_bitfield<piece_index_t> compressed_bitfield::to_bitfield() const
+	{
+		if (m_storage == storage::dense) return m_bits;
+
+		bool const inverted = m_storage == storage::inverted;
+		typed_bitfield<piece_index_t> ret(m_size, inverted);
+		for (piece_index_t const i : m_list)
+		{
+			if (inverted) ret.clear_bit(i);
+			else ret.set_bit(i);
+		}
+		return ret;
+	}
+
+	std::size_t compressed_bitfield::heap_size() const noexcept
+	{
+		std::size_t ret = m_list.capacity() * sizeof(piece_index_t);
+		// the bitfield stores its size in an extra word in front of the bits
+		if (!m_bits.empty())
+			ret += std::size_t(m_bits.num_words() + 1) * sizeof(std::uint32_t);
+		return ret;
+	}
+
+	void compressed_bitfield::make_dense()
+	{
+		if (m_storage == storage::dense) return;
+		m_bits = to_bitfield();
+		m_storage = storage::dense;
+		release_list();
+	}
+
+	void compressed_bitfield::compact(int const limit)
+	{
+		TORRENT_ASSERT(m_storage == storage::dense);
+		TORRENT_ASSERT(m_count == m_bits.count());
+
+		bool inverted;
+		if (m_count <= limit) inverted = false;
+		else if (m_size - m_count <= limit) inverted = true;
+		else return;
+
+		TORRENT_ASSERT(m_list.empty());
+		m_list.reserve(std::size_t(inverted ? m_size - m_count : m_count));
+		for (piece_index_t const i : m_bits.range())
+			if (m_bits.get_bit(i) != inverted) m_list.push_back(i);
+		m_bits.clear();
+		m_storage = inverted ? storage::inverted : storage::sparse;
+	}
+
+	void compressed_bitfield::release_list()
+	{
+		m_list.clear();
+		m_list.shrink_to_fit();
+	}
+}
@@ -147,6 +147,12 @@ struct TORRENT_EXTRA_EXPORT disabled_disk_io final
 		post(m_ios, [h = std::move(handler), index] { h(index); });
 	}
 
+	void async_storage_device(storage_index_t
+		, std::function<void(std::uint64_t, bool)> handler) override
+	{
+		post(m_ios, [h = std::move(handler)] { h(0, false); });
+	}
+
 	void update_stats_counters(counters& c) const override
 	{
 		c.set_value(counters::disk_blocks_in_use, 1);
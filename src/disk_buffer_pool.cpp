@@ -16,6 +16,9 @@ see LICENSE file.
 #include "libtorrent/io_context.hpp"
 #include "libtorrent/disk_observer.hpp"
 #include "libtorrent/disk_interface.hpp" // for default_block_size
+#include "libtorrent/aux_/platform_util.hpp" // for current_numa_node
+
+#include <algorithm>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 
@@ -27,6 +30,13 @@ see LICENSE file.
 #include <linux/unistd.h>
 #endif
 
+#if TORRENT_USE_NUMA
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#endif
+
 #ifdef TORRENT_ADDRESS_SANITIZER
 #include <sanitizer/asan_interface.h>
 #endif
@@ -48,6 +58,13 @@ namespace {
 		}
 	}
 
+#if TORRENT_USE_NUMA
+	// 2 MiB, the size of a huge page on x86-64 and arm64
+	constexpr std::size_t slab_size = 2 * 1024 * 1024;
+	constexpr int blocks_per_slab = int(slab_size / default_block_size);
+	static_assert(blocks_per_slab <= 256, "block indices must fit in a uint8_t");
+#endif
+
 } // anonymous namespace
 
 	disk_buffer_pool::disk_buffer_pool(io_context& ios)
@@ -63,6 +80,10 @@ namespace {
 		TORRENT_ASSERT(m_magic == 0x1337);
 #if TORRENT_USE_ASSERTS
 		m_magic = 0;
+#endif
+#if TORRENT_USE_NUMA
+		for (auto const& s : m_slabs)
+			::munmap(s.second.base, slab_size);
 #endif
 	}
 
@@ -83,10 +104,19 @@ namespace {
 		post(m_ios, std::bind(&watermark_callback, std::move(cbs)));
 	}
 
+	int disk_buffer_pool::numa_node() const
+	{
+#if TORRENT_USE_NUMA
+		if (m_numa.load(std::memory_order_relaxed)) return current_numa_node();
+#endif
+		return -1;
+	}
+
 	char* disk_buffer_pool::allocate_buffer(char const* category)
 	{
+		int const node = numa_node();
 		std::unique_lock<std::mutex> l(m_pool_mutex);
-		return allocate_buffer_impl(l, category);
+		return allocate_buffer_impl(l, category, node);
 	}
 
 	// we allow allocating more blocks even after we exceed the max size,
@@ -99,8 +129,9 @@ namespace {
 	char* disk_buffer_pool::allocate_buffer(bool& exceeded
 		, std::shared_ptr<disk_observer> o, char const* category)
 	{
+		int const node = numa_node();
 		std::unique_lock<std::mutex> l(m_pool_mutex);
-		char* ret = allocate_buffer_impl(l, category);
+		char* ret = allocate_buffer_impl(l, category, node);
 		if (m_exceeded_max_size)
 		{
 			exceeded = true;
@@ -110,15 +141,22 @@ namespace {
 	}
 
 	char* disk_buffer_pool::allocate_buffer_impl(std::unique_lock<std::mutex>& l
-		, char const* category)
+		, char const* category, int const node)
 	{
 		TORRENT_ASSERT(m_settings_set);
 		TORRENT_ASSERT(m_magic == 0x1337);
 		TORRENT_ASSERT(l.owns_lock());
 		TORRENT_UNUSED(l);
 		TORRENT_UNUSED(category);
+		TORRENT_UNUSED(node);
 
+#if TORRENT_USE_NUMA
+		char* ret = node >= 0 ? allocate_slab_buffer(node) : nullptr;
+		if (ret == nullptr)
+			ret = static_cast<char*>(std::malloc(default_block_size));
+#else
 		char* ret = static_cast<char*>(std::malloc(default_block_size));
+#endif
 
 		if (ret == nullptr)
 		{
@@ -137,7 +175,7 @@ namespace {
 		}
 		catch (...)
 		{
-			free_buffer_impl(ret, l);
+			free_buffer_impl(ret, l, node);
 			return nullptr;
 		}
 		m_histogram[category] += 1;
@@ -158,11 +196,12 @@ namespace {
 		// sort the pointers in order to maximize cache hits
 		std::sort(bufvec.begin(), bufvec.end());
 
+		int const node = numa_node();
 		std::unique_lock<std::mutex> l(m_pool_mutex);
 		for (char* buf : bufvec)
 		{
 			remove_buffer_in_use(buf);
-			free_buffer_impl(buf, l);
+			free_buffer_impl(buf, l, node);
 		}
 
 		check_buffer_level(l);
@@ -170,9 +209,10 @@ namespace {
 
 	void disk_buffer_pool::free_buffer(char* buf)
 	{
+		int const node = numa_node();
 		std::unique_lock<std::mutex> l(m_pool_mutex);
 		remove_buffer_in_use(buf);
-		free_buffer_impl(buf, l);
+		free_buffer_impl(buf, l, node);
 		check_buffer_level(l);
 	}
 
@@ -183,6 +223,10 @@ namespace {
 		int const pool_size = std::max(1, sett.get_int(settings_pack::max_queued_disk_bytes) / default_block_size);
 		m_max_use = pool_size;
 		m_low_watermark = m_max_use / 2;
+#if TORRENT_USE_NUMA
+		m_numa.store(sett.get_bool(settings_pack::numa_disk_buffers)
+			, std::memory_order_relaxed);
+#endif
 		if (m_in_use >= m_max_use && !m_exceeded_max_size)
 		{
 			m_exceeded_max_size = true;
@@ -237,18 +281,112 @@ namespace {
 	}
 #endif
 
-	void disk_buffer_pool::free_buffer_impl(char* buf, std::unique_lock<std::mutex>& l)
+	void disk_buffer_pool::free_buffer_impl(char* buf, std::unique_lock<std::mutex>& l
+		, int const node)
 	{
 		TORRENT_ASSERT(buf);
 		TORRENT_ASSERT(m_magic == 0x1337);
 		TORRENT_ASSERT(m_settings_set);
 		TORRENT_ASSERT(l.owns_lock());
 		TORRENT_UNUSED(l);
+		TORRENT_UNUSED(node);
 
+#if TORRENT_USE_NUMA
+		if (!free_slab_buffer(buf, node))
+#endif
 		std::free(buf);
 
 		--m_in_use;
 	}
 
+#if TORRENT_USE_NUMA
+	char* disk_buffer_pool::allocate_slab_buffer(int const node)
+	{
+		if (int(m_partial_slabs.size()) <= node)
+			m_partial_slabs.resize(std::size_t(node) + 1);
+
+		auto& partial = m_partial_slabs[std::size_t(node)];
+		if (partial.empty())
+		{
+			buffer_slab* s = new_slab(node);
+			if (s == nullptr) return nullptr;
+			partial.push_back(s);
+		}
+
+		buffer_slab& s = *partial.back();
+		TORRENT_ASSERT(!s.free_blocks.empty());
+		int const idx = s.free_blocks.back();
+		s.free_blocks.pop_back();
+		if (s.free_blocks.empty()) partial.pop_back();
+		return s.base + idx * default_block_size;
+	}
+
+	disk_buffer_pool::buffer_slab* disk_buffer_pool::new_slab(int const node)
+	{
+		// map twice the size, to be able to trim it to an aligned slab
+		void* const p = ::mmap(nullptr, slab_size * 2, PROT_READ | PROT_WRITE
+			, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) return nullptr;
+
+		auto const addr = reinterpret_cast<std::uintptr_t>(p);
+		auto const aligned = (addr + slab_size - 1) & ~(slab_size - 1);
+		if (aligned > addr)
+			::munmap(p, aligned - addr);
+		if (addr + slab_size * 2 > aligned + slab_size)
+			::munmap(reinterpret_cast<void*>(aligned + slab_size)
+				, addr + slab_size * 2 - (aligned + slab_size));
+
+		char* const base = reinterpret_cast<char*>(aligned);
+
+		// these are best-effort. Nothing has touched the memory yet, so pages
+		// will be allocated on the preferred node as they are first written
+#ifdef MADV_HUGEPAGE
+		::madvise(base, slab_size, MADV_HUGEPAGE);
+#endif
+		constexpr int bits = int(sizeof(unsigned long) * 8);
+		unsigned long nodemask[16] = {};
+		if (node < int(sizeof(nodemask) * 8))
+		{
+			nodemask[node / bits] |= 1ul << (node % bits);
+			::syscall(SYS_mbind, base, slab_size, MPOL_PREFERRED
+				, nodemask, sizeof(nodemask) * 8, 0);
+		}
+
+		buffer_slab& s = m_slabs[aligned];
+		s.base = base;
+		s.node = node;
+		s.free_blocks.resize(blocks_per_slab);
+		// hand out the blocks in address order
+		for (int i = 0; i < blocks_per_slab; ++i)
+			s.free_blocks[std::size_t(i)] = std::uint8_t(blocks_per_slab - 1 - i);
+		return &s;
+	}
+
+	bool disk_buffer_pool::free_slab_buffer(char* buf, int const node)
+	{
+		if (m_slabs.empty()) return false;
+
+		auto const it = m_slabs.find(reinterpret_cast<std::uintptr_t>(buf) & ~(slab_size - 1));
+		if (it == m_slabs.end()) return false;
+
+		buffer_slab& s = it->second;
+		if (node == s.node) ++m_local_node_frees;
+		else if (node >= 0) ++m_remote_node_frees;
+
+		auto& partial = m_partial_slabs[std::size_t(s.node)];
+		if (s.free_blocks.empty()) partial.push_back(&s);
+		s.free_blocks.push_back(std::uint8_t((buf - s.base) / default_block_size));
+
+		// keep one free slab per node around, release the others
+		if (int(s.free_blocks.size()) == blocks_per_slab && partial.size() > 1)
+		{
+			partial.erase(std::find(partial.begin(), partial.end(), &s));
+			::munmap(s.base, slab_size);
+			m_slabs.erase(it);
+		}
+		return true;
+	}
+#endif
+
 }
 }
@@ -55,8 +55,8 @@ namespace libtorrent::aux {
 #if TORRENT_USE_ASSERTS
 		if (!m_queued_jobs.empty())
 		{
-			for (auto i = m_queued_jobs.iterate(); i.get(); i.next())
-				std::printf("job: %d\n", int(i.get()->action.index()));
+			m_queued_jobs.visit_jobs([](aux::disk_job const* j)
+				{ std::printf("job: %d\n", int(j->action.index())); });
 		}
 		TORRENT_ASSERT(m_queued_jobs.empty());
 #endif
@@ -97,6 +97,12 @@ namespace {
 			j.handler(std::move(j.buf), m_job.error);
 		}
 
+		void operator()(job::storage_device& j) const
+		{
+			if (!j.handler) return;
+			j.handler(j.device, j.spinning);
+		}
+
 	private:
 		disk_job& m_job;
 	};
@@ -38,6 +38,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <optional>
 
+#if !defined TORRENT_WINDOWS
+#include <sys/stat.h>
+#endif
+
 #ifdef TORRENT_LINUX
 #include <sys/vfs.h>
 #include <linux/magic.h>
@@ -273,6 +277,41 @@ drive_info get_drive_info(std::string const&)
 	return drive_info::spinning;
 }
 #endif
+
+#if defined TORRENT_WINDOWS && !defined TORRENT_WINRT
+
+device_id get_device_id(std::string const& path)
+{
+	auto const native_path = convert_to_native_path_string(path);
+
+	std::array<wchar_t, 300> volume_path;
+	if (GetVolumePathNameW(native_path.c_str(), volume_path.data(), DWORD(volume_path.size())) == 0)
+		return 0;
+
+	DWORD serial = 0;
+	if (!GetVolumeInformationW(volume_path.data()
+		, nullptr, 0, &serial, nullptr, nullptr, nullptr, 0))
+		return 0;
+	return device_id(serial) + 1;
+}
+
+#elif !defined TORRENT_WINDOWS
+
+device_id get_device_id(std::string const& path)
+{
+	struct stat st{};
+	if (stat(path.c_str(), &st) != 0)
+		return 0;
+	return device_id(st.st_dev) + 1;
+}
+
+#else
+
+device_id get_device_id(std::string const&)
+{
+	return 0;
+}
+#endif
 }
 }
 
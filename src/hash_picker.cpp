@@ -114,7 +114,7 @@ bool validate_hash_request(hash_request const& hr, file_storage const& fs)
 		}
 	}
 
-	hash_request hash_picker::pick_hashes(typed_bitfield<piece_index_t> const& pieces)
+	hash_request hash_picker::pick_hashes(compressed_bitfield const& pieces)
 	{
 		auto const now = aux::time_now();
 
@@ -33,6 +33,49 @@ see LICENSE file.
 
 namespace libtorrent::aux {
 
+namespace {
+
+	// returns a pointer to the first '\n' in [pos, end), or end if there is
+	// none. memchr() is typically vectorized, unlike a plain loop
+	char const* find_newline(char const* pos, char const* end)
+	{
+		TORRENT_ASSERT(pos <= end);
+		auto const* ret = static_cast<char const*>(
+			std::memchr(pos, '\n', std::size_t(end - pos)));
+		return ret == nullptr ? end : ret;
+	}
+
+	// returns the line starting at pos and ending at newline, without the
+	// line terminator
+	string_view header_line(char const* pos, char const* newline)
+	{
+		// if the LF character is preceded by a CR
+		// character, don't include it in the line
+		char const* line_end = newline;
+		if (pos != line_end && *(line_end - 1) == '\r') --line_end;
+		return {pos, std::size_t(line_end - pos)};
+	}
+
+	// splits a "name: value" header line into the lower-cased name and the
+	// value, with leading whitespace removed. Returns false if the line is not
+	// a header (i.e. it doesn't have a colon)
+	bool split_header(string_view const line, std::string& name, string_view& value)
+	{
+		auto separator = line.find(':');
+		if (separator == string_view::npos) return false;
+
+		name.assign(line.data(), separator);
+		std::transform(name.begin(), name.end(), name.begin(), &to_lower);
+		++separator;
+		// skip whitespace
+		while (separator < line.size()
+			&& (line[separator] == ' ' || line[separator] == '\t'))
+			++separator;
+		value = line.substr(separator);
+		return true;
+	}
+}
+
 	bool is_ok_status(int http_status)
 	{
 		return http_status == 206 // partial content
@@ -175,7 +218,7 @@ restart_response:
 		{
 			TORRENT_ASSERT(!m_finished);
 			TORRENT_ASSERT(pos <= recv_buffer.end());
-			char const* newline = std::find(pos, recv_buffer.end(), '\n');
+			char const* newline = find_newline(pos, recv_buffer.end());
 			// if we don't have a full line yet, wait.
 			if (newline == recv_buffer.end())
 			{
@@ -230,22 +273,18 @@ restart_response:
 		{
 			TORRENT_ASSERT(!m_finished);
 			TORRENT_ASSERT(pos <= recv_buffer.end());
-			char const* newline = std::find(pos, recv_buffer.end(), '\n');
-			std::string line;
+			char const* newline = find_newline(pos, recv_buffer.end());
+			std::string name;
+			string_view value_str;
 
 			while (newline != recv_buffer.end() && m_state == read_header)
 			{
-				// if the LF character is preceded by a CR
-				// character, don't copy it into the line string.
-				char const* line_end = newline;
-				if (pos != line_end && *(line_end - 1) == '\r') --line_end;
-				line.assign(pos, line_end);
+				string_view const line = header_line(pos, newline);
 				++newline;
 				m_recv_pos += newline - pos;
 				pos = newline;
 
-				std::string::size_type separator = line.find(':');
-				if (separator == std::string::npos)
+				if (!split_header(line, name, value_str))
 				{
 					if (m_status_code == 100)
 					{
@@ -267,15 +306,11 @@ restart_response:
 					break;
 				}
 
-				std::string name = line.substr(0, separator);
-				std::transform(name.begin(), name.end(), name.begin(), &to_lower);
-				++separator;
-				// skip whitespace
-				while (separator < line.size()
-					&& (line[separator] == ' ' || line[separator] == '\t'))
-					++separator;
-				std::string value = line.substr(separator, std::string::npos);
-				m_header.insert(std::make_pair(name, value));
+				// the header strings are stored in the map directly, rather than
+				// going through temporary copies. The value refers to the copy in
+				// the map from here on, which is null terminated
+				auto const h = m_header.emplace(name, value_str);
+				std::string const& value = h->second;
 
 				if (name == "content-length")
 				{
@@ -343,7 +378,7 @@ restart_response:
 
 				TORRENT_ASSERT(m_recv_pos <= int(recv_buffer.size()));
 				TORRENT_ASSERT(pos <= recv_buffer.end());
-				newline = std::find(pos, recv_buffer.end(), '\n');
+				newline = find_newline(pos, recv_buffer.end());
 			}
 			std::get<1>(ret) += int(newline - (m_recv_buffer.data() + start_pos));
 		}
@@ -465,7 +500,7 @@ restart_response:
 		if (pos == buf.end()) return false;
 
 		TORRENT_ASSERT(pos <= buf.end());
-		char const* newline = std::find(pos, buf.end(), '\n');
+		char const* newline = find_newline(pos, buf.end());
 		if (newline == buf.end()) return false;
 		++newline;
 
@@ -511,21 +546,17 @@ restart_response:
 		// this is the terminator of the stream. Also read headers
 		std::map<std::string, std::string> tail_headers;
 		pos = newline;
-		newline = std::find(pos, buf.end(), '\n');
+		newline = find_newline(pos, buf.end());
 
-		std::string line;
+		std::string name;
+		string_view value;
 		while (newline != buf.end())
 		{
-			// if the LF character is preceded by a CR
-			// character, don't copy it into the line string.
-			char const* line_end = newline;
-			if (pos != line_end && *(line_end - 1) == '\r') --line_end;
-			line.assign(pos, line_end);
+			string_view const line = header_line(pos, newline);
 			++newline;
 			pos = newline;
 
-			std::string::size_type separator = line.find(':');
-			if (separator == std::string::npos)
+			if (!split_header(line, name, value))
 			{
 				// this means we got a blank line,
 				// the header is finished and the body
@@ -543,18 +574,10 @@ restart_response:
 				return true;
 			}
 
-			std::string name = line.substr(0, separator);
-			std::transform(name.begin(), name.end(), name.begin(), &to_lower);
-			++separator;
-			// skip whitespace
-			while (separator < line.size()
-				&& (line[separator] == ' ' || line[separator] == '\t'))
-				++separator;
-			std::string value = line.substr(separator, std::string::npos);
-			tail_headers.insert(std::make_pair(name, value));
-//			std::fprintf(stderr, "tail_header: %s: %s\n", name.c_str(), value.c_str());
-
-			newline = std::find(pos, buf.end(), '\n');
+			tail_headers.emplace(name, value);
+//			std::fprintf(stderr, "tail_header: %s: %s\n", name.c_str(), std::string(value).c_str());
+
+			newline = find_newline(pos, buf.end());
 		}
 		return false;
 	}
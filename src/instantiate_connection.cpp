@@ -36,14 +36,14 @@ namespace libtorrent::aux {
 			if (ssl_context)
 			{
 				ssl_stream<utp_stream> s(ios, *static_cast<ssl::context*>(ssl_context));
-				s.next_layer().set_impl(sm->new_utp_socket(&s.next_layer()));
+				s.next_layer().attach(*sm);
 				return socket_type(std::move(s));
 			}
 			else
 #endif
 			{
 				utp_stream s(ios);
-				s.set_impl(sm->new_utp_socket(&s));
+				s.attach(*sm);
 				return socket_type(std::move(s));
 			}
 		}
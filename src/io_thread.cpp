@@ -0,0 +1,41 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/io_thread.hpp"
+#include "libtorrent/aux_/platform_util.hpp" // for set_thread_name
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent::aux {
+
+#ifndef TORRENT_BUILD_SIMULATOR
+	// the simulation runs everything on a single, simulated, io_context. There's
+	// no io_context to give a thread of its own
+	io_thread::io_thread(char const* name)
+		: m_work(make_work_guard(m_ioc))
+		, m_thread([this, name]
+		{
+			set_thread_name(name);
+			m_ioc.run();
+		})
+	{}
+#endif
+
+	io_thread::~io_thread()
+	{
+		stop();
+	}
+
+	void io_thread::stop()
+	{
+		if (!m_thread.joinable()) return;
+		TORRENT_ASSERT(m_thread.get_id() != std::this_thread::get_id());
+		m_work.reset();
+		m_thread.join();
+	}
+}
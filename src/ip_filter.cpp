@@ -9,6 +9,8 @@ see LICENSE file.
 */
 
 #include <iterator> // for next
+#include <algorithm> // for push_heap, pop_heap, sort
+#include <cstddef>
 
 #include "libtorrent/ip_filter.hpp"
 #include "libtorrent/assert.hpp"
@@ -40,6 +42,32 @@ namespace libtorrent {
 			TORRENT_ASSERT_FAIL();
 	}
 
+	void ip_filter::add_rules(span<ip_range<address_v4> const> rules)
+	{
+		using rule = aux::filter_impl<address_v4::bytes_type>::rule;
+		std::vector<rule> r;
+		r.reserve(std::size_t(rules.size()));
+		for (auto const& i : rules)
+			r.push_back(rule{i.first.to_bytes(), i.last.to_bytes(), i.flags});
+		m_filter4.add_rules(r);
+	}
+
+	void ip_filter::add_rules(span<ip_range<address_v6> const> rules)
+	{
+		using rule = aux::filter_impl<address_v6::bytes_type>::rule;
+		std::vector<rule> r;
+		r.reserve(std::size_t(rules.size()));
+		for (auto const& i : rules)
+			r.push_back(rule{i.first.to_bytes(), i.last.to_bytes(), i.flags});
+		m_filter6.add_rules(r);
+	}
+
+	void ip_filter::compile()
+	{
+		m_filter4.compile();
+		m_filter6.compile();
+	}
+
 	std::uint32_t ip_filter::access(address const& addr) const
 	{
 		if (addr.is_v4())
@@ -139,6 +167,31 @@ namespace aux {
 	template EXPORT_INST address_v4::bytes_type max_addr<address_v4::bytes_type>();
 	template EXPORT_INST address_v6::bytes_type max_addr<address_v6::bytes_type>();
 
+namespace {
+
+	// fills in the implicit tree rooted at k, in-order, from sorted[i...].
+	// Returns the index of the next element of sorted to place
+	template <typename Range, typename Addr>
+	std::size_t eytzinger_fill(std::vector<Range> const& sorted, std::size_t i
+		, std::size_t const k, Addr* start, std::uint32_t* access)
+	{
+		if (k > sorted.size()) return i;
+		i = eytzinger_fill(sorted, i, 2 * k, start, access);
+		start[k] = sorted[i].start;
+		access[k] = sorted[i].access;
+		return eytzinger_fill(sorted, i + 1, 2 * k + 1, start, access);
+	}
+
+	inline void prefetch(void const* p)
+	{
+#if defined __GNUC__ || defined __clang__
+		__builtin_prefetch(p);
+#else
+		TORRENT_UNUSED(p);
+#endif
+	}
+}
+
 	template <typename Addr>
 	filter_impl<Addr>::filter_impl()
 	{
@@ -149,6 +202,13 @@ namespace aux {
 	template <typename Addr>
 	bool filter_impl<Addr>::empty() const
 	{
+		if (compiled())
+		{
+			return m_flat_start.size() == 2
+				&& m_flat_start[1] == zero<Addr>() && m_flat_access[1] == 0
+				&& std::all_of(m_single.begin(), m_single.end()
+					, [](auto const& e) { return e.second == 0; });
+		}
 		return m_access_list.empty()
 			|| (m_access_list.size() == 1 && *m_access_list.begin() == range(zero<Addr>(), 0));
 	}
@@ -156,15 +216,31 @@ namespace aux {
 	template <typename Addr>
 	void filter_impl<Addr>::add_rule(Addr first, Addr last, std::uint32_t const flags)
 	{
-		TORRENT_ASSERT(!m_access_list.empty());
 		TORRENT_ASSERT(first < last || first == last);
+		if (compiled())
+		{
+			if (first == last)
+			{
+				m_single[first] = flags;
+				return;
+			}
+			decompile();
+		}
+		insert_rule(m_access_list, first, last, flags);
+	}
 
-		auto i = m_access_list.upper_bound(first);
-		auto j = m_access_list.upper_bound(last);
+	template <typename Addr>
+	void filter_impl<Addr>::insert_rule(std::set<range>& list
+		, Addr first, Addr last, std::uint32_t const flags)
+	{
+		TORRENT_ASSERT(!list.empty());
 
-		if (i != m_access_list.begin()) --i;
+		auto i = list.upper_bound(first);
+		auto j = list.upper_bound(last);
 
-		TORRENT_ASSERT(j != m_access_list.begin());
+		if (i != list.begin()) --i;
+
+		TORRENT_ASSERT(j != list.begin());
 		TORRENT_ASSERT(j != i);
 
 		std::uint32_t first_access = i->access;
@@ -172,17 +248,17 @@ namespace aux {
 
 		if (i->start != first && first_access != flags)
 		{
-			i = m_access_list.insert(i, range(first, flags));
+			i = list.insert(i, range(first, flags));
 		}
-		else if (i != m_access_list.begin() && std::prev(i)->access == flags)
+		else if (i != list.begin() && std::prev(i)->access == flags)
 		{
 			--i;
 			first_access = i->access;
 		}
-		TORRENT_ASSERT(!m_access_list.empty());
-		TORRENT_ASSERT(i != m_access_list.end());
+		TORRENT_ASSERT(!list.empty());
+		TORRENT_ASSERT(i != list.end());
 
-		if (i != j) m_access_list.erase(std::next(i), j);
+		if (i != j) list.erase(std::next(i), j);
 		if (i->start == first)
 		{
 			// This is an optimization over erasing and inserting a new element
@@ -194,26 +270,215 @@ namespace aux {
 		}
 		else if (first_access != flags)
 		{
-			m_access_list.insert(i, range(first, flags));
+			list.insert(i, range(first, flags));
 		}
 
-		if ((j != m_access_list.end()
+		if ((j != list.end()
 				&& minus_one(j->start) != last)
-			|| (j == m_access_list.end()
+			|| (j == list.end()
 				&& last != max_addr<Addr>()))
 		{
-			TORRENT_ASSERT(j == m_access_list.end() || last < minus_one(j->start));
+			TORRENT_ASSERT(j == list.end() || last < minus_one(j->start));
 			if (last_access != flags)
-				j = m_access_list.insert(j, range(plus_one(last), last_access));
+				j = list.insert(j, range(plus_one(last), last_access));
 		}
 
-		if (j != m_access_list.end() && j->access == flags) m_access_list.erase(j);
-		TORRENT_ASSERT(!m_access_list.empty());
+		if (j != list.end() && j->access == flags) list.erase(j);
+		TORRENT_ASSERT(!list.empty());
+	}
+
+	template <typename Addr>
+	void filter_impl<Addr>::add_rules(std::vector<rule> const& rules)
+	{
+		// this is a sweep over all range boundaries, from low to high
+		// addresses. The ranges already in the filter partition the whole
+		// address space, and are treated as rules with lower priority than
+		// any of the new ones. Later rules have higher priority, just like
+		// they would overwrite earlier ones with add_rule(). At any address,
+		// the rule in effect is the highest priority one covering it, which is
+		// kept at the top of a heap. Rules that have ended are removed lazily,
+		// once they make it to the top
+		struct item
+		{
+			Addr first;
+			Addr last;
+			std::uint32_t flags;
+			std::ptrdiff_t priority;
+		};
+
+		std::vector<item> items;
+		{
+			std::vector<range> const current = sorted_ranges();
+			items.reserve(current.size() + rules.size());
+			for (std::size_t i = 0; i < current.size(); ++i)
+			{
+				Addr const last = i + 1 == current.size()
+					? max_addr<Addr>() : minus_one(current[i + 1].start);
+				items.push_back({current[i].start, last, current[i].access, -1});
+			}
+		}
+		for (std::size_t i = 0; i < rules.size(); ++i)
+		{
+			rule const& r = rules[i];
+			TORRENT_ASSERT(r.first < r.last || r.first == r.last);
+			if (r.last < r.first) continue;
+			items.push_back({r.first, r.last, r.flags, std::ptrdiff_t(i)});
+		}
+		std::sort(items.begin(), items.end()
+			, [](item const& lhs, item const& rhs) { return lhs.first < rhs.first; });
+
+		auto const lower_priority = [&](std::size_t const lhs, std::size_t const rhs)
+		{ return items[lhs].priority < items[rhs].priority; };
+
+		std::vector<range> result;
+		std::vector<std::size_t> active;
+		std::size_t next = 0;
+		Addr pos = zero<Addr>();
+		for (;;)
+		{
+			while (next < items.size() && !(pos < items[next].first))
+			{
+				active.push_back(next++);
+				std::push_heap(active.begin(), active.end(), lower_priority);
+			}
+			while (!active.empty() && items[active.front()].last < pos)
+			{
+				std::pop_heap(active.begin(), active.end(), lower_priority);
+				active.pop_back();
+			}
+			// the existing ranges cover every address
+			TORRENT_ASSERT(!active.empty());
+			item const& top = items[active.front()];
+
+			if (result.empty() || result.back().access != top.flags)
+				result.emplace_back(pos, top.flags);
+
+			// the next address where a different rule may take over is either
+			// where the current one ends, or where the next one starts,
+			// whichever comes first
+			if (top.last == max_addr<Addr>())
+			{
+				if (next == items.size()) break;
+				pos = items[next].first;
+			}
+			else
+			{
+				pos = plus_one(top.last);
+				if (next < items.size() && items[next].first < pos)
+					pos = items[next].first;
+			}
+		}
+
+		build_flat(result);
+		m_access_list.clear();
+		m_single.clear();
+	}
+
+	template <typename Addr>
+	void filter_impl<Addr>::compile()
+	{
+		if (compiled() && m_single.empty()) return;
+		build_flat(sorted_ranges());
+		m_access_list.clear();
+		m_single.clear();
+	}
+
+	template <typename Addr>
+	std::vector<typename filter_impl<Addr>::range> filter_impl<Addr>::sorted_ranges() const
+	{
+		if (!compiled())
+			return std::vector<range>(m_access_list.begin(), m_access_list.end());
+
+		// in-order traversal of the implicit tree
+		std::vector<range> ret;
+		std::size_t const n = m_flat_start.size() - 1;
+		ret.reserve(n);
+		std::size_t k = 1;
+		while (2 * k <= n) k *= 2;
+		for (;;)
+		{
+			ret.emplace_back(m_flat_start[k], m_flat_access[k]);
+			if (2 * k + 1 <= n)
+			{
+				k = 2 * k + 1;
+				while (2 * k <= n) k *= 2;
+			}
+			else
+			{
+				// walk up past all nodes we're the right child of
+				while (k & 1) k >>= 1;
+				k >>= 1;
+				if (k == 0) break;
+			}
+		}
+		TORRENT_ASSERT(ret.size() == n);
+		if (m_single.empty()) return ret;
+
+		std::set<range> list(ret.begin(), ret.end());
+		for (auto const& e : m_single)
+			insert_rule(list, e.first, e.first, e.second);
+		return std::vector<range>(list.begin(), list.end());
+	}
+
+	template <typename Addr>
+	void filter_impl<Addr>::build_flat(std::vector<range> const& sorted)
+	{
+		TORRENT_ASSERT(!sorted.empty());
+		TORRENT_ASSERT(sorted.front().start == zero<Addr>());
+		std::vector<Addr> start(sorted.size() + 1);
+		std::vector<std::uint32_t> access(sorted.size() + 1);
+		start[0] = zero<Addr>();
+		access[0] = 0;
+		std::size_t const filled = eytzinger_fill(sorted, 0, 1, start.data(), access.data());
+		TORRENT_ASSERT(filled == sorted.size());
+		TORRENT_UNUSED(filled);
+		m_flat_start = std::move(start);
+		m_flat_access = std::move(access);
+	}
+
+	template <typename Addr>
+	void filter_impl<Addr>::decompile()
+	{
+		TORRENT_ASSERT(m_access_list.empty());
+		for (auto const& r : sorted_ranges())
+			m_access_list.insert(m_access_list.end(), r);
+		m_flat_start = std::vector<Addr>();
+		m_flat_access = std::vector<std::uint32_t>();
+		m_single.clear();
 	}
 
 	template <typename Addr>
 	std::uint32_t filter_impl<Addr>::access(Addr const& addr) const
 	{
+		if (compiled())
+		{
+			if (!m_single.empty())
+			{
+				auto const it = m_single.find(addr);
+				if (it != m_single.end()) return it->second;
+			}
+
+			// the descendants of k a few levels down are adjacent in memory.
+			// Prefetch the cache line holding them while comparing against k
+			std::size_t const prefetch_stride = std::max(std::size_t(1)
+				, std::size_t(64 / sizeof(Addr)));
+			Addr const* start = m_flat_start.data();
+			std::size_t const n = m_flat_start.size() - 1;
+			std::size_t k = 1;
+			// the last element found whose start is <= addr. Since the first
+			// range starts at zero, there always is one
+			std::size_t found = 0;
+			while (k <= n)
+			{
+				prefetch(start + std::min(k * prefetch_stride, n));
+				bool const right = !(addr < start[k]);
+				found = right ? k : found;
+				k = 2 * k + std::size_t(right);
+			}
+			TORRENT_ASSERT(found > 0);
+			return m_flat_access[found];
+		}
+
 		TORRENT_ASSERT(!m_access_list.empty());
 		auto i = m_access_list.upper_bound(addr);
 		if (i != m_access_list.begin()) --i;
@@ -227,11 +492,12 @@ namespace aux {
 	template <typename ExternalAddressType>
 	std::vector<ip_range<ExternalAddressType>> filter_impl<Addr>::export_filter() const
 	{
+		std::vector<range> const ranges = sorted_ranges();
 		std::vector<ip_range<ExternalAddressType>> ret;
-		ret.reserve(m_access_list.size());
+		ret.reserve(ranges.size());
 
-		for (auto i = m_access_list.begin()
-			, end(m_access_list.end()); i != end;)
+		for (auto i = ranges.begin()
+			, end(ranges.end()); i != end;)
 		{
 			ip_range<ExternalAddressType> r;
 			r.first = ExternalAddressType(i->start);
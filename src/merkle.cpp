@@ -13,6 +13,9 @@ see LICENSE file.
 #include "libtorrent/aux_/vector.hpp"
 #include "libtorrent/bitfield.hpp"
 
+#include <algorithm>
+#include <array>
+
 namespace libtorrent {
 
 	int merkle_layer_start(int const layer)
@@ -256,6 +259,82 @@ namespace libtorrent {
 		return scratch_space[0];
 	}
 
+	sha256_hash merkle_subtree_root(span<sha256_hash const> const leafs, int const num_leafs)
+	{
+		TORRENT_ASSERT(num_leafs > 0);
+		TORRENT_ASSERT(((num_leafs - 1) & num_leafs) == 0);
+		TORRENT_ASSERT(leafs.size() <= num_leafs);
+
+		// the complete left-hand node at each layer, waiting for its right
+		// sibling. There's at most one per layer, so this is all the state we
+		// need to hash the tree one leaf at a time
+		std::array<sha256_hash, 32> pending;
+		int const count = int(leafs.size());
+		for (int i = 0; i < count; ++i)
+		{
+			sha256_hash node = leafs[i];
+			int layer = 0;
+			// each trailing 1-bit in the index means this node completes a
+			// right-hand sibling, and can be merged with the pending node
+			for (int k = i; k & 1; k >>= 1, ++layer)
+				node = hasher256().update(pending[std::size_t(layer)]).update(node).final();
+			pending[std::size_t(layer)] = node;
+		}
+
+		int const num_layers = merkle_num_layers(num_leafs);
+		if (count == num_leafs) return pending[std::size_t(num_layers)];
+
+		// fold in the padding along the right edge of the tree. At every layer
+		// where the number of leafs has a 1-bit, there's a pending node to the
+		// left of the edge
+		sha256_hash pad{};
+		sha256_hash edge;
+		bool have_edge = false;
+		for (int layer = 0; layer < num_layers; ++layer)
+		{
+			if (count & (1 << layer))
+			{
+				edge = hasher256().update(pending[std::size_t(layer)])
+					.update(have_edge ? edge : pad).final();
+				have_edge = true;
+			}
+			else if (have_edge)
+			{
+				edge = hasher256().update(edge).update(pad).final();
+			}
+			pad = hasher256().update(pad).update(pad).final();
+		}
+		return have_edge ? edge : pad;
+	}
+
+	void merkle_verify_subtrees(span<sha256_hash> const leafs
+		, span<sha256_hash const> const roots, int const leafs_per_root
+		, bitfield& verified)
+	{
+		TORRENT_ASSERT(leafs_per_root > 0);
+		TORRENT_ASSERT(verified.size() >= leafs.size());
+		int const num_leafs = int(leafs.size());
+		for (int r = 0; r < int(roots.size()); ++r)
+		{
+			int const first = r * leafs_per_root;
+			if (first >= num_leafs) break;
+			auto const subtree = leafs.subspan(first, std::min(leafs_per_root, num_leafs - first));
+			if (std::any_of(subtree.begin(), subtree.end()
+				, [](sha256_hash const& h) { return h.is_all_zeros(); }))
+				continue;
+
+			if (merkle_subtree_root(subtree, leafs_per_root) == roots[r])
+			{
+				for (int i = first; i < first + int(subtree.size()); ++i)
+					verified.set_bit(i);
+			}
+			else
+			{
+				for (auto& h : subtree) h.clear();
+			}
+		}
+	}
+
 	// returns the layer the given offset into the tree falls into.
 	// Layer 0 is the root of the tree, layer 1 is the two hashes below the
 	// root, and so on.
@@ -79,6 +79,8 @@ namespace aux {
 	{
 		m_tree.clear();
 		m_tree.shrink_to_fit();
+		m_blocks.clear();
+		m_blocks.shrink_to_fit();
 		m_block_verified.clear();
 		m_mode = mode_t::empty_tree;
 	}
@@ -163,6 +165,45 @@ namespace {
 				if (r != root()) clear();
 				return;
 			}
+
+			// if the mask covers all pieces, and otherwise only has block
+			// hashes, keep the piece layer and the block hashes without
+			// allocating the interior nodes. The blocks are verified piece by
+			// piece
+			if ((first_piece < mask_size) && (end_piece <= mask_size)
+				&& std::all_of(mask.begin() + first_piece, mask.begin() + end_piece, identity())
+				&& std::none_of(mask.begin() + end_piece, mask.begin() + std::min(first_block, mask_size), identity())
+				&& std::none_of(mask.begin() + std::min(end_block, mask_size), mask.begin() + mask_size, identity()))
+			{
+				auto const piece_index = std::count_if(mask.begin(), mask.begin() + first_piece, identity());
+				// discrepancy
+				if (t.size() < piece_index + piece_count)
+					return clear();
+
+				m_tree.assign(t.begin() + piece_index, t.begin() + piece_index + piece_count);
+
+				sha256_hash const piece_layer_pad = merkle_pad(1 << m_blocks_per_piece_log, 1);
+				// validation failed!
+				if (merkle_root(m_tree, piece_layer_pad) != root())
+					return clear();
+
+				m_blocks.assign(std::size_t(m_num_blocks), sha256_hash{});
+				m_block_verified.clear();
+				m_block_verified.resize(m_num_blocks, false);
+				m_mode = mode_t::partial_block_layer;
+
+				auto cursor = piece_index + piece_count;
+				for (int i = first_block, end = std::min(end_block, mask_size); i < end; ++i)
+				{
+					if (!mask[i]) continue;
+					if (cursor >= t.size()) break;
+					m_blocks[i - first_block] = t[cursor++];
+				}
+
+				merkle_verify_subtrees(m_blocks, m_tree, blocks_per_piece(), m_block_verified);
+				optimize_storage();
+				return;
+			}
 		}
 
 		// if the mask has only zeros, go straight to empty tree mode
@@ -202,6 +243,7 @@ namespace {
 					, m_tree.begin() + piece_layer_start() + num_pieces());
 				break;
 			case mode_t::piece_layer:
+			case mode_t::partial_block_layer:
 			{
 				ret = m_tree;
 				break;
@@ -229,6 +271,10 @@ namespace {
 		INVARIANT_CHECK;
 		if (m_mode == mode_t::block_layer) return true;
 
+		// we already have a piece layer that's been validated against the
+		// root hash, and possibly block hashes too
+		if (m_mode == mode_t::partial_block_layer) return true;
+
 		int const npieces = num_pieces();
 		if (piece_layer.size() != npieces * sha256_hash::size()) return false;
 
@@ -297,6 +343,27 @@ namespace {
 			return ret;
 		}
 
+		// if we have the piece layer, the block hashes of a single piece can
+		// be validated against it directly. The uncle hashes are redundant in
+		// that case
+		int const first_leaf_idx = block_layer_start();
+		if ((m_mode == mode_t::piece_layer || m_mode == mode_t::partial_block_layer)
+			&& piece_levels() > 0
+			&& hashes.size() == blocks_per_piece()
+			&& dest_start_idx >= first_leaf_idx
+			&& ((dest_start_idx - first_leaf_idx) & (blocks_per_piece() - 1)) == 0
+			&& ((dest_start_idx - first_leaf_idx) >> m_blocks_per_piece_log) < num_pieces())
+		{
+			int const piece = (dest_start_idx - first_leaf_idx) >> m_blocks_per_piece_log;
+			if (merkle_subtree_root(hashes, blocks_per_piece()) != m_tree[piece])
+				return {};
+
+			if (m_mode == mode_t::piece_layer) allocate_partial();
+			ret = add_piece_blocks(piece, file_piece_offset, hashes);
+			optimize_storage();
+			return ret;
+		}
+
 		allocate_full();
 
 		// TODO: this can be optimized by using m_tree as storage to fill this
@@ -486,6 +553,14 @@ namespace {
 				return std::make_tuple(set_block_result::block_hash_failed, block_index, 1);
 		}
 
+		// when we have the piece layer, there's no need for the interior nodes
+		// of the tree to verify block hashes. Only the block hashes are stored
+		if (m_mode == mode_t::piece_layer && piece_levels() > 0)
+			allocate_partial();
+
+		if (m_mode == mode_t::partial_block_layer)
+			return set_block_partial(block_index, h);
+
 		allocate_full();
 
 		m_tree[block_tree_index] = h;
@@ -529,6 +604,79 @@ namespace {
 		return std::make_tuple(set_block_result::ok, leafs_start, leafs_size);
 	}
 
+	std::tuple<merkle_tree::set_block_result, int, int> merkle_tree::set_block_partial(
+		int const block_index, sha256_hash const& h)
+	{
+		TORRENT_ASSERT(m_mode == mode_t::partial_block_layer);
+
+		int const piece = block_index >> m_blocks_per_piece_log;
+		int const first_block = piece << m_blocks_per_piece_log;
+		int const piece_blocks = std::min(blocks_per_piece(), m_num_blocks - first_block);
+
+		m_blocks[block_index] = h;
+
+		// the piece can't be verified until we have all of its block hashes
+		auto const blocks = span<sha256_hash>(m_blocks).subspan(first_block, piece_blocks);
+		if (std::any_of(blocks.begin(), blocks.end()
+			, [](sha256_hash const& b) { return b.is_all_zeros(); }))
+			return std::make_tuple(set_block_result::unknown, first_block, blocks_per_piece());
+
+		if (merkle_subtree_root(blocks, blocks_per_piece()) != m_tree[piece])
+		{
+			// the whole piece failed the hash check. Clear all block hashes
+			// in this piece and report a hash failure
+			for (auto& b : blocks) b.clear();
+			return std::make_tuple(set_block_result::hash_failed, first_block, blocks_per_piece());
+		}
+
+		for (int i = first_block; i < first_block + piece_blocks; ++i)
+			m_block_verified.set_bit(i);
+
+		// attempting to optimize storage is quite costly, only do it if we have
+		// a reason to believe it might have an effect
+		if (piece == num_pieces() - 1 || piece_verified(piece + 1))
+			optimize_storage();
+
+		return std::make_tuple(set_block_result::ok, first_block, blocks_per_piece());
+	}
+
+	// the block hashes in "hashes" have already been validated against the
+	// piece hash. Any block hashes we had for the piece are either confirmed
+	// or found to be invalid
+	add_hashes_result_t merkle_tree::add_piece_blocks(int const piece
+		, piece_index_t::diff_type const file_piece_offset
+		, span<sha256_hash const> hashes)
+	{
+		TORRENT_ASSERT(m_mode == mode_t::partial_block_layer);
+
+		add_hashes_result_t ret;
+		int const first_block = piece << m_blocks_per_piece_log;
+		int const piece_blocks = std::min(blocks_per_piece(), m_num_blocks - first_block);
+		auto const file_piece = piece_index_t{piece} + file_piece_offset;
+
+		for (int i = 0; i < piece_blocks; ++i)
+		{
+			sha256_hash& b = m_blocks[first_block + i];
+			if (!b.is_all_zeros())
+			{
+				if (b != hashes[i])
+				{
+					if (!ret.failed.empty())
+						ret.failed.back().second.push_back(i);
+					else
+						ret.failed.emplace_back(file_piece, std::vector<int>{i});
+				}
+				else if (ret.passed.empty())
+				{
+					ret.passed.push_back(file_piece);
+				}
+			}
+			b = hashes[i];
+			m_block_verified.set_bit(first_block + i);
+		}
+		return ret;
+	}
+
 	std::size_t merkle_tree::size() const
 	{
 		return static_cast<std::size_t>(merkle_num_nodes(merkle_num_leafs(m_num_blocks)));
@@ -573,6 +721,20 @@ namespace {
 			case mode_t::full_tree: return !m_tree[idx].is_all_zeros();
 			case mode_t::piece_layer: return idx < merkle_get_first_child(piece_layer_start());
 			case mode_t::block_layer: return idx < block_layer_start() + m_num_blocks;
+			case mode_t::partial_block_layer:
+			{
+				if (idx < merkle_get_first_child(piece_layer_start())) return true;
+				int const first_block = block_layer_start();
+				if (idx >= first_block)
+					return idx < first_block + m_num_blocks
+						&& !m_blocks[idx - first_block].is_all_zeros();
+				// interior nodes below the piece layer are known once the
+				// piece has been verified
+				int leaf = idx;
+				while (leaf < first_block) leaf = merkle_get_first_child(leaf);
+				int const piece = (leaf - first_block) >> m_blocks_per_piece_log;
+				return piece < num_pieces() && piece_verified(piece);
+			}
 		}
 		TORRENT_ASSERT_FAIL();
 		return false;
@@ -614,6 +776,8 @@ namespace {
 					return m_tree[idx - first] == h;
 				return (*this)[idx] == h;
 			}
+			case mode_t::partial_block_layer:
+				return (*this)[idx] == h;
 		}
 		TORRENT_ASSERT_FAIL();
 		return false;
@@ -627,6 +791,10 @@ namespace {
 
 	sha256_hash merkle_tree::get_impl(int idx, std::vector<sha256_hash>& scratch_space) const
 	{
+		if (m_mode == mode_t::partial_block_layer
+			&& idx >= merkle_get_first_child(piece_layer_start()))
+			return get_partial_node(idx);
+
 		switch (m_mode)
 		{
 			case mode_t::uninitialized_tree:
@@ -637,13 +805,13 @@ namespace {
 			case mode_t::full_tree:
 				return m_tree[idx];
 			case mode_t::piece_layer:
+			case mode_t::partial_block_layer:
 			case mode_t::block_layer:
 			{
-				int const start = (m_mode == mode_t::piece_layer)
-					? piece_layer_start()
-					: block_layer_start();
+				bool const pieces = m_mode != mode_t::block_layer;
+				int const start = pieces ? piece_layer_start() : block_layer_start();
 
-				if (m_mode == mode_t::piece_layer && idx >= merkle_get_first_child(start))
+				if (pieces && idx >= merkle_get_first_child(start))
 					return {};
 
 				int layer_size = 1;
@@ -656,13 +824,12 @@ namespace {
 				idx -= start;
 				if (idx >= m_tree.end_index())
 				{
-					return merkle_pad(
-						(m_mode == mode_t::piece_layer)
+					return merkle_pad(pieces
 						? layer_size << m_blocks_per_piece_log
 						: layer_size, 1);
 				}
 
-				sha256_hash const pad_hash = (m_mode == mode_t::piece_layer)
+				sha256_hash const pad_hash = pieces
 					? merkle_pad(1 << m_blocks_per_piece_log, 1)
 					: sha256_hash{};
 				auto const layer = span<sha256_hash const>(m_tree)
@@ -675,6 +842,39 @@ namespace {
 		return sha256_hash{};
 	}
 
+	sha256_hash merkle_tree::get_partial_node(int idx) const
+	{
+		TORRENT_ASSERT(m_mode == mode_t::partial_block_layer);
+
+		int const first_block = block_layer_start();
+		int layer_size = 1;
+		while (idx < first_block)
+		{
+			idx = merkle_get_first_child(idx);
+			layer_size *= 2;
+		}
+		idx -= first_block;
+
+		if (layer_size == 1)
+			return idx < m_num_blocks ? m_blocks[idx] : sha256_hash{};
+
+		int const piece = idx >> m_blocks_per_piece_log;
+		if (piece >= num_pieces() || !piece_verified(piece))
+			return {};
+
+		auto const leafs = span<sha256_hash const>(m_blocks)
+			.subspan(std::min(idx, m_num_blocks), std::max(0, std::min(layer_size, m_num_blocks - idx)));
+		return merkle_subtree_root(leafs, layer_size);
+	}
+
+	bool merkle_tree::piece_verified(int const piece) const
+	{
+		TORRENT_ASSERT(m_mode == mode_t::partial_block_layer);
+		TORRENT_ASSERT(piece < num_pieces());
+		// all blocks in a piece are verified at the same time
+		return m_block_verified.get_bit(piece << m_blocks_per_piece_log);
+	}
+
 	std::vector<sha256_hash> merkle_tree::build_vector() const
 	{
 		INVARIANT_CHECK;
@@ -690,6 +890,7 @@ namespace {
 				ret.assign(m_tree.begin(), m_tree.end());
 				break;
 			case mode_t::piece_layer:
+			case mode_t::partial_block_layer:
 			{
 				int const piece_layer_size = merkle_num_leafs(num_pieces());
 				sha256_hash const pad_hash = merkle_pad(1 << m_blocks_per_piece_log, 1);
@@ -699,6 +900,19 @@ namespace {
 				std::fill(ret.begin() + start + m_tree.end_index(), ret.begin() + start + piece_layer_size, pad_hash);
 				merkle_fill_tree(span<sha256_hash>(ret).subspan(0, merkle_num_nodes(piece_layer_size))
 					, piece_layer_size);
+
+				if (m_mode == mode_t::partial_block_layer)
+				{
+					int const first_block = block_layer_start();
+					std::copy(m_blocks.begin(), m_blocks.end(), ret.begin() + first_block);
+					// the interior nodes of verified pieces are known too
+					for (int p = 0; p < num_pieces(); ++p)
+					{
+						if (!piece_verified(p)) continue;
+						merkle_fill_tree(ret, blocks_per_piece()
+							, first_block + (p << m_blocks_per_piece_log));
+					}
+				}
 				break;
 			}
 			case mode_t::block_layer:
@@ -735,11 +949,25 @@ namespace {
 				}
 				break;
 			case mode_t::piece_layer:
+			case mode_t::partial_block_layer:
 			{
 				int const piece_layer_size = merkle_num_leafs(num_pieces());
 				for (int i = merkle_first_leaf(piece_layer_size), end = i + m_tree.end_index(); i < end; ++i)
 					mask.set_bit(i);
 				ret = m_tree;
+
+				// only the block hashes we have are saved. The interior nodes
+				// below the piece layer can be computed from them
+				if (m_mode == mode_t::partial_block_layer)
+				{
+					int const first_block = block_layer_start();
+					for (int i = 0; i < m_blocks.end_index(); ++i)
+					{
+						if (m_blocks[i].is_all_zeros()) continue;
+						ret.push_back(m_blocks[i]);
+						mask.set_bit(first_block + i);
+					}
+				}
 				break;
 			}
 			case mode_t::block_layer:
@@ -769,6 +997,7 @@ namespace {
 			case mode_t::block_layer:
 				return {m_num_blocks, true};
 			case mode_t::full_tree:
+			case mode_t::partial_block_layer:
 				return m_block_verified;
 		}
 		TORRENT_ASSERT_FAIL();
@@ -788,6 +1017,7 @@ namespace {
 			case mode_t::block_layer:
 				return true;
 			case mode_t::full_tree:
+			case mode_t::partial_block_layer:
 				return !m_block_verified.empty() && m_block_verified.all_set();
 		}
 		TORRENT_ASSERT_FAIL();
@@ -810,6 +1040,7 @@ namespace {
 			case mode_t::block_layer:
 				return true;
 			case mode_t::full_tree:
+			case mode_t::partial_block_layer:
 				for (int i = block_idx; i < block_idx + num_blocks; ++i)
 					if (!m_block_verified.get_bit(i)) return false;
 				return true;
@@ -829,12 +1060,34 @@ namespace {
 		TORRENT_ASSERT(m_mode != mode_t::block_layer);
 		m_tree = aux::vector<sha256_hash>(build_vector());
 		m_mode = mode_t::full_tree;
+		m_blocks.clear();
+		m_blocks.shrink_to_fit();
+		m_block_verified.resize(m_num_blocks, false);
+	}
+
+	void merkle_tree::allocate_partial()
+	{
+		INVARIANT_CHECK;
+
+		TORRENT_ASSERT(m_mode == mode_t::piece_layer);
+		TORRENT_ASSERT(piece_levels() > 0);
+		m_blocks.assign(std::size_t(m_num_blocks), sha256_hash{});
 		m_block_verified.resize(m_num_blocks, false);
+		m_mode = mode_t::partial_block_layer;
 	}
 
 	void merkle_tree::optimize_storage()
 	{
 		INVARIANT_CHECK;
+		if (m_mode == mode_t::partial_block_layer)
+		{
+			if (!m_block_verified.all_set()) return;
+			m_tree = std::move(m_blocks);
+			m_blocks.clear();
+			m_mode = mode_t::block_layer;
+			m_block_verified.clear();
+			return;
+		}
 		if (m_mode != mode_t::full_tree) return;
 
 		if (m_num_blocks == 1)
@@ -954,6 +1207,8 @@ namespace {
 			// have the root hash (unless the tree is uninitialized)
 			TORRENT_ASSERT(blocks_verified(0, 1));
 		}
+		if (m_mode != mode_t::partial_block_layer)
+			TORRENT_ASSERT(m_blocks.empty());
 		switch (m_mode)
 		{
 			case mode_t::uninitialized_tree:
@@ -1033,6 +1288,27 @@ namespace {
 				TORRENT_ASSERT(m_block_verified.empty());
 				break;
 			}
+			case mode_t::partial_block_layer:
+			{
+				TORRENT_ASSERT(piece_levels() > 0);
+				TORRENT_ASSERT(merkle_root(m_tree, merkle_pad(1 << m_blocks_per_piece_log, 1)) == root());
+				TORRENT_ASSERT(m_blocks.end_index() == m_num_blocks);
+				TORRENT_ASSERT(m_block_verified.size() == m_num_blocks);
+
+				// all blocks in a piece are verified together, and they must
+				// match the piece hash
+				for (int p = 0; p < num_pieces(); ++p)
+				{
+					int const first_block = p << m_blocks_per_piece_log;
+					int const piece_blocks = std::min(blocks_per_piece(), m_num_blocks - first_block);
+					for (int i = first_block; i < first_block + piece_blocks; ++i)
+						TORRENT_ASSERT(m_block_verified.get_bit(i) == piece_verified(p));
+					if (!piece_verified(p)) continue;
+					auto const blocks = span<sha256_hash const>(m_blocks).subspan(first_block, piece_blocks);
+					TORRENT_ASSERT(merkle_subtree_root(blocks, blocks_per_piece()) == m_tree[p]);
+				}
+				break;
+			}
 		}
 	}
 #endif
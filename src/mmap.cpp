@@ -30,6 +30,7 @@ see LICENSE file.
 #include <sys/mman.h> // for mmap
 #include <sys/stat.h>
 #include <fcntl.h> // for open
+#include <unistd.h> // for sysconf
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 auto const map_failed = MAP_FAILED;
@@ -164,24 +165,32 @@ file_mapping::file_mapping(file_handle file, open_mode_t const mode, std::int64_
 #if TORRENT_USE_MADVISE
 	if (m_mapping != nullptr && m_mapping != map_failed)
 	{
-		int const advise = ((mode & open_mode::sequential_access) ? MADV_SEQUENTIAL : 0)
+		// madvise() takes a single advice per call. Ignore errors here,
+		// since this is best-effort
+		auto const advise = [this](int const a)
+		{ ::madvise(m_mapping, static_cast<std::size_t>(m_size), a); };
+
+		if (mode & open_mode::sequential_access)
+			advise(MADV_SEQUENTIAL);
 #ifdef MADV_DONTDUMP
 		// on versions of linux that support it, ask for this region to not be
 		// included in coredumps (mostly to make the coredumps more manageable
 		// with large disk caches)
-		// ignore errors here, since this is best-effort
-			| MADV_DONTDUMP
+		advise(MADV_DONTDUMP);
 #endif
 #ifdef MADV_DONTFORK
-			| MADV_DONTFORK
+		advise(MADV_DONTFORK);
 #endif
 #ifdef MADV_NOCORE
 		// This is the BSD counterpart to exclude a range from core dumps
-			| MADV_NOCORE
+		advise(MADV_NOCORE);
+#endif
+#ifdef MADV_HUGEPAGE
+		// there's no point in asking for huge pages for mappings smaller than
+		// one (2 MiB)
+		if ((mode & open_mode::huge_pages) && m_size >= 2 * 1024 * 1024)
+			advise(MADV_HUGEPAGE);
 #endif
-		;
-		if (advise != 0)
-			::madvise(m_mapping, static_cast<std::size_t>(m_size), advise);
 	}
 #endif
 }
@@ -284,6 +293,20 @@ void file_mapping::dont_need(span<byte const> range)
 #endif
 }
 
+void file_mapping::will_need(span<byte const> range)
+{
+#if TORRENT_USE_MADVISE && defined MADV_WILLNEED
+	// the start address must be page aligned
+	static auto const page_size = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+	auto const start = reinterpret_cast<std::uintptr_t>(range.data());
+	auto const aligned = start & ~(page_size - 1);
+	::madvise(reinterpret_cast<void*>(aligned)
+		, static_cast<std::size_t>(range.size()) + (start - aligned), MADV_WILLNEED);
+#else
+	TORRENT_UNUSED(range);
+#endif
+}
+
 void file_mapping::page_out(span<byte const> range)
 {
 #if TORRENT_HAVE_MAP_VIEW_OF_FILE
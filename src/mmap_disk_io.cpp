@@ -27,7 +27,7 @@ see LICENSE file.
 #include "libtorrent/aux_/debug.hpp"
 #include "libtorrent/units.hpp"
 #include "libtorrent/hasher.hpp"
-#include "libtorrent/aux_/platform_util.hpp" // for set_thread_name
+#include "libtorrent/aux_/platform_util.hpp" // for set_thread_name, set_thread_affinity
 #include "libtorrent/aux_/disk_job_pool.hpp"
 #include "libtorrent/aux_/disk_io_thread_pool.hpp"
 #include "libtorrent/aux_/store_buffer.hpp"
@@ -40,6 +40,7 @@ see LICENSE file.
 #include "libtorrent/aux_/file_view_pool.hpp"
 #include "libtorrent/aux_/storage_array.hpp"
 #include "libtorrent/aux_/disk_completed_queue.hpp"
+#include "libtorrent/aux_/drive_info.hpp"
 
 #ifdef TORRENT_WINDOWS
 #include "signal_error_code.hpp"
@@ -52,6 +53,8 @@ see LICENSE file.
 #endif
 
 #include <functional>
+#include <string>
+#include <map>
 
 #include "libtorrent/aux_/debug_disk_thread.hpp"
 
@@ -65,6 +68,17 @@ namespace {
 		return ret;
 	}
 
+	// the piece a job reads, writes or hashes, if any
+	piece_index_t const* job_piece(aux::disk_job const& j)
+	{
+		if (auto const* a = std::get_if<aux::job::read>(&j.action)) return &a->piece;
+		if (auto const* a = std::get_if<aux::job::partial_read>(&j.action)) return &a->piece;
+		if (auto const* a = std::get_if<aux::job::write>(&j.action)) return &a->piece;
+		if (auto const* a = std::get_if<aux::job::hash>(&j.action)) return &a->piece;
+		if (auto const* a = std::get_if<aux::job::hash2>(&j.action)) return &a->piece;
+		return nullptr;
+	}
+
 #if TORRENT_USE_ASSERTS
 	bool valid_flags(disk_job_flags_t const flags)
 	{
@@ -128,6 +142,11 @@ struct TORRENT_EXTRA_EXPORT mmap_disk_io final
 
 	void async_clear_piece(storage_index_t storage, piece_index_t index
 		, std::function<void(piece_index_t)> handler) override;
+	void async_storage_device(storage_index_t storage
+		, std::function<void(std::uint64_t, bool)> handler) override;
+
+	void set_piece_deadline(storage_index_t storage, piece_index_t piece
+		, time_point deadline) override;
 
 	void update_stats_counters(counters& c) const override;
 
@@ -150,6 +169,7 @@ struct TORRENT_EXTRA_EXPORT mmap_disk_io final
 	status_t do_job(aux::job::stop_torrent& a, aux::mmap_disk_job* j);
 	status_t do_job(aux::job::file_priority& a, aux::mmap_disk_job* j);
 	status_t do_job(aux::job::clear_piece& a, aux::mmap_disk_job* j);
+	status_t do_job(aux::job::storage_device& a, aux::mmap_disk_job* j);
 
 private:
 
@@ -165,6 +185,13 @@ private:
 	void add_job(aux::mmap_disk_job* j, bool user_add = true);
 	void add_fence_job(aux::mmap_disk_job* j, bool user_add = true);
 
+	// returns the deadline of the piece the job is for, or max_time()
+	time_point job_deadline(aux::mmap_disk_job const& j) const;
+
+	// hints the storage to read ahead the pieces following the ones with a
+	// deadline, once a job for one of them has been executed
+	void read_ahead(aux::mmap_disk_job const& j);
+
 	void execute_job(aux::mmap_disk_job* j);
 	void immediate_execute();
 	void abort_jobs();
@@ -187,6 +214,14 @@ private:
 	// std::mutex to protect the m_generic_threads and m_hash_threads lists
 	mutable std::mutex m_job_mutex;
 
+	// the CPUs to pin disk and hashing threads to (see
+	// settings_pack::disk_thread_affinity). Threads pick up changes to these
+	// when they see a new m_affinity_generation. Must hold m_job_mutex to
+	// access the strings
+	std::string m_disk_thread_affinity;
+	std::string m_hash_thread_affinity;
+	std::atomic<int> m_affinity_generation{0};
+
 	// every write job is inserted into this map while it is in the job queue.
 	// It is removed after the write completes. This will let subsequent reads
 	// pull the buffers straight out of the queue instead of having to
@@ -223,6 +258,24 @@ private:
 
 	aux::storage_array<aux::mmap_storage> m_torrents;
 
+	struct deadline_pieces
+	{
+		std::map<piece_index_t, time_point> pieces;
+
+		// pieces below this one have already been read ahead
+		piece_index_t read_ahead_end{0};
+	};
+
+	// the pieces with a deadline, for the storages that have had any. Jobs
+	// for these pieces are queued by their deadline
+	std::map<storage_index_t, deadline_pieces> m_deadlines;
+	int m_num_deadline_pieces = 0;
+	mutable std::mutex m_deadline_mutex;
+
+	// set while any piece has a deadline, to not have to lock
+	// m_deadline_mutex for every job when there are none
+	std::atomic<bool> m_has_deadlines{false};
+
 	std::atomic_flag m_jobs_aborted = ATOMIC_FLAG_INIT;
 
 	// most jobs are posted to m_generic_io_jobs
@@ -280,6 +333,16 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 	void mmap_disk_io::remove_torrent(storage_index_t const idx)
 	{
+		{
+			std::lock_guard<std::mutex> l(m_deadline_mutex);
+			auto const i = m_deadlines.find(idx);
+			if (i != m_deadlines.end())
+			{
+				m_num_deadline_pieces -= int(i->second.pieces.size());
+				m_deadlines.erase(i);
+				m_has_deadlines = m_num_deadline_pieces > 0;
+			}
+		}
 		m_torrents.remove(idx);
 	}
 
@@ -351,6 +414,16 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 		m_generic_threads.set_max_threads(num_threads);
 		m_hash_threads.set_max_threads(num_hash_threads);
+
+		std::lock_guard<std::mutex> l(m_job_mutex);
+		std::string const& disk_cpus = m_settings.get_str(settings_pack::disk_thread_affinity);
+		std::string const& hash_cpus = m_settings.get_str(settings_pack::hashing_thread_affinity);
+		if (disk_cpus != m_disk_thread_affinity || hash_cpus != m_hash_thread_affinity)
+		{
+			m_disk_thread_affinity = disk_cpus;
+			m_hash_thread_affinity = hash_cpus;
+			++m_affinity_generation;
+		}
 	}
 
 	void mmap_disk_io::perform_job(aux::mmap_disk_job* j, jobqueue_t& completed_jobs)
@@ -404,6 +477,13 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 		m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, -1);
 
+		if (j->deadline != max_time())
+		{
+			if (clock_type::now() > j->deadline)
+				m_stats_counters.inc_stats_counter(counters::num_deadline_disk_jobs_missed);
+			read_ahead(*j);
+		}
+
 		j->ret = ret;
 
 		completed_jobs.push_back(j);
@@ -850,6 +930,20 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		add_fence_job(j);
 	}
 
+	void mmap_disk_io::async_storage_device(storage_index_t const storage
+		, std::function<void(std::uint64_t, bool)> handler)
+	{
+		aux::mmap_disk_job* j = m_job_pool.allocate_job<aux::job::storage_device>(
+			{},
+			m_torrents[storage]->shared_from_this(),
+			std::move(handler)
+		);
+
+		// the fence keeps this from racing with a move_storage job changing
+		// the save path
+		add_fence_job(j);
+	}
+
 	status_t mmap_disk_io::do_job(aux::job::hash& a, aux::mmap_disk_job* j)
 	{
 		// we're not using a cache. This is the simple path
@@ -1101,9 +1195,14 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		c.set_value(counters::num_jobs, m_job_pool.jobs_in_use());
 		c.set_value(counters::queued_disk_jobs, m_generic_threads.queue_size()
 			+ m_hash_threads.queue_size());
+		c.set_value(counters::queued_deadline_disk_jobs, m_generic_threads.num_deadline_jobs()
+			+ m_hash_threads.num_deadline_jobs());
 
 		jl.unlock();
 
+		c.set_value(counters::disk_buffer_local_node, m_buffer_pool.local_node_frees());
+		c.set_value(counters::disk_buffer_remote_node, m_buffer_pool.remote_node_frees());
+
 		// gauges
 		c.set_value(counters::disk_blocks_in_use, m_buffer_pool.in_use());
 	}
@@ -1126,6 +1225,14 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		return {};
 	}
 
+	status_t mmap_disk_io::do_job(aux::job::storage_device& a, aux::mmap_disk_job* j)
+	{
+		std::string const& path = j->storage->save_path();
+		a.device = aux::get_device_id(path);
+		a.spinning = aux::get_drive_info(path) == aux::drive_info::spinning;
+		return {};
+	}
+
 	void mmap_disk_io::add_fence_job(aux::mmap_disk_job* j, bool const user_add)
 	{
 		// if this happens, it means we started to shut down
@@ -1178,6 +1285,13 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 			, print_job(*j).c_str()
 			, j->storage ? j->storage->num_outstanding_jobs() : 0);
 
+		if (m_has_deadlines && j->storage)
+		{
+			j->deadline = job_deadline(*j);
+			if (j->deadline != max_time())
+				m_stats_counters.inc_stats_counter(counters::num_deadline_disk_jobs);
+		}
+
 		// is the fence up for this storage?
 		// jobs that are instantaneous are not affected by the fence, is_blocked()
 		// will take ownership of the job and queue it up, in case the fence is up
@@ -1207,6 +1321,84 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 			immediate_execute();
 	}
 
+	void mmap_disk_io::set_piece_deadline(storage_index_t const storage
+		, piece_index_t const piece, time_point const deadline)
+	{
+		std::lock_guard<std::mutex> l(m_deadline_mutex);
+		if (deadline == max_time())
+		{
+			auto const i = m_deadlines.find(storage);
+			if (i == m_deadlines.end()) return;
+			m_num_deadline_pieces -= int(i->second.pieces.erase(piece));
+		}
+		else
+		{
+			// the entry for the storage is kept once all its deadlines are
+			// removed, to remember how far it's been read ahead
+			auto& pieces = m_deadlines[storage].pieces;
+			if (pieces.insert_or_assign(piece, deadline).second)
+				++m_num_deadline_pieces;
+		}
+		TORRENT_ASSERT(m_num_deadline_pieces >= 0);
+		m_has_deadlines = m_num_deadline_pieces > 0;
+	}
+
+	time_point mmap_disk_io::job_deadline(aux::mmap_disk_job const& j) const
+	{
+		piece_index_t const* piece = job_piece(j);
+		if (piece == nullptr) return max_time();
+
+		std::lock_guard<std::mutex> l(m_deadline_mutex);
+		auto const i = m_deadlines.find(j.storage->storage_index());
+		if (i == m_deadlines.end()) return max_time();
+		auto const p = i->second.pieces.find(*piece);
+		if (p == i->second.pieces.end()) return max_time();
+		return p->second;
+	}
+
+	void mmap_disk_io::read_ahead(aux::mmap_disk_job const& j)
+	{
+		if (j.get_type() != aux::job_action_t::read
+			&& j.get_type() != aux::job_action_t::partial_read)
+			return;
+
+		int const num_pieces = m_settings.get_int(settings_pack::deadline_read_ahead);
+		if (num_pieces <= 0) return;
+
+		piece_index_t first;
+		piece_index_t last;
+		{
+			std::lock_guard<std::mutex> l(m_deadline_mutex);
+			auto const i = m_deadlines.find(j.storage->storage_index());
+			if (i == m_deadlines.end()) return;
+			deadline_pieces& d = i->second;
+
+			// read ahead the pieces following the last one with a deadline,
+			// that haven't been read ahead already. The deadline of the piece
+			// this job is for may have been removed by now
+			piece_index_t window_end = next(*job_piece(j));
+			if (!d.pieces.empty())
+				window_end = std::max(window_end, next(d.pieces.rbegin()->first));
+			last = std::min(j.storage->files().end_piece()
+				, piece_index_t(static_cast<int>(window_end) + num_pieces));
+
+			// if the window moved backwards, start over from it
+			if (d.read_ahead_end > last) d.read_ahead_end = window_end;
+			first = std::max(window_end, d.read_ahead_end);
+			if (first >= last) return;
+			d.read_ahead_end = last;
+		}
+
+		for (piece_index_t p = first; p < last; ++p)
+		{
+			// this is best-effort, ignore errors
+			storage_error ignore;
+			j.storage->read_ahead(m_settings, p, ignore);
+		}
+		m_stats_counters.inc_stats_counter(counters::num_read_ahead_pieces
+			, static_cast<int>(last) - static_cast<int>(first));
+	}
+
 	void mmap_disk_io::immediate_execute()
 	{
 		while (!m_generic_threads.empty())
@@ -1280,14 +1472,32 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		// time we should call it
 		time_point next_close_oldest_file = min_time();
 
+		// threads inherit the affinity of the thread that created them, so
+		// this is always applied once, even if the setting is empty
+		int affinity_generation = -1;
+
 		for (;;)
 		{
 			aux::mmap_disk_job* j = nullptr;
 			auto const result = pool.wait_for_job(l);
 			if (result == aux::wait_result::exit_thread) break;
 			j = static_cast<aux::mmap_disk_job*>(pool.pop_front());
+
+			std::string cpus;
+			bool const update_affinity = affinity_generation != m_affinity_generation;
+			if (update_affinity)
+			{
+				affinity_generation = m_affinity_generation;
+				cpus = &pool == &m_hash_threads
+					? m_hash_thread_affinity : m_disk_thread_affinity;
+			}
 			l.unlock();
 
+			if (update_affinity && !aux::set_thread_affinity(cpus))
+			{
+				DLOG("failed to set disk thread affinity: \"%s\"\n", cpus.c_str());
+			}
+
 			TORRENT_ASSERT((j->flags & aux::disk_job::in_progress) || !j->storage);
 
 			if (&pool == &m_generic_threads && thread_id == pool.first_thread_id())
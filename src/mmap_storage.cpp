@@ -671,6 +671,36 @@ error_code translate_error(std::error_code const& err, bool const write)
 		});
 	}
 
+	void mmap_storage::read_ahead(settings_interface const& sett
+		, piece_index_t const piece, storage_error& error)
+	{
+		char dummy = 0;
+		readwrite(files(), span<char const>{&dummy, files().piece_size(piece)}, piece, 0, error
+			, [this, &sett](file_index_t const file_index
+				, std::int64_t const file_offset
+				, span<char const> const buf, storage_error& ec)
+		{
+			if (files().pad_file_at(file_index)) return int(buf.size());
+
+			if (file_index < m_file_priority.end_index()
+				&& m_file_priority[file_index] == dont_download
+				&& use_partfile(file_index))
+				return int(buf.size());
+
+			auto handle = open_file(sett, file_index, aux::open_mode::read_only, ec);
+			if (ec) return -1;
+
+			if (!handle->has_memory_map()) return int(buf.size());
+
+			span<byte const> file_range = handle->range();
+			if (file_range.size() <= file_offset) return int(buf.size());
+
+			file_range = file_range.subspan(static_cast<std::ptrdiff_t>(file_offset));
+			handle->will_need(file_range.first(std::min(file_range.size(), buf.size())));
+			return int(buf.size());
+		});
+	}
+
 	int mmap_storage::hash(settings_interface const& sett
 		, hasher& ph, std::ptrdiff_t const len
 		, piece_index_t const piece, int const offset
@@ -879,6 +909,9 @@ error_code translate_error(std::error_code const& err, bool const write)
 		if (sett.get_bool(settings_pack::no_atime_storage))
 			mode |= aux::open_mode::no_atime;
 
+		if (sett.get_bool(settings_pack::mmap_huge_pages))
+			mode |= aux::open_mode::huge_pages;
+
 		if (files().file_size(file) / default_block_size
 			<= sett.get_int(settings_pack::mmap_file_size_cutoff))
 			mode |= aux::open_mode::no_mmap;
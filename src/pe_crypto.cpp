@@ -14,13 +14,28 @@ see LICENSE file.
 #if !defined TORRENT_DISABLE_ENCRYPTION
 
 #include <cstdint>
+#include <cstring>
 #include <algorithm>
+#include <memory>
 #include <random>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/multiprecision/integer.hpp>
+
+#if defined TORRENT_USE_LIBCRYPTO && !defined TORRENT_USE_WOLFSSL
+extern "C" {
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+}
+#endif
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
 
+#if defined TORRENT_USE_LIBCRYPTO && !defined TORRENT_USE_WOLFSSL && !defined OPENSSL_NO_RC4
+#define TORRENT_USE_EVP_RC4 1
+#else
+#define TORRENT_USE_EVP_RC4 0
+#endif
+
 #include "libtorrent/aux_/random.hpp"
 #include "libtorrent/aux_/alloca.hpp"
 #include "libtorrent/aux_/pe_crypto.hpp"
@@ -58,8 +73,119 @@ namespace libtorrent::aux {
 		return ret;
 	}
 
-	void rc4_init(const unsigned char* in, std::size_t len, rc4 *state);
-	std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4 *state);
+	namespace {
+
+#if defined TORRENT_USE_LIBCRYPTO && !defined TORRENT_USE_WOLFSSL
+	struct bn_deleter
+	{
+		void operator()(BIGNUM* bn) const { BN_clear_free(bn); }
+		void operator()(BN_CTX* ctx) const { BN_CTX_free(ctx); }
+	};
+
+	std::unique_ptr<BIGNUM, bn_deleter> to_bignum(key_t const& k)
+	{
+		std::array<char, 96> const buf = export_key(k);
+		return std::unique_ptr<BIGNUM, bn_deleter>(BN_bin2bn(
+			reinterpret_cast<unsigned char const*>(buf.data()), int(buf.size()), nullptr));
+	}
+#endif
+
+	// (base ^ exponent) % dh_prime
+	key_t dh_powm(key_t const& base, key_t const& exponent)
+	{
+#if defined TORRENT_USE_LIBCRYPTO && !defined TORRENT_USE_WOLFSSL
+		// the modular exponentiation in libcrypto is many times faster than
+		// the one in boost.multiprecision. This is the bulk of the cost of
+		// an encrypted handshake
+		std::unique_ptr<BN_CTX, bn_deleter> ctx(BN_CTX_new());
+		auto b = to_bignum(base);
+		auto e = to_bignum(exponent);
+		auto p = to_bignum(dh_prime);
+		std::unique_ptr<BIGNUM, bn_deleter> r(BN_new());
+		if (ctx && b && e && p && r)
+		{
+			// the exponent is our secret key
+			BN_set_flags(e.get(), BN_FLG_CONSTTIME);
+			std::array<unsigned char, 96> out;
+			if (BN_mod_exp(r.get(), b.get(), e.get(), p.get(), ctx.get()) == 1
+				&& BN_bn2binpad(r.get(), out.data(), int(out.size())) == int(out.size()))
+			{
+				key_t ret;
+				mp::import_bits(ret, out.begin(), out.end());
+				return ret;
+			}
+		}
+		// fall back to boost.multiprecision if libcrypto failed
+#endif
+		return mp::powm(base, exponent, dh_prime);
+	}
+
+	// RC4 state from libtomcrypt
+	struct rc4_state {
+		int x = 0;
+		int y = 0;
+		aux::array<std::uint8_t, 256> buf;
+	};
+
+	void rc4_init(const unsigned char* in, std::size_t len, rc4_state *state);
+	std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4_state *state);
+
+#if TORRENT_USE_EVP_RC4
+	struct cipher_ctx_deleter
+	{
+		void operator()(EVP_CIPHER_CTX* ctx) const { EVP_CIPHER_CTX_free(ctx); }
+	};
+#endif
+
+	} // anonymous namespace
+
+	struct rc4
+	{
+		explicit rc4(span<char const> key)
+		{
+			auto const* k = reinterpret_cast<unsigned char const*>(key.data());
+#if TORRENT_USE_EVP_RC4
+			// libcrypto's RC4 is implemented in assembly on most platforms.
+			// With OpenSSL 3.0 it's only available when the legacy provider is
+			// loaded, otherwise this fails and we fall back to the built-in one
+			ctx.reset(EVP_CIPHER_CTX_new());
+			if (ctx
+				&& EVP_EncryptInit_ex(ctx.get(), EVP_rc4(), nullptr, nullptr, nullptr) == 1
+				&& EVP_CIPHER_CTX_set_key_length(ctx.get(), int(key.size())) == 1
+				&& EVP_EncryptInit_ex(ctx.get(), nullptr, nullptr, k, nullptr) == 1)
+			{
+				return;
+			}
+			ctx.reset();
+#endif
+			rc4_init(k, std::size_t(key.size()), &state);
+		}
+
+		void crypt(span<char> buf)
+		{
+			auto* const pos = reinterpret_cast<unsigned char*>(buf.data());
+#if TORRENT_USE_EVP_RC4
+			if (ctx)
+			{
+				// RC4 is a stream cipher, it produces exactly as many bytes as
+				// it's given, and supports encrypting in-place
+				int out_len = 0;
+				int const ret = EVP_EncryptUpdate(ctx.get(), pos, &out_len
+					, pos, int(buf.size()));
+				TORRENT_ASSERT(ret == 1);
+				TORRENT_ASSERT(out_len == int(buf.size()));
+				TORRENT_UNUSED(ret);
+				return;
+			}
+#endif
+			rc4_encrypt(pos, std::size_t(buf.size()), &state);
+		}
+
+#if TORRENT_USE_EVP_RC4
+		std::unique_ptr<EVP_CIPHER_CTX, cipher_ctx_deleter> ctx;
+#endif
+		rc4_state state;
+	};
 
 	// Set the prime P and the generator, generate local public key
 	dh_key_exchange::dh_key_exchange()
@@ -72,7 +198,7 @@ namespace libtorrent::aux {
 		mp::import_bits(m_dh_local_secret, random_key.begin(), random_key.end());
 
 		// key = (2 ^ secret) % prime
-		m_dh_local_key = mp::powm(key_t(2), m_dh_local_secret, dh_prime);
+		m_dh_local_key = dh_powm(key_t(2), m_dh_local_secret);
 	}
 
 	// compute shared secret given remote public key
@@ -87,7 +213,7 @@ namespace libtorrent::aux {
 	void dh_key_exchange::compute_secret(key_t const& remote_pubkey)
 	{
 		// shared_secret = (remote_pubkey ^ local_secret) % prime
-		m_dh_shared_secret = mp::powm(remote_pubkey, m_dh_local_secret, dh_prime);
+		m_dh_shared_secret = dh_powm(remote_pubkey, m_dh_local_secret);
 
 		std::array<char, 96> buffer;
 		mp::export_bits(m_dh_shared_secret, reinterpret_cast<std::uint8_t*>(buffer.data()), 8);
@@ -252,18 +378,14 @@ namespace libtorrent::aux {
 	rc4_handler::rc4_handler()
 		: m_encrypt(false)
 		, m_decrypt(false)
-	{
-		m_rc4_incoming.x = 0;
-		m_rc4_incoming.y = 0;
-		m_rc4_outgoing.x = 0;
-		m_rc4_outgoing.y = 0;
-	}
+	{}
+
+	rc4_handler::~rc4_handler() = default;
 
 	void rc4_handler::set_incoming_key(span<char const> key)
 	{
 		m_decrypt = true;
-		rc4_init(reinterpret_cast<unsigned char const*>(key.data())
-			, std::size_t(key.size()), &m_rc4_incoming);
+		m_rc4_incoming = std::make_unique<rc4>(key);
 		// Discard first 1024 bytes
 		char buf[1024];
 		span<char> vec(buf, sizeof(buf));
@@ -273,8 +395,7 @@ namespace libtorrent::aux {
 	void rc4_handler::set_outgoing_key(span<char const> key)
 	{
 		m_encrypt = true;
-		rc4_init(reinterpret_cast<unsigned char const*>(key.data())
-			, std::size_t(key.size()), &m_rc4_outgoing);
+		m_rc4_outgoing = std::make_unique<rc4>(key);
 		// Discard first 1024 bytes
 		char buf[1024];
 		span<char> vec(buf, sizeof(buf));
@@ -291,14 +412,11 @@ namespace libtorrent::aux {
 		int bytes_processed = 0;
 		for (auto& buf : bufs)
 		{
-			auto* const pos = reinterpret_cast<unsigned char*>(buf.data());
-			int const len = int(buf.size());
-
-			TORRENT_ASSERT(len >= 0);
-			TORRENT_ASSERT(pos);
+			TORRENT_ASSERT(buf.size() >= 0);
+			TORRENT_ASSERT(buf.data());
 
-			bytes_processed += len;
-			rc4_encrypt(pos, std::uint32_t(len), &m_rc4_outgoing);
+			bytes_processed += int(buf.size());
+			m_rc4_outgoing->crypt(buf);
 		}
 		return std::make_tuple(bytes_processed, empty);
 	}
@@ -310,23 +428,27 @@ namespace libtorrent::aux {
 		int bytes_processed = 0;
 		for (auto& buf : bufs)
 		{
-			auto* const pos = reinterpret_cast<unsigned char*>(buf.data());
-			int const len = int(buf.size());
-
-			TORRENT_ASSERT(len >= 0);
-			TORRENT_ASSERT(pos);
+			TORRENT_ASSERT(buf.size() >= 0);
+			TORRENT_ASSERT(buf.data());
 
-			bytes_processed += len;
-			rc4_encrypt(pos, std::uint32_t(len), &m_rc4_incoming);
+			bytes_processed += int(buf.size());
+			m_rc4_incoming->crypt(buf);
 		}
 		return std::make_tuple(0, bytes_processed, 0);
 	}
 
+	std::size_t rc4_handler::heap_size() const
+	{
+		return ((m_rc4_incoming ? 1 : 0) + (m_rc4_outgoing ? 1 : 0)) * sizeof(rc4);
+	}
+
 // All this code is based on libTomCrypt (http://www.libtomcrypt.com/)
 // this library is public domain and has been specially
 // tailored for libtorrent by Arvid Norberg
 
-void rc4_init(const unsigned char* in, std::size_t len, rc4 *state)
+namespace {
+
+void rc4_init(const unsigned char* in, std::size_t len, rc4_state *state)
 {
 	std::size_t const key_size = sizeof(state->buf);
 	aux::array<std::uint8_t, key_size> key;
@@ -363,30 +485,56 @@ void rc4_init(const unsigned char* in, std::size_t len, rc4 *state)
 	state->y = 0;
 }
 
-std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4 *state)
+std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4_state *state)
 {
-	std::uint8_t x, y, *s, tmp;
-	std::size_t n;
-
 	TORRENT_ASSERT(out != nullptr);
 	TORRENT_ASSERT(state != nullptr);
 
-	n = outlen;
-	x = state->x & 0xff;
-	y = state->y & 0xff;
-	s = state->buf.data();
+	std::size_t const n = outlen;
+	unsigned int x = state->x & 0xff;
+	unsigned int y = state->y & 0xff;
+	std::uint8_t* const s = state->buf.data();
+
+	// the swapped values are kept in registers rather than loaded back from
+	// the state, and the key stream is generated 8 bytes at a time and XORed
+	// into the buffer as a single word
+	while (outlen >= 8) {
+		std::uint8_t stream[8];
+		for (auto& k : stream) {
+			x = (x + 1) & 255;
+			unsigned int const sx = s[x];
+			y = (y + sx) & 255;
+			unsigned int const sy = s[y];
+			s[x] = std::uint8_t(sy);
+			s[y] = std::uint8_t(sx);
+			k = s[(sx + sy) & 255];
+		}
+		std::uint64_t word;
+		std::uint64_t key_word;
+		std::memcpy(&word, out, 8);
+		std::memcpy(&key_word, stream, 8);
+		word ^= key_word;
+		std::memcpy(out, &word, 8);
+		out += 8;
+		outlen -= 8;
+	}
+
 	while (outlen--) {
 		x = (x + 1) & 255;
-		y = (y + s[x]) & 255;
-		tmp = s[x]; s[x] = s[y]; s[y] = tmp;
-		tmp = (s[x] + s[y]) & 255;
-		*out++ ^= s[tmp];
+		unsigned int const sx = s[x];
+		y = (y + sx) & 255;
+		unsigned int const sy = s[y];
+		s[x] = std::uint8_t(sy);
+		s[y] = std::uint8_t(sx);
+		*out++ ^= s[(sx + sy) & 255];
 	}
-	state->x = x;
-	state->y = y;
+	state->x = int(x);
+	state->y = int(y);
 	return n;
 }
 
+} // anonymous namespace
+
 } // namespace libtorrent::aux
 
 #endif // TORRENT_DISABLE_ENCRYPTION
@@ -56,6 +56,7 @@ see LICENSE file.
 #include "libtorrent/aux_/array.hpp"
 #include "libtorrent/aux_/set_socket_buffer.hpp"
 #include "libtorrent/aux_/set_traffic_class.hpp"
+#include "libtorrent/aux_/vector_utils.hpp" // for heap_size
 
 #if TORRENT_USE_ASSERTS
 #include <set>
@@ -83,6 +84,10 @@ namespace {
 	{
 		return pb.send_buffer_offset != pending_block::not_in_buffer;
 	}
+
+	// connections that haven't sent or received anything for this long
+	// release the memory of their empty queues and buffers
+	constexpr seconds idle_memory_timeout{30};
 }
 
 #if TORRENT_USE_ASSERTS
@@ -270,6 +275,40 @@ namespace {
 		return prio;
 	}
 
+	void peer_connection::memory_usage(connection_memory& m) const
+	{
+		TORRENT_ASSERT(is_single_thread());
+		m.objects += std::int64_t(sizeof(peer_connection));
+		m.recv_buffers += m_recv_buffer.capacity();
+		m.send_buffers += m_send_buffer.capacity()
+			+ std::int64_t(m_send_buffer.overhead_bytes());
+		m.queues += heap_size(m_download_queue)
+			+ heap_size(m_requests)
+			+ heap_size(m_request_queue)
+			+ heap_size(m_suggest_pieces)
+			+ heap_size(m_accept_fast)
+			+ heap_size(m_accept_fast_piece_cnt)
+			+ heap_size(m_allowed_fast)
+			+ heap_size(m_suggested_pieces);
+#ifndef TORRENT_DISABLE_EXTENSIONS
+		// every list node holds the shared_ptr and two links
+		m.queues += std::int64_t(m_extensions.size()
+			* (sizeof(std::shared_ptr<peer_plugin>) + 2 * sizeof(void*)));
+#endif
+		m.bitfields += std::int64_t(m_have_piece.heap_size());
+	}
+
+	void peer_connection::release_idle_memory()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		release_if_empty(m_download_queue);
+		release_if_empty(m_requests);
+		release_if_empty(m_request_queue);
+		release_if_empty(m_suggest_pieces);
+		release_if_empty(m_suggested_pieces);
+		m_send_buffer.release_memory();
+	}
+
 	void peer_connection::reset_choke_counters()
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -504,10 +543,12 @@ namespace {
 			t->need_picker();
 			piece_picker const& p = t->picker();
 			piece_index_t const end_piece(p.num_pieces());
-			for (piece_index_t j(0); j != end_piece; ++j)
+			// only visit the pieces the peer has. For a peer with just a few
+			// pieces, that's just a few lookups
+			for (piece_index_t j = m_have_piece.find_next_set(piece_index_t(0));
+				j < end_piece; j = m_have_piece.find_next_set(next(j)))
 			{
-				if (m_have_piece[j]
-					&& t->piece_priority(j) > dont_download
+				if (t->piece_priority(j) > dont_download
 					&& !p.have_piece(j))
 				{
 					interested = true;
@@ -792,13 +833,16 @@ namespace {
 			TORRENT_ASSERT(m_have_piece.size() == t->torrent_file().num_pieces());
 			t->peer_has(m_have_piece, this);
 			bool interesting = false;
-			for (auto const i : m_have_piece.range())
+			for (piece_index_t i = m_have_piece.find_next_set(piece_index_t(0));
+				i != m_have_piece.end_index(); i = m_have_piece.find_next_set(next(i)))
 			{
-				if (!m_have_piece[i]) continue;
 				// if the peer has a piece and we don't, the peer is interesting
 				if (!t->have_piece(i)
 					&& t->picker().piece_priority(i) != dont_download)
+				{
 					interesting = true;
+					break;
+				}
 			}
 			if (interesting) t->peer_is_interesting(*this);
 			else send_not_interested();
@@ -1194,7 +1238,7 @@ namespace {
 	}
 #endif
 
-	typed_bitfield<piece_index_t> const& peer_connection::get_bitfield() const
+	compressed_bitfield const& peer_connection::get_bitfield() const
 	{
 		TORRENT_ASSERT(is_single_thread());
 		return m_have_piece;
@@ -1922,7 +1966,12 @@ namespace {
 	// ----------- HAVE ------------
 	// -----------------------------
 
-	void peer_connection::incoming_have(piece_index_t const index)
+	void peer_connection::incoming_have(piece_index_t index)
+	{
+		incoming_haves({&index, 1});
+	}
+
+	void peer_connection::incoming_haves(span<piece_index_t> const pieces)
 	{
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
@@ -1930,109 +1979,135 @@ namespace {
 		auto t = m_torrent.lock();
 		TORRENT_ASSERT(t);
 
-#ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
+		// this is done in two passes. The first one validates the piece
+		// indices and calls out to extensions, which may disconnect the peer.
+		// None of the peer's state is changed until all indices have been
+		// accepted. Disconnecting removes the peer's bitfield from the piece
+		// picker, so m_have_piece must not contain pieces whose refcount hasn't
+		// been incremented yet. The pieces that pass are compacted into the
+		// front of the pieces span
+		int num_valid = 0;
+
+		for (piece_index_t const index : pieces)
 		{
-			if (e->on_have(index)) return;
-		}
+#ifndef TORRENT_DISABLE_EXTENSIONS
+			if (std::any_of(m_extensions.begin(), m_extensions.end()
+				, [=](auto const& e) { return e->on_have(index); }))
+				continue;
 #endif
 
-		if (is_disconnecting()) return;
-
-		// if we haven't received a bitfield, it was
-		// probably omitted, which is the same as 'have_none'
-		if (!m_bitfield_received) incoming_have_none();
+			if (is_disconnecting()) return;
 
-		// if this peer is choked, there's no point in sending suggest messages to
-		// it. They would just be out-of-date by the time we unchoke the peer
-		// anyway.
-		if (m_settings.get_int(settings_pack::suggest_mode) == settings_pack::suggest_read_cache
-			&& !is_choked()
-			&& std::any_of(m_suggest_pieces.begin(), m_suggest_pieces.end()
-				, [=](piece_index_t const idx) { return idx == index; }))
-		{
-			send_piece_suggestions(2);
-		}
+			// if we haven't received a bitfield, it was
+			// probably omitted, which is the same as 'have_none'
+			if (!m_bitfield_received) incoming_have_none();
+
+			// if this peer is choked, there's no point in sending suggest messages to
+			// it. They would just be out-of-date by the time we unchoke the peer
+			// anyway.
+			if (m_settings.get_int(settings_pack::suggest_mode) == settings_pack::suggest_read_cache
+				&& !is_choked()
+				&& std::any_of(m_suggest_pieces.begin(), m_suggest_pieces.end()
+					, [=](piece_index_t const idx) { return idx == index; }))
+			{
+				send_piece_suggestions(2);
+			}
 
 #ifndef TORRENT_DISABLE_LOGGING
-		peer_log(peer_log_alert::incoming_message, peer_log_alert::have, "piece: %d"
-			, static_cast<int>(index));
+			peer_log(peer_log_alert::incoming_message, peer_log_alert::have, "piece: %d"
+				, static_cast<int>(index));
 #endif
 
-		if (is_disconnecting()) return;
+			if (is_disconnecting()) return;
 
-		if (!t->valid_metadata() && index >= m_have_piece.end_index())
-		{
-			if (index <= piece_index_t(m_settings.get_int(settings_pack::max_piece_count)))
+			if (!t->valid_metadata() && index >= m_have_piece.end_index())
 			{
-				// if we don't have metadata
-				// and we might not have received a bitfield
-				// extend the bitmask to fit the new
-				// have message
-				m_have_piece.resize(static_cast<int>(index) + 1, false);
+				if (index <= piece_index_t(m_settings.get_int(settings_pack::max_piece_count)))
+				{
+					// if we don't have metadata
+					// and we might not have received a bitfield
+					// extend the bitmask to fit the new
+					// have message
+					m_have_piece.resize(static_cast<int>(index) + 1, false);
+				}
+				else
+				{
+					// unless the index > 64k, in which case
+					// we just ignore it
+					continue;
+				}
 			}
-			else
+
+			// if we got an invalid message, abort
+			if (index >= m_have_piece.end_index() || index < piece_index_t(0))
 			{
-				// unless the index > 64k, in which case
-				// we just ignore it
+#ifndef TORRENT_DISABLE_LOGGING
+				peer_log(peer_log_alert::info, peer_log_alert::invalid_have, "have-metadata have_piece: %d size: %d"
+					, static_cast<int>(index), m_have_piece.size());
+#endif
+				disconnect(errors::invalid_have, operation_t::bittorrent, peer_error);
 				return;
 			}
-		}
 
-		// if we got an invalid message, abort
-		if (index >= m_have_piece.end_index() || index < piece_index_t(0))
-		{
-#ifndef TORRENT_DISABLE_LOGGING
-			peer_log(peer_log_alert::info, peer_log_alert::invalid_have, "have-metadata have_piece: %d size: %d"
-				, static_cast<int>(index), m_have_piece.size());
-#endif
-			disconnect(errors::invalid_have, operation_t::bittorrent, peer_error);
-			return;
+			pieces[num_valid++] = index;
 		}
 
+		// the second pass records the pieces in the peer's bitfield. The ones
+		// the peer didn't already have are compacted into the front of the
+		// pieces span, to be passed on to the piece picker in one go
+		int num_new = 0;
+
+		for (piece_index_t const index : pieces.first(num_valid))
+		{
 #ifndef TORRENT_DISABLE_SUPERSEEDING
-		if (t->super_seeding()
+			if (t->super_seeding()
 #if TORRENT_ABI_VERSION == 1
-			&& !m_settings.get_bool(settings_pack::strict_super_seeding)
+				&& !m_settings.get_bool(settings_pack::strict_super_seeding)
 #endif
-			)
-		{
-			// if we're super-seeding and the peer just told
-			// us that it completed the piece we're super-seeding
-			// to it, change the super-seeding piece for this peer
-			// if the peer optimizes out redundant have messages
-			// this will be handled when the peer sends not-interested
-			// instead.
-			if (super_seeded_piece(index))
+				)
 			{
-				superseed_piece(index, t->get_piece_to_super_seed(m_have_piece));
+				// if we're super-seeding and the peer just told
+				// us that it completed the piece we're super-seeding
+				// to it, change the super-seeding piece for this peer
+				// if the peer optimizes out redundant have messages
+				// this will be handled when the peer sends not-interested
+				// instead.
+				if (super_seeded_piece(index))
+				{
+					superseed_piece(index, t->get_piece_to_super_seed(m_have_piece));
+				}
 			}
-		}
 #endif
 
-		if (m_have_piece[index])
-		{
+			if (m_have_piece[index])
+			{
 #ifndef TORRENT_DISABLE_LOGGING
-			peer_log(peer_log_alert::incoming, peer_log_alert::have
-				, "got redundant HAVE message for index: %d"
-				, static_cast<int>(index));
+				peer_log(peer_log_alert::incoming, peer_log_alert::have
+					, "got redundant HAVE message for index: %d"
+					, static_cast<int>(index));
 #endif
-			return;
-		}
+				continue;
+			}
 
-		m_have_piece.set_bit(index);
-		++m_num_pieces;
+			m_have_piece.set_bit(index);
+			++m_num_pieces;
 
-		// if the peer is downloading stuff, it must have metadata
-		m_has_metadata = true;
+			// if the peer is downloading stuff, it must have metadata
+			m_has_metadata = true;
 
-		// only update the piece_picker if
-		// we have the metadata and if
-		// we're not a seed (in which case
-		// we won't have a piece picker)
-		if (!t->valid_metadata()) return;
+			// only update the piece_picker if
+			// we have the metadata and if
+			// we're not a seed (in which case
+			// we won't have a piece picker)
+			if (!t->valid_metadata()) continue;
 
-		t->peer_has(index, this);
+			pieces[num_new++] = index;
+		}
+
+		if (num_new == 0) return;
+		auto const new_pieces = pieces.first(num_new);
+
+		t->peer_has(new_pieces, this);
 
 		// it's important to not disconnect before we have
 		// updated the piece picker, otherwise we will incorrectly
@@ -2063,11 +2138,17 @@ namespace {
 		// it's important to update whether we're interested in this peer before
 		// calling disconnect_if_redundant, otherwise we may disconnect even if
 		// we are interested
-		if (!t->have_piece(index)
-			&& !t->is_upload_only()
-			&& !is_interesting()
-			&& (!t->has_picker() || t->picker().piece_priority(index) != dont_download))
-			t->peer_is_interesting(*this);
+		if (!t->is_upload_only() && !is_interesting())
+		{
+			for (piece_index_t const index : new_pieces)
+			{
+				if (t->have_piece(index)) continue;
+				if (t->has_picker() && t->picker().piece_priority(index) == dont_download)
+					continue;
+				t->peer_is_interesting(*this);
+				break;
+			}
+		}
 
 		disconnect_if_redundant();
 		if (is_disconnecting()) return;
@@ -2078,14 +2159,17 @@ namespace {
 		// forwarded this piece. In which case we need to give
 		// a new piece to that peer
 		if (t->super_seeding()
-			&& m_settings.get_bool(settings_pack::strict_super_seeding)
-			&& (!super_seeded_piece(index) || t->num_peers() == 1))
+			&& m_settings.get_bool(settings_pack::strict_super_seeding))
 		{
-			for (auto& p : *t)
+			for (piece_index_t const index : new_pieces)
 			{
-				if (!p->super_seeded_piece(index)) continue;
-				if (!p->has_piece(index)) continue;
-				p->superseed_piece(index, t->get_piece_to_super_seed(p->get_bitfield()));
+				if (super_seeded_piece(index) && t->num_peers() != 1) continue;
+				for (auto& p : *t)
+				{
+					if (!p->super_seeded_piece(index)) continue;
+					if (!p->has_piece(index)) continue;
+					p->superseed_piece(index, t->get_piece_to_super_seed(p->get_bitfield()));
+				}
 			}
 		}
 #endif // TORRENT_ABI_VERSION
@@ -2285,11 +2369,11 @@ namespace {
 
 		// let the torrent know which pieces the peer has if we're a seed, we
 		// don't keep track of piece availability
-		t->peer_has(bits, this);
-
 		m_have_piece = bits;
 		m_num_pieces = num_pieces;
 
+		t->peer_has(m_have_piece, this);
+
 		update_interest();
 	}
 
@@ -4643,7 +4727,7 @@ namespace {
 			p.downloading_total = 0;
 		}
 
-		p.pieces = get_bitfield();
+		p.pieces = m_have_piece.to_bitfield();
 		p.last_request = now - m_last_request.get(m_connect);
 		p.last_active = now - std::max(m_last_sent.get(m_connect), m_last_receive.get(m_connect));
 
@@ -4813,6 +4897,16 @@ namespace {
 			m_desired_queue_size = std::uint16_t(queue_time * download_rate / bs);
 		}
 
+		// when requesting large, merged, blocks (from web seeds), make sure the
+		// next range is requested while the current one is still being
+		// received. Otherwise the HTTP request pipeline drains at the end of
+		// every range, and we wait a round-trip for the next one
+		if (m_request_large_blocks && m_desired_queue_size <= m_prefer_contiguous_blocks)
+		{
+			m_desired_queue_size = std::uint16_t(std::min(
+				int(m_prefer_contiguous_blocks) + 1, 0xffff));
+		}
+
 		if (m_desired_queue_size > m_max_out_request_queue)
 			m_desired_queue_size = m_max_out_request_queue;
 		if (m_desired_queue_size < min_request_queue)
@@ -4992,6 +5086,16 @@ namespace {
 			return;
 		}
 
+		// connections that have gone quiet don't need to hold on to the
+		// memory they used while they were busy. The receive buffer is in use
+		// by the outstanding read, it's shrunk once something is received
+		if (!m_connecting
+			&& now - std::max(m_last_receive.get(m_connect), m_last_sent.get(m_connect))
+				>= idle_memory_timeout)
+		{
+			release_idle_memory();
+		}
+
 		// disconnect peers that we unchoked, but they didn't send a request in
 		// the last 60 seconds, and we haven't been working on servicing a request
 		// for more than 60 seconds.
@@ -6119,7 +6223,12 @@ namespace {
 			return;
 		}
 
-		m_last_receive.set(m_connect, aux::time_now());
+		time_point const now = aux::time_now();
+		// if we haven't received anything in a while, the receive buffer is
+		// sized for traffic that has stopped. Shrink it once we're done with
+		// this batch
+		bool const was_idle = now - m_last_receive.get(m_connect) >= idle_memory_timeout;
+		m_last_receive.set(m_connect, now);
 
 		// submit all disk jobs later
 		m_ses.deferred_submit_jobs();
@@ -6217,9 +6326,13 @@ namespace {
 			if (m_disconnecting) return;
 		} while (bytes > 0 && sub_transferred > 0);
 
-		// if the peer went from unchoked to choked, suggest to the receive
-		// buffer that it shrinks to 100 bytes
-		int const force_shrink = (m_peer_choked && !prev_choked)
+		on_receive_done();
+		if (m_disconnecting) return;
+
+		// if the peer went from unchoked to choked, or was idle, suggest to the
+		// receive buffer that it shrinks to 100 bytes
+		int const force_shrink = ((m_peer_choked && !prev_choked)
+			|| (was_idle && m_recv_buffer.capacity() > 100))
 			? 100 : 0;
 		m_recv_buffer.normalize(force_shrink);
 
@@ -13,6 +13,7 @@ You may use, distribute and modify this code under the terms of the BSD license,
 see LICENSE file.
 */
 
+#include <cstring>
 #include <functional>
 
 #include "libtorrent/aux_/peer_connection.hpp"
@@ -45,21 +46,25 @@ namespace {
 
 	using namespace libtorrent;
 
-	struct match_peer_endpoint
+	// the key of a peer in the peer index
+	std::size_t address_hash(address const& a)
 	{
-		match_peer_endpoint(address const& addr, std::uint16_t port)
-			: m_addr(addr), m_port(port)
-		{}
+		if (a.is_v4()) return std::hash<std::uint32_t>()(a.to_v4().to_uint());
 
-		bool operator()(aux::torrent_peer const* p) const
-		{
-			TORRENT_ASSERT(p->in_use);
-			return p->address() == m_addr && p->port == m_port;
-		}
+		auto const b = a.to_v6().to_bytes();
+		std::uint64_t h[2];
+		std::memcpy(h, b.data(), sizeof(h));
+		return std::hash<std::uint64_t>()(h[0] ^ (h[1] * 0x9e3779b97f4a7c15ULL));
+	}
 
-		address const& m_addr;
-		std::uint16_t m_port;
-	};
+	std::size_t peer_hash(aux::torrent_peer const& p)
+	{
+		TORRENT_ASSERT(p.in_use);
+#if TORRENT_USE_I2P
+		if (p.is_i2p_addr) return std::hash<string_view>()(p.dest());
+#endif
+		return address_hash(p.address());
+	}
 
 	// this returns true if lhs is a better erase candidate than rhs
 	bool compare_peer_erase(aux::torrent_peer const& lhs, aux::torrent_peer const& rhs)
@@ -136,6 +141,9 @@ namespace libtorrent::aux {
 		for (auto* p : m_peers)
 			m_peer_allocator.free_peer_entry(p);
 		m_peers.clear();
+		m_peer_index.clear();
+		m_index_bits = 0;
+		m_round_robin = 0;
 		m_candidate_cache.clear();
 		m_num_connect_candidates = 0;
 		m_num_seeds = 0;
@@ -147,6 +155,141 @@ namespace libtorrent::aux {
 			m_peer_allocator.free_peer_entry(p);
 	}
 
+	std::size_t peer_list::index_slot(std::size_t const hash) const
+	{
+		TORRENT_ASSERT(m_index_bits > 0);
+		// std::hash is the identity function for integers in some standard
+		// libraries. Fibonacci hashing spreads IP addresses that only differ
+		// in their high bits over the table
+		return std::size_t((std::uint64_t(hash) * 0x9e3779b97f4a7c15ULL) >> (64 - m_index_bits));
+	}
+
+	void peer_list::index_insert(int const pos)
+	{
+		TORRENT_ASSERT(int(m_peer_index.size()) >= 2 * int(m_peers.size()));
+		std::size_t const mask = m_peer_index.size() - 1;
+		std::size_t slot = index_slot(peer_hash(*m_peers[pos]));
+		while (m_peer_index[slot] != -1) slot = (slot + 1) & mask;
+		m_peer_index[slot] = pos;
+	}
+
+	void peer_list::reserve_index(std::size_t const num_peers)
+	{
+		if (m_peer_index.size() >= 2 * num_peers) return;
+		int bits = std::max(m_index_bits, 4);
+		while ((std::size_t(1) << bits) < 2 * num_peers) ++bits;
+		m_index_bits = bits;
+		m_peer_index.assign(std::size_t(1) << bits, -1);
+		for (int i = 0; i < int(m_peers.size()); ++i)
+			index_insert(i);
+	}
+
+	void peer_list::update_index(torrent_peer const* p, int const from, int const to)
+	{
+		TORRENT_ASSERT(!m_peer_index.empty());
+		std::size_t const mask = m_peer_index.size() - 1;
+		std::size_t slot = index_slot(peer_hash(*p));
+		while (m_peer_index[slot] != from)
+		{
+			TORRENT_ASSERT(m_peer_index[slot] != -1);
+			slot = (slot + 1) & mask;
+		}
+
+		if (to >= 0)
+		{
+			m_peer_index[slot] = to;
+			return;
+		}
+
+		// removing an entry must not break the probe sequence of the entries
+		// after it. Move every entry that can move into the hole back, until
+		// we find an empty slot
+		std::size_t hole = slot;
+		for (std::size_t i = (slot + 1) & mask; m_peer_index[i] != -1; i = (i + 1) & mask)
+		{
+			std::size_t const home = index_slot(peer_hash(*m_peers[m_peer_index[i]]));
+			// the entry can only move if the hole is between its home slot
+			// and where it is now
+			if (((i - home) & mask) < ((i - hole) & mask)) continue;
+			m_peer_index[hole] = m_peer_index[i];
+			hole = i;
+		}
+		m_peer_index[hole] = -1;
+	}
+
+	void peer_list::append_peer(torrent_peer* p)
+	{
+		m_peers.push_back(p);
+		if (m_peer_index.size() < 2 * m_peers.size())
+			reserve_index(m_peers.size() * 2);
+		else
+			index_insert(int(m_peers.size()) - 1);
+	}
+
+	template <typename Pred>
+	int peer_list::find_peer_index(std::size_t const hash, Pred pred) const
+	{
+		if (m_peer_index.empty()) return -1;
+		std::size_t const mask = m_peer_index.size() - 1;
+		for (std::size_t slot = index_slot(hash); m_peer_index[slot] != -1
+			; slot = (slot + 1) & mask)
+		{
+			torrent_peer* p = m_peers[m_peer_index[slot]];
+			TORRENT_ASSERT(p->in_use);
+			if (pred(p)) return m_peer_index[slot];
+		}
+		return -1;
+	}
+
+	torrent_peer* peer_list::find_peer(address const& a) const
+	{
+		int const idx = find_peer_index(address_hash(a), [&a](torrent_peer const* p) {
+#if TORRENT_USE_I2P
+			if (p->is_i2p_addr) return false;
+#endif
+			return p->address() == a;
+		});
+		return idx < 0 ? nullptr : m_peers[idx];
+	}
+
+	torrent_peer* peer_list::find_peer(tcp::endpoint const& ep) const
+	{
+		address const a = ep.address();
+		int const idx = find_peer_index(address_hash(a), [&a, &ep](torrent_peer const* p) {
+#if TORRENT_USE_I2P
+			if (p->is_i2p_addr) return false;
+#endif
+			return p->address() == a && p->port == ep.port();
+		});
+		return idx < 0 ? nullptr : m_peers[idx];
+	}
+
+#if TORRENT_USE_I2P
+	torrent_peer* peer_list::find_i2p_peer(string_view const dest) const
+	{
+		int const idx = find_peer_index(std::hash<string_view>()(dest)
+			, [dest](torrent_peer const* p) { return p->is_i2p_addr && p->dest() == dest; });
+		return idx < 0 ? nullptr : m_peers[idx];
+	}
+#endif
+
+	std::vector<torrent_peer*> peer_list::find_peers(address const& a) const
+	{
+		TORRENT_ASSERT(is_single_thread());
+		std::vector<torrent_peer*> ret;
+#if TORRENT_USE_I2P
+		if (a == address()) return ret;
+#endif
+		find_peer_index(address_hash(a), [&a, &ret](torrent_peer* p) {
+#if TORRENT_USE_I2P
+			if (p->is_i2p_addr) return false;
+#endif
+			if (p->address() == a) ret.push_back(p);
+			return false;
+		});
+		return ret;
+	}
+
 	void peer_list::set_max_failcount(torrent_state* state)
 	{
 		INVARIANT_CHECK;
@@ -278,12 +421,11 @@ namespace libtorrent::aux {
 		TORRENT_ASSERT(p->in_use);
 		TORRENT_ASSERT(m_locked_peer != p);
 
-		auto const range = std::equal_range(m_peers.begin(), m_peers.end(), p, peer_address_compare{});
-		auto const iter = std::find_if(range.first, range.second, [&](torrent_peer const* needle) {
+		int const idx = find_peer_index(peer_hash(*p), [p](torrent_peer const* needle) {
 			return torrent_peer_equal(needle, p);
 		});
-		if (iter == range.second) return;
-		erase_peer(iter, state);
+		if (idx < 0) return;
+		erase_peer(m_peers.begin() + idx, state);
 	}
 
 	// any peer that is erased from m_peers will be
@@ -306,16 +448,46 @@ namespace libtorrent::aux {
 		if (is_connect_candidate(**i))
 			update_connect_candidates(-1);
 		TORRENT_ASSERT(m_num_connect_candidates < int(m_peers.size()));
-		if (m_round_robin > i - m_peers.begin()) --m_round_robin;
-		if (m_round_robin >= int(m_peers.size())) m_round_robin = 0;
+
+		int const current = int(i - m_peers.begin());
+		int const last = int(m_peers.size()) - 1;
 
 		// if this peer is in the connect candidate
 		// cache, erase it from there as well
 		auto const ci = std::find(m_candidate_cache.begin(), m_candidate_cache.end(), *i);
 		if (ci != m_candidate_cache.end()) m_candidate_cache.erase(ci);
 
+		update_index(*i, current, -1);
 		m_peer_allocator.free_peer_entry(*i);
-		m_peers.erase(i);
+
+		// the hole is filled by moving peers, rather than by shifting all
+		// peers after it. The moves must not make the round-robin cursor skip
+		// or revisit peers in its current lap. If the hole is before the
+		// cursor, it's filled with the last visited peer, the cursor steps
+		// back one, and the last peer moves into the slot now at the cursor.
+		// Otherwise the last peer moves into the hole, which is also not
+		// visited yet. Either way, the visited and the unvisited peers stay on
+		// their side of the cursor, so every peer is still visited exactly
+		// once per lap
+		int hole = current;
+		if (current < m_round_robin)
+		{
+			int const visited = m_round_robin - 1;
+			if (visited != hole)
+			{
+				m_peers[hole] = m_peers[visited];
+				update_index(m_peers[hole], visited, hole);
+				hole = visited;
+			}
+			--m_round_robin;
+		}
+		if (hole != last)
+		{
+			m_peers[hole] = m_peers[last];
+			update_index(m_peers[hole], last, hole);
+		}
+		m_peers.pop_back();
+		if (m_round_robin >= int(m_peers.size())) m_round_robin = 0;
 	}
 
 	bool peer_list::should_erase_immediately(torrent_peer const& p) const
@@ -355,8 +527,10 @@ namespace libtorrent::aux {
 
 		if (max_peerlist_size == 0 || m_peers.empty()) return;
 
-		int erase_candidate = -1;
-		int force_erase_candidate = -1;
+		// these are pointers rather than positions, since erasing a peer
+		// moves other peers around in m_peers
+		torrent_peer* erase_candidate = nullptr;
+		torrent_peer* force_erase_candidate = nullptr;
 
 		if (bool(m_finished) != state->is_finished)
 			recalculate_connect_candidates(state);
@@ -376,44 +550,39 @@ namespace libtorrent::aux {
 
 			torrent_peer& pe = *m_peers[round_robin];
 			TORRENT_ASSERT(pe.in_use);
-			int const current = round_robin;
 
 			if (is_erase_candidate(pe)
-				&& (erase_candidate == -1
-					|| !compare_peer_erase(*m_peers[erase_candidate], pe)))
+				&& (erase_candidate == nullptr
+					|| !compare_peer_erase(*erase_candidate, pe)))
 			{
 				if (should_erase_immediately(pe))
 				{
-					if (erase_candidate > current) --erase_candidate;
-					if (force_erase_candidate > current) --force_erase_candidate;
-					TORRENT_ASSERT(current >= 0 && current < int(m_peers.size()));
-					erase_peer(m_peers.begin() + current, state);
+					// erasing moves another peer into this slot
+					erase_peer(m_peers.begin() + round_robin, state);
 					continue;
 				}
 				else
 				{
-					erase_candidate = current;
+					erase_candidate = &pe;
 				}
 			}
 			if (is_force_erase_candidate(pe)
-				&& (force_erase_candidate == -1
-					|| !compare_peer_erase(*m_peers[force_erase_candidate], pe)))
+				&& (force_erase_candidate == nullptr
+					|| !compare_peer_erase(*force_erase_candidate, pe)))
 			{
-				force_erase_candidate = current;
+				force_erase_candidate = &pe;
 			}
 
 			++round_robin;
 		}
 
-		if (erase_candidate > -1)
+		if (erase_candidate != nullptr)
 		{
-			TORRENT_ASSERT(erase_candidate >= 0 && erase_candidate < int(m_peers.size()));
-			erase_peer(m_peers.begin() + erase_candidate, state);
+			erase_peer(erase_candidate, state);
 		}
-		else if ((flags & force_erase) && force_erase_candidate > -1)
+		else if ((flags & force_erase) && force_erase_candidate != nullptr)
 		{
-			TORRENT_ASSERT(force_erase_candidate >= 0 && force_erase_candidate < int(m_peers.size()));
-			erase_peer(m_peers.begin() + force_erase_candidate, state);
+			erase_peer(force_erase_candidate, state);
 		}
 	}
 
@@ -504,7 +673,9 @@ namespace libtorrent::aux {
 		const int candidate_count = 10;
 		peers.reserve(candidate_count);
 
-		int erase_candidate = -1;
+		// a pointer rather than a position, since erasing a peer moves other
+		// peers around in m_peers
+		torrent_peer* erase_candidate = nullptr;
 
 		if (bool(m_finished) != state->is_finished)
 			recalculate_connect_candidates(state);
@@ -528,7 +699,6 @@ namespace libtorrent::aux {
 
 			torrent_peer& pe = *m_peers[m_round_robin];
 			TORRENT_ASSERT(pe.in_use);
-			int current = m_round_robin;
 
 			// if the number of peers is growing large
 			// we need to start weeding.
@@ -537,18 +707,18 @@ namespace libtorrent::aux {
 				&& max_peerlist_size > 0)
 			{
 				if (is_erase_candidate(pe)
-					&& (erase_candidate == -1
-						|| !compare_peer_erase(*m_peers[erase_candidate], pe)))
+					&& (erase_candidate == nullptr
+						|| !compare_peer_erase(*erase_candidate, pe)))
 				{
 					if (should_erase_immediately(pe))
 					{
-						if (erase_candidate > current) --erase_candidate;
-						erase_peer(m_peers.begin() + current, state);
+						// erasing moves another, unvisited, peer into this slot
+						erase_peer(m_peers.begin() + m_round_robin, state);
 						continue;
 					}
 					else
 					{
-						erase_candidate = current;
+						erase_candidate = &pe;
 					}
 				}
 			}
@@ -579,9 +749,9 @@ namespace libtorrent::aux {
 			peers.insert(i, &pe);
 		}
 
-		if (erase_candidate > -1)
+		if (erase_candidate != nullptr)
 		{
-			erase_peer(m_peers.begin() + erase_candidate, state);
+			erase_peer(erase_candidate, state);
 		}
 	}
 
@@ -593,7 +763,6 @@ namespace libtorrent::aux {
 
 		INVARIANT_CHECK;
 
-		iterator iter;
 		torrent_peer* i = nullptr;
 
 #if TORRENT_USE_I2P
@@ -602,63 +771,23 @@ namespace libtorrent::aux {
 		std::string const i2p_dest;
 #endif
 
-		bool found = false;
 		// this check doesn't support i2p peers
 		if (state->allow_multiple_connections_per_ip && i2p_dest.empty())
 		{
-			auto const& remote = c.remote();
-			auto const addr = remote.address();
-			auto const range = find_peers(addr);
-			iter = std::find_if(range.first, range.second, match_peer_endpoint(addr, remote.port()));
-
-			if (iter != range.second)
-			{
-				TORRENT_ASSERT((*iter)->in_use);
-				found = true;
-			}
+			i = find_peer(c.remote());
 		}
 		else
 		{
 #if TORRENT_USE_I2P
 			if (!i2p_dest.empty())
-			{
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, i2p_dest, peer_address_compare()
-					);
-
-				if (iter != m_peers.end() && (*iter)->is_i2p_addr && (*iter)->dest() == i2p_dest)
-				{
-					TORRENT_ASSERT((*iter)->in_use);
-					found = true;
-				}
-			}
+				i = find_i2p_peer(i2p_dest);
 			else
 #endif
-			{
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, c.remote().address(), peer_address_compare()
-					);
-
-				if (iter != m_peers.end() && (*iter)->address() == c.remote().address())
-				{
-					TORRENT_ASSERT((*iter)->in_use);
-					found = true;
-				}
-			}
+				i = find_peer(c.remote().address());
 		}
 
-		// make sure the iterator we got is properly sorted relative
-		// to the connection's address
-//		TORRENT_ASSERT(m_peers.empty()
-//			|| (iter == m_peers.end() && (*(iter-1))->address() < c.remote().address())
-//			|| (iter != m_peers.end() && c.remote().address() < (*iter)->address())
-//			|| (iter != m_peers.end() && iter != m_peers.begin() && (*(iter-1))->address() < c.remote().address()));
-
-		if (found)
+		if (i != nullptr)
 		{
-			i = *iter;
 			TORRENT_ASSERT(i->in_use);
 			TORRENT_ASSERT(i->connection != &c);
 			TORRENT_ASSERT(i->address() == c.remote().address());
@@ -825,11 +954,6 @@ namespace libtorrent::aux {
 					c.disconnect(errors::too_many_connections, operation_t::bittorrent);
 					return false;
 				}
-				// restore it
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, c.remote().address(), peer_address_compare()
-				);
 			}
 
 #if TORRENT_USE_I2P
@@ -854,11 +978,9 @@ namespace libtorrent::aux {
 				else
 					p = new (p) ipv4_peer(c.remote(), false, {});
 
-				iter = m_peers.insert(iter, p);
-
-				if (m_round_robin >= iter - m_peers.begin()) ++m_round_robin;
+				append_peer(p);
 
-				i = *iter;
+				i = p;
 
 				i->source = static_cast<std::uint8_t>(peer_info::incoming);
 			}
@@ -900,13 +1022,10 @@ namespace libtorrent::aux {
 
 		if (state->allow_multiple_connections_per_ip)
 		{
-			auto const addr = p->address();
-			auto const range = find_peers(addr);
-			auto const i = std::find_if(range.first, range.second
-				, match_peer_endpoint(addr, std::uint16_t(port)));
-			if (i != range.second)
+			torrent_peer* const i = find_peer(tcp::endpoint(p->address(), std::uint16_t(port)));
+			if (i != nullptr)
 			{
-				torrent_peer& pp = **i;
+				torrent_peer& pp = *i;
 				TORRENT_ASSERT(pp.in_use);
 				if (pp.connection)
 				{
@@ -936,8 +1055,7 @@ namespace libtorrent::aux {
 #if TORRENT_USE_ASSERTS
 		else
 		{
-			std::pair<iterator, iterator> range = find_peers(p->address());
-			TORRENT_ASSERT(std::distance(range.first, range.second) == 1);
+			TORRENT_ASSERT(find_peers(p->address()).size() == 1);
 		}
 #endif
 
@@ -986,8 +1104,7 @@ namespace libtorrent::aux {
 	}
 
 	// this is an internal function
-	bool peer_list::insert_peer(torrent_peer* p, iterator iter
-		, pex_flags_t const flags
+	bool peer_list::insert_peer(torrent_peer* p, pex_flags_t const flags
 		, torrent_state* state)
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -1004,26 +1121,9 @@ namespace libtorrent::aux {
 			erase_peers(state);
 			if (int(m_peers.size()) >= max_peerlist_size)
 				return false;
-
-			// since some peers were removed, we need to
-			// update the iterator to make it valid again
-#if TORRENT_USE_I2P
-			if (p->is_i2p_addr)
-			{
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, p->dest(), peer_address_compare());
-			}
-			else
-#endif
-			iter = std::lower_bound(
-				m_peers.begin(), m_peers.end()
-				, p->address(), peer_address_compare());
 		}
 
-		iter = m_peers.insert(iter, p);
-
-		if (m_round_robin >= iter - m_peers.begin()) ++m_round_robin;
+		append_peer(p);
 
 #if !defined TORRENT_DISABLE_ENCRYPTION
 		if (flags & pex_encryption) p->pe_support = true;
@@ -1110,13 +1210,11 @@ namespace libtorrent::aux {
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
-		auto iter = std::lower_bound(m_peers.begin(), m_peers.end()
-			, destination, peer_address_compare());
-
-		if (iter != m_peers.end() && (*iter)->dest() == destination)
+		torrent_peer* const existing = find_i2p_peer(destination);
+		if (existing != nullptr)
 		{
-			update_peer(*iter, src, flags, tcp::endpoint());
-			return *iter;
+			update_peer(existing, src, flags, tcp::endpoint());
+			return existing;
 		}
 
 		// we don't have any info about this peer.
@@ -1126,7 +1224,7 @@ namespace libtorrent::aux {
 		if (p == nullptr) return nullptr;
 		p = new (p) i2p_peer(destination, true, src);
 
-		if (!insert_peer(p, iter, flags, state))
+		if (!insert_peer(p, flags, state))
 		{
 			m_peer_allocator.free_peer_entry(p);
 			return nullptr;
@@ -1143,14 +1241,13 @@ namespace libtorrent::aux {
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
-		iterator const iter = std::lower_bound(m_peers.begin(), m_peers.end()
-				, remote.address(), peer_address_compare());
+		torrent_peer* const existing = state->allow_multiple_connections_per_ip
+			? nullptr : find_peer(remote.address());
 
-		if (!state->allow_multiple_connections_per_ip
-				&& iter != m_peers.end() && (*iter)->address() == remote.address())
+		if (existing != nullptr)
 		{
 			// the peer exists
-			torrent_peer* p = *iter;
+			torrent_peer* p = existing;
 			if (!p->is_rtc_addr)
 				return nullptr; // prefer the non-rtc peer
 
@@ -1167,7 +1264,7 @@ namespace libtorrent::aux {
 		if (p == nullptr) return nullptr;
 		p = new (p) rtc_peer(remote, src);
 
-		if (!insert_peer(p, iter, flags, state))
+		if (!insert_peer(p, flags, state))
 		{
 			m_peer_allocator.free_peer_entry(p);
 			return nullptr;
@@ -1183,7 +1280,47 @@ namespace libtorrent::aux {
 	{
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
+		return add_peer_impl(remote, src, flags, state);
+	}
+
+	void peer_list::add_peers(span<tcp::endpoint const> const remotes
+		, peer_source_flags_t const src, pex_flags_t const flags
+		, span<pex_flags_t const> const peer_flags
+		, torrent_state* state, std::vector<add_peer_result>& result)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(peer_flags.empty() || peer_flags.size() == remotes.size());
+		INVARIANT_CHECK;
+
+		result.clear();
+		result.reserve(std::size_t(remotes.size()));
+
+		// make room for the whole batch up-front, rather than growing the
+		// peer list and rehashing the index step by step. Never reserve
+		// exactly what's needed, since that would reallocate for every batch
+		std::size_t want = m_peers.size() + std::size_t(remotes.size());
+		if (state->max_peerlist_size > 0)
+			want = std::min(want, std::size_t(state->max_peerlist_size));
+		if (want > m_peers.capacity())
+			m_peers.reserve(std::max(want, m_peers.capacity() * 2));
+		// the index grows to a power of two, so this never rehashes it
+		// for every batch either
+		reserve_index(want);
+
+		for (int i = 0; i < int(remotes.size()); ++i)
+		{
+			pex_flags_t const f = peer_flags.empty() ? flags : flags | peer_flags[i];
+			torrent_peer* const p = add_peer_impl(remotes[i], src, f, state);
+			result.push_back(p == nullptr ? add_peer_result::rejected
+				: state->first_time_seen ? add_peer_result::added
+				: add_peer_result::updated);
+		}
+	}
 
+	torrent_peer* peer_list::add_peer_impl(tcp::endpoint const& remote
+		, peer_source_flags_t const src, pex_flags_t const flags
+		, torrent_state* state)
+	{
 		auto const remote_address = remote.address();
 
 		// just ignore the obviously invalid entries
@@ -1196,26 +1333,10 @@ namespace libtorrent::aux {
 		if (remote_address.is_v6() && remote_address.to_v6().is_link_local())
 			return nullptr;
 
-		iterator iter;
-		torrent_peer* p = nullptr;
+		torrent_peer* p = state->allow_multiple_connections_per_ip
+			? find_peer(remote) : find_peer(remote_address);
 
-		bool found = false;
-		if (state->allow_multiple_connections_per_ip)
-		{
-			auto const range = find_peers(remote_address);
-			iter = std::find_if(range.first, range.second
-				, match_peer_endpoint(remote_address, remote.port()));
-			if (iter != range.second) found = true;
-		}
-		else
-		{
-			iter = std::lower_bound(m_peers.begin(), m_peers.end()
-				, remote_address, peer_address_compare());
-
-			if (iter != m_peers.end() && (*iter)->address() == remote_address) found = true;
-		}
-
-		if (!found)
+		if (p == nullptr)
 		{
 			// we don't have any info about this peer.
 			// add a new entry
@@ -1233,7 +1354,7 @@ namespace libtorrent::aux {
 
 			try
 			{
-				if (!insert_peer(p, iter, flags, state))
+				if (!insert_peer(p, flags, state))
 				{
 					m_peer_allocator.free_peer_entry(p);
 					return nullptr;
@@ -1248,7 +1369,6 @@ namespace libtorrent::aux {
 		}
 		else
 		{
-			p = *iter;
 			TORRENT_ASSERT(p->in_use);
 			update_peer(p, src, flags, remote);
 			state->first_time_seen = false;
@@ -1402,10 +1522,7 @@ namespace libtorrent::aux {
 
 		TORRENT_ASSERT(c);
 
-		auto const iter = std::lower_bound(m_peers.begin(), m_peers.end()
-			, c->remote().address(), peer_address_compare());
-
-		if (iter != m_peers.end() && (*iter)->address() == c->remote().address())
+		if (find_peer(c->remote().address()) != nullptr)
 			return true;
 
 		return std::any_of(m_peers.begin(), m_peers.end()
@@ -1428,16 +1545,26 @@ namespace libtorrent::aux {
 #ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
 		int connect_candidates = 0;
 
-		const_iterator prev = m_peers.end();
-		for (const_iterator i = m_peers.begin(); i != m_peers.end(); ++i)
+		// every peer is in the index exactly once, and can be found by
+		// probing from its home slot
+		TORRENT_ASSERT(m_peer_index.size() >= 2 * m_peers.size());
+		std::vector<bool> indexed(std::size_t(m_peers.size()), false);
+		std::size_t const mask = m_peer_index.size() - 1;
+		for (std::size_t slot = 0; slot < m_peer_index.size(); ++slot)
 		{
-			if (prev != m_peers.end()) ++prev;
-			if (i == m_peers.begin() + 1) prev = m_peers.begin();
-			if (prev != m_peers.end())
-			{
-				TORRENT_ASSERT(!((*i)->address() < (*prev)->address()));
-			}
-			torrent_peer const& p = **i;
+			int const pos = m_peer_index[slot];
+			if (pos == -1) continue;
+			TORRENT_ASSERT(pos >= 0 && pos < int(m_peers.size()));
+			TORRENT_ASSERT(!indexed[std::size_t(pos)]);
+			indexed[std::size_t(pos)] = true;
+			for (std::size_t i = index_slot(peer_hash(*m_peers[pos])); i != slot; i = (i + 1) & mask)
+				TORRENT_ASSERT(m_peer_index[i] != -1);
+		}
+		TORRENT_ASSERT(std::count(indexed.begin(), indexed.end(), true) == int(m_peers.size()));
+
+		for (torrent_peer const* pe : m_peers)
+		{
+			torrent_peer const& p = *pe;
 			TORRENT_ASSERT(p.in_use);
 			if (is_connect_candidate(p)) ++connect_candidates;
 			if (!p.connection)
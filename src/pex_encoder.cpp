@@ -0,0 +1,137 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/pex_encoder.hpp"
+#include "libtorrent/aux_/bencoder.hpp"
+#include "libtorrent/aux_/socket_io.hpp" // for write_endpoint
+#include "libtorrent/aux_/ip_helpers.hpp" // for is_v4
+
+#include <algorithm>
+#include <iterator>
+
+namespace libtorrent::aux {
+
+namespace {
+
+	// the compact peer strings of a message
+	struct pex_lists
+	{
+		std::vector<char> added;
+		std::vector<char> added_f;
+		std::vector<char> added6;
+		std::vector<char> added6_f;
+		std::vector<char> dropped;
+		std::vector<char> dropped6;
+
+		void add(pex_peer const& p)
+		{
+			if (aux::is_v4(p.ep))
+			{
+				aux::write_endpoint(p.ep, std::back_inserter(added));
+				added_f.push_back(static_cast<char>(static_cast<std::uint8_t>(p.flags)));
+			}
+			else
+			{
+				aux::write_endpoint(p.ep, std::back_inserter(added6));
+				added6_f.push_back(static_cast<char>(static_cast<std::uint8_t>(p.flags)));
+			}
+		}
+
+		void drop(tcp::endpoint const& ep)
+		{
+			if (aux::is_v4(ep))
+				aux::write_endpoint(ep, std::back_inserter(dropped));
+			else
+				aux::write_endpoint(ep, std::back_inserter(dropped6));
+		}
+
+		pex_encoder::message encode() const
+		{
+			auto ret = std::make_shared<std::vector<char>>();
+			ret->reserve(std::size_t(80) + added.size() + added_f.size()
+				+ added6.size() + added6_f.size() + dropped.size() + dropped6.size());
+
+			auto str = [](std::vector<char> const& v)
+			{ return string_view(v.data(), v.size()); };
+
+			// the keys must be written in sorted order
+			aux::bencode::dict d(*ret);
+			d.add("added", str(added));
+			d.add("added.f", str(added_f));
+			d.add("added6", str(added6));
+			d.add("added6.f", str(added6_f));
+			d.add("dropped", str(dropped));
+			d.add("dropped6", str(dropped6));
+			return ret;
+		}
+	};
+}
+
+	void pex_encoder::update(span<pex_peer const> const peers, int const max_added)
+	{
+		pex_lists lists;
+		m_num_added = 0;
+		m_num_dropped = 0;
+
+		m_current.clear();
+		m_next.clear();
+		for (auto const& p : peers)
+		{
+			m_current.push_back(p.ep);
+
+			// this peer was in the previous message
+			if (std::binary_search(m_peers.begin(), m_peers.end(), p.ep))
+			{
+				m_next.push_back(p.ep);
+				continue;
+			}
+
+			// don't write too big of a message. The peers left out will be
+			// added next time
+			if (m_num_added >= max_added) continue;
+
+			lists.add(p);
+			m_next.push_back(p.ep);
+			++m_num_added;
+		}
+
+		std::sort(m_current.begin(), m_current.end());
+
+		// the peers from the last message we're no longer connected to. Both
+		// lists are sorted, so this is a single pass over them
+		auto cur = m_current.begin();
+		for (auto const& ep : m_peers)
+		{
+			while (cur != m_current.end() && *cur < ep) ++cur;
+			if (cur != m_current.end() && *cur == ep) continue;
+			lists.drop(ep);
+			++m_num_dropped;
+		}
+
+		std::sort(m_next.begin(), m_next.end());
+		m_next.erase(std::unique(m_next.begin(), m_next.end()), m_next.end());
+		m_peers.swap(m_next);
+
+		m_msg = lists.encode();
+	}
+
+	pex_encoder::message pex_encoder::full_message(span<pex_peer const> const peers
+		, int const max_added)
+	{
+		pex_lists lists;
+		int num_added = 0;
+		for (auto const& p : peers)
+		{
+			if (num_added >= max_added) break;
+			lists.add(p);
+			++num_added;
+		}
+		return lists.encode();
+	}
+}
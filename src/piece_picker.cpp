@@ -414,7 +414,7 @@ namespace libtorrent::aux {
 	}
 
 	void piece_picker::verify_pick(span<piece_block const> const picked
-		, typed_bitfield<piece_index_t> const& bits) const
+		, compressed_bitfield const& bits) const
 	{
 		TORRENT_ASSERT(bits.size() == num_pieces());
 		for (piece_block const& pb : picked)
@@ -438,7 +438,7 @@ namespace libtorrent::aux {
 		}
 	}
 
-	void piece_picker::check_peer_invariant(typed_bitfield<piece_index_t> const& have
+	void piece_picker::check_peer_invariant(compressed_bitfield const& have
 		, aux::torrent_peer const* p) const
 	{
 #ifdef TORRENT_DEBUG_REFCOUNTS
@@ -1238,6 +1238,58 @@ namespace libtorrent::aux {
 			update(prev_priority, p.index);
 	}
 
+	void piece_picker::inc_refcount(span<piece_index_t const> const pieces
+		, const aux::torrent_peer* peer)
+	{
+#ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
+		INVARIANT_CHECK;
+#endif
+
+#ifdef TORRENT_PICKER_LOG
+		std::cerr << "[" << this << "] " << "inc_refcount(" << pieces.size() << " pieces)" << std::endl;
+#endif
+
+		if (pieces.size() == 1)
+		{
+			inc_refcount(pieces[0], peer);
+			return;
+		}
+
+		// just like when incrementing a bitfield, if many pieces are updated
+		// it's cheaper to only update the counters and rebuild the piece list
+		// the next time we need it, than to move each piece in the priority
+		// list one at a time
+		bool const rebuild = m_dirty
+			|| pieces.size() >= std::min(50, int(m_piece_map.size()) / 2);
+
+		for (piece_index_t const index : pieces)
+		{
+			piece_pos& p = m_piece_map[index];
+#ifdef TORRENT_DEBUG_REFCOUNTS
+			TORRENT_ASSERT(p.have_peers.count(peer) == 0);
+			p.have_peers.insert(peer);
+#else
+			TORRENT_UNUSED(peer);
+#endif
+			if (rebuild)
+			{
+				++p.peer_count;
+				continue;
+			}
+
+			int const prev_priority = p.priority(this);
+			++p.peer_count;
+			int const new_priority = p.priority(this);
+			if (prev_priority == new_priority) continue;
+			if (prev_priority == -1)
+				add(index);
+			else
+				update(prev_priority, p.index);
+		}
+
+		if (rebuild && !pieces.empty()) m_dirty = true;
+	}
+
 	// this function decrements the m_seeds counter
 	// and increments the peer counter on every piece
 	// instead. Sometimes of we connect to a seed that
@@ -1295,7 +1347,7 @@ namespace libtorrent::aux {
 		if (prev_priority >= 0) update(prev_priority, p.index);
 	}
 
-	void piece_picker::inc_refcount(typed_bitfield<piece_index_t> const& bitmask
+	void piece_picker::inc_refcount(compressed_bitfield const& bitmask
 		, const aux::torrent_peer* peer)
 	{
 #ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
@@ -1315,82 +1367,41 @@ namespace libtorrent::aux {
 			return;
 		}
 
-		int const size = std::min(50, int(bitmask.size() / 2));
-
 		// this is an optimization where if just a few
 		// pieces end up changing, instead of making
 		// the piece list dirty, just update those pieces
-		// instead
-		TORRENT_ALLOCA(incremented, piece_index_t, size);
+		// instead. Otherwise we'll just update the counters and mark the
+		// picker as dirty, so we'll rebuild it next time we need it.
+		bool const rebuild = m_dirty
+			|| bitmask.count() >= std::min(50, bitmask.size() / 2);
 
-		if (!m_dirty)
+		bitmask.for_each_set([&](piece_index_t const index)
 		{
-			// first count how many pieces we're updating. If it's few (less than half)
-			// we'll just update them one at a time. Otherwise we'll just update the counters
-			// and mark the picker as dirty, so we'll rebuild it next time we need it.
-			// this only matters if we're not already dirty, in which case the fasted
-			// thing to do is to just update the counters and be done
-			piece_index_t index{0};
-			int num_inc = 0;
-			for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
-			{
-				if (!*i) continue;
-				if (num_inc < size) incremented[num_inc] = index;
-				++num_inc;
-				if (num_inc >= size) break;
-			}
-
-			if (num_inc < size)
-			{
-				// not that many pieces were updated
-				// just update those individually instead of
-				// rebuilding the whole piece list
-				for (int i = 0; i < num_inc; ++i)
-				{
-					piece_index_t const piece = incremented[i];
-					piece_pos& p = m_piece_map[piece];
-					int prev_priority = p.priority(this);
-					++p.peer_count;
+			piece_pos& p = m_piece_map[index];
 #ifdef TORRENT_DEBUG_REFCOUNTS
-					TORRENT_ASSERT(p.have_peers.count(peer) == 0);
-					p.have_peers.insert(peer);
+			TORRENT_ASSERT(p.have_peers.count(peer) == 0);
+			p.have_peers.insert(peer);
 #else
-					TORRENT_UNUSED(peer);
+			TORRENT_UNUSED(peer);
 #endif
-					int new_priority = p.priority(this);
-					if (prev_priority == new_priority) continue;
-					else if (prev_priority >= 0) update(prev_priority, p.index);
-					else add(piece);
-				}
-				return;
-			}
-		}
-
-		piece_index_t index{0};
-		bool updated = false;
-		for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
-		{
-			if (*i)
+			if (rebuild)
 			{
-#ifdef TORRENT_DEBUG_REFCOUNTS
-				TORRENT_ASSERT(m_piece_map[index].have_peers.count(peer) == 0);
-				m_piece_map[index].have_peers.insert(peer);
-#else
-				TORRENT_UNUSED(peer);
-#endif
-
-				++m_piece_map[index].peer_count;
-				updated = true;
+				++p.peer_count;
+				return;
 			}
-		}
 
-		// if we're already dirty, no point in doing anything more
-		if (m_dirty) return;
+			int const prev_priority = p.priority(this);
+			++p.peer_count;
+			int const new_priority = p.priority(this);
+			if (prev_priority == new_priority) return;
+			if (prev_priority >= 0) update(prev_priority, p.index);
+			else add(index);
+		});
 
-		if (updated) m_dirty = true;
+		if (rebuild) m_dirty = true;
 	}
 
-	void piece_picker::dec_refcount(typed_bitfield<piece_index_t> const& bitmask
+	void piece_picker::dec_refcount(compressed_bitfield const& bitmask
 		, const aux::torrent_peer* peer)
 	{
 #ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
@@ -1411,100 +1422,35 @@ namespace libtorrent::aux {
 			return;
 		}
 
-		int const size = std::min(50, int(bitmask.size() / 2));
-
-		// this is an optimization where if just a few
-		// pieces end up changing, instead of making
-		// the piece list dirty, just update those pieces
-		// instead
-		TORRENT_ALLOCA(decremented, piece_index_t, size);
+		bool const rebuild = m_dirty
+			|| bitmask.count() >= std::min(50, bitmask.size() / 2);
 
-		if (!m_dirty)
+		bitmask.for_each_set([&](piece_index_t const index)
 		{
-			// first count how many pieces we're updating. If it's few (less than half)
-			// we'll just update them one at a time. Otherwise we'll just update the counters
-			// and mark the picker as dirty, so we'll rebuild it next time we need it.
-			// this only matters if we're not already dirty, in which case the fasted
-			// thing to do is to just update the counters and be done
-			piece_index_t index{0};
-			int num_dec = 0;
-			for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
+			piece_pos& p = m_piece_map[index];
+			if (p.peer_count == 0)
 			{
-				if (!*i) continue;
-				if (num_dec < size) decremented[num_dec] = index;
-				++num_dec;
-				if (num_dec >= size) break;
+				TORRENT_ASSERT(m_seeds > 0);
+				// this is the case where we have one or more
+				// seeds, and one of them saying: I don't have this
+				// piece anymore. we need to break up one of the seed
+				// counters into actual peer counters on the pieces
+				break_one_seed();
 			}
 
-			if (num_dec < size)
-			{
-				// not that many pieces were updated
-				// just update those individually instead of
-				// rebuilding the whole piece list
-				for (int i = 0; i < num_dec; ++i)
-				{
-					piece_index_t const piece = decremented[i];
-					piece_pos& p = m_piece_map[piece];
-					int prev_priority = p.priority(this);
-
-					if (p.peer_count == 0)
-					{
-						TORRENT_ASSERT(m_seeds > 0);
-						// this is the case where we have one or more
-						// seeds, and one of them saying: I don't have this
-						// piece anymore. we need to break up one of the seed
-						// counters into actual peer counters on the pieces
-						break_one_seed();
-					}
-
-#ifdef TORRENT_DEBUG_REFCOUNTS
-					TORRENT_ASSERT(p.have_peers.count(peer) == 1);
-					p.have_peers.erase(peer);
-#else
-					TORRENT_UNUSED(peer);
-#endif
-					TORRENT_ASSERT(p.peer_count > 0);
-					--p.peer_count;
-					if (!m_dirty && prev_priority >= 0) update(prev_priority, p.index);
-				}
-				return;
-			}
-		}
-
-		piece_index_t index{0};
-		bool updated = false;
-		for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
-		{
-			if (*i)
-			{
-				piece_pos& p = m_piece_map[index];
-				if (p.peer_count == 0)
-				{
-					TORRENT_ASSERT(m_seeds > 0);
-					// this is the case where we have one or more
-					// seeds, and one of them saying: I don't have this
-					// piece anymore. we need to break up one of the seed
-					// counters into actual peer counters on the pieces
-					break_one_seed();
-				}
-
+			int const prev_priority = p.priority(this);
 #ifdef TORRENT_DEBUG_REFCOUNTS
-				TORRENT_ASSERT(p.have_peers.count(peer) == 1);
-				p.have_peers.erase(peer);
+			TORRENT_ASSERT(p.have_peers.count(peer) == 1);
+			p.have_peers.erase(peer);
 #else
-				TORRENT_UNUSED(peer);
+			TORRENT_UNUSED(peer);
 #endif
+			TORRENT_ASSERT(p.peer_count > 0);
+			--p.peer_count;
+			if (!rebuild && !m_dirty && prev_priority >= 0) update(prev_priority, p.index);
+		});
 
-				TORRENT_ASSERT(p.peer_count > 0);
-				--p.peer_count;
-				updated = true;
-			}
-		}
-
-		// if we're already dirty, no point in doing anything more
-		if (m_dirty) return;
-
-		if (updated) m_dirty = true;
+		if (rebuild) m_dirty = true;
 	}
 
 	void piece_picker::update_pieces() const
@@ -1945,7 +1891,7 @@ namespace {
 	// the return value is a combination of picker_flags_t,
 	// indicating which path thought the picker we took to arrive at the
 	// returned block picks.
-	picker_flags_t piece_picker::pick_pieces(typed_bitfield<piece_index_t> const& pieces
+	picker_flags_t piece_picker::pick_pieces(compressed_bitfield const& pieces
 		, std::vector<piece_block>& interesting_blocks, int num_blocks
 		, int prefer_contiguous_blocks, aux::torrent_peer* peer
 		, picker_options_t options, std::vector<piece_index_t> const& suggested_pieces
@@ -2515,22 +2461,26 @@ get_out:
 	}
 
 	bool piece_picker::is_piece_free(piece_index_t const piece
-		, typed_bitfield<piece_index_t> const& bitmask) const
+		, compressed_bitfield const& bitmask) const
 	{
-		return bitmask[piece]
-			&& !m_piece_map[piece].have()
-			&& !m_piece_map[piece].filtered();
+		// the peer's bitfield may be a list that needs a search, check our
+		// own state first
+		piece_pos const& p = m_piece_map[piece];
+		return !p.have()
+			&& !p.filtered()
+			&& bitmask[piece];
 	}
 
 	bool piece_picker::can_pick(piece_index_t const piece
-		, typed_bitfield<piece_index_t> const& bitmask) const
+		, compressed_bitfield const& bitmask) const
 	{
-		return bitmask[piece]
-			&& !m_piece_map[piece].have()
+		piece_pos const& p = m_piece_map[piece];
+		return !p.have()
 			// TODO: when expanding pieces for cache stripe reasons,
 			// the !downloading condition doesn't make much sense
-			&& !m_piece_map[piece].downloading()
-			&& !m_piece_map[piece].filtered();
+			&& !p.downloading()
+			&& !p.filtered()
+			&& bitmask[piece];
 	}
 
 #if TORRENT_USE_INVARIANT_CHECKS
@@ -2603,7 +2553,7 @@ get_out:
 	}
 
 	int piece_picker::add_blocks(piece_index_t piece
-		, typed_bitfield<piece_index_t> const& pieces
+		, compressed_bitfield const& pieces
 		, std::vector<piece_block>& interesting_blocks
 		, std::vector<piece_block>& backup_blocks
 		, int num_blocks, int prefer_contiguous_blocks
@@ -2686,7 +2636,7 @@ get_out:
 	}
 
 	int piece_picker::add_blocks_downloading(downloading_piece const& dp
-		, typed_bitfield<piece_index_t> const& pieces
+		, compressed_bitfield const& pieces
 		, std::vector<piece_block>& interesting_blocks
 		, std::vector<piece_block>& backup_blocks
 		, int num_blocks, int prefer_contiguous_blocks
@@ -2777,7 +2727,7 @@ get_out:
 
 	index_range<piece_index_t>
 	piece_picker::expand_piece(piece_index_t const piece, int const contiguous_blocks
-		, typed_bitfield<piece_index_t> const& have, picker_options_t const options) const
+		, compressed_bitfield const& have, picker_options_t const options) const
 	{
 		if (contiguous_blocks == 0) return {piece, next(piece)};
 
@@ -15,6 +15,7 @@ see LICENSE file.
 
 #include <cstdint>
 #include <limits>
+#include <cstdlib>
 
 #if TORRENT_HAS_PTHREAD_SET_NAME
 #include <pthread.h>
@@ -27,6 +28,14 @@ see LICENSE file.
 #include <kernel/OS.h>
 #endif
 
+#if TORRENT_USE_NUMA
+#include <sched.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <cstdio>
+#include <string>
+#endif
+
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 
 #if TORRENT_USE_RLIMIT
@@ -104,6 +113,127 @@ namespace libtorrent::aux {
 #endif
 #ifdef TORRENT_BEOS
 		rename_thread(find_thread(nullptr), name);
+#endif
+	}
+
+	bool parse_cpu_list(string_view list, std::vector<int>& cpus)
+	{
+		cpus.clear();
+
+		auto parse_int = [](string_view str, int& out)
+		{
+			if (str.empty() || str.size() > 6) return false;
+			out = 0;
+			for (char const c : str)
+			{
+				if (c < '0' || c > '9') return false;
+				out = out * 10 + (c - '0');
+			}
+			return true;
+		};
+
+		while (!list.empty())
+		{
+			auto const comma = list.find(',');
+			string_view item = list.substr(0, comma);
+			list = comma == string_view::npos ? string_view() : list.substr(comma + 1);
+
+			while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+			while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+
+			auto const dash = item.find('-');
+			int first = 0;
+			int last = 0;
+			if (!parse_int(item.substr(0, dash), first)) return false;
+			if (dash == string_view::npos) last = first;
+			else if (!parse_int(item.substr(dash + 1), last)) return false;
+			if (last < first) return false;
+
+			for (int i = first; i <= last; ++i)
+				cpus.push_back(i);
+		}
+		return true;
+	}
+
+	bool set_thread_affinity(string_view const cpus)
+	{
+		std::vector<int> list;
+		if (!parse_cpu_list(cpus, list)) return false;
+#if TORRENT_USE_NUMA && !defined TORRENT_BUILD_SIMULATOR
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		// with no CPUs specified, use the same as the main thread, which is
+		// what the process was started with
+		if (list.empty() && sched_getaffinity(::getpid(), sizeof(set), &set) != 0)
+		{
+			for (int i = 0; i < CPU_SETSIZE; ++i)
+				CPU_SET(i, &set);
+		}
+		for (int const cpu : list)
+		{
+			if (cpu >= CPU_SETSIZE) return false;
+			CPU_SET(cpu, &set);
+		}
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+		return list.empty();
+#endif
+	}
+
+#if TORRENT_USE_NUMA
+namespace {
+
+	// maps CPU numbers to the NUMA node they belong to, as listed in sysfs.
+	// CPUs that aren't listed belong to node 0
+	std::vector<int> read_cpu_node_map()
+	{
+		std::vector<int> ret;
+		DIR* dir = ::opendir("/sys/devices/system/node");
+		if (dir == nullptr) return ret;
+
+		std::vector<int> cpus;
+		while (dirent const* e = ::readdir(dir))
+		{
+			int node = 0;
+			if (std::sscanf(e->d_name, "node%d", &node) != 1 || node < 0) continue;
+
+			std::string const path = std::string("/sys/devices/system/node/")
+				+ e->d_name + "/cpulist";
+			FILE* f = std::fopen(path.c_str(), "r");
+			if (f == nullptr) continue;
+			char buf[1024];
+			std::size_t const len = std::fread(buf, 1, sizeof(buf), f);
+			std::fclose(f);
+
+			string_view list(buf, len);
+			while (!list.empty() && (list.back() == '\n' || list.back() == ' '))
+				list.remove_suffix(1);
+			if (!parse_cpu_list(list, cpus)) continue;
+
+			for (int const cpu : cpus)
+			{
+				if (cpu >= int(ret.size())) ret.resize(std::size_t(cpu) + 1, 0);
+				ret[std::size_t(cpu)] = node;
+			}
+		}
+		::closedir(dir);
+		return ret;
+	}
+}
+#endif
+
+	int current_numa_node()
+	{
+#if TORRENT_USE_NUMA
+		// the topology doesn't change while we're running, so it's read once.
+		// sched_getcpu() is served by the vDSO, so this is cheap enough to
+		// call for every disk buffer
+		static std::vector<int> const cpu_node = read_cpu_node_map();
+		int const cpu = ::sched_getcpu();
+		if (cpu < 0 || cpu >= int(cpu_node.size())) return 0;
+		return cpu_node[std::size_t(cpu)];
+#else
+		return 0;
 #endif
 	}
 }
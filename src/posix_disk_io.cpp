@@ -24,6 +24,7 @@ see LICENSE file.
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/add_torrent_params.hpp"
 #include "libtorrent/aux_/storage_free_list.hpp"
+#include "libtorrent/aux_/drive_info.hpp"
 
 #include <vector>
 
@@ -346,6 +347,18 @@ namespace {
 			post(m_ios, [=, h = std::move(handler)]{ h(index); });
 		}
 
+		void async_storage_device(storage_index_t storage
+			, std::function<void(std::uint64_t, bool)> handler) override
+		{
+			// like every other job here, this is resolved in the calling
+			// thread. The stat() and sysfs reads are no worse than the file
+			// reads the checking that follows does in this thread
+			std::string const& path = m_torrents[storage]->save_path();
+			std::uint64_t const device = aux::get_device_id(path);
+			bool const spinning = aux::get_drive_info(path) == aux::drive_info::spinning;
+			post(m_ios, [=, h = std::move(handler)]{ h(device, spinning); });
+		}
+
 		void update_stats_counters(counters&) const override {}
 
 		std::vector<open_file_state> get_status(storage_index_t) const override
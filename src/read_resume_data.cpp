@@ -244,6 +244,7 @@ namespace {
 		apply_flag(ret.flags, rd, "disable_dht", torrent_flags::disable_dht);
 		apply_flag(ret.flags, rd, "disable_lsd", torrent_flags::disable_lsd);
 		apply_flag(ret.flags, rd, "disable_pex", torrent_flags::disable_pex);
+		apply_flag(ret.flags, rd, "dormant", torrent_flags::dormant);
 
 		ret.save_path = rd.dict_find_string_value("save_path");
 
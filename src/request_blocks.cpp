@@ -10,7 +10,7 @@ You may use, distribute and modify this code under the terms of the BSD license,
 see LICENSE file.
 */
 
-#include "libtorrent/bitfield.hpp"
+#include "libtorrent/aux_/compressed_bitfield.hpp"
 #include "libtorrent/aux_/peer_connection.hpp"
 #include "libtorrent/aux_/torrent.hpp"
 #include "libtorrent/aux_/socket_type.hpp"
@@ -127,7 +127,7 @@ namespace libtorrent::aux {
 
 		std::vector<piece_index_t> const& suggested = c.suggested_pieces();
 		auto const* bits = &c.get_bitfield();
-		typed_bitfield<piece_index_t> fast_mask;
+		compressed_bitfield fast_mask;
 
 		if (c.has_peer_choked())
 		{
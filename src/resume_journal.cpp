@@ -0,0 +1,792 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/resume_journal.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/read_resume_data.hpp"
+#include "libtorrent/write_resume_data.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/bdecode.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/aux_/bencoder.hpp"
+#include "libtorrent/aux_/io_bytes.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/socket_io.hpp" // for print_endpoint
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/crc.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef TORRENT_WINDOWS
+#include <io.h> // for _commit
+#else
+#include <unistd.h> // for fsync
+#endif
+
+namespace libtorrent {
+
+namespace {
+
+	// The journal starts with this magic string, followed by records. Each
+	// record is:
+	//
+	//   u32 (big endian) payload length
+	//   u32 (big endian) CRC32C of payload
+	//   payload
+	//
+	// The first byte of the payload is the record type:
+	//
+	//   'F' full, followed by the bencoded resume data
+	//   'D' delta, followed by a bencoded dictionary of the fields that
+	//       change as a torrent downloads
+	//   'R' removed, followed by the v1 and v2 info-hashes
+	char const journal_magic[] = "LTJOURN1";
+	constexpr int header_size = 8;
+	constexpr int record_header_size = 8;
+
+	char const record_full = 'F';
+	char const record_delta = 'D';
+	char const record_removed = 'R';
+
+	// don't bother compacting journals smaller than this
+	constexpr std::int64_t min_compact_size = 1024 * 1024;
+
+	// the torrent flags saved in resume data, and hence in delta records
+	torrent_flags_t const journal_flags = torrent_flags::seed_mode
+		| torrent_flags::upload_mode
+		| torrent_flags::share_mode
+		| torrent_flags::apply_ip_filter
+		| torrent_flags::paused
+		| torrent_flags::auto_managed
+		| torrent_flags::super_seeding
+		| torrent_flags::i2p_torrent
+		| torrent_flags::sequential_download
+		| torrent_flags::stop_when_ready
+		| torrent_flags::disable_dht
+		| torrent_flags::disable_lsd
+		| torrent_flags::disable_pex
+		| torrent_flags::dormant;
+
+	std::uint32_t checksum(span<char const> buf)
+	{
+		boost::crc_optimal<32, 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF, true, true> crc;
+		crc.process_bytes(buf.data(), std::size_t(buf.size()));
+		return crc.checksum();
+	}
+
+	aux::file_pointer open_file(std::string const& path, char const* mode)
+	{
+#ifdef TORRENT_WINDOWS
+		std::wstring const wmode(mode, mode + std::strlen(mode));
+		return aux::file_pointer(::_wfopen(convert_to_native_path_string(path).c_str()
+			, wmode.c_str()));
+#else
+		return aux::file_pointer(std::fopen(path.c_str(), mode));
+#endif
+	}
+
+	void sync_file(FILE* f, error_code& ec)
+	{
+		if (std::fflush(f) != 0)
+		{
+			ec.assign(errno, generic_category());
+			return;
+		}
+#ifdef TORRENT_WINDOWS
+		if (::_commit(::_fileno(f)) != 0)
+#else
+		if (::fsync(::fileno(f)) != 0)
+#endif
+			ec.assign(errno, generic_category());
+	}
+
+	void write_all(FILE* f, span<char const> buf, error_code& ec)
+	{
+		if (buf.empty()) return;
+		if (std::fwrite(buf.data(), 1, std::size_t(buf.size()), f) != std::size_t(buf.size()))
+			ec.assign(errno, generic_category());
+	}
+
+	// reads the bytes [start, end) of the file. If end is -1, the file is read
+	// until its end
+	void read_range(std::string const& path, std::int64_t const start
+		, std::int64_t const end, std::vector<char>& buf, error_code& ec)
+	{
+		buf.clear();
+		aux::file_pointer f = open_file(path, "rb");
+		if (f.file() == nullptr)
+		{
+			ec.assign(errno, generic_category());
+			return;
+		}
+
+		std::int64_t last = end;
+		if (last < 0)
+		{
+			if (aux::portable_fseeko(f.file(), 0, SEEK_END) < 0)
+			{
+				ec.assign(errno, generic_category());
+				return;
+			}
+			last = std::int64_t(std::ftell(f.file()));
+			if (last < 0)
+			{
+				ec.assign(errno, generic_category());
+				return;
+			}
+		}
+		if (last <= start) return;
+
+		if (aux::portable_fseeko(f.file(), start, SEEK_SET) < 0)
+		{
+			ec.assign(errno, generic_category());
+			return;
+		}
+		buf.resize(std::size_t(last - start));
+		std::size_t const read = std::fread(buf.data(), 1, buf.size(), f.file());
+		if (read != buf.size())
+		{
+			if (std::ferror(f.file()))
+			{
+				ec.assign(errno, generic_category());
+				return;
+			}
+			buf.resize(read);
+		}
+	}
+
+	info_hash_t journal_key(add_torrent_params const& atp)
+	{
+		if (atp.info_hashes.has_v1() || atp.info_hashes.has_v2() || !atp.ti)
+			return atp.info_hashes;
+		return atp.ti->info_hashes();
+	}
+
+	// a hash of all the fields that delta records don't carry. As long as it
+	// doesn't change, a delta is enough to bring the previous record up to date
+	sha1_hash hash_fields(add_torrent_params const& atp)
+	{
+		hasher h;
+		auto const add_int = [&](std::int64_t const v)
+		{
+			char buf[8];
+			char* ptr = buf;
+			aux::write_int64(v, ptr);
+			h.update(buf);
+		};
+		auto const add_str = [&](string_view const s)
+		{
+			add_int(std::int64_t(s.size()));
+			// the hasher doesn't accept empty buffers
+			if (!s.empty()) h.update(s.data(), int(s.size()));
+		};
+		auto const add_bits = [&](bitfield const& b)
+		{
+			add_int(b.size());
+			if (b.num_bytes() > 0) h.update(b.data(), b.num_bytes());
+		};
+
+		add_int(atp.ti ? 1 : 0);
+		add_str(atp.name);
+		add_str(atp.save_path);
+		add_int(atp.storage_mode);
+		add_str(atp.comment);
+		add_str(atp.created_by);
+		add_int(atp.creation_date);
+		add_int(atp.max_uploads);
+		add_int(atp.max_connections);
+		add_int(atp.upload_limit);
+		add_int(atp.download_limit);
+
+		add_int(std::int64_t(atp.trackers.size()));
+		for (auto const& t : atp.trackers) add_str(t);
+		add_int(std::int64_t(atp.tracker_tiers.size()));
+		for (auto const t : atp.tracker_tiers) add_int(t);
+		add_int(std::int64_t(atp.url_seeds.size()));
+		for (auto const& u : atp.url_seeds) add_str(u);
+		add_int(std::int64_t(atp.http_seeds.size()));
+		for (auto const& u : atp.http_seeds) add_str(u);
+
+		add_int(std::int64_t(atp.file_priorities.size()));
+		for (auto const p : atp.file_priorities) add_int(static_cast<std::uint8_t>(p));
+		add_int(std::int64_t(atp.piece_priorities.size()));
+		for (auto const p : atp.piece_priorities) add_int(static_cast<std::uint8_t>(p));
+
+		add_int(std::int64_t(atp.renamed_files.size()));
+		for (auto const& f : atp.renamed_files)
+		{
+			add_int(static_cast<int>(f.first));
+			add_str(f.second);
+		}
+
+		add_int(std::int64_t(atp.banned_peers.size()));
+		for (auto const& ep : atp.banned_peers) add_str(aux::print_endpoint(ep));
+
+		add_int(std::int64_t(atp.merkle_trees.size()));
+		for (auto const& tree : atp.merkle_trees)
+		{
+			add_int(std::int64_t(tree.size()));
+			for (auto const& n : tree) h.update(n.data(), int(n.size()));
+		}
+		add_int(std::int64_t(atp.merkle_tree_mask.size()));
+		for (auto const& m : atp.merkle_tree_mask) add_bits(m);
+		add_int(std::int64_t(atp.verified_leaf_hashes.size()));
+		for (auto const& v : atp.verified_leaf_hashes) add_bits(v);
+
+		return h.final();
+	}
+
+	string_view to_string_view(bitfield const& b)
+	{
+		return {b.data(), std::size_t(b.num_bytes())};
+	}
+
+	// appends a record to ``out``. ``encode`` is expected to append the
+	// record body
+	template <typename Fun>
+	void append_record(std::vector<char>& out, char const type, Fun const& encode)
+	{
+		std::size_t const start = out.size();
+		out.resize(start + record_header_size);
+		out.push_back(type);
+		encode(out);
+
+		span<char const> const payload(out.data() + start + record_header_size
+			, std::ptrdiff_t(out.size() - start - record_header_size));
+		char* ptr = out.data() + start;
+		aux::write_uint32(std::uint32_t(payload.size()), ptr);
+		aux::write_uint32(checksum(payload), ptr);
+	}
+
+	void write_delta(std::vector<char>& out, info_hash_t const& ih
+		, add_torrent_params const& atp, typed_bitfield<piece_index_t> const& prev_have)
+	{
+		using namespace lt::aux::bencode;
+
+		// the pieces we have now, that we didn't have as of the last record.
+		// If we lost any piece, the whole bitfield is saved instead
+		std::vector<piece_index_t> added;
+		bool lost_piece = prev_have.size() > atp.have_pieces.size();
+		for (piece_index_t i(0); !lost_piece && i < atp.have_pieces.end_index(); ++i)
+		{
+			bool const had = i < prev_have.end_index() && prev_have.get_bit(i);
+			if (atp.have_pieces.get_bit(i) == had) continue;
+			if (had) lost_piece = true;
+			else added.push_back(i);
+		}
+		// the list of piece indices takes about 6 bytes per piece. Fall back
+		// to the bitfield once that's larger
+		bool const full_bitfield = lost_piece
+			|| std::int64_t(added.size()) * 6 > atp.have_pieces.num_bytes();
+
+		// the keys are written in sorted order
+		dict d(out);
+		d.add("active_time", atp.active_time);
+		d.add("added_time", atp.added_time);
+		d.add("completed_time", atp.completed_time);
+		d.add("finished_time", atp.finished_time);
+		d.add("flags", std::int64_t(static_cast<std::uint64_t>(atp.flags & journal_flags)));
+		d.add("info-hash", {ih.v1.data(), std::size_t(ih.v1.size())});
+		d.add("info-hash2", {ih.v2.data(), std::size_t(ih.v2.size())});
+		d.add("last_download", atp.last_download);
+		d.add("last_seen_complete", atp.last_seen_complete);
+		d.add("last_upload", atp.last_upload);
+		d.add("num_complete", atp.num_complete);
+		d.add("num_downloaded", atp.num_downloaded);
+		d.add("num_incomplete", atp.num_incomplete);
+		if (full_bitfield)
+		{
+			d.add("pieces", to_string_view(atp.have_pieces));
+		}
+		else if (!added.empty())
+		{
+			d.add_key("pieces-added");
+			list l(out);
+			for (auto const p : added) l.add(static_cast<int>(p));
+		}
+		d.add("seeding_time", atp.seeding_time);
+		d.add("total_downloaded", atp.total_downloaded);
+		d.add("total_uploaded", atp.total_uploaded);
+
+		// unfinished pieces and verified pieces are saved in full, an empty
+		// list means there are none left
+		d.add_key("unfinished");
+		{
+			list up(out);
+			for (auto const& p : atp.unfinished_pieces)
+			{
+				dict piece_struct(out);
+				piece_struct.add("bitmask", {p.second.data(), std::size_t(p.second.size() + 7) / 8});
+				piece_struct.add("piece", static_cast<int>(p.first));
+			}
+		}
+		d.add("verified", to_string_view(atp.verified_pieces));
+	}
+
+	bool apply_delta(span<char const> const body
+		, std::map<info_hash_t, add_torrent_params>& torrents)
+	{
+		error_code ec;
+		bdecode_node const d = bdecode(body, ec);
+		if (ec || d.type() != bdecode_node::dict_t) return false;
+
+		string_view const v1 = d.dict_find_string_value("info-hash");
+		string_view const v2 = d.dict_find_string_value("info-hash2");
+		if (v1.size() != std::size_t(sha1_hash::size())
+			|| v2.size() != std::size_t(sha256_hash::size()))
+			return false;
+
+		auto const it = torrents.find(info_hash_t(sha1_hash(v1.data()), sha256_hash(v2.data())));
+		// a delta without a full record to apply it to. This is not expected
+		// to happen, but there's nothing to apply it to
+		if (it == torrents.end()) return true;
+		add_torrent_params& atp = it->second;
+
+		atp.active_time = int(d.dict_find_int_value("active_time", atp.active_time));
+		atp.added_time = std::time_t(d.dict_find_int_value("added_time", atp.added_time));
+		atp.completed_time = std::time_t(d.dict_find_int_value("completed_time", atp.completed_time));
+		atp.finished_time = int(d.dict_find_int_value("finished_time", atp.finished_time));
+		atp.last_download = std::time_t(d.dict_find_int_value("last_download", atp.last_download));
+		atp.last_seen_complete = std::time_t(d.dict_find_int_value("last_seen_complete", atp.last_seen_complete));
+		atp.last_upload = std::time_t(d.dict_find_int_value("last_upload", atp.last_upload));
+		atp.num_complete = int(d.dict_find_int_value("num_complete", atp.num_complete));
+		atp.num_downloaded = int(d.dict_find_int_value("num_downloaded", atp.num_downloaded));
+		atp.num_incomplete = int(d.dict_find_int_value("num_incomplete", atp.num_incomplete));
+		atp.seeding_time = int(d.dict_find_int_value("seeding_time", atp.seeding_time));
+		atp.total_downloaded = d.dict_find_int_value("total_downloaded", atp.total_downloaded);
+		atp.total_uploaded = d.dict_find_int_value("total_uploaded", atp.total_uploaded);
+
+		if (bdecode_node const flags = d.dict_find_int("flags"))
+		{
+			atp.flags = (atp.flags & ~journal_flags)
+				| (torrent_flags_t(static_cast<std::uint64_t>(flags.int_value())) & journal_flags);
+		}
+
+		if (bdecode_node const pieces = d.dict_find_string("pieces"))
+		{
+			string_view const str = pieces.string_value();
+			atp.have_pieces.assign(str.data(), int(str.size()) * 8);
+		}
+		else if (bdecode_node const added = d.dict_find_list("pieces-added"))
+		{
+			for (int i = 0; i < added.list_size(); ++i)
+			{
+				piece_index_t const p(int(added.list_int_value_at(i, -1)));
+				if (p < piece_index_t(0)) return false;
+				if (p >= atp.have_pieces.end_index())
+					atp.have_pieces.resize((static_cast<int>(p) + 8) & ~7, false);
+				atp.have_pieces.set_bit(p);
+			}
+		}
+
+		if (bdecode_node const unfinished = d.dict_find_list("unfinished"))
+		{
+			atp.unfinished_pieces.clear();
+			for (int i = 0; i < unfinished.list_size(); ++i)
+			{
+				bdecode_node const e = unfinished.list_at(i);
+				if (e.type() != bdecode_node::dict_t) continue;
+				piece_index_t const piece(int(e.dict_find_int_value("piece", -1)));
+				if (piece < piece_index_t(0)) continue;
+
+				bdecode_node const bitmask = e.dict_find_string("bitmask");
+				if (!bitmask || bitmask.string_length() == 0) continue;
+				atp.unfinished_pieces[piece].assign(
+					bitmask.string_ptr(), bitmask.string_length() * 8);
+			}
+		}
+
+		if (bdecode_node const verified = d.dict_find_string("verified"))
+		{
+			string_view const str = verified.string_value();
+			atp.verified_pieces.assign(str.data(), int(str.size()) * 8);
+		}
+		return true;
+	}
+
+	bool apply_record(span<char const> const payload
+		, std::map<info_hash_t, add_torrent_params>& torrents)
+	{
+		span<char const> const body = payload.subspan(1);
+		switch (payload[0])
+		{
+			case record_full:
+			{
+				error_code ec;
+				add_torrent_params atp = read_resume_data(body, ec);
+				if (ec) return false;
+				info_hash_t const ih = journal_key(atp);
+				torrents[ih] = std::move(atp);
+				return true;
+			}
+			case record_delta:
+				return apply_delta(body, torrents);
+			case record_removed:
+			{
+				if (body.size() != sha1_hash::size() + sha256_hash::size()) return false;
+				torrents.erase(info_hash_t(sha1_hash(body.data())
+					, sha256_hash(body.data() + sha1_hash::size())));
+				return true;
+			}
+			default:
+				return false;
+		}
+	}
+
+	// replays the records in ``buf`` into ``torrents``. Returns the number of
+	// bytes that were valid, including the header. Replay stops at the first
+	// record that's cut short or fails its checksum. Such a record, and any
+	// record after it, is considered lost
+	std::int64_t replay(span<char const> const buf
+		, std::map<info_hash_t, add_torrent_params>& torrents)
+	{
+		if (buf.size() < header_size
+			|| std::memcmp(buf.data(), journal_magic, header_size) != 0)
+			return 0;
+
+		std::ptrdiff_t pos = header_size;
+		while (buf.size() - pos >= record_header_size)
+		{
+			char const* ptr = buf.data() + pos;
+			std::ptrdiff_t const len = aux::read_uint32(ptr);
+			std::uint32_t const crc = aux::read_uint32(ptr);
+			if (len == 0 || len > buf.size() - pos - record_header_size) break;
+
+			span<char const> const payload(ptr, len);
+			if (checksum(payload) != crc) break;
+			if (!apply_record(payload, torrents)) break;
+			pos += record_header_size + len;
+		}
+		return pos;
+	}
+
+	// writes a new journal to ``path`` with one full record per torrent. The
+	// file is left open, for the caller to append to
+	aux::file_pointer write_snapshot(std::string const& path
+		, std::map<info_hash_t, add_torrent_params> const& torrents
+		, std::int64_t& size, error_code& ec)
+	{
+		aux::file_pointer f = open_file(path, "wb");
+		if (f.file() == nullptr)
+		{
+			ec.assign(errno, generic_category());
+			return f;
+		}
+
+		std::vector<char> buf(journal_magic, journal_magic + header_size);
+		size = 0;
+		for (auto const& t : torrents)
+		{
+			append_record(buf, record_full, [&](std::vector<char>& out)
+				{ write_resume_data_buf(t.second, out); });
+
+			if (buf.size() < 1024 * 1024) continue;
+			write_all(f.file(), buf, ec);
+			if (ec) return f;
+			size += std::int64_t(buf.size());
+			buf.clear();
+		}
+		write_all(f.file(), buf, ec);
+		size += std::int64_t(buf.size());
+		return f;
+	}
+
+	// makes the snapshot in ``tmp`` durable and moves it into place
+	void replace_journal(aux::file_pointer f, std::string const& tmp
+		, std::string const& path, error_code& ec)
+	{
+		sync_file(f.file(), ec);
+		f = aux::file_pointer();
+		if (ec) return;
+#ifdef TORRENT_WINDOWS
+		// rename() fails on windows if the target exists
+		error_code ignore;
+		remove(path, ignore);
+#endif
+		rename(tmp, path, ec);
+	}
+}
+
+	resume_journal::resume_journal(std::string path)
+		: m_path(std::move(path))
+	{}
+
+	resume_journal::~resume_journal()
+	{
+		join_compaction();
+	}
+
+	std::vector<add_torrent_params> resume_journal::open(error_code& ec)
+	{
+		join_compaction();
+		ec.clear();
+
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_file = aux::file_pointer();
+		m_torrents.clear();
+		m_compaction_error.clear();
+		m_size = 0;
+		m_compacted_size = 0;
+
+		std::vector<char> buf;
+		read_range(m_path, 0, -1, buf, ec);
+		if (ec == boost::system::errc::no_such_file_or_directory) ec.clear();
+		if (ec) return {};
+
+		// don't overwrite a file that isn't a journal
+		if (buf.size() >= header_size
+			&& std::memcmp(buf.data(), journal_magic, header_size) != 0)
+		{
+			ec = errors::invalid_file_tag;
+			return {};
+		}
+
+		std::map<info_hash_t, add_torrent_params> torrents;
+		std::int64_t const valid = replay(buf, torrents);
+
+		if (valid < header_size || valid < std::int64_t(buf.size()))
+		{
+			// the journal doesn't exist or ends with a partial record. Rewrite
+			// it, to have new records be appended after the last valid one
+			std::string const tmp = m_path + ".tmp";
+			std::int64_t size = 0;
+			aux::file_pointer f = write_snapshot(tmp, torrents, size, ec);
+			if (ec) return {};
+			replace_journal(std::move(f), tmp, m_path, ec);
+			if (ec) return {};
+			m_size = size;
+		}
+		else
+		{
+			m_size = valid;
+		}
+		m_compacted_size = m_size;
+
+		m_file = open_file(m_path, "ab");
+		if (m_file.file() == nullptr)
+		{
+			ec.assign(errno, generic_category());
+			return {};
+		}
+
+		// remember what was replayed, for the next append() of these torrents
+		// to write a delta rather than a full record
+		std::vector<add_torrent_params> ret;
+		ret.reserve(torrents.size());
+		for (auto& t : torrents)
+		{
+			torrent_state& st = m_torrents[t.first];
+			st.fields = hash_fields(t.second);
+			st.have_pieces = t.second.have_pieces;
+			ret.push_back(std::move(t.second));
+		}
+		return ret;
+	}
+
+	void resume_journal::append(add_torrent_params const& atp, error_code& ec)
+	{
+		ec.clear();
+		info_hash_t const ih = journal_key(atp);
+		sha1_hash const fields = hash_fields(atp);
+
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_buffer.clear();
+		auto const it = m_torrents.find(ih);
+		if (it != m_torrents.end() && it->second.fields == fields)
+		{
+			append_record(m_buffer, record_delta, [&](std::vector<char>& out)
+				{ write_delta(out, ih, atp, it->second.have_pieces); });
+		}
+		else
+		{
+			append_record(m_buffer, record_full, [&](std::vector<char>& out)
+				{ write_resume_data_buf(atp, out); });
+		}
+
+		write_buffer(ec);
+		if (ec) return;
+
+		torrent_state& st = m_torrents[ih];
+		st.fields = fields;
+		st.have_pieces = atp.have_pieces;
+		maybe_compact();
+	}
+
+	void resume_journal::remove(info_hash_t const& ih, error_code& ec)
+	{
+		ec.clear();
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_buffer.clear();
+		append_record(m_buffer, record_removed, [&](std::vector<char>& out)
+		{
+			out.insert(out.end(), ih.v1.begin(), ih.v1.end());
+			out.insert(out.end(), ih.v2.begin(), ih.v2.end());
+		});
+		write_buffer(ec);
+		if (ec) return;
+		m_torrents.erase(ih);
+		maybe_compact();
+	}
+
+	void resume_journal::flush(error_code& ec)
+	{
+		ec.clear();
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_compaction_error)
+		{
+			ec = m_compaction_error;
+			m_compaction_error.clear();
+			return;
+		}
+		if (m_file.file() == nullptr)
+		{
+			ec = error_code(boost::system::errc::bad_file_descriptor, generic_category());
+			return;
+		}
+		sync_file(m_file.file(), ec);
+	}
+
+	void resume_journal::compact(error_code& ec)
+	{
+		ec.clear();
+		join_compaction();
+		compact_impl(ec);
+	}
+
+	std::int64_t resume_journal::size() const
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		return m_size;
+	}
+
+	void resume_journal::write_buffer(error_code& ec)
+	{
+		if (m_file.file() == nullptr)
+		{
+			ec = error_code(boost::system::errc::bad_file_descriptor, generic_category());
+			return;
+		}
+		write_all(m_file.file(), m_buffer, ec);
+		if (ec)
+		{
+			// the journal may end with a partial record now. Any record
+			// appended after it would be lost, so stop appending until the
+			// journal is opened (and repaired) again
+			m_file = aux::file_pointer();
+			return;
+		}
+		m_size += std::int64_t(m_buffer.size());
+	}
+
+	void resume_journal::maybe_compact()
+	{
+		if (m_compacting) return;
+		if (m_size <= std::max(min_compact_size, m_compacted_size * 2)) return;
+
+		// the previous compaction thread has completed, but it may not have
+		// been joined yet
+		if (m_compaction.joinable()) m_compaction.join();
+
+		m_compacting = true;
+		m_compaction = std::thread([this]
+		{
+			error_code ec;
+			compact_impl(ec);
+			std::lock_guard<std::mutex> l(m_mutex);
+			if (ec)
+			{
+				m_compaction_error = ec;
+				// don't retry until the journal has grown some more
+				m_compacted_size = m_size;
+			}
+			m_compacting = false;
+		});
+	}
+
+	void resume_journal::compact_impl(error_code& ec)
+	{
+		std::int64_t end = 0;
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			if (m_file.file() == nullptr)
+			{
+				ec = error_code(boost::system::errc::bad_file_descriptor, generic_category());
+				return;
+			}
+			if (std::fflush(m_file.file()) != 0)
+			{
+				ec.assign(errno, generic_category());
+				return;
+			}
+			end = m_size;
+		}
+
+		// records may be appended while we replay the journal and write the
+		// snapshot. They're copied over once the snapshot is complete
+		std::map<info_hash_t, add_torrent_params> torrents;
+		{
+			std::vector<char> buf;
+			read_range(m_path, 0, end, buf, ec);
+			if (ec) return;
+			replay(buf, torrents);
+		}
+
+		std::string const tmp = m_path + ".tmp";
+		std::int64_t size = 0;
+		aux::file_pointer f = write_snapshot(tmp, torrents, size, ec);
+		if (ec) return;
+		torrents.clear();
+
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_file.file() == nullptr)
+		{
+			ec = error_code(boost::system::errc::bad_file_descriptor, generic_category());
+			return;
+		}
+		if (m_size > end)
+		{
+			if (std::fflush(m_file.file()) != 0)
+			{
+				ec.assign(errno, generic_category());
+				return;
+			}
+			std::vector<char> tail;
+			read_range(m_path, end, m_size, tail, ec);
+			if (ec) return;
+			write_all(f.file(), tail, ec);
+			if (ec) return;
+			size += std::int64_t(tail.size());
+		}
+
+		// the journal has to be closed before it can be replaced on windows
+		m_file = aux::file_pointer();
+		replace_journal(std::move(f), tmp, m_path, ec);
+
+		// if replacing the journal failed, keep appending to the old one
+		m_file = open_file(m_path, "ab");
+		if (m_file.file() == nullptr)
+		{
+			if (!ec) ec.assign(errno, generic_category());
+			return;
+		}
+		if (ec) return;
+		m_size = size;
+		m_compacted_size = size;
+	}
+
+	void resume_journal::join_compaction()
+	{
+		if (m_compaction.joinable()) m_compaction.join();
+	}
+}
@@ -281,6 +281,7 @@ namespace {
 
 		if (!params.ip_filter.empty())
 		{
+			params.ip_filter.compile();
 			std::shared_ptr<ip_filter> copy = std::make_shared<ip_filter>(std::move(params.ip_filter));
 			m_impl->set_ip_filter(std::move(copy));
 		}
@@ -784,6 +784,9 @@ namespace {
 
 	void session_handle::set_ip_filter(ip_filter f)
 	{
+		// compile the filter on the caller's thread, rather than the network
+		// thread
+		f.compile();
 		std::shared_ptr<ip_filter> copy = std::make_shared<ip_filter>(std::move(f));
 		async_call(&session_impl::set_ip_filter, std::move(copy));
 	}
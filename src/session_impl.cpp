@@ -36,6 +36,7 @@ see LICENSE file.
 #include <functional>
 #include <type_traits>
 #include <numeric> // for accumulate
+#include <stdexcept>
 
 #if TORRENT_USE_INVARIANT_CHECKS
 #include <unordered_set>
@@ -72,6 +73,7 @@ see LICENSE file.
 #include "libtorrent/natpmp.hpp"
 #include "libtorrent/aux_/lsd.hpp"
 #include "libtorrent/aux_/instantiate_connection.hpp"
+#include "libtorrent/aux_/utp_channel.hpp"
 #include "libtorrent/peer_info.hpp"
 #include "libtorrent/aux_/random.hpp"
 #include "libtorrent/magnet_uri.hpp"
@@ -476,11 +478,27 @@ bool ssl_server_name_callback(ssl::stream_handle_type stream_handle, std::string
 	} // anonymous namespace
 #endif // TORRENT_SSL_PEERS
 
+namespace {
+
+	std::unique_ptr<io_thread> make_utp_thread(session_settings const& sett)
+	{
+#ifdef TORRENT_BUILD_SIMULATOR
+		// the simulation runs everything on a single io_context
+		TORRENT_UNUSED(sett);
+		return {};
+#else
+		if (!sett.get_bool(settings_pack::utp_io_thread)) return {};
+		return std::make_unique<io_thread>("libtorrent-utp-thread");
+#endif
+	}
+}
+
 	session_impl::session_impl(io_context& ioc, settings_pack const& pack
 		, disk_io_constructor_type disk_io_constructor
 		, session_flags_t const flags)
 		: m_settings(pack)
 		, m_io_context(ioc)
+		, m_utp_thread(make_utp_thread(m_settings))
 #if TORRENT_USE_SSL
 		, m_ssl_ctx(ssl::context::tls_client)
 #ifdef TORRENT_SSL_PEERS
@@ -517,23 +535,38 @@ bool ssl_server_name_callback(ssl::stream_handle_type stream_handle, std::string
 		, m_dht_announce_timer(m_io_context)
 #endif
 		, m_utp_socket_manager(
-			std::bind(&session_impl::send_udp_packet, this, _1, _2, _3, _4, _5)
-			, [this](socket_type s) { this->incoming_connection(std::move(s)); }
-			, m_io_context
+			std::bind(&session_impl::send_udp_packet_direct, this, _1, _2, _3, _4, _5)
+			, [this](socket_type s)
+			{
+				if (m_utp_thread) on_utp_thread_incoming(std::move(s), transport::plaintext);
+				else incoming_connection(std::move(s));
+			}
+			, utp_context()
 			, m_settings, m_stats_counters, nullptr)
 #ifdef TORRENT_SSL_PEERS
+		// when uTP runs on its own thread, the SSL stream of an incoming
+		// connection is added on the network thread, by on_utp_thread_incoming()
 		, m_ssl_utp_socket_manager(
-			std::bind(&session_impl::send_udp_packet, this, _1, _2, _3, _4, _5)
-			, std::bind(&session_impl::on_incoming_utp_ssl, this, _1)
-			, m_io_context
+			std::bind(&session_impl::send_udp_packet_direct, this, _1, _2, _3, _4, _5)
+			, [this](socket_type s)
+			{
+				if (m_utp_thread) on_utp_thread_incoming(std::move(s), transport::ssl);
+				else on_incoming_utp_ssl(std::move(s));
+			}
+			, utp_context()
 			, m_settings, m_stats_counters
-			, &m_peer_ssl_ctx)
+			, m_utp_thread ? nullptr : &m_peer_ssl_ctx)
 #endif
 		, m_timer(m_io_context)
 		, m_lsd_announce_timer(m_io_context)
 		, m_close_file_timer(m_io_context)
 		, m_paused(flags & session::paused)
 	{
+		if (m_utp_thread)
+		{
+			m_utp_tick_timer.emplace(utp_context());
+			m_utp_resolver.emplace(utp_context());
+		}
 #if !defined TORRENT_DISABLE_LOGGING || TORRENT_USE_ASSERTS
 		validate_settings();
 #endif
@@ -698,6 +731,12 @@ bool ssl_server_name_callback(ssl::stream_handle_type stream_handle, std::string
 #endif
 		post(m_io_context, [this]{ wrap(&session_impl::on_tick, error_code()); });
 
+		if (m_utp_thread)
+		{
+			ADD_OUTSTANDING_ASYNC("session_impl::on_utp_tick");
+			post(utp_context(), [this]{ on_utp_tick(error_code()); });
+		}
+
 		int const lsd_announce_interval
 			= m_settings.get_int(settings_pack::local_service_announce_interval);
 		int const delay = std::max(lsd_announce_interval
@@ -1103,7 +1142,7 @@ bool ssl_server_name_callback(ssl::stream_handle_type stream_handle, std::string
 			// the uTP connections cannot be closed gracefully
 			if (l->udp_sock)
 			{
-				l->udp_sock->sock.close();
+				udp_call([us = l->udp_sock] { us->sock.close(); });
 			}
 		}
 
@@ -1178,6 +1217,8 @@ bool ssl_server_name_callback(ssl::stream_handle_type stream_handle, std::string
 	{
 		TORRENT_ASSERT(is_single_thread());
 		if (!m_ip_filter) m_ip_filter = std::make_shared<ip_filter>();
+		// a rule for a single address leaves a compiled filter compiled, it's
+		// kept in a small side table instead of rebuilding the whole filter
 		m_ip_filter->add_rule(addr, addr, ip_filter::blocked);
 		for (auto& i : m_torrents)
 			i->set_ip_filter(m_ip_filter);
@@ -1802,7 +1843,9 @@ retry:
 		{
 			udp_bind_ep.port(bind_ep.port());
 
-			ret->udp_sock = std::make_shared<session_udp_socket>(m_io_context, ret);
+			// the socket's handlers, and with them the uTP socket managers, run
+			// on the uTP thread, if there is one
+			ret->udp_sock = std::make_shared<session_udp_socket>(utp_context(), ret);
 			ret->udp_sock->sock.open(udp_bind_ep.protocol(), ec);
 			if (ec)
 			{
@@ -1885,6 +1928,7 @@ retry:
 
 				return ret;
 			}
+			ret->udp_sock->cache_local_endpoint();
 		}
 
 		if (bind_ep.port() != udp_bind_ep.port())
@@ -1914,21 +1958,28 @@ retry:
 		if (err)
 		{
 			if (m_alerts.should_post<udp_error_alert>())
-				m_alerts.emplace_alert<udp_error_alert>(ret->udp_sock->sock.local_endpoint(ec)
+				m_alerts.emplace_alert<udp_error_alert>(ret->udp_sock->local_endpoint()
 					, operation_t::alloc_recvbuf, err);
 		}
 
-		// this call is necessary here because, unless the settings actually
-		// change after the session is up and listening, at no other point
-		// set_proxy_settings is called with the correct proxy configuration,
-		// internally, this method handle the SOCKS5's connection logic
-		ret->udp_sock->sock.set_proxy_settings(proxy(), m_alerts, get_resolver()
-			, settings().get_bool(settings_pack::socks5_udp_send_local_ep));
+		// from here on, the UDP socket is only used by the thread running
+		// utp_context()
+		udp_call([this, ret, us = ret->udp_sock, ps = proxy()
+			, send_local_ep = settings().get_bool(settings_pack::socks5_udp_send_local_ep)]
+		{
+			us->sock.thread_started();
 
-		ADD_OUTSTANDING_ASYNC("session_impl::on_udp_packet");
-		ret->udp_sock->sock.async_read(aux::make_handler([this, ret](error_code const& e)
-			{ this->on_udp_packet(ret->udp_sock, ret, ret->ssl, e); }
-			, ret->udp_handler_storage, *this));
+			// this call is necessary here because, unless the settings actually
+			// change after the session is up and listening, at no other point
+			// set_proxy_settings is called with the correct proxy configuration,
+			// internally, this method handle the SOCKS5's connection logic
+			us->sock.set_proxy_settings(ps, m_alerts, udp_resolver(), send_local_ep);
+
+			ADD_OUTSTANDING_ASYNC("session_impl::on_udp_packet");
+			us->sock.async_read(aux::make_handler([this, ret](error_code const& e)
+				{ this->on_udp_packet(ret->udp_sock, ret, ret->ssl, e); }
+				, ret->udp_handler_storage, udp_error_handler()));
+		});
 
 #ifndef TORRENT_DISABLE_LOGGING
 		if (should_log())
@@ -2138,7 +2189,8 @@ retry:
 			}
 #endif
 			if ((*remove_iter)->sock) (*remove_iter)->sock->close(ec);
-			if ((*remove_iter)->udp_sock) (*remove_iter)->udp_sock->sock.close();
+			if ((*remove_iter)->udp_sock)
+				udp_call([us = (*remove_iter)->udp_sock] { us->sock.close(); });
 			if ((*remove_iter)->natpmp_mapper) (*remove_iter)->natpmp_mapper->close();
 			if ((*remove_iter)->upnp_mapper) (*remove_iter)->upnp_mapper->close();
 			if ((*remove_iter)->lsd) (*remove_iter)->lsd->close();
@@ -2231,8 +2283,9 @@ retry:
 
 				if (l->udp_sock)
 				{
-					udp::endpoint const udp_ep = l->udp_sock->sock.local_endpoint(err);
-					if (!err && l->udp_sock->sock.is_open())
+					// the endpoint is only cached once the socket has been bound
+					udp::endpoint const udp_ep = l->udp_sock->local_endpoint();
+					if (udp_ep.port() != 0)
 					{
 						socket_type_t const socket_type
 							= l->ssl == transport::ssl
@@ -2324,7 +2377,7 @@ retry:
 		, listen_socket_t& s)
 	{
 		tcp::endpoint const tcp_ep = s.sock ? s.sock->local_endpoint() : tcp::endpoint();
-		udp::endpoint const udp_ep = s.udp_sock ? s.udp_sock->sock.local_endpoint() : udp::endpoint();
+		udp::endpoint const udp_ep = s.udp_sock ? s.udp_sock->local_endpoint() : udp::endpoint();
 
 		if ((mask & remap_natpmp) && s.natpmp_mapper)
 		{
@@ -2456,6 +2509,47 @@ retry:
 		, span<char const> p
 		, error_code& ec
 		, udp_send_flags_t const flags)
+	{
+		if (!m_utp_thread)
+		{
+			send_udp_packet_hostname_direct(std::move(sock), hostname, port, p, ec, flags);
+			return;
+		}
+
+		post(utp_context(), [this, sock = std::move(sock), host = std::string(hostname)
+			, port, buf = std::vector<char>(p.begin(), p.end()), flags]
+		{
+			error_code err;
+			send_udp_packet_hostname_direct(sock, host.c_str(), port, buf, err, flags);
+		});
+	}
+
+	void session_impl::send_udp_packet(std::weak_ptr<utp_socket_interface> sock
+		, udp::endpoint const& ep
+		, span<char const> p
+		, error_code& ec
+		, udp_send_flags_t const flags)
+	{
+		if (!m_utp_thread)
+		{
+			send_udp_packet_direct(std::move(sock), ep, p, ec, flags);
+			return;
+		}
+
+		post(utp_context(), [this, sock = std::move(sock), ep
+			, buf = std::vector<char>(p.begin(), p.end()), flags]
+		{
+			error_code err;
+			send_udp_packet_direct(sock, ep, buf, err, flags);
+		});
+	}
+
+	void session_impl::send_udp_packet_hostname_direct(std::weak_ptr<utp_socket_interface> sock
+		, char const* hostname
+		, int const port
+		, span<char const> p
+		, error_code& ec
+		, udp_send_flags_t const flags)
 	{
 		auto si = sock.lock();
 		if (!si)
@@ -2464,7 +2558,8 @@ retry:
 			return;
 		}
 
-		auto s = std::static_pointer_cast<aux::listen_socket_t>(si)->udp_sock;
+		auto ls = std::static_pointer_cast<aux::listen_socket_t>(si);
+		auto s = ls->udp_sock;
 
 		s->sock.send_hostname(hostname, port, p, ec, flags);
 
@@ -2474,11 +2569,11 @@ retry:
 			s->write_blocked = true;
 			ADD_OUTSTANDING_ASYNC("session_impl::on_udp_writeable");
 			s->sock.async_write(std::bind(&session_impl::on_udp_writeable
-				, this, s, _1));
+				, this, s, ls->ssl, _1));
 		}
 	}
 
-	void session_impl::send_udp_packet(std::weak_ptr<utp_socket_interface> sock
+	void session_impl::send_udp_packet_direct(std::weak_ptr<utp_socket_interface> sock
 		, udp::endpoint const& ep
 		, span<char const> p
 		, error_code& ec
@@ -2491,7 +2586,8 @@ retry:
 			return;
 		}
 
-		auto s = std::static_pointer_cast<aux::listen_socket_t>(si)->udp_sock;
+		auto ls = std::static_pointer_cast<aux::listen_socket_t>(si);
+		auto s = ls->udp_sock;
 
 		// the destination address family matching the local socket's address
 		// family does not hold for proxies that we talk to over IPv4 but can
@@ -2507,11 +2603,12 @@ retry:
 			s->write_blocked = true;
 			ADD_OUTSTANDING_ASYNC("session_impl::on_udp_writeable");
 			s->sock.async_write(std::bind(&session_impl::on_udp_writeable
-				, this, s, _1));
+				, this, s, ls->ssl, _1));
 		}
 	}
 
-	void session_impl::on_udp_writeable(std::weak_ptr<session_udp_socket> sock, error_code const& ec)
+	void session_impl::on_udp_writeable(std::weak_ptr<session_udp_socket> sock
+		, transport const ssl, error_code const& ec)
 	{
 		COMPLETE_ASYNC("session_impl::on_udp_writeable");
 		if (ec) return;
@@ -2521,23 +2618,19 @@ retry:
 
 		s->write_blocked = false;
 
-#ifdef TORRENT_SSL_PEERS
-		auto i = std::find_if(
-			m_listen_sockets.begin(), m_listen_sockets.end()
-			, [&s] (std::shared_ptr<listen_socket_t> const& ls) { return ls->udp_sock == s; });
-#endif
-
 		// notify the utp socket manager it can start sending on the socket again
 		struct utp_socket_manager& mgr =
 #ifdef TORRENT_SSL_PEERS
-			(i != m_listen_sockets.end() && (*i)->ssl == transport::ssl) ? m_ssl_utp_socket_manager :
+			ssl == transport::ssl ? m_ssl_utp_socket_manager :
 #endif
 			m_utp_socket_manager;
+#ifndef TORRENT_SSL_PEERS
+		TORRENT_UNUSED(ssl);
+#endif
 
 		mgr.writable();
 	}
 
-
 	void session_impl::on_udp_packet(std::weak_ptr<session_udp_socket> socket
 		, std::weak_ptr<listen_socket_t> ls, transport const ssl, error_code const& ec)
 	{
@@ -2586,52 +2679,15 @@ retry:
 
 			for (udp_socket::packet& packet : span<udp_socket::packet>(p).first(num_packets))
 			{
-				if (packet.error)
-				{
-					// TODO: 3 it would be neat if the utp socket manager would
-					// handle ICMP errors too
-
-#ifndef TORRENT_DISABLE_DHT
-					if (m_dht)
-						m_dht->incoming_error(packet.error, packet.from);
-#endif
-
-					m_tracker_manager.incoming_error(packet.error, packet.from);
-					continue;
-				}
-
-				span<char const> const buf = packet.data;
-				if (!packet.hostname.empty())
-				{
-					// only the tracker manager supports receiving UDP packets
-					// from hostnames. If it won't handle it, no one else will
-					// either
-					m_tracker_manager.incoming_packet(packet.hostname, buf);
-					continue;
-				}
-
 				// give the uTP socket manager first dibs on the packet. Presumably
 				// the majority of packets are uTP packets.
-				if (!mgr.incoming_packet(ls, packet.from, buf))
+				if (packet.error
+					|| !packet.hostname.empty()
+					|| !mgr.incoming_packet(ls, packet.from, packet.data))
 				{
 					// if it wasn't a uTP packet, try the other users of the UDP
 					// socket
-					bool handled = false;
-#ifndef TORRENT_DISABLE_DHT
-					auto listen_socket = ls.lock();
-					if (m_dht && buf.size() > 20
-						&& buf.front() == 'd'
-						&& buf.back() == 'e'
-						&& listen_socket)
-					{
-						handled = m_dht->incoming_packet(listen_socket, packet.from, buf);
-					}
-#endif
-
-					if (!handled)
-					{
-						m_tracker_manager.incoming_packet(packet.from, buf);
-					}
+					dispatch_udp_packet(ls, packet);
 				}
 			}
 
@@ -2694,7 +2750,128 @@ retry:
 		ADD_OUTSTANDING_ASYNC("session_impl::on_udp_packet");
 		s->sock.async_read(make_handler([this, socket, ls, ssl](error_code const& e)
 			{ this->on_udp_packet(std::move(socket), std::move(ls), ssl, e); }
-			, s->udp_handler_storage, *this));
+			, s->udp_handler_storage, udp_error_handler()));
+	}
+
+	void session_impl::dispatch_udp_packet(std::weak_ptr<listen_socket_t> const& ls
+		, udp_socket::packet const& packet)
+	{
+		if (!m_utp_thread)
+		{
+			handle_udp_packet(ls, packet);
+			return;
+		}
+
+		// the packet's buffer is reused by the next read() on the socket, the
+		// network thread gets a copy
+		post(m_io_context, [this, ls, from = packet.from, error = packet.error
+			, hostname = std::string(packet.hostname)
+			, buf = std::vector<char>(packet.data.begin(), packet.data.end())]() mutable
+		{
+			udp_socket::packet p;
+			p.data = buf;
+			p.from = from;
+			p.hostname = hostname;
+			p.error = error;
+			handle_udp_packet(ls, p);
+		});
+	}
+
+	void session_impl::handle_udp_packet(std::weak_ptr<listen_socket_t> const& ls
+		, udp_socket::packet const& packet)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		if (packet.error)
+		{
+			// TODO: 3 it would be neat if the utp socket manager would
+			// handle ICMP errors too
+
+#ifndef TORRENT_DISABLE_DHT
+			if (m_dht)
+				m_dht->incoming_error(packet.error, packet.from);
+#endif
+
+			m_tracker_manager.incoming_error(packet.error, packet.from);
+			return;
+		}
+
+		span<char const> const buf = packet.data;
+		if (!packet.hostname.empty())
+		{
+			// only the tracker manager supports receiving UDP packets
+			// from hostnames. If it won't handle it, no one else will
+			// either
+			m_tracker_manager.incoming_packet(packet.hostname, buf);
+			return;
+		}
+
+		bool handled = false;
+#ifndef TORRENT_DISABLE_DHT
+		auto listen_socket = ls.lock();
+		if (m_dht && buf.size() > 20
+			&& buf.front() == 'd'
+			&& buf.back() == 'e'
+			&& listen_socket)
+		{
+			handled = m_dht->incoming_packet(listen_socket, packet.from, buf);
+		}
+#else
+		TORRENT_UNUSED(ls);
+#endif
+
+		if (!handled)
+		{
+			m_tracker_manager.incoming_packet(packet.from, buf);
+		}
+	}
+
+	error_handler_interface& session_impl::udp_error_handler()
+	{
+		if (m_utp_thread) return m_utp_error_handler;
+		return *this;
+	}
+
+	void session_impl::utp_error_handler_t::on_exception(std::exception const& e)
+	{
+		post(m_ses.m_io_context, [&s = m_ses, what = std::string(e.what())]
+			{ s.on_exception(std::runtime_error(what)); });
+	}
+
+	void session_impl::utp_error_handler_t::on_error(error_code const& ec)
+	{
+		post(m_ses.m_io_context, [&s = m_ses, ec] { s.on_error(ec); });
+	}
+
+	void session_impl::on_utp_thread_incoming(socket_type s, transport const ssl)
+	{
+		// this is called on the uTP thread, by the socket manager accepting a
+		// connection. The uTP stream stays on this thread, the network thread
+		// gets a stream forwarding to it through a channel
+		struct utp_socket_manager& mgr =
+#ifdef TORRENT_SSL_PEERS
+			ssl == transport::ssl ? m_ssl_utp_socket_manager :
+#endif
+			m_utp_socket_manager;
+		auto ch = utp_channel::accept(m_io_context, mgr, std::move(std::get<utp_stream>(s)));
+
+		post(m_io_context, [this, ch = std::move(ch), ssl]() mutable
+		{
+#ifdef TORRENT_SSL_PEERS
+			if (ssl == transport::ssl)
+			{
+				ssl_stream<utp_stream> str(m_io_context, m_peer_ssl_ctx);
+				str.next_layer().set_channel(std::move(ch));
+				on_incoming_utp_ssl(socket_type(std::move(str)));
+				return;
+			}
+#else
+			TORRENT_UNUSED(ssl);
+#endif
+			utp_stream str(m_io_context);
+			str.set_channel(std::move(ch));
+			incoming_connection(socket_type(std::move(str)));
+		});
 	}
 
 	void session_impl::async_accept(std::shared_ptr<tcp::acceptor> const& listener
@@ -3369,6 +3546,68 @@ retry:
 		m_stat.received_synack(ipv6);
 	}
 
+	int session_impl::num_utp_sockets() const
+	{
+		if (m_utp_thread) return m_utp_num_sockets.load(std::memory_order_relaxed);
+		return m_utp_socket_manager.num_sockets()
+#ifdef TORRENT_SSL_PEERS
+			+ m_ssl_utp_socket_manager.num_sockets()
+#endif
+			;
+	}
+
+	// when uTP runs on its own thread, this replaces the ticking of the socket
+	// managers in on_tick()
+	void session_impl::on_utp_tick(error_code const& e)
+	{
+		COMPLETE_ASYNC("session_impl::on_utp_tick");
+		if (e) return;
+
+		time_point const now = aux::time_now();
+
+		m_utp_socket_manager.tick(now);
+#ifdef TORRENT_SSL_PEERS
+		m_ssl_utp_socket_manager.tick(now);
+#endif
+
+		if (now - m_last_utp_decay >= seconds(1))
+		{
+			m_last_utp_decay = now;
+			m_utp_socket_manager.decay();
+#ifdef TORRENT_SSL_PEERS
+			m_ssl_utp_socket_manager.decay();
+#endif
+		}
+
+		m_utp_num_sockets.store(m_utp_socket_manager.num_sockets()
+#ifdef TORRENT_SSL_PEERS
+			+ m_ssl_utp_socket_manager.num_sockets()
+#endif
+			, std::memory_order_relaxed);
+
+		ADD_OUTSTANDING_ASYNC("session_impl::on_utp_tick");
+		m_utp_tick_timer->expires_at(now + milliseconds(m_settings.get_int(settings_pack::tick_interval)));
+		m_utp_tick_timer->async_wait([this](error_code const& err) { on_utp_tick(err); });
+	}
+
+	void session_impl::stop_utp_thread()
+	{
+		if (!m_utp_thread || !m_utp_thread->is_running()) return;
+
+		// the uTP streams still attached to the socket managers are closed on
+		// the uTP thread. They would otherwise outlive the managers
+		post(utp_context(), [this]
+		{
+			m_utp_tick_timer->cancel();
+			m_utp_resolver->abort();
+			m_utp_socket_manager.close_channels();
+#ifdef TORRENT_SSL_PEERS
+			m_ssl_utp_socket_manager.close_channels();
+#endif
+		});
+		m_utp_thread->stop();
+	}
+
 	void session_impl::on_tick(error_code const& e)
 	{
 		COMPLETE_ASYNC("session_impl::on_tick");
@@ -3406,26 +3645,18 @@ retry:
 		// there are outstanding announces
 		if (m_abort)
 		{
-			if (m_utp_socket_manager.num_sockets() == 0
-#ifdef TORRENT_SSL_PEERS
-				&& m_ssl_utp_socket_manager.num_sockets() == 0
-#endif
+			if (num_utp_sockets() == 0
 				&& m_undead_peers.empty()
 				&& m_tracker_manager.empty())
 			{
 				// this is where shutdown completes. We won't issue another
 				// on_tick()
+				stop_utp_thread();
 				return;
 			}
 #if defined TORRENT_ASIO_DEBUGGING
-			std::fprintf(stderr, "uTP sockets: %d ssl-uTP sockets: %d undead-peers left: %d\n"
-				, m_utp_socket_manager.num_sockets()
-#ifdef TORRENT_SSL_PEERS
-				, m_ssl_utp_socket_manager.num_sockets()
-#else
-				, 0
-#endif
-				, int(m_undead_peers.size()));
+			std::fprintf(stderr, "uTP sockets: %d undead-peers left: %d\n"
+				, num_utp_sockets(), int(m_undead_peers.size()));
 #endif
 		}
 
@@ -3449,10 +3680,13 @@ retry:
 
 		m_last_tick = now;
 
-		m_utp_socket_manager.tick(now);
+		if (!m_utp_thread)
+		{
+			m_utp_socket_manager.tick(now);
 #ifdef TORRENT_SSL_PEERS
-		m_ssl_utp_socket_manager.tick(now);
+			m_ssl_utp_socket_manager.tick(now);
 #endif
+		}
 
 		// only tick the following once per second
 		if (now - m_last_second_tick < seconds(1)) return;
@@ -3464,10 +3698,13 @@ retry:
 			update_dht_announce_interval();
 #endif
 
-		m_utp_socket_manager.decay();
+		if (!m_utp_thread)
+		{
+			m_utp_socket_manager.decay();
 #ifdef TORRENT_SSL_PEERS
-		m_ssl_utp_socket_manager.decay();
+			m_ssl_utp_socket_manager.decay();
 #endif
+		}
 
 		int const tick_interval_ms = aux::numeric_cast<int>(total_milliseconds(now - m_last_second_tick));
 		m_last_second_tick = now;
@@ -4818,6 +5055,19 @@ retry:
 		m_stats_counters.set_value(counters::limiter_down_bytes
 			, m_download_rate.queued_bytes());
 
+		connection_memory mem;
+		for (auto const& p : m_connections) p->memory_usage(mem);
+		m_stats_counters.set_value(counters::peer_object_bytes, mem.objects);
+		m_stats_counters.set_value(counters::peer_recv_buffer_bytes, mem.recv_buffers);
+		m_stats_counters.set_value(counters::peer_send_buffer_bytes, mem.send_buffers);
+		m_stats_counters.set_value(counters::peer_queue_bytes, mem.queues);
+		m_stats_counters.set_value(counters::peer_bitfield_bytes, mem.bitfields);
+
+		m_stats_counters.set_value(counters::num_checking_devices
+			, m_checking_scheduler.num_active_devices());
+		m_stats_counters.set_value(counters::queued_checking_torrents
+			, m_checking_scheduler.num_queued());
+
 		m_alerts.emplace_alert<session_stats_alert>(m_stats_counters);
 	}
 
@@ -5157,17 +5407,17 @@ retry:
 			// TODO: factor out this logic into a separate function for unit
 			// testing
 
-			utp_socket_impl* impl = nullptr;
+			utp_stream* str = nullptr;
 			transport ssl = transport::plaintext;
 #if TORRENT_USE_SSL
 			if (std::get_if<ssl_stream<utp_stream>>(&s.var()) != nullptr)
 			{
-				impl = std::get<ssl_stream<utp_stream>>(s).next_layer().get_impl();
+				str = &std::get<ssl_stream<utp_stream>>(s).next_layer();
 				ssl = transport::ssl;
 			}
 			else
 #endif
-				impl = std::get<utp_stream>(s).get_impl();
+				str = &std::get<utp_stream>(s);
 
 			std::vector<std::shared_ptr<listen_socket_t>> with_gateways;
 			std::shared_ptr<listen_socket_t> match;
@@ -5193,7 +5443,7 @@ retry:
 
 			if (match)
 			{
-				impl->m_sock = match;
+				str->set_udp_socket(match);
 				return match->local_endpoint;
 			}
 			ec.assign(boost::system::errc::not_supported, generic_category());
@@ -5415,13 +5665,20 @@ retry:
 	{
 		int const timeout = m_settings.get_int(settings_pack::resolver_cache_timeout);
 		m_host_resolver.set_cache_timeout(seconds(timeout));
+		if (m_utp_resolver)
+			udp_call([this, timeout] { m_utp_resolver->set_cache_timeout(seconds(timeout)); });
 	}
 
 	void session_impl::update_proxy()
 	{
 		for (auto& i : m_listen_sockets)
-			i->udp_sock->sock.set_proxy_settings(proxy(), m_alerts, get_resolver()
-				, settings().get_bool(settings_pack::socks5_udp_send_local_ep));
+		{
+			udp_call([this, us = i->udp_sock, ps = proxy()
+				, send_local_ep = settings().get_bool(settings_pack::socks5_udp_send_local_ep)]
+			{
+				us->sock.set_proxy_settings(ps, m_alerts, udp_resolver(), send_local_ep);
+			});
+		}
 	}
 
 	void session_impl::update_ip_notifier()
@@ -6269,6 +6526,7 @@ retry:
 
 		// this has probably been called already, but in case of sudden
 		// termination through an exception, it may not have been done
+		stop_utp_thread();
 		abort_stage2();
 
 #if defined TORRENT_ASIO_DEBUGGING
@@ -6403,18 +6661,21 @@ retry:
 
 			if (l->udp_sock)
 			{
-				error_code ec;
-				set_traffic_class(l->udp_sock->sock, value, ec);
+				udp_call([this, us = l->udp_sock, value]
+				{
+					error_code ec;
+					set_traffic_class(us->sock, value, ec);
 
 #ifndef TORRENT_DISABLE_LOGGING
-				if (should_log())
-				{
-					session_log(">>> SET_DSCP [ udp (%s %d) value: %x e: %s ]"
-						, l->udp_sock->sock.local_endpoint().address().to_string().c_str()
-						, l->udp_sock->sock.local_port()
-						, std::uint32_t(value), ec.message().c_str());
-				}
+					if (should_log())
+					{
+						session_log(">>> SET_DSCP [ udp (%s %d) value: %x e: %s ]"
+							, us->local_endpoint().address().to_string().c_str()
+							, us->sock.local_port()
+							, std::uint32_t(value), ec.message().c_str());
+					}
 #endif
+				});
 			}
 		}
 	}
@@ -6510,6 +6771,40 @@ retry:
 			m_settings.set_int(settings_pack::hashing_threads, 0);
 	}
 
+	void session_impl::update_network_thread_affinity()
+	{
+		// settings passed to the session constructor are applied before the
+		// network thread is started. Posting this makes sure it's the network
+		// thread that's pinned
+		post(m_io_context, [this, cpus = m_settings.get_str(settings_pack::network_thread_affinity)]
+		{
+			if (aux::set_thread_affinity(cpus)) return;
+#ifndef TORRENT_DISABLE_LOGGING
+			session_log("failed to set network thread affinity: \"%s\"", cpus.c_str());
+#endif
+		});
+	}
+
+	void session_impl::update_checking_queue_depth()
+	{
+		m_checking_scheduler.set_depth(std::max(1
+			, m_settings.get_int(settings_pack::checking_queue_depth)));
+	}
+
+	void session_impl::add_checking_device(device_id const dev, bool const spinning)
+	{
+		if (m_checking_scheduler.has_device(dev)) return;
+
+		// spinning disks are read by one torrent at a time. Devices we
+		// can't identify are assumed to not be
+		bool const sequential = dev != 0 && spinning;
+		m_checking_scheduler.add_device(dev, sequential);
+#ifndef TORRENT_DISABLE_LOGGING
+		session_log("checking files on device %" PRIu64 " (%s)"
+			, dev, sequential ? "sequential" : "shared");
+#endif
+	}
+
 	void session_impl::update_report_web_seed_downloads()
 	{
 		// if this flag changed, update all web seed connections
@@ -6559,17 +6854,20 @@ retry:
 	{
 		for (auto const& l : m_listen_sockets)
 		{
-			error_code ec;
-			set_socket_buffer_size(l->udp_sock->sock, m_settings, ec);
-#ifndef TORRENT_DISABLE_LOGGING
-			if (ec && should_log())
+			udp_call([this, us = l->udp_sock]
 			{
-				session_log("listen socket buffer size [ udp %s:%d ] %s"
-					, l->udp_sock->sock.local_endpoint().address().to_string().c_str()
-					, l->udp_sock->sock.local_port(), print_error(ec).c_str());
-			}
+				error_code err;
+				set_socket_buffer_size(us->sock, m_settings, err);
+#ifndef TORRENT_DISABLE_LOGGING
+				if (err && should_log())
+				{
+					session_log("listen socket buffer size [ udp %s:%d ] %s"
+						, us->local_endpoint().address().to_string().c_str()
+						, us->sock.local_port(), print_error(err).c_str());
+				}
 #endif
-			ec.clear();
+			});
+			error_code ec;
 			set_socket_buffer_size(*l->sock, m_settings, ec);
 #ifndef TORRENT_DISABLE_LOGGING
 			if (ec && should_log())
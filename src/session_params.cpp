@@ -151,6 +151,8 @@ session_params read_session_params(bdecode_node const& e, save_state_flags_t con
 		if (v4)
 		{
 			int const count = v4.list_size();
+			std::vector<ip_range<address_v4>> rules4;
+			rules4.reserve(std::size_t(count));
 			for (int i = 0; i < count; ++i)
 			{
 				auto const str = v4.list_string_value_at(i);
@@ -161,14 +163,17 @@ session_params read_session_params(bdecode_node const& e, save_state_flags_t con
 				auto const f = aux::read_uint32(ptr);
 				// ignore invalid entries
 				if (first > last) continue;
-				load.add_rule(first, last, f);
+				rules4.push_back({first, last, f});
 			}
+			load.add_rules(rules4);
 		}
 
 		auto const v6 = e.dict_find_list("ip_filter6");
 		if (v6)
 		{
 			int const count = v6.list_size();
+			std::vector<ip_range<address_v6>> rules6;
+			rules6.reserve(std::size_t(count));
 			for (int i = 0; i < count; ++i)
 			{
 				auto const str = v6.list_string_value_at(i);
@@ -179,8 +184,9 @@ session_params read_session_params(bdecode_node const& e, save_state_flags_t con
 				auto const f = aux::read_uint32(ptr);
 				// ignore invalid entries
 				if (first > last) continue;
-				load.add_rule(first, last, f);
+				rules6.push_back({first, last, f});
 			}
+			load.add_rules(rules6);
 		}
 
 		if (!load.empty())
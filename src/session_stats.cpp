@@ -207,6 +207,10 @@ namespace {
 		// IP filter applied to them.
 		METRIC(ses, non_filter_torrents)
 
+		// the total size of the info-dictionaries (the metadata) of all
+		// torrents in the session whose metadata is known, in bytes
+		METRIC(ses, torrent_metadata_bytes)
+
 		// these count the number of times a piece has passed the
 		// hash check, the number of times a piece was successfully
 		// written to disk and the number of total possible pieces
@@ -308,8 +312,10 @@ namespace {
 		METRIC(disk, disk_blocks_in_use)
 
 		// ``queued_disk_jobs`` is the number of disk jobs currently queued,
-		// waiting to be executed by a disk thread.
+		// waiting to be executed by a disk thread. ``queued_deadline_disk_jobs``
+		// is the number of those that are for pieces with a deadline.
 		METRIC(disk, queued_disk_jobs)
+		METRIC(disk, queued_deadline_disk_jobs)
 		METRIC(disk, num_running_disk_jobs)
 		METRIC(disk, num_read_jobs)
 		METRIC(disk, num_write_jobs)
@@ -335,6 +341,10 @@ namespace {
 		// the total number of blocks run through SHA-1 hashing
 		METRIC(disk, num_blocks_hashed)
 
+		// the number of bytes read and hashed while checking torrents. Its
+		// rate is the checking throughput
+		METRIC(disk, checking_bytes)
+
 		// the number of disk I/O operation for reads and writes. One disk
 		// operation may transfer more then one block.
 		METRIC(disk, num_write_ops)
@@ -351,6 +361,21 @@ namespace {
 		METRIC(disk, disk_hash_time)
 		METRIC(disk, disk_job_time)
 
+		// the number of disk jobs issued for pieces with a deadline (see
+		// torrent_handle::set_piece_deadline()), the number of those that
+		// completed after their deadline had passed, and the number of pieces
+		// read ahead of the pieces with a deadline.
+		METRIC(disk, num_deadline_disk_jobs)
+		METRIC(disk, num_deadline_disk_jobs_missed)
+		METRIC(disk, num_read_ahead_pieces)
+
+		// when settings_pack::numa_disk_buffers is enabled, the number of
+		// disk buffers released by a thread running on the same NUMA node as
+		// the buffer's memory, and on a different node. Buffers released on a
+		// remote node were accessed across nodes.
+		METRIC(disk, disk_buffer_local_node)
+		METRIC(disk, disk_buffer_remote_node)
+
 		// for each kind of disk job, a counter of how many jobs of that kind
 		// are currently blocked by a disk fence
 		METRIC(disk, num_fenced_read)
@@ -371,6 +396,12 @@ namespace {
 		METRIC(disk, num_fenced_clear_piece)
 		METRIC(disk, num_fenced_tick_storage)
 
+		// the number of storage devices torrents are currently checking files
+		// on, and the number of checking torrents waiting for their device to
+		// be available. See settings_pack::checking_queue_depth
+		METRIC(disk, num_checking_devices)
+		METRIC(disk, queued_checking_torrents)
+
 		// The number of nodes in the DHT routing table
 		METRIC(dht, dht_nodes)
 
@@ -540,6 +571,13 @@ namespace {
 		// this measure the number of tracker announces currently in the
 		// queue
 		METRIC(tracker, num_queued_tracker_announces)
+
+		// the memory used by peer connections, broken down by component
+		METRIC(peer, peer_object_bytes)
+		METRIC(peer, peer_recv_buffer_bytes)
+		METRIC(peer, peer_send_buffer_bytes)
+		METRIC(peer, peer_queue_bytes)
+		METRIC(peer, peer_bitfield_bytes)
 		// ... more
 	}});
 #undef METRIC
@@ -123,7 +123,10 @@ namespace {
 		SET(i2p_hostname, "", &session_impl::update_i2p_bridge),
 		SET(peer_fingerprint, "-LT2100-", nullptr),
 		SET(dht_bootstrap_nodes, "dht.libtorrent.org:25401", &session_impl::update_dht_bootstrap_nodes),
-		SET(webtorrent_stun_server, "stun.l.google.com:19302", nullptr)
+		SET(webtorrent_stun_server, "stun.l.google.com:19302", nullptr),
+		SET(network_thread_affinity, "", &session_impl::update_network_thread_affinity),
+		SET(disk_thread_affinity, "", nullptr),
+		SET(hashing_thread_affinity, "", nullptr)
 	}});
 
 	CONSTEXPR_SETTINGS
@@ -213,6 +216,11 @@ namespace {
 		SET(allow_idna, false, nullptr),
 		SET(enable_set_file_valid_data, false, nullptr),
 		SET(socks5_udp_send_local_ep, false, nullptr),
+		SET(utp_pacing, false, nullptr),
+		SET(utp_coalesce_acks, false, nullptr),
+		SET(utp_io_thread, false, nullptr),
+		SET(numa_disk_buffers, false, nullptr),
+		SET(mmap_huge_pages, false, nullptr),
 	}});
 
 	CONSTEXPR_SETTINGS
@@ -380,7 +388,10 @@ namespace {
 		SET(i2p_inbound_length_variance, 0, nullptr),
 		SET(i2p_outbound_length_variance, 0, nullptr),
 		SET(min_websocket_announce_interval, 1 * 60, nullptr),
-		SET(webtorrent_connection_timeout, 2 * 60, nullptr)
+		SET(webtorrent_connection_timeout, 2 * 60, nullptr),
+		SET(utp_max_window, 1024 * 1024, nullptr),
+		SET(checking_queue_depth, 16, &session_impl::update_checking_queue_depth),
+		SET(deadline_read_ahead, 4, nullptr)
 	}});
 
 #undef SET
@@ -0,0 +1,97 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/spsc_ring.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace libtorrent::aux {
+
+namespace {
+
+	std::uint32_t round_up_pow2(int const v)
+	{
+		std::uint32_t ret = 1;
+		while (ret < std::uint32_t(v)) ret <<= 1;
+		return ret;
+	}
+}
+
+	spsc_ring::spsc_ring(int const capacity)
+		: m_mask(round_up_pow2(std::clamp(capacity, 1, 1 << 30)) - 1)
+	{
+		m_buf.reset(new char[m_mask + 1]);
+	}
+
+	int spsc_ring::write(span<char const> buf)
+	{
+		int ret = 0;
+		for (span<char> r : write_regions())
+		{
+			int const n = std::min(int(r.size()), int(buf.size()) - ret);
+			if (n == 0) break;
+			std::memcpy(r.data(), buf.data() + ret, std::size_t(n));
+			ret += n;
+		}
+		commit_write(ret);
+		return ret;
+	}
+
+	int spsc_ring::read(span<char> buf)
+	{
+		int ret = 0;
+		for (span<char const> r : read_regions())
+		{
+			int const n = std::min(int(r.size()), int(buf.size()) - ret);
+			if (n == 0) break;
+			std::memcpy(buf.data() + ret, r.data(), std::size_t(n));
+			ret += n;
+		}
+		commit_read(ret);
+		return ret;
+	}
+
+	std::array<span<char>, 2> spsc_ring::write_regions()
+	{
+		std::uint32_t const tail = m_tail.load(std::memory_order_relaxed);
+		std::uint32_t const head = m_head.load(std::memory_order_acquire);
+		int const free = capacity() - int(tail - head);
+		int const offset = int(tail & m_mask);
+		int const first = std::min(free, capacity() - offset);
+		return {{ {m_buf.get() + offset, first}, {m_buf.get(), free - first} }};
+	}
+
+	void spsc_ring::commit_write(int const bytes)
+	{
+		TORRENT_ASSERT(bytes >= 0);
+		TORRENT_ASSERT(bytes <= space());
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + std::uint32_t(bytes)
+			, std::memory_order_release);
+	}
+
+	std::array<span<char const>, 2> spsc_ring::read_regions() const
+	{
+		std::uint32_t const head = m_head.load(std::memory_order_relaxed);
+		std::uint32_t const tail = m_tail.load(std::memory_order_acquire);
+		int const used = int(tail - head);
+		int const offset = int(head & m_mask);
+		int const first = std::min(used, capacity() - offset);
+		return {{ {m_buf.get() + offset, first}, {m_buf.get(), used - first} }};
+	}
+
+	void spsc_ring::commit_read(int const bytes)
+	{
+		TORRENT_ASSERT(bytes >= 0);
+		TORRENT_ASSERT(bytes <= size());
+		m_head.store(m_head.load(std::memory_order_relaxed) + std::uint32_t(bytes)
+			, std::memory_order_release);
+	}
+}
@@ -59,6 +59,7 @@ see LICENSE file.
 #include "libtorrent/torrent_handle.hpp"
 #include "libtorrent/announce_entry.hpp"
 #include "libtorrent/torrent_info.hpp"
+#include "libtorrent/aux_/scope_end.hpp"
 #include "libtorrent/aux_/parse_url.hpp"
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/hasher.hpp"
@@ -234,6 +235,7 @@ bool is_downloading_state(int const st)
 		, m_torrent_initialized(false)
 		, m_outstanding_file_priority(false)
 		, m_complete_sent(false)
+		, m_dormant(false)
 	{
 		if (p.flags & torrent_flags::need_save_resume)
 		{
@@ -265,11 +267,20 @@ bool is_downloading_state(int const st)
 			m_i2p = true;
 #endif
 
+		// only torrents with metadata have anything to defer loading of
+		m_dormant = (p.flags & torrent_flags::dormant)
+			&& (p.flags & torrent_flags::paused)
+			&& m_torrent_file->is_valid();
+
 		if (m_torrent_file->is_valid())
 		{
-			// merkle trees are loaded from add_torrent_params below, in load_merkle_trees()
-			error_code ec = initialize_merkle_trees();
-			if (ec) throw system_error(ec);
+			// merkle trees are loaded from add_torrent_params below, in
+			// load_merkle_trees(). Dormant torrents do this in leave_dormant()
+			if (!m_dormant)
+			{
+				error_code ec = initialize_merkle_trees();
+				if (ec) throw system_error(ec);
+			}
 			m_size_on_disk = m_torrent_file->layout().size_on_disk();
 		}
 
@@ -387,7 +398,8 @@ bool is_downloading_state(int const st)
 
 		// --- V2 HASHES ---
 
-		if (m_torrent_file->is_valid() && m_torrent_file->info_hashes().has_v2())
+		if (m_torrent_file->is_valid() && m_torrent_file->info_hashes().has_v2()
+			&& !m_dormant)
 		{
 			if (!p.merkle_trees.empty())
 				load_merkle_trees(
@@ -558,14 +570,16 @@ bool is_downloading_state(int const st)
 			set_limit_impl(p.upload_limit, peer_connection::upload_channel, false);
 			set_limit_impl(p.download_limit, peer_connection::download_channel, false);
 
-			for (auto const& peer : p.peers)
+			// a dormant torrent adds its peers once it's loaded, when the
+			// resume data has been checked
+			if (!m_dormant)
 			{
-				add_peer(peer, peer_info::resume_data);
-			}
+				add_peers(p.peers, peer_info::resume_data);
 
-			if (!p.peers.empty())
-			{
-				do_connect_boost();
+				if (!p.peers.empty())
+				{
+					do_connect_boost();
+				}
 			}
 
 #ifndef TORRENT_DISABLE_LOGGING
@@ -621,6 +635,16 @@ bool is_downloading_state(int const st)
 		}
 #endif
 
+		if (m_dormant)
+		{
+			// until the torrent is loaded, report the state implied by the
+			// resume data. This also puts it in the right auto-manage queue
+			auto const& have = m_add_torrent_params->have_pieces;
+			bool const seed = m_seed_mode
+				|| (have.size() >= m_torrent_file->num_pieces() && have.all_set());
+			m_state = seed ? torrent_status::seeding : torrent_status::downloading;
+		}
+
 		update_gauge();
 
 		update_want_peers();
@@ -629,7 +653,7 @@ bool is_downloading_state(int const st)
 
 		if (m_torrent_file->is_valid())
 		{
-			init();
+			if (!m_dormant) init();
 		}
 		else
 		{
@@ -735,6 +759,7 @@ bool is_downloading_state(int const st)
 
 	void torrent::read_piece(piece_index_t const piece)
 	{
+		leave_dormant();
 		error_code ec;
 		if (m_abort || m_deleted)
 		{
@@ -886,12 +911,20 @@ bool is_downloading_state(int const st)
 			ret |= torrent_flags::disable_pex;
 		if (m_i2p)
 			ret |= torrent_flags::i2p_torrent;
+		if (m_dormant)
+			ret |= torrent_flags::dormant;
 		return ret;
 	}
 
 	void torrent::set_flags(torrent_flags_t const flags
 		, torrent_flags_t const mask)
 	{
+		// the dormant flag can only be cleared
+		if ((mask & torrent_flags::dormant)
+			&& !(flags & torrent_flags::dormant))
+		{
+			leave_dormant();
+		}
 		if (mask & torrent_flags::i2p_torrent)
 		{
 			m_i2p = bool(flags & torrent_flags::i2p_torrent);
@@ -1228,6 +1261,7 @@ bool is_downloading_state(int const st)
 
 	void torrent::set_sequential_range(piece_index_t first_piece, piece_index_t last_piece)
 	{
+		leave_dormant();
 		if (!has_picker()) {
 			if (!valid_metadata() || !m_connections_initialized) return;
 			else if (!m_have_all
@@ -1338,6 +1372,7 @@ bool is_downloading_state(int const st)
 	void torrent::add_piece_async(piece_index_t const piece
 		, std::vector<char> data, add_piece_flags_t const flags)
 	{
+		leave_dormant();
 		TORRENT_ASSERT(is_single_thread());
 
 		// make sure the piece index is correct
@@ -1356,6 +1391,7 @@ bool is_downloading_state(int const st)
 	void torrent::add_piece(piece_index_t const piece, char const* data
 		, add_piece_flags_t const flags)
 	{
+		leave_dormant();
 		TORRENT_ASSERT(is_single_thread());
 
 		// make sure the piece index is correct
@@ -1795,6 +1831,43 @@ bool is_downloading_state(int const st)
 		return *lowest_rank;
 	}
 
+	// a dormant torrent has not loaded its merkle trees or piece picker, and
+	// has not validated its resume data. This completes that, the first time
+	// the torrent is resumed or anything needs its full state
+	void torrent::leave_dormant()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (!m_dormant) return;
+		m_dormant = false;
+
+#ifndef TORRENT_DISABLE_LOGGING
+		debug_log("leaving dormant state");
+#endif
+
+		TORRENT_ASSERT(m_add_torrent_params);
+		if (m_torrent_file->info_hashes().has_v2())
+		{
+			error_code const ec = initialize_merkle_trees();
+			if (ec)
+			{
+				set_error(ec, torrent_status::error_file_metadata);
+				pause();
+				return;
+			}
+
+			add_torrent_params& p = *m_add_torrent_params;
+			if (!p.merkle_trees.empty())
+				load_merkle_trees(
+					std::move(p.merkle_trees)
+					, std::move(p.merkle_tree_mask)
+					, std::move(p.verified_leaf_hashes));
+		}
+
+		set_state(torrent_status::checking_resume_data);
+		init();
+		state_updated();
+	}
+
 	// this may not be called from a constructor because of the call to
 	// shared_from_this(). It's either called when we start() the torrent, or at a
 	// later time if it's a magnet link, once the metadata is downloaded
@@ -2023,6 +2096,8 @@ bool is_downloading_state(int const st)
 		// this will remove the piece picker, if we're done with it
 		maybe_done_flushing();
 
+		inc_stats_counter(counters::torrent_metadata_bytes
+			, m_torrent_file->metadata_size());
 		m_torrent_initialized = true;
 	}
 
@@ -2108,10 +2183,7 @@ bool is_downloading_state(int const st)
 		{
 			// --- PEERS ---
 
-			for (auto const& p : m_add_torrent_params->peers)
-			{
-				add_peer(p , peer_info::resume_data);
-			}
+			add_peers(m_add_torrent_params->peers, peer_info::resume_data);
 
 #ifndef TORRENT_DISABLE_LOGGING
 			if (should_log() && !m_add_torrent_params->peers.empty())
@@ -2320,6 +2392,7 @@ bool is_downloading_state(int const st)
 
 	void torrent::force_recheck()
 	{
+		leave_dormant();
 		INVARIANT_CHECK;
 
 		if (!valid_metadata()) return;
@@ -2446,7 +2519,25 @@ bool is_downloading_state(int const st)
 			return;
 		}
 
-		for (int i = 0; i < num_outstanding; ++i)
+		num_outstanding = std::min(num_outstanding
+			, static_cast<int>(m_torrent_file->end_piece()) - static_cast<int>(m_checking_piece));
+
+		// hash jobs are handed out per storage device, shared with the other
+		// torrents checking files on the same device. If we don't get any
+		// now, we'll be notified once we can issue some. Finding the device
+		// may block, so it's done on the disk thread, and we pick up here
+		// once it's known
+		if (m_checking_slots == 0 && !m_checking_device_known)
+		{
+			resolve_checking_device();
+			return;
+		}
+		num_outstanding = m_ses.checking_scheduler().acquire(m_checking_device
+			, shared_from_this(), num_outstanding);
+		m_checking_slots += num_outstanding;
+
+		int issued = 0;
+		for (; issued < num_outstanding; ++issued)
 		{
 			if (has_picker())
 			{
@@ -2474,8 +2565,9 @@ bool is_downloading_state(int const st)
 				(piece_index_t p, sha1_hash const& h, storage_error const& error) mutable
 				{ self->on_piece_hashed(std::move(hashes1), p, h, error); });
 			++m_checking_piece;
-			if (m_checking_piece >= m_torrent_file->end_piece()) break;
 		}
+		// return the slots we didn't need
+		if (issued < num_outstanding) release_checking_slots(num_outstanding - issued);
 		m_ses.deferred_submit_jobs();
 #ifndef TORRENT_DISABLE_LOGGING
 		debug_log("start_checking, m_checking_piece: %d"
@@ -2484,6 +2576,45 @@ bool is_downloading_state(int const st)
 	}
 	catch (...) { handle_exception(); }
 
+	void torrent::resolve_checking_device()
+	{
+		if (m_resolving_checking_device) return;
+		m_resolving_checking_device = true;
+		m_ses.disk_thread().async_storage_device(m_storage
+			, [self = shared_from_this()](std::uint64_t const device, bool const spinning)
+			{ self->on_checking_device(device, spinning); });
+		m_ses.deferred_submit_jobs();
+	}
+
+	void torrent::on_checking_device(aux::device_id const device, bool const spinning) try
+	{
+		TORRENT_ASSERT(is_single_thread());
+		m_resolving_checking_device = false;
+		if (m_abort) return;
+
+		// we don't ask for slots until the device is known
+		TORRENT_ASSERT(m_checking_slots == 0);
+		m_checking_device = device;
+		m_checking_device_known = true;
+		m_ses.add_checking_device(device, spinning);
+		if (should_check_files()) start_checking();
+	}
+	catch (...) { handle_exception(); }
+
+	void torrent::checking_slots_available()
+	{
+		if (!should_check_files()) return;
+		start_checking();
+	}
+
+	void torrent::release_checking_slots(int const n)
+	{
+		TORRENT_ASSERT(n > 0);
+		TORRENT_ASSERT(n <= m_checking_slots);
+		m_checking_slots -= n;
+		m_ses.checking_scheduler().release(m_checking_device, this, n);
+	}
+
 	// This is only used for checking of torrents. i.e. force-recheck or initial checking
 	// of existing files
 	void torrent::on_piece_hashed(aux::vector<sha256_hash> block_hashes
@@ -2493,12 +2624,17 @@ bool is_downloading_state(int const st)
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
+		// the hash job slot of this piece is either passed on to the next
+		// piece, or returned to the checking scheduler
+		auto release_slot = aux::scope_end([this] { release_checking_slots(1); });
+
 		if (m_abort) return;
 		if (m_deleted) return;
 
 		state_updated();
 
 		++m_num_checked_pieces;
+		if (!error) inc_stats_counter(counters::checking_bytes, m_torrent_file->piece_size(piece));
 
 		if (error)
 		{
@@ -2642,6 +2778,16 @@ bool is_downloading_state(int const st)
 			if (m_checking_piece >= m_torrent_file->end_piece())
 				return;
 
+			// if other torrents are waiting to check files on the same device,
+			// we may have to hand over this slot
+			release_slot.disarm();
+			if (!m_ses.checking_scheduler().keep(m_checking_device, shared_from_this()))
+			{
+				// keep() already returned the slot
+				--m_checking_slots;
+				return;
+			}
+
 			auto flags = disk_interface::sequential_access | disk_interface::volatile_read;
 
 			if (torrent_file().info_hashes().has_v1())
@@ -2877,8 +3023,7 @@ bool is_downloading_state(int const st)
 
 		if (torrent_file().priv()) return;
 
-		for (auto const& p : peers)
-			add_peer(p, peer_info::dht, v == protocol_version::V2 ? pex_lt_v2 : pex_flags_t(0));
+		add_peers(peers, peer_info::dht, v == protocol_version::V2 ? pex_lt_v2 : pex_flags_t(0));
 
 #ifndef TORRENT_DISABLE_LOGGING
 		if (should_log() && !peers.empty())
@@ -3678,18 +3823,13 @@ namespace {
 
 		pex_flags_t flags = v == protocol_version::V2 ? pex_lt_v2 : pex_flags_t(0);
 
-		bool need_update = false;
+		std::vector<tcp::endpoint> peers;
+		peers.reserve(resp.peers4.size() + resp.peers6.size());
 		for (auto const& i : resp.peers4)
-		{
-			tcp::endpoint const a(address_v4(i.ip), i.port);
-			need_update |= bool(add_peer(a, peer_info::tracker, flags) != nullptr);
-		}
-
+			peers.emplace_back(address_v4(i.ip), i.port);
 		for (auto const& i : resp.peers6)
-		{
-			tcp::endpoint const a(address_v6(i.ip), i.port);
-			need_update |= bool(add_peer(a, peer_info::tracker, flags) != nullptr);
-		}
+			peers.emplace_back(address_v6(i.ip), i.port);
+		bool const need_update = add_peers(peers, peer_info::tracker, flags) > 0;
 
 #ifndef TORRENT_DISABLE_LOGGING
 		if (should_log() && (!resp.peers4.empty() || !resp.peers6.empty()))
@@ -4066,6 +4206,17 @@ namespace {
 			- std::int64_t(pc.pad_bytes);
 	}
 
+	// the number of pieces we have, counted from the resume data
+	int torrent::dormant_num_have() const
+	{
+		TORRENT_ASSERT(m_dormant);
+		bitfield const& have = m_add_torrent_params->have_pieces;
+		if (have.size() <= m_torrent_file->num_pieces()) return have.count();
+		bitfield trimmed = have;
+		trimmed.resize(m_torrent_file->num_pieces());
+		return trimmed.count();
+	}
+
 	// fills in total_wanted, total_wanted_done and total_done
 // TODO: 3 this could probably be pulled out into a free function
 	void torrent::bytes_done(torrent_status& st, status_flags_t const flags) const
@@ -4095,6 +4246,17 @@ namespace {
 			TORRENT_ASSERT(st.total_done <= m_torrent_file->total_size());
 			return;
 		}
+		else if (m_dormant)
+		{
+			// the piece picker isn't loaded yet. Estimate the progress from the
+			// pieces the resume data says we have
+			std::int64_t const have = std::int64_t(dormant_num_have())
+				* m_torrent_file->piece_length();
+			st.total_done = std::min(have, m_torrent_file->total_size() - m_padding_bytes);
+			st.total_wanted_done = std::min(have, m_size_on_disk);
+			st.total_wanted = m_size_on_disk;
+			return;
+		}
 		else if (!has_picker())
 		{
 			st.total_done = 0;
@@ -4894,8 +5056,22 @@ namespace {
 		}
 	}
 
+	void torrent::peer_has(span<piece_index_t const> const pieces
+		, peer_connection const* peer)
+	{
+		if (has_picker())
+		{
+			torrent_peer* pp = peer->peer_info_struct();
+			m_picker->inc_refcount(pieces, pp);
+		}
+		else
+		{
+			TORRENT_ASSERT(is_seed() || !m_have_all);
+		}
+	}
+
 	// when we get a bitfield message, this is called for that piece
-	void torrent::peer_has(typed_bitfield<piece_index_t> const& bits
+	void torrent::peer_has(compressed_bitfield const& bits
 		, peer_connection const* peer)
 	{
 		if (has_picker())
@@ -4923,7 +5099,7 @@ namespace {
 		}
 	}
 
-	void torrent::peer_lost(typed_bitfield<piece_index_t> const& bits
+	void torrent::peer_lost(compressed_bitfield const& bits
 		, peer_connection const* peer)
 	{
 		if (has_picker())
@@ -5028,6 +5204,12 @@ namespace {
 			m_apply_ip_filter = true;
 		}
 
+		if (m_torrent_initialized)
+		{
+			inc_stats_counter(counters::torrent_metadata_bytes
+				, -m_torrent_file->metadata_size());
+		}
+
 		m_paused = false;
 		m_auto_managed = false;
 		update_state_list();
@@ -5082,7 +5264,7 @@ namespace {
 
 	// TODO: 3 this should return optional<>. piece index -1 should not be
 	// allowed
-	piece_index_t torrent::get_piece_to_super_seed(typed_bitfield<piece_index_t> const& bits)
+	piece_index_t torrent::get_piece_to_super_seed(compressed_bitfield const& bits)
 	{
 		// return a piece with low availability that is not in
 		// the bitfield and that is not currently being super
@@ -5239,6 +5421,7 @@ namespace {
 	void torrent::set_piece_deadline(piece_index_t const piece, int const t
 		, deadline_flags_t const flags)
 	{
+		leave_dormant();
 		INVARIANT_CHECK;
 
 		TORRENT_ASSERT_PRECOND(piece >= piece_index_t(0));
@@ -5266,7 +5449,13 @@ namespace {
 		if (is_seed() || (has_picker() && m_picker->have_piece(piece)))
 		{
 			if (flags & torrent_handle::alert_when_available)
+			{
+				// the read jobs are scheduled by the deadline they are issued
+				// with
+				set_disk_deadline(piece, deadline);
 				read_piece(piece);
+				set_disk_deadline(piece, max_time());
+			}
 			return;
 		}
 
@@ -5287,6 +5476,7 @@ namespace {
 			if (i->piece != piece) continue;
 			i->deadline = deadline;
 			i->flags = flags;
+			set_disk_deadline(piece, deadline);
 
 			// resort i since deadline might have changed
 			while (std::next(i) != m_time_critical_pieces.end() && i->deadline > std::next(i)->deadline)
@@ -5323,6 +5513,7 @@ namespace {
 		auto const critical_piece_it = std::upper_bound(m_time_critical_pieces.begin()
 			, m_time_critical_pieces.end(), p);
 		m_time_critical_pieces.insert(critical_piece_it, p);
+		set_disk_deadline(piece, deadline);
 
 		// just in case this piece had priority 0
 		download_priority_t const prev_prio = m_picker->piece_priority(piece);
@@ -5402,10 +5593,17 @@ namespace {
 			}
 			if (has_picker()) m_picker->set_piece_priority(piece, low_priority);
 			m_time_critical_pieces.erase(i);
+			set_disk_deadline(piece, max_time());
 			return;
 		}
 	}
 
+	void torrent::set_disk_deadline(piece_index_t const piece, time_point const deadline)
+	{
+		if (!m_storage) return;
+		m_ses.disk_thread().set_piece_deadline(m_storage, piece, deadline);
+	}
+
 	void torrent::clear_time_critical()
 	{
 		for (auto i = m_time_critical_pieces.begin(); i != m_time_critical_pieces.end();)
@@ -5417,6 +5615,7 @@ namespace {
 					get_handle(), i->piece, error_code(boost::system::errc::operation_canceled, generic_category()));
 			}
 			if (has_picker()) m_picker->set_piece_priority(i->piece, low_priority);
+			set_disk_deadline(i->piece, max_time());
 			i = m_time_critical_pieces.erase(i);
 		}
 	}
@@ -5434,6 +5633,7 @@ namespace {
 					alerts().emplace_alert<read_piece_alert>(
 						get_handle(), i->piece, error_code(boost::system::errc::operation_canceled, generic_category()));
 				}
+				set_disk_deadline(i->piece, max_time());
 				i = m_time_critical_pieces.erase(i);
 				continue;
 			}
@@ -5466,6 +5666,7 @@ namespace {
 	void torrent::set_piece_priority(piece_index_t const index
 		, download_priority_t const priority)
 	{
+		leave_dormant();
 //		INVARIANT_CHECK;
 
 #ifndef TORRENT_DISABLE_LOGGING
@@ -5521,6 +5722,7 @@ namespace {
 	void torrent::prioritize_piece_list(std::vector<std::pair<piece_index_t
 		, download_priority_t>> const& pieces)
 	{
+		leave_dormant();
 		INVARIANT_CHECK;
 
 		// this call is only valid on torrents with metadata
@@ -5564,6 +5766,7 @@ namespace {
 
 	void torrent::prioritize_pieces(aux::vector<download_priority_t, piece_index_t> const& pieces)
 	{
+		leave_dormant();
 		INVARIANT_CHECK;
 
 		// this call is only valid on torrents with metadata
@@ -7333,6 +7536,23 @@ namespace {
 				}
 			}
 		}
+
+		if (m_dormant)
+		{
+			// a dormant torrent hasn't loaded any of its piece state, peers or
+			// renamed files. Save what it was added with
+			add_torrent_params const& p = *m_add_torrent_params;
+			ret.have_pieces = p.have_pieces;
+			ret.verified_pieces = p.verified_pieces;
+			ret.unfinished_pieces = p.unfinished_pieces;
+			ret.piece_priorities = p.piece_priorities;
+			ret.renamed_files = p.renamed_files;
+			ret.peers = p.peers;
+			ret.banned_peers = p.banned_peers;
+			ret.merkle_trees = p.merkle_trees;
+			ret.merkle_tree_mask = p.merkle_tree_mask;
+			ret.verified_leaf_hashes = p.verified_leaf_hashes;
+		}
 	}
 
 #if TORRENT_ABI_VERSION == 1
@@ -8760,6 +8980,7 @@ namespace {
 
 	void torrent::rename_file(file_index_t const index, std::string name)
 	{
+		leave_dormant();
 		INVARIANT_CHECK;
 
 		file_storage const& fs = m_torrent_file->layout();
@@ -8795,6 +9016,10 @@ namespace {
 			return;
 		}
 
+		// a dormant torrent doesn't have a storage object yet. Without one, only
+		// the save path would change, leaving the files behind
+		leave_dormant();
+
 		// if we don't have metadata yet, we don't know anything about the file
 		// structure and we have to assume we don't have any file.
 		if (!valid_metadata())
@@ -8853,6 +9078,7 @@ namespace {
 			if (alerts().should_post<storage_moved_alert>())
 				alerts().emplace_alert<storage_moved_alert>(get_handle(), path, m_save_path);
 			m_save_path = path;
+			m_checking_device_known = false;
 			set_need_save_resume(torrent_handle::if_config_changed);
 			if (status & disk_status::need_full_check)
 				force_recheck();
@@ -9129,22 +9355,6 @@ namespace {
 			TORRENT_ASSERT(m_abort || m_error || !m_picker || m_picker->num_pieces() == 0);
 		}
 
-#ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
-		// make sure we haven't modified the peer object
-		// in a way that breaks the sort order
-		if (m_peer_list && m_peer_list->begin() != m_peer_list->end())
-		{
-			auto i = m_peer_list->begin();
-			auto p = i++;
-			auto end(m_peer_list->end());
-			peer_address_compare cmp;
-			for (; i != end; ++i, ++p)
-			{
-				TORRENT_ASSERT(!cmp(*i, *p));
-			}
-		}
-#endif
-
 /*
 		if (m_picker && !m_abort)
 		{
@@ -9339,6 +9549,10 @@ namespace {
 	{
 		TORRENT_ASSERT(is_single_thread());
 
+		// a dormant torrent doesn't have a storage object yet, which is what
+		// deletes the files
+		leave_dormant();
+
 #ifndef TORRENT_DISABLE_LOGGING
 		log_to_all_peers("deleting files");
 #endif
@@ -9618,6 +9832,7 @@ namespace {
 
 	void torrent::flush_cache()
 	{
+		leave_dormant();
 		TORRENT_ASSERT(is_single_thread());
 
 		// storage may be nullptr during shutdown
@@ -9941,6 +10156,9 @@ namespace {
 			return;
 		}
 
+		leave_dormant();
+		if (is_paused()) return;
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		for (auto& ext : m_extensions)
 		{
@@ -11283,13 +11501,10 @@ namespace {
 		return true;
 	}
 
-	torrent_peer* torrent::add_peer(tcp::endpoint const& adr
-		, peer_source_flags_t const source, pex_flags_t flags)
+	bool torrent::reject_peer(tcp::endpoint const& adr
+		, peer_source_flags_t const source)
 	{
-		TORRENT_ASSERT(is_single_thread());
-
-		TORRENT_ASSERT(info_hash().has_v2() || !(flags & pex_lt_v2));
-
+		TORRENT_UNUSED(source);
 		if (m_apply_ip_filter
 			&& m_ip_filter
 			&& m_ip_filter->access(adr.address()) & ip_filter::blocked)
@@ -11301,7 +11516,7 @@ namespace {
 #ifndef TORRENT_DISABLE_EXTENSIONS
 			notify_extension_add_peer(adr, source, torrent_plugin::filtered);
 #endif
-			return nullptr;
+			return true;
 		}
 
 		if (m_ses.get_port_filter().access(adr.port()) & port_filter::blocked)
@@ -11312,7 +11527,7 @@ namespace {
 #ifndef TORRENT_DISABLE_EXTENSIONS
 			notify_extension_add_peer(adr, source, torrent_plugin::filtered);
 #endif
-			return nullptr;
+			return true;
 		}
 
 #if TORRENT_USE_I2P
@@ -11323,7 +11538,7 @@ namespace {
 			if (alerts().should_post<peer_blocked_alert>())
 				alerts().emplace_alert<peer_blocked_alert>(get_handle()
 					, adr, peer_blocked_alert::i2p_mixed);
-			return nullptr;
+			return true;
 		}
 #endif
 
@@ -11335,9 +11550,21 @@ namespace {
 #ifndef TORRENT_DISABLE_EXTENSIONS
 			notify_extension_add_peer(adr, source, torrent_plugin::filtered);
 #endif
-			return nullptr;
+			return true;
 		}
 
+		return false;
+	}
+
+	torrent_peer* torrent::add_peer(tcp::endpoint const& adr
+		, peer_source_flags_t const source, pex_flags_t flags)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		TORRENT_ASSERT(info_hash().has_v2() || !(flags & pex_lt_v2));
+
+		if (reject_peer(adr, source)) return nullptr;
+
 #ifndef TORRENT_DISABLE_DHT
 		if (source != peer_info::resume_data)
 		{
@@ -11378,6 +11605,65 @@ namespace {
 		return p;
 	}
 
+	int torrent::add_peers(span<tcp::endpoint const> const peers
+		, peer_source_flags_t const source, pex_flags_t flags
+		, span<pex_flags_t const> const peer_flags)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		TORRENT_ASSERT(info_hash().has_v2() || !(flags & pex_lt_v2));
+		TORRENT_ASSERT(peer_flags.empty() || peer_flags.size() == peers.size());
+
+		if (peers.empty()) return 0;
+
+		// filter the whole batch before touching the peer list
+		std::vector<tcp::endpoint> accepted;
+		std::vector<pex_flags_t> accepted_flags;
+		accepted.reserve(std::size_t(peers.size()));
+		if (!peer_flags.empty()) accepted_flags.reserve(std::size_t(peers.size()));
+		for (int i = 0; i < int(peers.size()); ++i)
+		{
+			if (reject_peer(peers[i], source)) continue;
+			accepted.push_back(peers[i]);
+			if (!peer_flags.empty()) accepted_flags.push_back(peer_flags[i]);
+		}
+		if (accepted.empty()) return 0;
+
+#ifndef TORRENT_DISABLE_DHT
+		if (source != peer_info::resume_data)
+		{
+			// see add_peer()
+			for (auto const& adr : accepted)
+				session().add_dht_node({adr.address(), adr.port()});
+		}
+#endif
+
+		if (!torrent_file().info_hashes().has_v1())
+			flags |= pex_lt_v2;
+
+		need_peer_list();
+		torrent_state st = get_peer_list_state();
+		std::vector<add_peer_result> result;
+		m_peer_list->add_peers(accepted, source, flags, accepted_flags, &st, result);
+		peers_erased(st.erased);
+
+		int ret = 0;
+		for (std::size_t i = 0; i < result.size(); ++i)
+		{
+			if (result[i] != add_peer_result::rejected) ++ret;
+#ifndef TORRENT_DISABLE_EXTENSIONS
+			notify_extension_add_peer(accepted[i], source
+				, result[i] == add_peer_result::added ? torrent_plugin::first_time
+				: result[i] == add_peer_result::updated ? add_peer_flags_t{}
+				: torrent_plugin::filtered);
+#endif
+		}
+
+		update_want_peers();
+		state_updated();
+		return ret;
+	}
+
 	bool torrent::ban_peer(torrent_peer* tp)
 	{
 		if (!settings().get_bool(settings_pack::ban_web_seeds) && tp->web_seed)
@@ -11417,7 +11703,7 @@ namespace {
 		update_want_peers();
 	}
 
-	std::pair<peer_list::iterator, peer_list::iterator> torrent::find_peers(address const& a)
+	std::vector<torrent_peer*> torrent::find_peers(address const& a)
 	{
 		need_peer_list();
 		return m_peer_list->find_peers(a);
@@ -11588,6 +11874,7 @@ namespace {
 	void torrent::file_progress(aux::vector<std::int64_t, file_index_t>& fp
 		, file_progress_flags_t const flags)
 	{
+		leave_dormant();
 		TORRENT_ASSERT(is_single_thread());
 		if (!valid_metadata())
 		{
@@ -12125,7 +12412,12 @@ namespace {
 		if (flags & torrent_handle::query_pieces)
 		{
 			int const num_pieces = m_torrent_file->num_pieces();
-			if (has_picker())
+			if (m_dormant && !m_seed_mode)
+			{
+				st->pieces = m_add_torrent_params->have_pieces;
+				st->pieces.resize(num_pieces, false);
+			}
+			else if (has_picker())
 			{
 				st->pieces.resize(num_pieces, false);
 				for (auto const i : st->pieces.range())
@@ -12140,7 +12432,7 @@ namespace {
 				st->pieces.resize(num_pieces, false);
 			}
 		}
-		st->num_pieces = num_have();
+		st->num_pieces = m_dormant && !m_seed_mode ? dormant_num_have() : num_have();
 #if TORRENT_USE_INVARIANT_CHECKS
 		{
 			// The documentation states that `num_pieces` is the count of number
@@ -12150,6 +12442,12 @@ namespace {
 			{
 				num_have_pieces = m_torrent_file->num_pieces();
 			}
+			else if (m_dormant)
+			{
+				bitfield have = m_add_torrent_params->have_pieces;
+				have.resize(m_torrent_file->num_pieces(), false);
+				num_have_pieces = have.count();
+			}
 			else if (has_picker())
 			{
 				for (auto const i : m_torrent_file->piece_range())
@@ -727,6 +727,8 @@ namespace libtorrent {
 #if TORRENT_ABI_VERSION < 4
 	std::shared_ptr<torrent_info> torrent_handle::torrent_file_with_hashes() const
 	{
+		// the merkle trees of a dormant torrent aren't loaded
+		sync_call(&aux::torrent::leave_dormant);
 		return sync_call_ret<std::shared_ptr<torrent_info>>(
 			std::shared_ptr<torrent_info>(), &aux::torrent::get_torrent_copy_with_hashes);
 	}
@@ -734,6 +736,7 @@ namespace libtorrent {
 
 	std::vector<std::vector<sha256_hash>> torrent_handle::piece_layers() const
 	{
+		sync_call(&aux::torrent::leave_dormant);
 		return sync_call_ret<std::vector<std::vector<sha256_hash>>>({}
 			, &aux::torrent::get_piece_layers);
 	}
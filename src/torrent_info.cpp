@@ -981,18 +981,20 @@ TORRENT_VERSION_NAMESPACE_4
 	{
 		if (!(m_flags & ssl_torrent)) return "";
 
-		// this is parsed lazily
-		if (!m_info_dict)
-		{
-			error_code ec;
-			bdecode(m_info_section.get(), m_info_section.get()
-				+ m_info_section_size, m_info_dict, ec);
-			TORRENT_ASSERT(!ec);
-			if (ec) return "";
-		}
-		TORRENT_ASSERT(m_info_dict.type() == bdecode_node::dict_t);
-		if (m_info_dict.type() != bdecode_node::dict_t) return "";
-		return m_info_dict.dict_find_string_value("ssl-cert");
+		// the returned string points into m_info_section, so there's no need
+		// to hold on to the parsed info dictionary. Keeping it around would
+		// cost one token per item in the info section, for as long as the
+		// torrent is loaded
+		if (m_info_dict)
+			return m_info_dict.dict_find_string_value("ssl-cert");
+
+		error_code ec;
+		bdecode_node const info = bdecode(info_section(), ec);
+		TORRENT_ASSERT(!ec);
+		if (ec) return "";
+		TORRENT_ASSERT(info.type() == bdecode_node::dict_t);
+		if (info.type() != bdecode_node::dict_t) return "";
+		return info.dict_find_string_value("ssl-cert");
 	}
 
 #if TORRENT_ABI_VERSION < 3
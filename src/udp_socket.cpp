@@ -27,9 +27,16 @@ see LICENSE file.
 #include "libtorrent/aux_/keepalive.hpp"
 #include "libtorrent/aux_/resolver_interface.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 #include <functional>
 
+#if TORRENT_HAS_RECVMMSG && !defined TORRENT_BUILD_SIMULATOR
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cerrno>
+#endif
+
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/asio/ip/v6_only.hpp>
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
@@ -165,21 +172,124 @@ struct set_dont_frag
 udp_socket::udp_socket(io_context& ios, aux::listen_socket_handle ls)
 	: m_socket(ios)
 	, m_ioc(ios)
-	, m_buf(new receive_buffer())
+	, m_buf(new std::array<receive_buffer, read_batch_size>())
 	, m_listen_socket(std::move(ls))
 	, m_bind_port(0)
 	, m_abort(true)
 {}
 
+bool udp_socket::filter_packet(packet& p)
+{
+	// support packets coming from the SOCKS5 proxy
+	if (active_socks5())
+	{
+		// if the source IP doesn't match the proxy's, ignore the packet
+		if (p.from != m_socks5_connection->target()) return false;
+		// if we failed to unwrap, silently ignore the packet
+		return unwrap(p);
+	}
+
+	// if we don't proxy trackers or peers, we may be receiving unwrapped
+	// packets and we must let them through.
+	bool const proxy_only
+		= m_proxy_settings.proxy_peer_connections
+		&& m_proxy_settings.proxy_tracker_connections
+		;
+
+	// if we proxy everything, block all packets that aren't coming from
+	// the proxy
+	return m_proxy_settings.type == settings_pack::none || !proxy_only;
+}
+
 int udp_socket::read(span<packet> pkts, error_code& ec)
 {
-	auto const num = int(pkts.size());
+#if TORRENT_HAS_RECVMMSG && !defined TORRENT_BUILD_SIMULATOR
+	return read_recvmmsg(pkts, ec);
+#else
+	return read_receive_from(pkts, ec);
+#endif
+}
+
+#if TORRENT_HAS_RECVMMSG && !defined TORRENT_BUILD_SIMULATOR
+int udp_socket::read_recvmmsg(span<packet> pkts, error_code& ec)
+{
+	auto const num = std::min(int(pkts.size()), read_batch_size);
+	int ret = 0;
+
+	// drain up to a whole batch of packets with a single system call
+	ec.clear();
+	std::array<::mmsghdr, read_batch_size> hdrs{};
+	std::array<::iovec, read_batch_size> iov{};
+	std::array<udp::endpoint, read_batch_size> from;
+	for (int i = 0; i < num; ++i)
+	{
+		auto& buf = (*m_buf)[std::size_t(i)];
+		iov[std::size_t(i)].iov_base = buf.data();
+		iov[std::size_t(i)].iov_len = buf.size();
+		auto& h = hdrs[std::size_t(i)].msg_hdr;
+		h.msg_name = from[std::size_t(i)].data();
+		h.msg_namelen = socklen_t(from[std::size_t(i)].capacity());
+		h.msg_iov = &iov[std::size_t(i)];
+		h.msg_iovlen = 1;
+	}
+
+	int received = 0;
+	do
+	{
+		received = ::recvmmsg(m_socket.native_handle(), hdrs.data()
+			, unsigned(num), MSG_DONTWAIT, nullptr);
+	} while (received < 0 && errno == EINTR);
+
+	if (received < 0)
+	{
+		ec.assign(errno, boost::system::system_category());
+		if (ec == error::would_block
+			|| ec == error::try_again
+			|| ec == error::operation_aborted
+			|| ec == error::bad_descriptor)
+		{
+			return 0;
+		}
+
+		// SOCKS5 cannot wrap ICMP errors. And even if it could, they certainly
+		// would not arrive as unwrapped (regular) ICMP errors. If we're using
+		// a proxy we must ignore these
+		if (m_proxy_settings.type != settings_pack::none)
+		{
+			ec.clear();
+			return 0;
+		}
+
+		packet p;
+		p.error = ec;
+		pkts[0] = p;
+		return 1;
+	}
+
+	for (int i = 0; i < received; ++i)
+	{
+		packet p;
+		from[std::size_t(i)].resize(hdrs[std::size_t(i)].msg_hdr.msg_namelen);
+		p.from = from[std::size_t(i)];
+		p.data = {(*m_buf)[std::size_t(i)].data(), int(hdrs[std::size_t(i)].msg_len)};
+		if (!filter_packet(p)) continue;
+		pkts[ret] = p;
+		++ret;
+	}
+	return ret;
+}
+#endif
+
+int udp_socket::read_receive_from(span<packet> pkts, error_code& ec)
+{
+	auto const num = std::min(int(pkts.size()), read_batch_size);
 	int ret = 0;
 	packet p;
 
 	while (ret < num)
 	{
-		int const len = int(m_socket.receive_from(boost::asio::buffer(*m_buf)
+		auto& buf = (*m_buf)[std::size_t(ret)];
+		int const len = int(m_socket.receive_from(boost::asio::buffer(buf)
 			, p.from, 0, ec));
 
 		if (ec == error::would_block
@@ -204,41 +314,19 @@ int udp_socket::read(span<packet> pkts, error_code& ec)
 
 			p.error = ec;
 			p.data = span<char>();
+			pkts[ret] = p;
+			++ret;
+
+			// let the caller deal with the error before reading more
+			break;
 		}
-		else
-		{
-			p.data = {m_buf->data(), len};
-
-			// support packets coming from the SOCKS5 proxy
-			if (active_socks5())
-			{
-				// if the source IP doesn't match the proxy's, ignore the packet
-				if (p.from != m_socks5_connection->target()) continue;
-				// if we failed to unwrap, silently ignore the packet
-				if (!unwrap(p)) continue;
-			}
-			else
-			{
-				// if we don't proxy trackers or peers, we may be receiving unwrapped
-				// packets and we must let them through.
-				bool const proxy_only
-					= m_proxy_settings.proxy_peer_connections
-					&& m_proxy_settings.proxy_tracker_connections
-					;
-
-				// if we proxy everything, block all packets that aren't coming from
-				// the proxy
-				if (m_proxy_settings.type != settings_pack::none && proxy_only) continue;
-			}
-		}
+
+		p.data = {buf.data(), len};
+		p.hostname = {};
+		if (!filter_packet(p)) continue;
 
 		pkts[ret] = p;
 		++ret;
-
-		// we only have a single buffer for now, so we can only return a
-		// single packet. In the future though, we could attempt to drain
-		// the socket here, or maybe even use recvmmsg()
-		break;
 	}
 
 	return ret;
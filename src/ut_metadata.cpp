@@ -123,7 +123,9 @@ namespace {
 		{
 			if (m_torrent.valid_metadata()) return;
 			if (size <= 0 || size > 4 * 1024 * 1024) return;
-			m_metadata.resize(size);
+			// the buffer itself is not allocated until the first piece of
+			// metadata is received. Peers may advertise a size and then
+			// never send anything
 			m_requested_metadata.resize(div_round_up(size, 16 * 1024));
 		}
 
@@ -135,8 +137,9 @@ namespace {
 
 		// this buffer is filled with the info-section of
 		// the metadata file while downloading it from
-		// peers. Once we have metadata, we seed it directly from the
-		// torrent_info of the underlying torrent
+		// peers. It's allocated when the first piece arrives. Once we have
+		// metadata, we seed it directly from the torrent_info of the
+		// underlying torrent
 		aux::vector<char> m_metadata;
 
 		struct metadata_piece
@@ -25,7 +25,7 @@ see LICENSE file.
 #include "libtorrent/performance_counters.hpp" // for counters
 #include "libtorrent/extensions/ut_pex.hpp"
 #include "libtorrent/aux_/time.hpp"
-#include "libtorrent/aux_/ip_helpers.hpp" // for is_v4
+#include "libtorrent/aux_/pex_encoder.hpp"
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
 
@@ -52,6 +52,38 @@ namespace libtorrent { namespace {
 		return true;
 	}
 
+	// the flags to advertise for a peer
+	pex_flags_t peer_pex_flags(aux::bt_peer_connection const& p)
+	{
+		// 0x01 - peer supports encryption
+		// 0x02 - peer is a seed
+		// 0x04 - supports uTP. This is only a positive flags
+		//        passing 0 doesn't mean the peer doesn't
+		//        support uTP
+		// 0x08 - supports hole punching protocol. If this
+		//        flag is received from a peer, it can be
+		//        used as a rendezvous point in case direct
+		//        connections to the peer fail
+		pex_flags_t flags = p.is_seed() ? pex_seed : pex_flags_t{};
+#if !defined TORRENT_DISABLE_ENCRYPTION
+		flags |= p.supports_encryption() ? pex_encryption : pex_flags_t{};
+#endif
+		flags |= is_utp(p.get_socket()) ? pex_utp : pex_flags_t{};
+		flags |= p.supports_holepunch() ? pex_holepunch : pex_flags_t{};
+		return flags;
+	}
+
+	// keeps a shared pex message alive while it's queued in the send buffer
+	// of a peer connection
+	struct pex_msg_holder
+	{
+		explicit pex_msg_holder(aux::pex_encoder::message m) : m_msg(std::move(m)) {}
+		char* data() const { return const_cast<char*>(m_msg->data()); }
+		std::size_t size() const { return m_msg->size(); }
+	private:
+		aux::pex_encoder::message m_msg;
+	};
+
 	struct ut_pex_plugin final
 		: torrent_plugin
 	{
@@ -69,16 +101,24 @@ namespace libtorrent { namespace {
 		std::shared_ptr<peer_plugin> new_connection(
 			peer_connection_handle const& pc) override;
 
-		std::vector<char>& get_ut_pex_msg()
-		{
-			return m_ut_pex_msg;
-		}
+		aux::pex_encoder const& diff() const { return m_encoder; }
 
-		int peers_in_msg() const
+		// the message with all our peers, sent as the first message to a
+		// peer. It's built at most once per second, and shared by all peers
+		// it's sent to in that time
+		aux::pex_encoder::message const& full_msg()
 		{
-			return m_peers_in_message;
+			if (!m_full_msg)
+			{
+				collect_peers();
+				m_full_msg = aux::pex_encoder::full_message(m_peers, max_peer_entries);
+				m_full_msg_peers = std::min(int(m_peers.size()), int(max_peer_entries));
+			}
+			return m_full_msg;
 		}
 
+		int full_msg_peers() const { return m_full_msg_peers; }
+
 		// the second tick of the torrent
 		// each minute the new lists of "added" + "added.f" and "dropped"
 		// are calculated here and the pex message is created
@@ -86,6 +126,8 @@ namespace libtorrent { namespace {
 		// max_peer_entries limits the packet size
 		void tick() override
 		{
+			m_full_msg.reset();
+
 			if (m_torrent.flags() & torrent_flags::disable_pex) return;
 
 			time_point const now = aux::time_now();
@@ -94,116 +136,55 @@ namespace libtorrent { namespace {
 
 			if (m_torrent.num_peers() == 0) return;
 
-			entry pex;
-			std::string& pla = pex["added"].string();
-			std::string& pld = pex["dropped"].string();
-			std::string& plf = pex["added.f"].string();
-			std::back_insert_iterator<std::string> pla_out(pla);
-			std::back_insert_iterator<std::string> pld_out(pld);
-			std::back_insert_iterator<std::string> plf_out(plf);
-			std::string& pla6 = pex["added6"].string();
-			std::string& pld6 = pex["dropped6"].string();
-			std::string& plf6 = pex["added6.f"].string();
-			std::back_insert_iterator<std::string> pla6_out(pla6);
-			std::back_insert_iterator<std::string> pld6_out(pld6);
-			std::back_insert_iterator<std::string> plf6_out(plf6);
-
-			std::set<tcp::endpoint> dropped;
-			m_old_peers.swap(dropped);
-
-			m_peers_in_message = 0;
-			int num_added = 0;
+			collect_peers();
+			m_encoder.update(m_peers, max_peer_entries);
+		}
+
+	private:
+
+		void collect_peers()
+		{
+			m_peers.clear();
 			for (auto const* peer : m_torrent)
 			{
 				if (!send_peer(*peer)) continue;
 
+				TORRENT_ASSERT(peer->type() == connection_type::bittorrent);
+				auto const* const p = static_cast<aux::bt_peer_connection const*>(peer);
+
 				tcp::endpoint remote = peer->remote();
-				m_old_peers.insert(remote);
 
-				auto const di = dropped.find(remote);
-				if (di == dropped.end())
-				{
-					// don't write too big of a package
-					if (num_added >= max_peer_entries) break;
-
-					TORRENT_ASSERT(peer->type() == connection_type::bittorrent);
-					auto const* const p = static_cast<aux::bt_peer_connection const*>(peer);
-
-					// if the peer has told us which port its listening on,
-					// use that port. But only if we didn't connect to the peer.
-					// if we connected to it, use the port we know works
-					if (!p->is_outgoing())
-					{
-						aux::torrent_peer const* const pi = peer->peer_info_struct();
-						if (pi != nullptr && pi->port > 0)
-							remote.port(pi->port);
-					}
-
-					// no supported flags to set yet
-					// 0x01 - peer supports encryption
-					// 0x02 - peer is a seed
-					// 0x04 - supports uTP. This is only a positive flags
-					//        passing 0 doesn't mean the peer doesn't
-					//        support uTP
-					// 0x08 - supports hole punching protocol. If this
-					//        flag is received from a peer, it can be
-					//        used as a rendezvous point in case direct
-					//        connections to the peer fail
-					pex_flags_t flags = p->is_seed() ? pex_seed : pex_flags_t{};
-#if !defined TORRENT_DISABLE_ENCRYPTION
-					flags |= p->supports_encryption() ? pex_encryption : pex_flags_t{};
-#endif
-					flags |= is_utp(p->get_socket()) ? pex_utp : pex_flags_t{};
-					flags |= p->supports_holepunch() ? pex_holepunch : pex_flags_t{};
-
-					// i->first was added since the last time
-					if (aux::is_v4(remote))
-					{
-						aux::write_endpoint(remote, pla_out);
-						aux::write_uint8(static_cast<std::uint8_t>(flags), plf_out);
-					}
-					else
-					{
-						aux::write_endpoint(remote, pla6_out);
-						aux::write_uint8(static_cast<std::uint8_t>(flags), plf6_out);
-					}
-					++num_added;
-					++m_peers_in_message;
-				}
-				else
+				// if the peer has told us which port its listening on,
+				// use that port. But only if we didn't connect to the peer.
+				// if we connected to it, use the port we know works
+				if (!p->is_outgoing())
 				{
-					// this was in the previous message
-					// so, it wasn't dropped
-					dropped.erase(di);
+					aux::torrent_peer const* const pi = peer->peer_info_struct();
+					if (pi != nullptr && pi->port > 0)
+						remote.port(pi->port);
 				}
-			}
 
-			for (auto const& i : dropped)
-			{
-				if (aux::is_v4(i))
-					aux::write_endpoint(i, pld_out);
-				else
-					aux::write_endpoint(i, pld6_out);
-				++m_peers_in_message;
+				m_peers.push_back({remote, peer_pex_flags(*p)});
 			}
-
-			m_ut_pex_msg.clear();
-			bencode(std::back_inserter(m_ut_pex_msg), pex);
 		}
 
-	private:
 		aux::torrent& m_torrent;
 
-		std::set<tcp::endpoint> m_old_peers;
+		aux::pex_encoder m_encoder;
+
+		// scratch space for the peers to put in a message
+		std::vector<aux::pex_peer> m_peers;
+
+		aux::pex_encoder::message m_full_msg;
+		int m_full_msg_peers = 0;
+
 		time_point m_last_msg;
-		std::vector<char> m_ut_pex_msg;
-		int m_peers_in_message = 0;
 	};
 
 	struct ut_pex_peer_plugin final
 		: aux::ut_pex_peer_store, peer_plugin
 	{
-		ut_pex_peer_plugin(aux::torrent& t, aux::peer_connection& pc, ut_pex_plugin& tp)
+		ut_pex_peer_plugin(aux::torrent& t, aux::bt_peer_connection& pc, ut_pex_plugin& tp)
 			: m_torrent(t)
 			, m_pc(pc)
 			, m_tp(tp)
@@ -300,7 +281,9 @@ namespace libtorrent { namespace {
 			p = pex_msg.dict_find_string("added");
 			bdecode_node const pf = pex_msg.dict_find_string("added.f");
 
-			bool peers_added = false;
+			// the new peers are added to the torrent in one batch
+			std::vector<tcp::endpoint> added_peers;
+			std::vector<pex_flags_t> added_flags;
 #ifndef TORRENT_DISABLE_LOGGING
 			if (p) num_added += p.string_length() / 6;
 #endif
@@ -329,8 +312,8 @@ namespace libtorrent { namespace {
 					// do we already know about this peer?
 					if (j != m_peers.end() && *j == v) continue;
 					m_peers.insert(j, v);
-					m_torrent.add_peer(adr, peer_info::pex, flags);
-					peers_added = true;
+					added_peers.push_back(adr);
+					added_flags.push_back(flags);
 				}
 			}
 
@@ -381,8 +364,8 @@ namespace libtorrent { namespace {
 					// do we already know about this peer?
 					if (j != m_peers6.end() && *j == v) continue;
 					m_peers6.insert(j, v);
-					m_torrent.add_peer(adr, peer_info::pex, flags);
-					peers_added = true;
+					added_peers.push_back(adr);
+					added_flags.push_back(flags);
 				}
 			}
 #ifndef TORRENT_DISABLE_LOGGING
@@ -392,7 +375,11 @@ namespace libtorrent { namespace {
 
 			m_pc.stats_counters().inc_stats_counter(counters::num_incoming_pex);
 
-			if (peers_added) m_torrent.do_connect_boost();
+			if (!added_peers.empty())
+			{
+				m_torrent.add_peers(added_peers, peer_info::pex, {}, added_flags);
+				m_torrent.do_connect_boost();
+			}
 			return true;
 		}
 
@@ -432,45 +419,17 @@ namespace libtorrent { namespace {
 		{
 			if (m_torrent.flags() & torrent_flags::disable_pex) return;
 
-			// if there's no change in our peer set, don't send anything
-			if (m_tp.peers_in_msg() == 0) return;
-
-			std::vector<char> const& pex_msg = m_tp.get_ut_pex_msg();
-
-			char msg[6];
-			char* ptr = msg;
+			aux::pex_encoder const& diff = m_tp.diff();
 
-			aux::write_uint32(1 + 1 + int(pex_msg.size()), ptr);
-			aux::write_uint8(aux::bt_peer_connection::msg_extended, ptr);
-			aux::write_uint8(m_message_index, ptr);
-			m_pc.send_buffer(msg);
-			m_pc.send_buffer(pex_msg);
+			// if there's no change in our peer set, don't send anything
+			if (diff.num_added() + diff.num_dropped() == 0) return;
 
-			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_extended);
-			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_pex);
+			send_pex_msg(diff.msg());
 
 #ifndef TORRENT_DISABLE_LOGGING
-			if (m_pc.should_log(peer_log_alert::outgoing_message))
-			{
-				bdecode_node m;
-				error_code ec;
-				int const ret = bdecode(&pex_msg[0], &pex_msg[0] + pex_msg.size(), m, ec);
-				TORRENT_ASSERT(ret == 0);
-				TORRENT_ASSERT(!ec);
-				TORRENT_UNUSED(ret);
-				int num_dropped = 0;
-				int num_added = 0;
-				bdecode_node e = m.dict_find_string("added");
-				if (e) num_added += e.string_length() / 6;
-				e = m.dict_find_string("dropped");
-				if (e) num_dropped += e.string_length() / 6;
-				e = m.dict_find_string("added6");
-				if (e) num_added += e.string_length() / 18;
-				e = m.dict_find_string("dropped6");
-				if (e) num_dropped += e.string_length() / 18;
-				m_pc.peer_log(peer_log_alert::outgoing_message, peer_log_alert::pex_diff, "dropped: %d added: %d msg_size: %d"
-					, num_dropped, num_added, int(pex_msg.size()));
-			}
+			m_pc.peer_log(peer_log_alert::outgoing_message, peer_log_alert::pex_diff
+				, "dropped: %d added: %d msg_size: %d"
+				, diff.num_dropped(), diff.num_added(), int(diff.msg()->size()));
 #endif
 		}
 
@@ -478,93 +437,35 @@ namespace libtorrent { namespace {
 		{
 			if (m_torrent.flags() & torrent_flags::disable_pex) return;
 
-			entry pex;
-			// leave the dropped string empty
-			pex["dropped"].string();
-			std::string& pla = pex["added"].string();
-			std::string& plf = pex["added.f"].string();
-			std::back_insert_iterator<std::string> pla_out(pla);
-			std::back_insert_iterator<std::string> plf_out(plf);
-
-			pex["dropped6"].string();
-			std::string& pla6 = pex["added6"].string();
-			std::string& plf6 = pex["added6.f"].string();
-			std::back_insert_iterator<std::string> pla6_out(pla6);
-			std::back_insert_iterator<std::string> plf6_out(plf6);
+			aux::pex_encoder::message const& pex_msg = m_tp.full_msg();
+			send_pex_msg(pex_msg);
 
-			int num_added = 0;
-			for (auto const* peer : m_torrent)
-			{
-				if (!send_peer(*peer)) continue;
-
-				// don't write too big of a package
-				if (num_added >= max_peer_entries) break;
-
-				TORRENT_ASSERT(peer->type() == connection_type::bittorrent);
-				auto const* const p = static_cast<aux::bt_peer_connection const*>(peer);
-
-				// no supported flags to set yet
-				// 0x01 - peer supports encryption
-				// 0x02 - peer is a seed
-				// 0x04 - supports uTP. This is only a positive flags
-				//        passing 0 doesn't mean the peer doesn't
-				//        support uTP
-				// 0x08 - supports hole punching protocol. If this
-				//        flag is received from a peer, it can be
-				//        used as a rendezvous point in case direct
-				//        connections to the peer fail
-				std::uint8_t flags = p->is_seed() ? 2u : 0u;
-#if !defined TORRENT_DISABLE_ENCRYPTION
-				flags |= p->supports_encryption() ? 1u : 0u;
+#ifndef TORRENT_DISABLE_LOGGING
+			m_pc.peer_log(peer_log_alert::outgoing_message, peer_log_alert::pex_full
+				, "added: %d msg_size: %d", m_tp.full_msg_peers(), int(pex_msg->size()));
 #endif
-				flags |= is_utp(p->get_socket()) ? 4u : 0u;
-				flags |= p->supports_holepunch() ? 8u : 0u;
-
-				tcp::endpoint remote = peer->remote();
-
-				if (!p->is_outgoing())
-				{
-					aux::torrent_peer const* const pi = peer->peer_info_struct();
-					if (pi != nullptr && pi->port > 0)
-						remote.port(pi->port);
-				}
-
-				// i->first was added since the last time
-				if (aux::is_v4(remote))
-				{
-					aux::write_endpoint(remote, pla_out);
-					aux::write_uint8(flags, plf_out);
-				}
-				else
-				{
-					aux::write_endpoint(remote, pla6_out);
-					aux::write_uint8(flags, plf6_out);
-				}
-				++num_added;
-			}
-			std::vector<char> pex_msg;
-			bencode(std::back_inserter(pex_msg), pex);
+		}
 
+		void send_pex_msg(aux::pex_encoder::message const& pex_msg)
+		{
 			char msg[6];
 			char* ptr = msg;
 
-			aux::write_uint32(1 + 1 + int(pex_msg.size()), ptr);
+			int const size = int(pex_msg->size());
+			aux::write_uint32(1 + 1 + size, ptr);
 			aux::write_uint8(aux::bt_peer_connection::msg_extended, ptr);
 			aux::write_uint8(m_message_index, ptr);
 			m_pc.send_buffer(msg);
-			m_pc.send_buffer(pex_msg);
+			// the message body is shared with all other peers it's sent to
+			m_pc.append_const_send_buffer(pex_msg_holder(pex_msg), size);
+			m_pc.setup_send();
 
 			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_extended);
 			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_pex);
-
-#ifndef TORRENT_DISABLE_LOGGING
-			m_pc.peer_log(peer_log_alert::outgoing_message, peer_log_alert::pex_full
-				, "added: %d msg_size: %d", num_added, int(pex_msg.size()));
-#endif
 		}
 
 		aux::torrent& m_torrent;
-		aux::peer_connection& m_pc;
+		aux::bt_peer_connection& m_pc;
 		ut_pex_plugin& m_tp;
 
 		// the last pex messages we received
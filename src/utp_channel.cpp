@@ -0,0 +1,567 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/utp_channel.hpp"
+#include "libtorrent/aux_/utp_socket_manager.hpp"
+#include "libtorrent/assert.hpp"
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/asio/buffer.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+#include <array>
+
+namespace libtorrent::aux {
+
+namespace {
+
+	// the size of each of the two queues of a channel. Together with the
+	// receive window of the uTP socket, this is how much data may be buffered
+	// in each direction
+	constexpr int queue_size = 32 * 1024;
+}
+
+	utp_channel::utp_channel(io_context& ios, io_context& utp_ios)
+		: m_ios(ios)
+		, m_utp_ios(utp_ios)
+		, m_rx(queue_size)
+		, m_tx(queue_size)
+	{}
+
+	utp_channel::~utp_channel() = default;
+
+	std::shared_ptr<utp_channel> utp_channel::open(io_context& ios, utp_socket_manager& sm)
+	{
+		auto ch = std::make_shared<utp_channel>(ios, sm.get_context());
+		post(sm.get_context(), [ch, &sm]
+		{
+			ch->m_stream.emplace(sm.get_context());
+			ch->m_stream->set_impl(sm.new_utp_socket(&*ch->m_stream));
+			sm.add_channel(ch);
+		});
+		return ch;
+	}
+
+	std::shared_ptr<utp_channel> utp_channel::accept(io_context& ios
+		, utp_socket_manager& sm, utp_stream s)
+	{
+		auto ch = std::make_shared<utp_channel>(ios, sm.get_context());
+		ch->m_stream.emplace(std::move(s));
+		error_code ec;
+		ch->m_remote = ch->m_stream->remote_endpoint(ec);
+		if (utp_socket_impl* impl = ch->m_stream->get_impl())
+			ch->m_sock = impl->m_sock;
+		sm.add_channel(ch);
+		ch->net_start();
+		return ch;
+	}
+
+	// ============ network thread ============
+
+	void utp_channel::detach()
+	{
+		m_user = nullptr;
+		m_read_handler = false;
+		m_write_handler = false;
+		m_writeable_handler = false;
+		m_connect_handler = false;
+		m_read_buffer.clear();
+		m_write_buffer.clear();
+		post(m_utp_ios, [self = shared_from_this()] { self->net_detach(); });
+	}
+
+	void utp_channel::add_read_buffer(void* buf, int const len)
+	{
+		TORRENT_ASSERT(len > 0);
+		m_read_buffer.emplace_back(static_cast<char*>(buf), len);
+	}
+
+	void utp_channel::issue_read()
+	{
+		TORRENT_ASSERT(m_user);
+		TORRENT_ASSERT(!m_read_handler);
+		m_null_buffers = m_read_buffer.empty();
+		m_read_handler = true;
+		try_read();
+	}
+
+	bool utp_channel::rx_eof(error_code& ec) const
+	{
+		// m_rx_done is set after the last bytes were put in the queue, so once
+		// it's set, an empty queue means there won't be any more
+		if (!m_rx_done.load(std::memory_order_acquire) || m_rx.size() > 0) return false;
+		TORRENT_ASSERT(m_rx_error);
+		ec = m_rx_error;
+		return true;
+	}
+
+	std::size_t utp_channel::read_some(bool const clear_buffers, error_code& ec)
+	{
+		ec.clear();
+		std::size_t ret = 0;
+		for (span<char> const b : m_read_buffer)
+		{
+			int const n = m_rx.read(b);
+			ret += std::size_t(n);
+			if (n < b.size()) break;
+		}
+		if (clear_buffers) m_read_buffer.clear();
+
+		if (ret > 0) wake_net_reader();
+		else rx_eof(ec);
+		return ret;
+	}
+
+	void utp_channel::try_read()
+	{
+		while (m_read_handler)
+		{
+			error_code ec;
+			std::size_t bytes = 0;
+			bool done = false;
+			if (m_null_buffers)
+			{
+				// the user just wants to know when there's something to read
+				done = m_rx.size() > 0 || rx_eof(ec);
+			}
+			else
+			{
+				bytes = read_some(false, ec);
+				done = bytes > 0 || ec;
+			}
+
+			if (done)
+			{
+				m_read_handler = false;
+				m_read_buffer.clear();
+				utp_stream::on_read(m_user, bytes, ec, false);
+				return;
+			}
+
+			// wait for the uTP thread to wake us up, unless it put something in
+			// the queue while we were setting the flag
+			m_read_wanted.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_rx.size() == 0 && !m_rx_done.load()) return;
+			if (!m_read_wanted.exchange(false)) return;
+		}
+	}
+
+	void utp_channel::on_readable()
+	{
+		if (m_user == nullptr) return;
+		try_read();
+	}
+
+	void utp_channel::wake_net_reader()
+	{
+		// the uTP thread may have stopped reading, waiting for space in the
+		// receive queue
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_net_read_stalled.load() && m_net_read_stalled.exchange(false))
+			post(m_utp_ios, [self = shared_from_this()] { self->net_read(); });
+	}
+
+	void utp_channel::add_write_buffer(void const* buf, int const len)
+	{
+		TORRENT_ASSERT(len > 0);
+		TORRENT_ASSERT(!m_closed);
+		m_write_buffer.emplace_back(static_cast<char const*>(buf), len);
+	}
+
+	void utp_channel::issue_write()
+	{
+		TORRENT_ASSERT(m_user);
+		TORRENT_ASSERT(!m_write_handler);
+		m_write_handler = true;
+		try_write();
+	}
+
+	std::size_t utp_channel::write_some(bool const clear_buffers)
+	{
+		std::size_t ret = 0;
+		if (!m_tx_done.load(std::memory_order_acquire))
+		{
+			for (span<char const> const b : m_write_buffer)
+			{
+				int const n = m_tx.write(b);
+				ret += std::size_t(n);
+				if (n < b.size()) break;
+			}
+		}
+		if (clear_buffers) m_write_buffer.clear();
+
+		if (ret > 0) wake_net_writer();
+		return ret;
+	}
+
+	bool utp_channel::wait_writable()
+	{
+		m_write_wanted.store(true);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_tx.space() == 0 && !m_tx_done.load()) return false;
+		return m_write_wanted.exchange(false);
+	}
+
+	void utp_channel::try_write()
+	{
+		while (m_write_handler)
+		{
+			std::size_t const bytes = write_some(false);
+			error_code ec;
+			if (bytes == 0 && m_tx_done.load(std::memory_order_acquire))
+				ec = m_tx_error;
+
+			if (bytes > 0 || ec)
+			{
+				m_write_handler = false;
+				m_write_buffer.clear();
+				utp_stream::on_write(m_user, bytes, ec, false);
+				return;
+			}
+
+			// the send queue is full
+			if (!wait_writable()) return;
+		}
+	}
+
+	void utp_channel::subscribe_writeable()
+	{
+		TORRENT_ASSERT(m_user);
+		TORRENT_ASSERT(!m_writeable_handler);
+		m_writeable_handler = true;
+		try_writeable();
+	}
+
+	void utp_channel::try_writeable()
+	{
+		while (m_writeable_handler)
+		{
+			bool const failed = m_tx_done.load(std::memory_order_acquire);
+			if (m_tx.space() > 0 || failed)
+			{
+				m_writeable_handler = false;
+				utp_stream::on_writeable(m_user, failed ? m_tx_error : error_code());
+				return;
+			}
+
+			if (!wait_writable()) return;
+		}
+	}
+
+	void utp_channel::on_writable()
+	{
+		if (m_user == nullptr) return;
+		try_write();
+		try_writeable();
+	}
+
+	void utp_channel::wake_net_writer()
+	{
+		// the uTP thread may have stopped sending, since the send queue was
+		// empty
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_net_write_idle.load() && m_net_write_idle.exchange(false))
+			post(m_utp_ios, [self = shared_from_this()] { self->net_write(); });
+	}
+
+	void utp_channel::do_connect(tcp::endpoint const& ep)
+	{
+		TORRENT_ASSERT(m_user);
+		TORRENT_ASSERT(!m_connect_handler);
+		m_connect_handler = true;
+		m_remote = ep;
+		post(m_utp_ios, [self = shared_from_this(), ep] { self->net_connect(ep); });
+	}
+
+	void utp_channel::on_connected(error_code const& ec)
+	{
+		if (!m_connect_handler) return;
+		m_connect_handler = false;
+		utp_stream::on_connect(m_user, ec, false);
+	}
+
+	void utp_channel::close()
+	{
+		if (m_closed) return;
+		m_closed = true;
+
+		// just like with utp_socket_impl, an outstanding write fails once the
+		// stream is closed. Whatever is in the send queue is still sent
+		if (m_write_handler)
+		{
+			m_write_handler = false;
+			m_write_buffer.clear();
+			utp_stream::on_write(m_user, 0, boost::asio::error::eof, false);
+		}
+		post(m_utp_ios, [self = shared_from_this()] { self->net_close(); });
+	}
+
+	void utp_channel::set_close_reason(close_reason_t const code)
+	{
+		post(m_utp_ios, [self = shared_from_this(), code]
+		{
+			if (self->m_stream) self->m_stream->set_close_reason(code);
+		});
+	}
+
+	void utp_channel::cancel_handlers(error_code const& ec)
+	{
+		bool const read = m_read_handler;
+		bool const write = m_write_handler;
+		bool const writeable = m_writeable_handler;
+		bool const connect = m_connect_handler;
+		m_read_handler = false;
+		m_write_handler = false;
+		m_writeable_handler = false;
+		m_connect_handler = false;
+		m_read_buffer.clear();
+		m_write_buffer.clear();
+
+		if (read) utp_stream::on_read(m_user, 0, ec, false);
+		if (write) utp_stream::on_write(m_user, 0, ec, false);
+		if (writeable) utp_stream::on_writeable(m_user, ec);
+		if (connect) utp_stream::on_connect(m_user, ec, false);
+	}
+
+	tcp::endpoint utp_channel::remote_endpoint(error_code& ec) const
+	{
+		if (m_remote == tcp::endpoint())
+		{
+			ec = boost::asio::error::not_connected;
+			return {};
+		}
+		return m_remote;
+	}
+
+	tcp::endpoint utp_channel::local_endpoint(error_code& ec) const
+	{
+		auto s = m_sock.lock();
+		if (!s)
+		{
+			ec = boost::asio::error::not_connected;
+			return {};
+		}
+
+		udp::endpoint const ep = s->get_local_endpoint();
+		return {ep.address(), ep.port()};
+	}
+
+	void utp_channel::set_udp_socket(std::weak_ptr<utp_socket_interface> sock)
+	{
+		m_sock = sock;
+		post(m_utp_ios, [self = shared_from_this(), s = std::move(sock)]
+		{
+			if (self->m_stream) self->m_stream->set_udp_socket(s);
+		});
+	}
+
+	// ============ uTP thread ============
+
+	void utp_channel::net_connect(tcp::endpoint const& ep)
+	{
+		if (!m_stream)
+		{
+			net_on_connect(boost::asio::error::not_connected);
+			return;
+		}
+		m_stream->async_connect(ep, [self = shared_from_this()](error_code const& ec)
+			{ self->net_on_connect(ec); });
+	}
+
+	void utp_channel::net_on_connect(error_code const& ec)
+	{
+		if (ec)
+		{
+			net_read_failed(ec);
+			net_write_failed(ec);
+		}
+		else
+		{
+			net_start();
+		}
+		post(m_ios, [self = shared_from_this(), ec] { self->on_connected(ec); });
+	}
+
+	void utp_channel::net_start()
+	{
+		net_read();
+		net_write();
+	}
+
+	void utp_channel::net_read()
+	{
+		while (m_stream && !m_net_reading && !m_rx_done.load(std::memory_order_relaxed))
+		{
+			auto const r = m_rx.write_regions();
+			if (r[0].empty())
+			{
+				// the receive queue is full. Wait for the user to make room,
+				// unless it did so while we were setting the flag
+				m_net_read_stalled.store(true);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (m_rx.space() == 0) return;
+				if (!m_net_read_stalled.exchange(false)) return;
+				continue;
+			}
+
+			std::array<boost::asio::mutable_buffer, 2> const bufs{{
+				{r[0].data(), std::size_t(r[0].size())}
+				, {r[1].data(), std::size_t(r[1].size())}}};
+			m_net_reading = true;
+			m_stream->async_read_some(bufs
+				, [self = shared_from_this()](error_code const& ec, std::size_t const bytes)
+				{ self->net_on_read(ec, bytes); });
+		}
+	}
+
+	void utp_channel::net_on_read(error_code const& ec, std::size_t const bytes)
+	{
+		m_net_reading = false;
+		if (bytes > 0)
+		{
+			m_rx.commit_write(int(bytes));
+			wake_reader();
+		}
+		if (ec)
+		{
+			net_read_failed(ec);
+			return;
+		}
+		net_read();
+	}
+
+	void utp_channel::net_read_failed(error_code const& ec)
+	{
+		TORRENT_ASSERT(ec);
+		if (m_rx_done.load(std::memory_order_relaxed)) return;
+		if (m_stream)
+			m_incoming_close_reason.store(m_stream->get_close_reason(), std::memory_order_relaxed);
+		m_rx_error = ec;
+		m_rx_done.store(true, std::memory_order_release);
+		wake_reader();
+	}
+
+	void utp_channel::wake_reader()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_read_wanted.load() && m_read_wanted.exchange(false))
+			post(m_ios, [self = shared_from_this()] { self->on_readable(); });
+	}
+
+	void utp_channel::net_write()
+	{
+		while (m_stream && !m_net_writing && !m_tx_done.load(std::memory_order_relaxed))
+		{
+			auto const r = m_tx.read_regions();
+			if (r[0].empty())
+			{
+				// everything has been sent
+				net_maybe_close();
+				if (!m_stream) return;
+
+				// wait for the user to write more, unless it did so while we were
+				// setting the flag
+				m_net_write_idle.store(true);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (m_tx.size() == 0) return;
+				if (!m_net_write_idle.exchange(false)) return;
+				continue;
+			}
+
+			std::array<boost::asio::const_buffer, 2> const bufs{{
+				{r[0].data(), std::size_t(r[0].size())}
+				, {r[1].data(), std::size_t(r[1].size())}}};
+			m_net_writing = true;
+			m_stream->async_write_some(bufs
+				, [self = shared_from_this()](error_code const& ec, std::size_t const bytes)
+				{ self->net_on_write(ec, bytes); });
+		}
+	}
+
+	void utp_channel::net_on_write(error_code const& ec, std::size_t const bytes)
+	{
+		m_net_writing = false;
+		if (bytes > 0)
+		{
+			m_tx.commit_read(int(bytes));
+			wake_writer();
+		}
+		if (ec)
+		{
+			net_write_failed(ec);
+			net_maybe_close();
+			return;
+		}
+		net_write();
+	}
+
+	void utp_channel::net_write_failed(error_code const& ec)
+	{
+		TORRENT_ASSERT(ec);
+		if (m_tx_done.load(std::memory_order_relaxed)) return;
+		m_tx_error = ec;
+		m_tx_done.store(true, std::memory_order_release);
+		wake_writer();
+	}
+
+	void utp_channel::wake_writer()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_write_wanted.load() && m_write_wanted.exchange(false))
+			post(m_ios, [self = shared_from_this()] { self->on_writable(); });
+	}
+
+	void utp_channel::net_close()
+	{
+		m_net_closing = true;
+		net_maybe_close();
+	}
+
+	void utp_channel::net_detach()
+	{
+		m_net_detached = true;
+		net_maybe_close();
+	}
+
+	void utp_channel::net_maybe_close()
+	{
+		if (!m_stream || m_net_writing) return;
+
+		// whatever is left in the send queue is sent before closing, unless
+		// the stream has failed
+		if (m_tx.size() > 0 && !m_tx_done.load(std::memory_order_relaxed)) return;
+
+		if (m_net_detached)
+		{
+			// destructing the stream closes it. The uTP socket lingers until its
+			// FIN has been acknowledged
+			net_abort();
+			return;
+		}
+
+		if (m_net_closing && !m_net_closed)
+		{
+			m_net_closed = true;
+			m_stream->close();
+		}
+	}
+
+	void utp_channel::net_abort()
+	{
+		if (!m_stream) return;
+
+		// the stream must not have any outstanding operations when it's
+		// destructed. Cancelling them posts their handlers, which still hold a
+		// reference to this channel
+		error_code ec;
+		m_stream->cancel(ec);
+		m_stream.reset();
+	}
+}
@@ -11,6 +11,7 @@ see LICENSE file.
 */
 
 #include "libtorrent/aux_/utp_stream.hpp"
+#include "libtorrent/aux_/utp_channel.hpp"
 #include "libtorrent/aux_/udp_socket.hpp"
 #include "libtorrent/aux_/utp_socket_manager.hpp"
 #include "libtorrent/aux_/instantiate_connection.hpp"
@@ -22,6 +23,8 @@ see LICENSE file.
 #include "libtorrent/aux_/time.hpp" // for aux::time_now()
 #include "libtorrent/span.hpp"
 
+#include <limits>
+
 // #define TORRENT_DEBUG_MTU 1135
 
 namespace libtorrent::aux {
@@ -35,6 +38,8 @@ namespace libtorrent::aux {
 		, void* ssl_context)
 		: m_send_fun(std::move(send_fun))
 		, m_cb(std::move(cb))
+		, m_wheel_cursor(wheel_slot(clock_type::now()))
+		, m_pacing_timer(ios)
 		, m_sett(sett)
 		, m_counters(cnt)
 		, m_ios(ios)
@@ -45,21 +50,116 @@ namespace libtorrent::aux {
 
 	utp_socket_manager::~utp_socket_manager() = default;
 
-	void utp_socket_manager::tick(time_point now)
+	std::int64_t utp_socket_manager::wheel_slot(time_point const t)
 	{
-		for (auto i = m_utp_sockets.begin()
-			, end(m_utp_sockets.end()); i != end;)
+		if (t == time_point::min()) return std::numeric_limits<std::int64_t>::min();
+		if (t == time_point::max()) return std::numeric_limits<std::int64_t>::max();
+		return total_milliseconds(t.time_since_epoch()) / timer_wheel_resolution;
+	}
+
+	int utp_socket_manager::tick(time_point const now)
+	{
+		std::int64_t const now_slot = wheel_slot(now);
+		int visited = 0;
+
+		// if we haven't been ticked in a whole revolution of the wheel, every
+		// slot has expired, but there's no need to visit any of them more
+		// than once
+		std::int64_t const last = std::min(now_slot
+			, m_wheel_cursor + timer_wheel_size - 1);
+
+		while (m_wheel_cursor <= last)
 		{
-			if (i->second->should_delete())
+			std::int64_t const slot = m_wheel_cursor++;
+			auto& bucket = m_timer_wheel[std::size_t(slot) & (timer_wheel_size - 1)];
+			if (bucket.empty()) continue;
+
+			// sockets may be filed again (into later slots) as we tick them,
+			// so move this slot out of the wheel first
+			m_expired_sockets.clear();
+			m_expired_sockets.swap(bucket);
+			for (auto* s : m_expired_sockets) s->m_wheel_slot = -1;
+
+			for (auto* s : m_expired_sockets)
 			{
-				if (m_last_socket == i->second.get()) m_last_socket = nullptr;
-				if (m_deferred_ack == i->second.get()) m_deferred_ack = nullptr;
-				i = m_utp_sockets.erase(i);
-				continue;
+				// ticking an earlier socket in this slot may have caused this
+				// one to be filed again
+				if (s->m_wheel_slot != -1) continue;
+
+				++visited;
+				if (s->should_delete())
+				{
+					delete_socket(s);
+					continue;
+				}
+
+				if (now > s->next_tick()) s->tick(now);
+
+				time_point const next = s->next_tick();
+				if (next != time_point::max()) schedule_tick(s, next);
 			}
-			i->second->tick(now);
-			++i;
 		}
+
+		m_wheel_cursor = std::max(m_wheel_cursor, now_slot + 1);
+		return visited;
+	}
+
+	void utp_socket_manager::schedule_tick(utp_socket_impl* s, time_point const at)
+	{
+		std::int64_t const slot = std::max(wheel_slot(at), m_wheel_cursor);
+		if (s->m_wheel_slot != -1)
+		{
+			if (s->m_wheel_slot <= slot) return;
+			unlink_timer(s);
+		}
+		file_timer(s, slot);
+	}
+
+	void utp_socket_manager::file_timer(utp_socket_impl* s, std::int64_t const slot)
+	{
+		TORRENT_ASSERT(s->m_wheel_slot == -1);
+		TORRENT_ASSERT(slot >= m_wheel_cursor);
+		auto& bucket = m_timer_wheel[std::size_t(slot) & (timer_wheel_size - 1)];
+		s->m_wheel_slot = slot;
+		s->m_wheel_pos = int(bucket.size());
+		bucket.push_back(s);
+	}
+
+	void utp_socket_manager::unlink_timer(utp_socket_impl* s)
+	{
+		if (s->m_wheel_slot == -1) return;
+		auto& bucket = m_timer_wheel[std::size_t(s->m_wheel_slot) & (timer_wheel_size - 1)];
+		auto const pos = std::size_t(s->m_wheel_pos);
+		TORRENT_ASSERT(pos < bucket.size());
+		TORRENT_ASSERT(bucket[pos] == s);
+		bucket[pos] = bucket.back();
+		bucket[pos]->m_wheel_pos = int(pos);
+		bucket.pop_back();
+		s->m_wheel_slot = -1;
+		s->m_wheel_pos = -1;
+	}
+
+	void utp_socket_manager::delete_socket(utp_socket_impl* s)
+	{
+		unlink_timer(s);
+		if (m_last_socket == s) m_last_socket = nullptr;
+		if (m_deferred_ack == s) m_deferred_ack = nullptr;
+		if (m_held_ack_socket == s) m_held_ack_socket = nullptr;
+		if (s->paced())
+		{
+			auto const i = std::find_if(m_paced_sockets.begin(), m_paced_sockets.end()
+				, [s](std::pair<time_point, utp_socket_impl*> const& e) { return e.second == s; });
+			TORRENT_ASSERT(i != m_paced_sockets.end());
+			if (i != m_paced_sockets.end()) m_paced_sockets.erase(i);
+		}
+		auto r = m_utp_sockets.equal_range(s->receive_id());
+		for (; r.first != r.second; ++r.first)
+		{
+			if (r.first->second.get() != s) continue;
+			m_utp_sockets.erase(r.first);
+			return;
+		}
+		TORRENT_ASSERT_FAIL();
 	}
 
 	int utp_socket_manager::mtu_for_dest(address const& addr) const
@@ -134,9 +234,12 @@ namespace libtorrent::aux {
 		// in most cases it is
 		if (m_last_socket && m_last_socket->match(ep, id))
 		{
+			if (hold_ack(m_last_socket, ph, p, ep, receive_time)) return true;
 			return m_last_socket->incoming_packet(p, ep, receive_time);
 		}
 
+		flush_held_ack();
+
 		// we send the deferred ACK when the socket is drained as well,
 		// so as long as the incoming packets go to the last socket
 		// (m_last_socket) we can derfer the ACK more. However, if we
@@ -152,9 +255,15 @@ namespace libtorrent::aux {
 
 		for (; r.first != r.second; ++r.first)
 		{
-			if (!r.first->second->match(ep, id)) continue;
-			bool const ret = r.first->second->incoming_packet(p, ep, receive_time);
-			if (ret) m_last_socket = r.first->second.get();
+			utp_socket_impl* const s = r.first->second.get();
+			if (!s->match(ep, id)) continue;
+			if (hold_ack(s, ph, p, ep, receive_time))
+			{
+				m_last_socket = s;
+				return true;
+			}
+			bool const ret = s->incoming_packet(p, ep, receive_time);
+			if (ret) m_last_socket = s;
 			return ret;
 		}
 
@@ -208,6 +317,97 @@ namespace libtorrent::aux {
 		return false;
 	}
 
+	bool utp_socket_manager::hold_ack(utp_socket_impl* const s
+		, utp_header const* const ph, span<char const> const p
+		, udp::endpoint const& ep, time_point const receive_time)
+	{
+		if (!m_sett.get_bool(settings_pack::utp_coalesce_acks))
+		{
+			flush_held_ack();
+			return false;
+		}
+
+		auto const* held = m_held_ack_socket == s
+			? reinterpret_cast<utp_header const*>(m_held_ack.data()) : nullptr;
+		switch (coalesce_ack(*ph, held))
+		{
+			case utp_ack_action::deliver:
+				flush_held_ack();
+				return false;
+			case utp_ack_action::hold:
+				flush_held_ack();
+				break;
+			case utp_ack_action::replace:
+				break;
+		}
+
+		m_held_ack_socket = s;
+		m_held_ack.assign(p.begin(), p.end());
+		m_held_ack_ep = ep;
+		m_held_ack_time = receive_time;
+		return true;
+	}
+
+	void utp_socket_manager::flush_held_ack()
+	{
+		if (m_held_ack_socket == nullptr) return;
+		utp_socket_impl* const s = m_held_ack_socket;
+		m_held_ack_socket = nullptr;
+
+		// the socket may defer the ACK it sends in response, and only one
+		// socket at a time may do that
+		if (m_deferred_ack && m_deferred_ack != s)
+		{
+			m_deferred_ack->send_deferred_ack();
+			m_deferred_ack = nullptr;
+		}
+		s->incoming_packet(m_held_ack, m_held_ack_ep, m_held_ack_time);
+	}
+
+	void utp_socket_manager::subscribe_pacing(utp_socket_impl* const s, time_point const at)
+	{
+		TORRENT_ASSERT(std::find_if(m_paced_sockets.begin(), m_paced_sockets.end()
+			, [s](std::pair<time_point, utp_socket_impl*> const& e) { return e.second == s; })
+			== m_paced_sockets.end());
+		m_paced_sockets.emplace_back(at, s);
+		if (at < m_pacing_expiry) arm_pacing_timer(at);
+	}
+
+	void utp_socket_manager::arm_pacing_timer(time_point const at)
+	{
+		m_pacing_expiry = at;
+		m_pacing_timer.expires_at(at);
+		m_pacing_timer.async_wait([this](error_code const& ec) { on_pacing_timer(ec); });
+	}
+
+	void utp_socket_manager::on_pacing_timer(error_code const& ec)
+	{
+		// the timer is cancelled when it's moved to an earlier time, or when
+		// we're shutting down. In the latter case, this object may not exist
+		// anymore
+		if (ec) return;
+
+		m_pacing_expiry = time_point::max();
+		time_point const now = clock_type::now();
+		time_point next = time_point::max();
+
+		m_temp_paced.clear();
+		m_paced_sockets.swap(m_temp_paced);
+		for (auto const& e : m_temp_paced)
+		{
+			if (e.first > now)
+			{
+				m_paced_sockets.push_back(e);
+				next = std::min(next, e.first);
+				continue;
+			}
+			// this may subscribe the socket again
+			e.second->pacer_wakeup();
+		}
+
+		if (next < m_pacing_expiry) arm_pacing_timer(next);
+	}
+
 	void utp_socket_manager::subscribe_writable(utp_socket_impl* s)
 	{
 		TORRENT_ASSERT(std::find(m_stalled_sockets.begin(), m_stalled_sockets.end()
@@ -230,6 +430,8 @@ namespace libtorrent::aux {
 
 	void utp_socket_manager::socket_drained()
 	{
+		flush_held_ack();
+
 		if (m_deferred_ack)
 		{
 			utp_socket_impl* s = m_deferred_ack;
@@ -282,9 +484,7 @@ namespace libtorrent::aux {
 	{
 		auto const i = m_utp_sockets.find(id);
 		if (i == m_utp_sockets.end()) return;
-		if (m_last_socket == i->second.get()) m_last_socket = nullptr;
-		if (m_deferred_ack == i->second.get()) m_deferred_ack = nullptr;
-		m_utp_sockets.erase(i);
+		delete_socket(i->second.get());
 	}
 
 	void utp_socket_manager::inc_stats_counter(int counter, int delta)
@@ -314,6 +514,28 @@ namespace libtorrent::aux {
 		auto impl = std::make_unique<utp_socket_impl>(recv_id, send_id, str, *this);
 		auto* const ret = impl.get();
 		m_utp_sockets.emplace(recv_id, std::move(impl));
+		schedule_tick(ret, ret->next_tick());
 		return ret;
 	}
+
+	void utp_socket_manager::add_channel(std::weak_ptr<utp_channel> ch)
+	{
+		if (m_channels.size() >= m_channels_prune_size)
+		{
+			m_channels.erase(std::remove_if(m_channels.begin(), m_channels.end()
+				, [](std::weak_ptr<utp_channel> const& c) { return c.expired(); })
+				, m_channels.end());
+			m_channels_prune_size = std::max(std::size_t(64), m_channels.size() * 2);
+		}
+		m_channels.emplace_back(std::move(ch));
+	}
+
+	void utp_socket_manager::close_channels()
+	{
+		for (auto const& c : m_channels)
+		{
+			if (auto ch = c.lock()) ch->net_abort();
+		}
+		m_channels.clear();
+	}
 }
@@ -17,6 +17,7 @@ see LICENSE file.
 #include "libtorrent/config.hpp"
 #include "libtorrent/aux_/utp_stream.hpp"
 #include "libtorrent/aux_/utp_socket_manager.hpp"
+#include "libtorrent/aux_/utp_channel.hpp"
 #include "libtorrent/aux_/alloca.hpp"
 #include "libtorrent/error.hpp"
 #include "libtorrent/aux_/random.hpp"
@@ -133,6 +134,43 @@ bool compare_less_wrap(std::uint32_t lhs
 	return dist_up < dist_down;
 }
 
+std::int64_t utp_pacer::rate(std::int64_t const cwnd, int const rtt, bool const slow_start)
+{
+	TORRENT_ASSERT(rtt > 0);
+	return std::max(std::int64_t(1), cwnd * 1000 * (slow_start ? 2 : 1) / rtt);
+}
+
+time_duration utp_pacer::delay(int const bytes, time_point const now
+	, std::int64_t const rate, int const mtu)
+{
+	TORRENT_ASSERT(rate > 0);
+	std::int64_t const max_burst = std::max(std::int64_t(mtu) * 2, rate / 1000);
+
+	std::int64_t const elapsed = std::min(total_microseconds(now - m_last)
+		, std::int64_t(1000000));
+	m_last = now;
+	m_credit = std::min(max_burst, m_credit + elapsed * rate / 1000000);
+
+	if (m_credit >= bytes)
+	{
+		m_credit -= bytes;
+		return time_duration(0);
+	}
+	return microseconds((bytes - m_credit) * 1000000 / rate + 1);
+}
+
+utp_ack_action coalesce_ack(utp_header const& ph, utp_header const* const held)
+{
+	if (ph.get_type() != ST_STATE
+		|| (ph.extension != utp_no_extension && ph.extension != utp_sack))
+		return utp_ack_action::deliver;
+
+	if (held != nullptr && compare_less_wrap(held->ack_nr, ph.ack_nr, 0xffff))
+		return utp_ack_action::replace;
+
+	return utp_ack_action::hold;
+}
+
 utp_socket_impl::utp_socket_impl(std::uint16_t const recv_id
 	, std::uint16_t const send_id
 	, utp_stream* userdata, utp_socket_manager& sm)
@@ -154,12 +192,14 @@ utp_socket_impl::utp_socket_impl(std::uint16_t const recv_id
 	, m_subscribe_drained(false)
 	, m_stalled(false)
 	, m_confirmed(false)
+	, m_paced(false)
 {
 	TORRENT_ASSERT((m_recv_id == ((m_send_id + 1) & 0xffff))
 		|| (m_send_id == ((m_recv_id + 1) & 0xffff)));
 	m_sm.inc_stats_counter(counters::num_utp_idle);
 	TORRENT_ASSERT(m_userdata);
 	m_delay_sample_hist.fill(std::numeric_limits<std::uint32_t>::max());
+	m_receive_buffer_capacity = m_sm.max_window();
 }
 
 tcp::endpoint utp_socket_impl::remote_endpoint(error_code& ec) const
@@ -224,6 +264,15 @@ udp::endpoint utp_socket_impl::remote_endpoint() const
 	return {m_remote_address, m_port};
 }
 
+time_point utp_socket_impl::next_tick() const
+{
+	// in these states there's nothing for tick() to do. We're waiting for the
+	// client to detach
+	if (state() == state_t::error_wait || state() == state_t::deleting)
+		return time_point::max();
+	return m_timeout;
+}
+
 void utp_socket_impl::send_deferred_ack()
 {
 	TORRENT_ASSERT(m_deferred_ack);
@@ -276,6 +325,7 @@ void utp_socket_impl::update_mtu_limits()
 	m_mtu_seq = 0;
 }
 
+// the delay of a stream forwarded to a channel isn't known on this thread
 int utp_stream::send_delay() const
 {
 	return m_impl ? m_impl->send_delay() : 0;
@@ -300,28 +350,33 @@ utp_socket_impl* utp_stream::get_impl()
 
 void utp_stream::set_close_reason(close_reason_t code)
 {
+	if (m_channel) m_channel->set_close_reason(code);
 	if (!m_impl) return;
 	m_impl->set_close_reason(code);
 }
 
 close_reason_t utp_stream::get_close_reason() const
 {
+	if (m_channel) return m_channel->incoming_close_reason();
 	return m_incoming_close_reason;
 }
 
 void utp_stream::close()
 {
+	if (m_channel) m_channel->close();
 	if (!m_impl) return;
 	m_impl->close();
 }
 
 std::size_t utp_stream::available() const
 {
+	if (m_channel) return m_channel->available();
 	return m_impl ? m_impl->available() : 0;
 }
 
 utp_stream::endpoint_type utp_stream::remote_endpoint(error_code& ec) const
 {
+	if (m_channel) return m_channel->remote_endpoint(ec);
 	if (!m_impl)
 	{
 		ec = boost::asio::error::not_connected;
@@ -332,6 +387,7 @@ utp_stream::endpoint_type utp_stream::remote_endpoint(error_code& ec) const
 
 utp_stream::endpoint_type utp_stream::local_endpoint(error_code& ec) const
 {
+	if (m_channel) return m_channel->local_endpoint(ec);
 	if (m_impl == nullptr)
 	{
 		ec = boost::asio::error::not_connected;
@@ -352,16 +408,23 @@ utp_stream::endpoint_type utp_stream::local_endpoint(error_code& ec) const
 utp_stream::utp_stream(utp_stream&& rhs) noexcept
 	: m_io_service(rhs.m_io_service)
 	, m_impl(rhs.m_impl)
+	, m_channel(std::move(rhs.m_channel))
 	, m_open(rhs.m_open)
 {
 	if (&rhs == this) return;
 	rhs.m_open = false;
 	rhs.m_impl = nullptr;
 	if (m_impl) m_impl->set_userdata(this);
+	if (m_channel) m_channel->set_user(this);
 }
 
 utp_stream::~utp_stream()
 {
+	if (m_channel)
+	{
+		m_channel->detach();
+		m_channel.reset();
+	}
 	if (m_impl)
 	{
 		UTP_LOGV("%8p: utp_stream destructed\n", static_cast<void*>(m_impl));
@@ -379,8 +442,33 @@ void utp_stream::set_impl(utp_socket_impl* impl)
 	m_open = true;
 }
 
+void utp_stream::set_channel(std::shared_ptr<utp_channel> ch)
+{
+	TORRENT_ASSERT(m_impl == nullptr);
+	TORRENT_ASSERT(!m_channel);
+	TORRENT_ASSERT(!m_open);
+	m_channel = std::move(ch);
+	m_channel->set_user(this);
+	m_open = true;
+}
+
+void utp_stream::attach(utp_socket_manager& sm)
+{
+	if (&sm.get_context() == &m_io_service)
+		set_impl(sm.new_utp_socket(this));
+	else
+		set_channel(utp_channel::open(m_io_service, sm));
+}
+
+void utp_stream::set_udp_socket(std::weak_ptr<utp_socket_interface> sock)
+{
+	if (m_channel) m_channel->set_udp_socket(std::move(sock));
+	else if (m_impl) m_impl->m_sock = std::move(sock);
+}
+
 int utp_stream::read_buffer_size() const
 {
+	if (m_channel) return m_channel->read_buffer_size();
 	TORRENT_ASSERT(m_impl);
 	return m_impl->receive_buffer_size();
 }
@@ -400,7 +488,8 @@ void utp_stream::on_read(utp_stream* s, std::size_t const bytes_transferred
 		, int(bytes_transferred), ec.message().c_str(), shutdown);
 
 	TORRENT_ASSERT(s->m_read_handler);
-	TORRENT_ASSERT(bytes_transferred > 0 || ec || s->m_impl->null_buffers());
+	TORRENT_ASSERT(bytes_transferred > 0 || ec
+		|| (s->m_channel ? s->m_channel->null_buffers() : s->m_impl->null_buffers()));
 	post(s->m_io_service, std::bind<void>(std::move(s->m_read_handler), ec, bytes_transferred));
 	s->m_read_handler = nullptr;
 	if (shutdown && s->m_impl)
@@ -461,11 +550,12 @@ void utp_stream::on_connect(utp_stream* s, error_code const& ec, bool const shut
 
 void utp_stream::add_read_buffer(void* buf, int const len)
 {
-	TORRENT_ASSERT(m_impl);
+	TORRENT_ASSERT(m_impl || m_channel);
 	TORRENT_ASSERT(len < INT_MAX);
 	TORRENT_ASSERT(len > 0);
 	TORRENT_ASSERT(buf);
-	m_impl->add_read_buffer(buf, len);
+	if (m_channel) m_channel->add_read_buffer(buf, len);
+	else m_impl->add_read_buffer(buf, len);
 }
 
 // this is the wrapper to add a user provided write buffer to the
@@ -473,16 +563,18 @@ void utp_stream::add_read_buffer(void* buf, int const len)
 // up to date
 void utp_stream::add_write_buffer(void const* buf, int const len)
 {
-	TORRENT_ASSERT(m_impl);
+	TORRENT_ASSERT(m_impl || m_channel);
 	TORRENT_ASSERT(len < INT_MAX);
 	TORRENT_ASSERT(len > 0);
 	TORRENT_ASSERT(buf);
-	m_impl->add_write_buffer(buf, len);
+	if (m_channel) m_channel->add_write_buffer(buf, len);
+	else m_impl->add_write_buffer(buf, len);
 }
 
 bool utp_stream::check_fin_sent() const
 {
-	TORRENT_ASSERT(m_impl);
+	TORRENT_ASSERT(m_impl || m_channel);
+	if (m_channel) return m_channel->check_fin_sent();
 	return m_impl->check_fin_sent();
 }
 
@@ -493,11 +585,13 @@ bool utp_stream::check_fin_sent() const
 // handler immediately.
 void utp_stream::issue_read()
 {
-	m_impl->issue_read();
+	if (m_channel) m_channel->issue_read();
+	else m_impl->issue_read();
 }
 
 std::size_t utp_stream::read_some(bool const clear_buffers, error_code& ec)
 {
+	if (m_channel) return m_channel->read_some(clear_buffers, ec);
 	return m_impl->read_some(clear_buffers, ec);
 }
 
@@ -505,6 +599,7 @@ std::size_t utp_stream::read_some(bool const clear_buffers, error_code& ec)
 // immediately if there is some space in the congestion window.
 std::size_t utp_stream::write_some(bool const clear_buffers)
 {
+	if (m_channel) return m_channel->write_some(clear_buffers);
 	return m_impl->write_some(clear_buffers);
 }
 
@@ -512,17 +607,20 @@ std::size_t utp_stream::write_some(bool const clear_buffers)
 // added. Start trying to send packets with the payload immediately.
 void utp_stream::issue_write()
 {
-	m_impl->issue_write();
+	if (m_channel) m_channel->issue_write();
+	else m_impl->issue_write();
 }
 
 void utp_stream::subscribe_writeable()
 {
-	m_impl->subscribe_writeable();
+	if (m_channel) m_channel->subscribe_writeable();
+	else m_impl->subscribe_writeable();
 }
 
 void utp_stream::do_connect(tcp::endpoint const& ep)
 {
-	m_impl->do_connect(ep);
+	if (m_channel) m_channel->do_connect(ep);
+	else m_impl->do_connect(ep);
 }
 
 // =========== utp_socket_impl ============
@@ -828,9 +926,10 @@ bool utp_socket_impl::should_delete() const
 	// pointer to this socket, waiting for the UDP socket to
 	// become writable again. We have to wait for that, so that
 	// the pointer is removed from that queue. Otherwise we would
-	// leave a dangling pointer in the socket manager
+	// leave a dangling pointer in the socket manager. The same
+	// goes for m_paced
 	bool ret = (m_state >= static_cast<std::uint8_t>(state_t::error_wait) || state() == state_t::none)
-		&& !m_attached && !m_stalled;
+		&& !m_attached && !m_stalled && !m_paced;
 
 	if (ret)
 	{
@@ -963,6 +1062,9 @@ void utp_socket_impl::detach()
 
 	UTP_LOGV("%8p: detach()\n", static_cast<void*>(this));
 	m_attached = false;
+
+	// we may be ready to be deleted now
+	m_sm.schedule_tick(this, time_point::min());
 }
 
 void utp_socket_impl::send_syn()
@@ -1062,6 +1164,7 @@ void utp_socket_impl::writable()
 #endif
 	TORRENT_ASSERT(m_stalled);
 	m_stalled = false;
+	m_sm.schedule_tick(this, time_point::min());
 	maybe_trigger_writeable_callback({});
 	if (should_delete()) return;
 
@@ -1084,6 +1187,45 @@ void utp_socket_impl::writable()
 	maybe_trigger_send_callback({});
 }
 
+// returns true if we don't have enough pacing credit to send ``bytes`` right
+// now. In that case we subscribe to the socket manager's pacing timer, to try
+// again once we do
+bool utp_socket_impl::pace(int const bytes)
+{
+	if (m_paced) return true;
+
+	// without an RTT estimate we don't know what rate to pace at
+	int const rtt = m_rtt.mean();
+	if (rtt <= 0) return false;
+
+	std::int64_t const rate = utp_pacer::rate(m_cwnd >> 16, rtt, m_slow_start);
+	time_point const now = clock_type::now();
+	time_duration const wait = m_pacer.delay(bytes, now, rate, m_mtu);
+	if (wait == time_duration(0)) return false;
+
+	m_paced = true;
+	m_sm.subscribe_pacing(this, now + wait);
+	return true;
+}
+
+void utp_socket_impl::pacer_wakeup()
+{
+	INVARIANT_CHECK;
+
+	TORRENT_ASSERT(m_paced);
+	m_paced = false;
+
+	if (state() != state_t::connected)
+	{
+		// we may have been kept alive by the pacer
+		m_sm.schedule_tick(this, time_point::min());
+		return;
+	}
+
+	while (send_pkt());
+	maybe_trigger_send_callback({});
+}
+
 void utp_socket_impl::send_fin()
 {
 	INVARIANT_CHECK;
@@ -1581,6 +1723,14 @@ bool utp_socket_impl::send_pkt(int const flags)
 		return false;
 	}
 
+	// ACKs and FINs are never held back by the pacer
+	if (!force && m_sm.pacing() && pace(payload_size))
+	{
+		UTP_LOGV("%8p: waiting for pacing credit (%d bytes)\n"
+			, static_cast<void*>(this), payload_size);
+		return false;
+	}
+
 	packet_ptr p;
 	std::uint8_t* ptr = nullptr;
 	utp_header* h = nullptr;
@@ -1832,6 +1982,7 @@ bool utp_socket_impl::send_pkt(int const flags)
 		if (m_bytes_in_flight == 0)
 		{
 			m_timeout = now + milliseconds(packet_timeout());
+			m_sm.schedule_tick(this, m_timeout);
 #if TORRENT_UTP_LOG
 			UTP_LOGV("%8p: updating timeout to: now + %d\n"
 			, static_cast<void*>(this), packet_timeout());
@@ -2112,6 +2263,11 @@ void utp_socket_impl::set_state(state_t const s)
 	m_sm.inc_stats_counter(counters::num_utp_idle + m_state, -1);
 	m_state = static_cast<std::uint8_t>(s);
 	m_sm.inc_stats_counter(counters::num_utp_idle + m_state, 1);
+
+	// closing states may make us eligible for deletion, make sure the socket
+	// manager looks at us on the next tick
+	if (s >= state_t::error_wait)
+		m_sm.schedule_tick(this, time_point::min());
 }
 
 void utp_socket_impl::maybe_inc_acked_seq_nr()
@@ -2762,6 +2918,7 @@ bool utp_socket_impl::incoming_packet(span<char const> b
 	// do this after processing sacks/acks as that can effect packet_timeout()
 	m_num_timeouts = 0;
 	m_timeout = receive_time + milliseconds(packet_timeout());
+	m_sm.schedule_tick(this, m_timeout);
 	UTP_LOGV("%8p: updating timeout to: now + %d\n"
 		, static_cast<void*>(this), packet_timeout());
 
@@ -3315,6 +3472,7 @@ void utp_stream::bind(endpoint_type const&, error_code&) { }
 
 void utp_stream::cancel_handlers(error_code const& ec)
 {
+	if (m_channel) m_channel->cancel_handlers(ec);
 	if (!m_impl) return;
 	m_impl->cancel_handlers(ec, false);
 }
@@ -265,10 +265,13 @@ void web_peer_connection::disconnect(error_code const& ec
 		m_requests.clear();
 	}
 
-	if (m_web && !m_web->supports_keepalive && error == peer_connection_interface::normal)
+	if (m_web && (!m_web->supports_keepalive || m_server_closing)
+		&& error == peer_connection_interface::normal)
 	{
-		// if the web server doesn't support keepalive and we were
-		// disconnected as a graceful EOF, reconnect right away
+		// if the web server doesn't support keepalive, or it told us it would
+		// close the connection (say, because it limits the number of requests
+		// per connection), and we were disconnected as a graceful EOF,
+		// reconnect right away
 		if (t) post(get_context()
 			, std::bind(&aux::torrent::maybe_connect_web_seeds, t));
 	}
@@ -837,6 +840,7 @@ void web_peer_connection::on_receive(error_code const& error
 			if (m_parser.connection_close())
 			{
 				incoming_choke();
+				m_server_closing = true;
 				if (m_num_responses == 1)
 					m_web->supports_keepalive = false;
 			}
@@ -23,6 +23,7 @@ see LICENSE file.
 #include "libtorrent/aux_/numeric_cast.hpp" // for clamp
 #include "libtorrent/aux_/merkle.hpp" // for merkle_
 #include "libtorrent/aux_/ip_helpers.hpp" // for is_v6
+#include "libtorrent/aux_/bencoder.hpp"
 
 namespace libtorrent {
 namespace {
@@ -53,6 +54,69 @@ namespace {
 	{
 		return {b.data(), std::size_t(b.num_bytes())};
 	}
+
+	string_view to_string_view(bitfield const& b)
+	{
+		return {b.data(), std::size_t(b.num_bytes())};
+	}
+
+	// the streaming counterpart of build_tracker_list()
+	void write_tracker_list(aux::bencode::buffer& out
+		, std::vector<std::string> const& trackers
+		, std::vector<int> const& tracker_tiers)
+	{
+		aux::bencode::list tiers(out);
+		if (trackers.empty()) return;
+
+		// trackers are not necessarily ordered by tier
+		std::vector<std::size_t> tracker_tier;
+		tracker_tier.reserve(trackers.size());
+		std::size_t tier = 0;
+		std::size_t num_tiers = 1;
+		auto tier_it = tracker_tiers.begin();
+		for (std::size_t i = 0; i < trackers.size(); ++i)
+		{
+			if (tier_it != tracker_tiers.end())
+				tier = std::clamp(std::size_t(*tier_it++), std::size_t{0}, std::size_t{1024});
+			tracker_tier.push_back(tier);
+			num_tiers = std::max(num_tiers, tier + 1);
+		}
+
+		for (std::size_t t = 0; t < num_tiers; ++t)
+		{
+			// build_tracker_list() leaves the tiers without any trackers as
+			// undefined entries, which are encoded as empty strings
+			if (t > 0 && std::find(tracker_tier.begin(), tracker_tier.end(), t) == tracker_tier.end())
+			{
+				tiers.add(string_view());
+				continue;
+			}
+			aux::bencode::list tier_list(out);
+			for (std::size_t i = 0; i < trackers.size(); ++i)
+				if (tracker_tier[i] == t) tier_list.add(trackers[i]);
+		}
+	}
+
+	// writes the IPv4 and IPv6 endpoints in ``eps`` as two compact strings,
+	// under the keys ``key`` and ``key6``
+	void write_endpoints(aux::bencode::dict& d, aux::bencode::buffer& out
+		, string_view const key, string_view const key6
+		, std::vector<tcp::endpoint> const& eps)
+	{
+		std::int64_t const num_v6 = std::count_if(eps.begin(), eps.end()
+			, [](tcp::endpoint const& ep) { return aux::is_v6(ep); });
+		std::int64_t const num_v4 = std::int64_t(eps.size()) - num_v6;
+
+		d.add_key(key);
+		aux::bencode::write_string_length(out, num_v4 * 6);
+		for (auto const& ep : eps)
+			if (!aux::is_v6(ep)) aux::write_endpoint(ep, std::back_inserter(out));
+
+		d.add_key(key6);
+		aux::bencode::write_string_length(out, num_v6 * 18);
+		for (auto const& ep : eps)
+			if (aux::is_v6(ep)) aux::write_endpoint(ep, std::back_inserter(out));
+	}
 }
 
 	entry write_resume_data(add_torrent_params const& atp)
@@ -100,6 +164,7 @@ namespace {
 		ret["disable_dht"] = bool(atp.flags & torrent_flags::disable_dht);
 		ret["disable_lsd"] = bool(atp.flags & torrent_flags::disable_lsd);
 		ret["disable_pex"] = bool(atp.flags & torrent_flags::disable_pex);
+		ret["dormant"] = bool(atp.flags & torrent_flags::dormant);
 
 		ret["added_time"] = atp.added_time;
 		ret["completed_time"] = atp.completed_time;
@@ -317,7 +382,9 @@ namespace {
 				if (int(piece_layer.size()) != fs.file_num_pieces(f))
 					aux::throw_ex<system_error>(errors::torrent_invalid_piece_layer);
 
+				// identical files have the same root, and the same piece layer
 				auto& layer = piece_layers[t.root().to_string()].string();
+				layer.clear();
 
 				for (auto const& h : piece_layer)
 					layer += h.to_string();
@@ -387,19 +454,368 @@ namespace {
 	}
 
 	std::vector<char> write_torrent_file_buf(add_torrent_params const& atp
-		, write_torrent_flags_t flags)
+		, write_torrent_flags_t const flags)
 	{
+		if (!atp.ti)
+			aux::throw_ex<system_error>(errors::torrent_missing_info);
+
+		// compute the piece layers up-front, since this is what may fail. The
+		// keys in the "piece layers" dictionary are the file roots, so they
+		// need to be written in sorted order
+		std::vector<std::pair<sha256_hash, std::vector<sha256_hash>>> piece_layers;
+		if (!atp.merkle_trees.empty())
+		{
+			file_storage const& fs = atp.ti->layout();
+			auto& trees = atp.merkle_trees;
+			if (int(trees.size()) != fs.num_files())
+				aux::throw_ex<system_error>(errors::torrent_missing_piece_layer);
+
+			bitfield const empty_verified;
+			for (file_index_t f : fs.file_range())
+			{
+				if (fs.pad_file_at(f) || fs.file_size(f) <= fs.piece_length())
+					continue;
+
+				aux::merkle_tree t(fs.file_num_blocks(f), fs.blocks_per_piece(), fs.root_ptr(f));
+
+				bitfield const& verified = (f >= atp.verified_leaf_hashes.end_index())
+					? empty_verified : atp.verified_leaf_hashes[f];
+
+				auto const& tree = trees[f];
+				if (f < atp.merkle_tree_mask.end_index() && !atp.merkle_tree_mask[f].empty())
+				{
+					t.load_sparse_tree(tree, atp.merkle_tree_mask[f], verified);
+				}
+				else
+				{
+					t.load_tree(tree, verified);
+				}
+
+				auto piece_layer = t.get_piece_layer();
+				if (int(piece_layer.size()) != fs.file_num_pieces(f))
+					aux::throw_ex<system_error>(errors::torrent_invalid_piece_layer);
+
+				piece_layers.emplace_back(t.root(), std::move(piece_layer));
+			}
+			std::sort(piece_layers.begin(), piece_layers.end()
+				, [](auto const& lhs, auto const& rhs) { return lhs.first < rhs.first; });
+		}
+		else if (atp.ti->v2() && !(flags & write_flags::allow_missing_piece_layer))
+		{
+			// we must have piece layers for v2 torrents for them to be valid
+			// .torrent files
+			aux::throw_ex<system_error>(errors::torrent_missing_piece_layer);
+		}
+
 		std::vector<char> ret;
-		entry e = write_torrent_file(atp, flags);
-		bencode(std::back_inserter(ret), e);
+		{
+			using namespace lt::aux::bencode;
+
+			// the keys are written in sorted order
+			dict torrent_file(ret);
+
+			if (atp.trackers.size() == 1)
+				torrent_file.add("announce", atp.trackers.front());
+			else if (atp.trackers.size() > 1)
+			{
+				torrent_file.add_key("announce-list");
+				write_tracker_list(ret, atp.trackers, atp.tracker_tiers);
+			}
+
+			if (!atp.ti->collections().empty() && !atp.ti->info("collections"))
+			{
+				torrent_file.add_key("collections");
+				list l(ret);
+				for (auto const& n : atp.ti->collections())
+					l.add(n);
+			}
+
+			if (!atp.comment.empty())
+				torrent_file.add("comment", atp.comment);
+			if (!atp.created_by.empty())
+				torrent_file.add("created by", atp.created_by);
+			if (atp.creation_date != 0)
+				torrent_file.add("creation date", atp.creation_date);
+
+#if TORRENT_ABI_VERSION < 4
+			if (!atp.http_seeds.empty() && !(flags & write_flags::no_http_seeds))
+			{
+				torrent_file.add_key("httpseeds");
+				list l(ret);
+				for (auto const& url : atp.http_seeds)
+					l.add(url);
+			}
+#endif
+
+			torrent_file.add_key("info");
+			auto const info = atp.ti->info_section();
+			ret.insert(ret.end(), info.begin(), info.end());
+
+			// save DHT nodes
+			if (!atp.dht_nodes.empty() && (flags & write_flags::include_dht_nodes))
+			{
+				torrent_file.add_key("nodes");
+				list nodes(ret);
+				for (auto const& n : atp.dht_nodes)
+				{
+					list node(ret);
+					node.add(n.first);
+					node.add(n.second);
+				}
+			}
+
+			if (!piece_layers.empty())
+			{
+				torrent_file.add_key("piece layers");
+				dict layers(ret);
+				for (auto i = piece_layers.begin(); i != piece_layers.end(); ++i)
+				{
+					// identical files have the same root, and the same piece layer
+					if (i != piece_layers.begin() && std::prev(i)->first == i->first)
+						continue;
+					layers.add_key({i->first.data(), std::size_t(i->first.size())});
+					write_string_length(ret, std::int64_t(i->second.size()) * sha256_hash::size());
+					for (auto const& h : i->second)
+						ret.insert(ret.end(), h.data(), h.data() + h.size());
+				}
+			}
+			else if (!atp.merkle_trees.empty())
+			{
+				// there are trees, but no files large enough to have a piece
+				// layer
+				torrent_file.add_key("piece layers");
+				dict layers(ret);
+			}
+
+			if (!atp.ti->similar_torrents().empty() && !atp.ti->info("similar"))
+			{
+				torrent_file.add_key("similar");
+				list l(ret);
+				for (auto const& n : atp.ti->similar_torrents())
+					l.add({n.data(), std::size_t(n.size())});
+			}
+
+			// save web seeds
+			if (!atp.url_seeds.empty() && !(flags & write_flags::no_http_seeds))
+			{
+				torrent_file.add_key("url-list");
+				list l(ret);
+				for (auto const& url : atp.url_seeds)
+					l.add(url);
+			}
+		}
+
+#if TORRENT_USE_ASSERTS
+		try {
+			TORRENT_ASSERT(ret == bencode(write_torrent_file(atp, flags)));
+		} catch (...)
+		{
+			TORRENT_ASSERT_FAIL();
+		}
+#endif
 		return ret;
 	}
 
+	void write_resume_data_buf(add_torrent_params const& atp, std::vector<char>& ret)
+	{
+		using namespace lt::aux::bencode;
+
+		auto const flag = [&](torrent_flags_t const f) { return std::int64_t(bool(atp.flags & f)); };
+
+		// the keys are written in sorted order
+		dict rd(ret);
+
+		rd.add("active_time", atp.active_time);
+		rd.add("added_time", atp.added_time);
+		rd.add("allocation", atp.storage_mode == storage_mode_allocate
+			? "allocate" : "sparse");
+		rd.add("apply_ip_filter", flag(torrent_flags::apply_ip_filter));
+		rd.add("auto_managed", flag(torrent_flags::auto_managed));
+
+		if (!atp.banned_peers.empty())
+		{
+			write_endpoints(rd, ret, "banned_peers", "banned_peers6", atp.banned_peers);
+		}
+
+		if (!atp.comment.empty())
+			rd.add("comment", atp.comment);
+		rd.add("completed_time", atp.completed_time);
+		if (!atp.created_by.empty())
+			rd.add("created by", atp.created_by);
+		if (atp.creation_date != 0)
+			rd.add("creation date", atp.creation_date);
+
+		rd.add("disable_dht", flag(torrent_flags::disable_dht));
+		rd.add("disable_lsd", flag(torrent_flags::disable_lsd));
+		rd.add("disable_pex", flag(torrent_flags::disable_pex));
+		rd.add("dormant", flag(torrent_flags::dormant));
+		rd.add("download_rate_limit", atp.download_limit);
+		rd.add("file-format", "libtorrent resume file");
+		rd.add("file-version", 2);
+
+		if (!atp.file_priorities.empty())
+		{
+			rd.add_key("file_priority");
+			list prio(ret);
+			for (auto const p : atp.file_priorities)
+				prio.add(static_cast<std::uint8_t>(p));
+		}
+
+		rd.add("finished_time", atp.finished_time);
+#if TORRENT_USE_I2P
+		rd.add("i2p", flag(torrent_flags::i2p_torrent));
+#endif
+
+		if (atp.ti)
+		{
+			rd.add_key("info");
+			auto const info = atp.ti->info_section();
+			ret.insert(ret.end(), info.begin(), info.end());
+		}
+
+		rd.add("info-hash", {atp.info_hashes.v1.data(), std::size_t(atp.info_hashes.v1.size())});
+		rd.add("info-hash2", {atp.info_hashes.v2.data(), std::size_t(atp.info_hashes.v2.size())});
+		rd.add("last_download", atp.last_download);
+		rd.add("last_seen_complete", atp.last_seen_complete);
+		rd.add("last_upload", atp.last_upload);
+		rd.add("libtorrent-version", lt::version_str);
+
+		// write renamed files
+		if (!atp.renamed_files.empty())
+		{
+			rd.add_key("mapped_files");
+			list fl(ret);
+			// files that aren't renamed are written as empty strings
+			int idx = 0;
+			for (auto const& ent : atp.renamed_files)
+			{
+				for (; idx < static_cast<int>(ent.first); ++idx) fl.add("");
+				fl.add(ent.second);
+				++idx;
+			}
+		}
+
+		rd.add("max_connections", atp.max_connections);
+		rd.add("max_uploads", atp.max_uploads);
+		if (!atp.name.empty()) rd.add("name", atp.name);
+		rd.add("num_complete", atp.num_complete);
+		rd.add("num_downloaded", atp.num_downloaded);
+		rd.add("num_incomplete", atp.num_incomplete);
+		rd.add("paused", flag(torrent_flags::paused));
+
+		// write local peers
+		if (!atp.peers.empty())
+		{
+			write_endpoints(rd, ret, "peers", "peers6", atp.peers);
+		}
+
+		if (!atp.piece_priorities.empty())
+		{
+			rd.add_key("piece_priority");
+			write_string_length(ret, std::int64_t(atp.piece_priorities.size()));
+			for (auto const p : atp.piece_priorities)
+				ret.push_back(static_cast<char>(static_cast<std::uint8_t>(p)));
+		}
+
+		// write have bitmask
+		if (!atp.have_pieces.empty())
+			rd.add("pieces", to_string_view(atp.have_pieces));
+
+		rd.add("save_path", atp.save_path);
+		rd.add("seed_mode", flag(torrent_flags::seed_mode));
+		rd.add("seeding_time", atp.seeding_time);
+		rd.add("sequential_download", flag(torrent_flags::sequential_download));
+#ifndef TORRENT_DISABLE_SHARE_MODE
+		rd.add("share_mode", flag(torrent_flags::share_mode));
+#endif
+		rd.add("stop_when_ready", flag(torrent_flags::stop_when_ready));
+#ifndef TORRENT_DISABLE_SUPERSEEDING
+		rd.add("super_seeding", flag(torrent_flags::super_seeding));
+#endif
+		rd.add("total_downloaded", atp.total_downloaded);
+		rd.add("total_uploaded", atp.total_uploaded);
+
+		// save trackers
+		rd.add_key("trackers");
+		write_tracker_list(ret, atp.trackers, atp.tracker_tiers);
+
+		if (!atp.merkle_trees.empty())
+		{
+			rd.add_key("trees");
+			list trees(ret);
+			for (file_index_t f(0); f < file_index_t{int(atp.merkle_trees.size())}; ++f)
+			{
+				auto const& tree = atp.merkle_trees[f];
+				dict tree_dict(ret);
+				tree_dict.add_key("hashes");
+				write_string_length(ret, std::int64_t(tree.size()) * sha256_hash::size());
+				for (auto const& n : tree)
+					ret.insert(ret.end(), n.data(), n.data() + n.size());
+
+				if (f < atp.merkle_tree_mask.end_index())
+				{
+					auto const& mask = atp.merkle_tree_mask[f];
+					if (!mask.empty()) tree_dict.add("mask", to_string_view(mask));
+				}
+
+				if (f < atp.verified_leaf_hashes.end_index())
+				{
+					auto const& verified = atp.verified_leaf_hashes[f];
+					if (!verified.empty()) tree_dict.add("verified", to_string_view(verified));
+				}
+			}
+		}
+
+		if (!atp.unfinished_pieces.empty())
+		{
+			rd.add_key("unfinished");
+			list up(ret);
+
+			// info for each unfinished piece
+			for (auto const& p : atp.unfinished_pieces)
+			{
+				dict piece_struct(ret);
+				piece_struct.add("bitmask", {p.second.data(), std::size_t(p.second.size() + 7) / 8});
+				// the unfinished piece's index
+				piece_struct.add("piece", static_cast<int>(p.first));
+			}
+		}
+
+		rd.add("upload_mode", flag(torrent_flags::upload_mode));
+		rd.add("upload_rate_limit", atp.upload_limit);
+
+#if TORRENT_ABI_VERSION == 1
+		// deprecated in 1.2
+		if (!atp.url.empty()) rd.add("url", atp.url);
+#endif
+
+		// save web seeds
+		// if we removed the web seeds, make sure to record that in the resume
+		// data
+		rd.add_key("url-list");
+		{
+			list url_list(ret);
+			for (auto const& url : atp.url_seeds)
+				url_list.add(url);
+		}
+
+		if (!atp.verified_pieces.empty() && !atp.verified_pieces.none_set())
+			rd.add("verified", to_string_view(atp.verified_pieces));
+	}
+
 	std::vector<char> write_resume_data_buf(add_torrent_params const& atp)
 	{
 		std::vector<char> ret;
-		entry rd = write_resume_data(atp);
-		bencode(std::back_inserter(ret), rd);
+		write_resume_data_buf(atp, ret);
+
+#if TORRENT_USE_ASSERTS
+		try {
+			TORRENT_ASSERT(ret == bencode(write_resume_data(atp)));
+		} catch (...)
+		{
+			TORRENT_ASSERT_FAIL();
+		}
+#endif
 		return ret;
 	}
 }
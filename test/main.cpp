@@ -62,6 +62,7 @@ bool redirect_stdout = true;
 // it, so don't redirect stderr by default
 bool redirect_stderr = false;
 bool keep_files = false;
+bool run_benchmarks = false;
 
 // the current tests file descriptor
 unit_test::unit_test_t* current_test = nullptr;
@@ -219,9 +220,11 @@ void print_usage(char const* executable)
 		"                     temporary file, but let it go straight\n"
 		"                     to stdout\n"
 		"--stderr-redirect    also redirect stderr in addition to stdout\n"
+		"-b,--benchmarks      also run the benchmarks\n"
 		"\n"
 		"for tests, specify one or more test names as printed\n"
-		"by -l. If no test is specified, all tests are run\n", executable);
+		"by -l. If no test is specified, all tests are run, except\n"
+		"benchmarks\n", executable);
 }
 
 void change_directory(std::string const& f, error_code& ec)
@@ -318,7 +321,8 @@ int EXPORT main(int argc, char const* argv[])
 			std::printf("TESTS:\n");
 			for (int i = 0; i < ::unit_test::g_num_unit_tests; ++i)
 			{
-				std::printf(" - %s\n", ::unit_test::g_unit_tests[i].name);
+				auto const& t = ::unit_test::g_unit_tests[i];
+				std::printf(" - %s%s\n", t.name, t.benchmark ? " (benchmark)" : "");
 			}
 			return 0;
 		}
@@ -338,6 +342,11 @@ int EXPORT main(int argc, char const* argv[])
 		{
 			keep_files = true;
 		}
+
+		if (argv[0] == "-b"_sv || argv[0] == "--benchmarks"_sv)
+		{
+			run_benchmarks = true;
+		}
 		++argv;
 		--argc;
 	}
@@ -415,6 +424,10 @@ int EXPORT main(int argc, char const* argv[])
 		if (filter && tests_to_run.count(unit_test::g_unit_tests[i].name) == 0)
 			continue;
 
+		// benchmarks only run when asked for
+		if (!filter && !run_benchmarks && unit_test::g_unit_tests[i].benchmark)
+			continue;
+
 		std::string const unit_dir = unit_dir_prefix + std::to_string(i);
 		error_code ec;
 		create_directory(unit_dir, ec);
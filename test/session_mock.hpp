@@ -88,6 +88,8 @@ struct session_mock : aux::session_interface
 	int num_connections() const override { return 0; }
 
 	void deferred_submit_jobs() override {}
+	void add_checking_device(aux::device_id, bool) override {}
+	aux::checking_scheduler<aux::torrent>& checking_scheduler() override { return _checking_scheduler; }
 
 	std::uint16_t listen_port() const override { return 0; }
 	std::uint16_t ssl_listen_port() const override { return 0; }
@@ -234,6 +236,7 @@ struct session_mock : aux::session_interface
 	std::unique_ptr<disk_interface> _disk_io;
 
 	aux::vector<aux::torrent*> _torrent_list;
+	aux::checking_scheduler<aux::torrent> _checking_scheduler;
 	std::vector<block_info> _block_info_list;
 };
 
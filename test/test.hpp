@@ -55,6 +55,9 @@ struct unit_test_t
 	char const* name;
 	int num_failures;
 	bool run;
+	// benchmarks are only run when asked for explicitly, see
+	// TORRENT_BENCHMARK
+	bool benchmark;
 	FILE* output;
 };
 
@@ -65,7 +68,7 @@ extern int g_test_idx;
 
 } // unit_test
 
-#define TORRENT_TEST(test_name) \
+#define TORRENT_REGISTER_TEST(test_name, is_benchmark) \
 	static void BOOST_PP_CAT(unit_test_, test_name)(); \
 	static struct BOOST_PP_CAT(register_class_, test_name) { \
 		BOOST_PP_CAT(register_class_, test_name) () { \
@@ -74,12 +77,20 @@ extern int g_test_idx;
 			t.name = __FILE__ "." #test_name; \
 			t.num_failures = 0; \
 			t.run = false; \
+			t.benchmark = is_benchmark; \
 			t.output = nullptr; \
 			::unit_test::g_num_unit_tests++; \
 		} \
 	} BOOST_PP_CAT(g_static_registrar_for, test_name); \
 	static void BOOST_PP_CAT(unit_test_, test_name)()
 
+#define TORRENT_TEST(test_name) TORRENT_REGISTER_TEST(test_name, false)
+
+// a test that measures and prints the performance of something, rather than
+// checking its behavior. These are not part of a normal test run, they are
+// only run with --benchmarks or when named on the command line
+#define TORRENT_BENCHMARK(test_name) TORRENT_REGISTER_TEST(test_name, true)
+
 #define TEST_REPORT_AUX(x, line, file) \
 	unit_test::report_failure(x, line, file)
 
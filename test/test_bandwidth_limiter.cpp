@@ -21,10 +21,14 @@ see LICENSE file.
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/aux_/array.hpp"
 
+#include <algorithm>
+#include <cinttypes>
 #include <cmath>
+#include <cstdio>
 #include <functional>
 #include <iostream>
 #include <utility>
+#include <vector>
 
 struct torrent;
 struct peer_connection;
@@ -442,6 +446,60 @@ void test_no_starvation(int limit)
 	TEST_CHECK(close_to(p->m_quota / sample_time, float(limit) / 200 / num_peers, 5));
 }
 
+// runs num_peers equal peers, spread over num_torrents unlimited torrents,
+// all limited by the global channel. Returns the number of microseconds it
+// took to run the ticks
+std::int64_t test_many_peers(int const num_torrents, int const num_peers, int const limit)
+{
+	std::cout << "\ntest many peers " << num_torrents << " " << num_peers
+		<< " " << limit << std::endl;
+	aux::bandwidth_manager manager(0);
+	std::vector<aux::bandwidth_channel> torrents(static_cast<std::size_t>(num_torrents));
+
+	global_bwc.throttle(limit);
+
+	connections_t v;
+	for (auto& t : torrents)
+		spawn_connections(v, manager, t, num_peers / num_torrents, "p");
+
+	time_point const start = clock_type::now();
+	run_test(v, manager);
+	std::int64_t const elapsed = total_microseconds(clock_type::now() - start);
+
+	// accuracy: the peers get the global limit between them
+	float sum = 0.f;
+	for (auto const& p : v) sum += float(p->m_quota);
+	sum /= sample_time;
+	std::cout << sum << " target: " << limit << std::endl;
+	TEST_CHECK(sum > 0);
+	TEST_CHECK(close_to(sum, float(limit), float(limit) / 100));
+
+	// fairness: every torrent, and every peer, gets an equal share
+	int const peers_per_torrent = num_peers / num_torrents;
+	float const torrent_target = float(limit) / float(num_torrents);
+	float const peer_target = float(limit) / float(v.size());
+	float min_peer = peer_target;
+	float max_peer = peer_target;
+	for (int t = 0; t < num_torrents; ++t)
+	{
+		float torrent_sum = 0.f;
+		for (int i = 0; i < peers_per_torrent; ++i)
+		{
+			float const rate = float(v[std::size_t(t * peers_per_torrent + i)]->m_quota)
+				/ sample_time;
+			torrent_sum += rate;
+			min_peer = std::min(min_peer, rate);
+			max_peer = std::max(max_peer, rate);
+		}
+		TEST_CHECK(close_to(torrent_sum, torrent_target, torrent_target / 20));
+	}
+	std::cout << "peer rate: " << min_peer << " - " << max_peer
+		<< " target: " << peer_target << std::endl;
+	TEST_CHECK(close_to(min_peer, peer_target, peer_target / 20));
+	TEST_CHECK(close_to(max_peer, peer_target, peer_target / 20));
+	return elapsed;
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -505,3 +563,26 @@ TORRENT_TEST(no_starvation)
 {
 	test_no_starvation(40000);
 }
+
+TORRENT_TEST(many_peers)
+{
+	test_many_peers(10, 2000, 10000000);
+}
+
+// the per-tick cost with a large number of queued peers, every one of which
+// times out and re-requests bandwidth periodically
+TORRENT_BENCHMARK(benchmark_many_peers)
+{
+#if TORRENT_USE_ASSERTS
+	// debug builds check that a peer isn't already queued, which is linear in
+	// the queue size
+	int const num_peers = 10000;
+#else
+	int const num_peers = 100000;
+#endif
+	lt::aux::session_settings s;
+	int const num_ticks = int(sample_time * 1000 / s.get_int(settings_pack::tick_interval));
+	std::int64_t const elapsed = test_many_peers(100, num_peers, 10000000);
+	std::printf("%d peers, %d ticks: %" PRId64 " us (%" PRId64 " us per tick)\n"
+		, num_peers, num_ticks, elapsed, elapsed / num_ticks);
+}
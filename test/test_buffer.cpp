@@ -287,3 +287,50 @@ TORRENT_TEST(chained_buffer)
 	}
 	TEST_CHECK(buffer_list.empty());
 }
+
+TORRENT_TEST(chained_buffer_release_memory)
+{
+	char data_test[] = "foobar";
+	{
+		chained_buffer b;
+		TEST_EQUAL(b.overhead_bytes(), 0);
+
+		char* b1 = allocate_buffer(512);
+		std::memcpy(b1, data_test, 6);
+		b.append_buffer(holder(b1, 512), 6);
+		TEST_CHECK(b.overhead_bytes() > 0);
+
+		// the buffer is not empty, it can't be released
+		b.release_memory();
+		TEST_EQUAL(b.size(), 6);
+		TEST_EQUAL(b.capacity(), 512);
+		TEST_CHECK(compare_chained_buffer(b, "foobar", 6));
+
+		b.pop_front(6);
+		TEST_CHECK(b.empty());
+		TEST_CHECK(buffer_list.empty());
+
+		b.release_memory();
+		TEST_EQUAL(b.overhead_bytes(), 0);
+		TEST_EQUAL(b.space_in_last_buffer(), 0);
+		TEST_EQUAL(b.allocate_appendix(1), static_cast<char*>(nullptr));
+		b.pop_front(0);
+
+		// the buffer chain is allocated again on demand
+		char* b2 = allocate_buffer(512);
+		std::memcpy(b2, data_test, 6);
+		b.append_buffer(holder(b2, 512), 6);
+		TEST_EQUAL(b.size(), 6);
+		TEST_CHECK(compare_chained_buffer(b, "foobar", 6));
+
+		// a buffer with no bytes used is released too
+		b.pop_front(6);
+		char* b3 = allocate_buffer(20);
+		b.append_buffer(holder(b3, 20), 0);
+		TEST_EQUAL(buffer_list.size(), 1);
+		b.release_memory();
+		TEST_CHECK(buffer_list.empty());
+		TEST_EQUAL(b.capacity(), 0);
+	}
+	TEST_CHECK(buffer_list.empty());
+}
@@ -0,0 +1,161 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "test.hpp"
+
+#include <memory>
+#include <vector>
+
+#include "libtorrent/aux_/checking_scheduler.hpp"
+
+using namespace lt;
+
+namespace {
+
+struct client
+{
+	void checking_slots_available() { ++woken; }
+	int woken = 0;
+};
+
+using scheduler = aux::checking_scheduler<client>;
+
+aux::device_id const disk1 = 1;
+aux::device_id const disk2 = 2;
+
+} // anonymous namespace
+
+TORRENT_TEST(checking_shared_device)
+{
+	scheduler s;
+	s.set_depth(8);
+	s.add_device(disk1, false);
+
+	auto a = std::make_shared<client>();
+	auto b = std::make_shared<client>();
+
+	// the first torrent may use the whole device
+	TEST_EQUAL(s.acquire(disk1, a, 8), 8);
+	TEST_EQUAL(s.num_queued(), 0);
+
+	// the second has to wait
+	TEST_EQUAL(s.acquire(disk1, b, 4), 0);
+	TEST_EQUAL(s.num_queued(), 1);
+
+	// once a job completes, the slot is handed to b, since a holds more than
+	// its fair share
+	TEST_CHECK(!s.keep(disk1, a));
+	TEST_EQUAL(b->woken, 1);
+	TEST_EQUAL(s.acquire(disk1, b, 4), 1);
+
+	// a and b are entitled to half of the device each
+	for (int i = 0; i < 3; ++i)
+	{
+		TEST_CHECK(!s.keep(disk1, a));
+		TEST_EQUAL(s.acquire(disk1, b, 4), 1);
+	}
+	TEST_CHECK(s.keep(disk1, a));
+	TEST_CHECK(s.keep(disk1, b));
+
+	s.release(disk1, a.get(), 4);
+	s.release(disk1, b.get(), 4);
+	TEST_EQUAL(s.num_active_devices(), 0);
+}
+
+TORRENT_TEST(checking_sequential_device)
+{
+	scheduler s;
+	s.set_depth(8);
+	s.add_device(disk1, true);
+
+	auto a = std::make_shared<client>();
+	auto b = std::make_shared<client>();
+
+	TEST_EQUAL(s.acquire(disk1, a, 4), 4);
+	// there is room on the device, but only one torrent reads at a time
+	TEST_EQUAL(s.acquire(disk1, b, 4), 0);
+
+	// a keeps the device until it's done
+	TEST_CHECK(s.keep(disk1, a));
+	TEST_EQUAL(b->woken, 0);
+
+	s.release(disk1, a.get(), 3);
+	TEST_EQUAL(b->woken, 0);
+	s.release(disk1, a.get(), 1);
+	TEST_EQUAL(b->woken, 1);
+
+	TEST_EQUAL(s.acquire(disk1, b, 4), 4);
+	TEST_EQUAL(s.acquire(disk1, a, 4), 0);
+	s.release(disk1, b.get(), 4);
+	TEST_EQUAL(a->woken, 1);
+}
+
+TORRENT_TEST(checking_separate_devices)
+{
+	scheduler s;
+	s.set_depth(4);
+	s.add_device(disk1, true);
+	s.add_device(disk2, true);
+
+	auto a = std::make_shared<client>();
+	auto b = std::make_shared<client>();
+
+	// torrents on different devices don't affect each other
+	TEST_EQUAL(s.acquire(disk1, a, 4), 4);
+	TEST_EQUAL(s.acquire(disk2, b, 4), 4);
+	TEST_EQUAL(s.num_active_devices(), 2);
+	TEST_EQUAL(s.num_queued(), 0);
+
+	s.release(disk1, a.get(), 4);
+	s.release(disk2, b.get(), 4);
+	TEST_EQUAL(s.num_active_devices(), 0);
+}
+
+TORRENT_TEST(checking_depth)
+{
+	scheduler s;
+	s.set_depth(4);
+	s.add_device(disk1, false);
+
+	auto a = std::make_shared<client>();
+	TEST_EQUAL(s.acquire(disk1, a, 8), 4);
+	TEST_EQUAL(s.num_queued(), 1);
+
+	// lowering the depth takes effect as jobs complete
+	s.set_depth(2);
+	TEST_CHECK(!s.keep(disk1, a));
+	TEST_CHECK(!s.keep(disk1, a));
+	TEST_CHECK(s.keep(disk1, a));
+
+	// raising it hands out slots to waiting torrents right away
+	s.set_depth(3);
+	TEST_EQUAL(a->woken, 1);
+	TEST_EQUAL(s.acquire(disk1, a, 1), 1);
+	s.release(disk1, a.get(), 3);
+}
+
+TORRENT_TEST(checking_expired_client)
+{
+	scheduler s;
+	s.set_depth(1);
+	s.add_device(disk1, false);
+
+	auto a = std::make_shared<client>();
+	auto b = std::make_shared<client>();
+	auto c = std::make_shared<client>();
+
+	TEST_EQUAL(s.acquire(disk1, a, 1), 1);
+	TEST_EQUAL(s.acquire(disk1, b, 1), 0);
+	TEST_EQUAL(s.acquire(disk1, c, 1), 0);
+
+	// b is removed while waiting, c is next in line
+	b.reset();
+	s.release(disk1, a.get(), 1);
+	TEST_EQUAL(c->woken, 1);
+}
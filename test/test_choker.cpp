@@ -0,0 +1,210 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/choker.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace lt;
+using lt::aux::unchoke_state;
+using lt::aux::unchoke_candidate;
+
+namespace {
+
+// these are the comparison functions unchoke_sort() used before the sort
+// keys were computed up-front. They compare the peers' properties directly,
+// in every comparison. The keys must order peers the same way
+
+int compare_peers(unchoke_state const& lhs, unchoke_state const& rhs)
+{
+	if (lhs.priority != rhs.priority) return lhs.priority > rhs.priority ? 1 : -1;
+
+	std::int64_t const c1 = lhs.downloaded_in_last_round;
+	std::int64_t const c2 = rhs.downloaded_in_last_round;
+	if (c1 != c2) return c1 > c2 ? 1 : -1;
+	return 0;
+}
+
+bool compare_rr(unchoke_state const& lhs, unchoke_state const& rhs
+	, int const pieces, time_point const now)
+{
+	int const cmp = compare_peers(lhs, rhs);
+	if (cmp != 0) return cmp > 0;
+
+	bool const c1_quota_complete = !lhs.choked
+		&& lhs.uploaded_since_unchoked > std::int64_t(lhs.piece_length) * pieces
+		&& now - lhs.last_unchoke > minutes(1);
+	bool const c2_quota_complete = !rhs.choked
+		&& rhs.uploaded_since_unchoked > std::int64_t(rhs.piece_length) * pieces
+		&& now - rhs.last_unchoke > minutes(1);
+
+	if (c1_quota_complete != c2_quota_complete)
+		return int(c1_quota_complete) < int(c2_quota_complete);
+
+	std::int64_t const c1 = lhs.choked ? 0 : lhs.uploaded_in_last_round;
+	std::int64_t const c2 = rhs.choked ? 0 : rhs.uploaded_in_last_round;
+	if (c1 != c2) return c1 > c2;
+
+	return lhs.last_unchoke < rhs.last_unchoke;
+}
+
+bool compare_fastest_upload(unchoke_state const& lhs, unchoke_state const& rhs)
+{
+	int const cmp = compare_peers(lhs, rhs);
+	if (cmp != 0) return cmp > 0;
+
+	std::int64_t const c1 = lhs.uploaded_in_last_round;
+	std::int64_t const c2 = rhs.uploaded_in_last_round;
+	if (c1 != c2) return c1 > c2;
+
+	return lhs.last_unchoke < rhs.last_unchoke;
+}
+
+int anti_leech_score(unchoke_state const& s)
+{
+	std::int64_t const total_size = s.total_size;
+	if (total_size == 0) return 0;
+	std::int64_t const given_size = std::min(s.total_payload_upload
+		, total_size / 2);
+	std::int64_t const have_size = std::max(given_size
+		, std::int64_t(s.piece_length) * s.num_have_pieces);
+	return int(std::abs((have_size - total_size / 2) * 2000 / total_size));
+}
+
+bool compare_anti_leech(unchoke_state const& lhs, unchoke_state const& rhs)
+{
+	int const cmp = compare_peers(lhs, rhs);
+	if (cmp != 0) return cmp > 0;
+
+	int const score1 = anti_leech_score(lhs);
+	int const score2 = anti_leech_score(rhs);
+	if (score1 != score2) return score1 > score2;
+
+	return lhs.last_unchoke < rhs.last_unchoke;
+}
+
+// the values are drawn from small ranges, to make peers tie on some keys
+// and differ on others
+std::vector<unchoke_state> random_peers(std::mt19937& rng, time_point const now
+	, int const num)
+{
+	std::vector<unchoke_state> ret;
+	for (int i = 0; i < num; ++i)
+	{
+		unchoke_state s;
+		s.priority = int(rng() % 3) + 1;
+		s.downloaded_in_last_round = std::int64_t(rng() % 3) * 16384;
+		s.uploaded_in_last_round = std::int64_t(rng() % 4) * 16384;
+		s.uploaded_since_unchoked = std::int64_t(rng() % 4) * 1024 * 1024;
+		s.total_payload_upload = std::int64_t(rng() % 8) * 1024 * 1024;
+		s.piece_length = (rng() & 1) ? 0x4000 : 0x40000;
+		s.total_size = std::int64_t(rng() % 4) * 16 * s.piece_length;
+		s.num_have_pieces = int(rng() % 65);
+		s.choked = (rng() & 1) != 0;
+		s.last_unchoke = now - seconds(int(rng() % 4) * 40);
+		ret.push_back(s);
+	}
+	return ret;
+}
+
+template <typename Compare>
+void test_same_order(int const algorithm, Compare old_compare)
+{
+	std::mt19937 rng(0x1234);
+	int const pieces = 3;
+	time_point const now = clock_type::now();
+
+	std::vector<unchoke_state> const peers = random_peers(rng, now, 200);
+	std::vector<unchoke_candidate> keys;
+	for (auto const& s : peers)
+		keys.push_back(aux::make_unchoke_candidate(s, algorithm, pieces, now));
+
+	// every pair of peers compares the same way with the keys as with the
+	// old comparison function. This covers ties, in both directions
+	for (std::size_t i = 0; i < peers.size(); ++i)
+	{
+		for (std::size_t j = 0; j < peers.size(); ++j)
+		{
+			bool const expected = old_compare(peers[i], peers[j], pieces, now);
+			TEST_EQUAL(aux::unchoke_compare(keys[i], keys[j]), expected);
+			if (aux::unchoke_compare(keys[i], keys[j]) != expected) return;
+		}
+	}
+
+	// and sorting by either puts the peers in the same order
+	std::vector<int> old_order(peers.size());
+	for (std::size_t i = 0; i < old_order.size(); ++i) old_order[i] = int(i);
+	std::vector<int> new_order = old_order;
+	std::stable_sort(old_order.begin(), old_order.end(), [&](int const l, int const r)
+		{ return old_compare(peers[std::size_t(l)], peers[std::size_t(r)], pieces, now); });
+	std::stable_sort(new_order.begin(), new_order.end(), [&](int const l, int const r)
+		{ return aux::unchoke_compare(keys[std::size_t(l)], keys[std::size_t(r)]); });
+	TEST_CHECK(old_order == new_order);
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(unchoke_order_round_robin)
+{
+	test_same_order(settings_pack::round_robin, &compare_rr);
+}
+
+TORRENT_TEST(unchoke_order_fastest_upload)
+{
+	test_same_order(settings_pack::fastest_upload
+		, [](unchoke_state const& lhs, unchoke_state const& rhs, int, time_point)
+		{ return compare_fastest_upload(lhs, rhs); });
+}
+
+TORRENT_TEST(unchoke_order_anti_leech)
+{
+	test_same_order(settings_pack::anti_leech
+		, [](unchoke_state const& lhs, unchoke_state const& rhs, int, time_point)
+		{ return compare_anti_leech(lhs, rhs); });
+}
+
+TORRENT_TEST(unchoke_round_robin_quota)
+{
+	time_point const now = clock_type::now();
+
+	unchoke_state s;
+	s.priority = 1;
+	s.choked = false;
+	s.piece_length = 0x4000;
+	s.uploaded_since_unchoked = 4 * 0x4000;
+	s.uploaded_in_last_round = 1000;
+	s.last_unchoke = now - minutes(2);
+
+	// a peer that's been unchoked for more than a minute and has received
+	// more than its quota is de-prioritized
+	unchoke_candidate const done = aux::make_unchoke_candidate(s
+		, settings_pack::round_robin, 3, now);
+	TEST_CHECK(done.quota_complete);
+
+	s.last_unchoke = now - seconds(30);
+	unchoke_candidate const recent = aux::make_unchoke_candidate(s
+		, settings_pack::round_robin, 3, now);
+	TEST_CHECK(!recent.quota_complete);
+	TEST_CHECK(aux::unchoke_compare(recent, done));
+
+	// choked peers are ranked as if they didn't upload anything
+	s.choked = true;
+	unchoke_candidate const choked = aux::make_unchoke_candidate(s
+		, settings_pack::round_robin, 3, now);
+	TEST_EQUAL(choked.score, 0);
+	TEST_CHECK(!choked.quota_complete);
+	TEST_CHECK(aux::unchoke_compare(recent, choked));
+}
@@ -0,0 +1,383 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/compressed_bitfield.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cinttypes> // for PRId64
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace lt;
+using lt::aux::compressed_bitfield;
+
+namespace {
+
+using storage = compressed_bitfield::storage;
+
+// the plain bitfield stores its size in an extra word
+std::int64_t bitfield_bytes(int const bits)
+{
+	return (std::int64_t(bits) + 31) / 32 * 4 + 4;
+}
+
+void check_equal(compressed_bitfield const& c, typed_bitfield<piece_index_t> const& b)
+{
+	TEST_EQUAL(c.size(), b.size());
+	TEST_EQUAL(c.count(), b.count());
+	TEST_EQUAL(c.all_set(), b.all_set());
+	TEST_EQUAL(c.none_set(), b.none_set());
+	TEST_CHECK(c.to_bitfield() == b);
+
+	std::vector<piece_index_t> set;
+	c.for_each_set([&](piece_index_t const i) { set.push_back(i); });
+	TEST_EQUAL(int(set.size()), b.count());
+
+	auto it = set.begin();
+	for (piece_index_t i = c.find_next_set(piece_index_t(0)); i != c.end_index();
+		i = c.find_next_set(next(i)), ++it)
+	{
+		TEST_CHECK(it != set.end());
+		if (it == set.end()) break;
+		TEST_EQUAL(i, *it);
+	}
+	TEST_CHECK(it == set.end());
+
+	for (auto const i : b.range())
+		TEST_EQUAL(c[i], b[i]);
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(compressed_bitfield_empty)
+{
+	compressed_bitfield c;
+	TEST_CHECK(c.empty());
+	TEST_CHECK(c.none_set());
+	TEST_CHECK(c.all_set());
+	TEST_EQUAL(c.find_next_set(piece_index_t(0)), piece_index_t(0));
+	TEST_EQUAL(c.heap_size(), 0);
+
+	c.resize(100, true);
+	TEST_CHECK(c.all_set());
+	TEST_EQUAL(c.count(), 100);
+
+	c.clear();
+	TEST_CHECK(c.empty());
+	TEST_EQUAL(c.count(), 0);
+}
+
+TORRENT_TEST(compressed_bitfield_seed)
+{
+	compressed_bitfield c(4096, true);
+	TEST_CHECK(c.all_set());
+	TEST_CHECK(c.storage_type() == storage::inverted);
+	TEST_EQUAL(c.heap_size(), 0);
+
+	// a seed that loses a piece keeps a list of the missing pieces
+	c.clear_bit(piece_index_t(100));
+	TEST_CHECK(!c.all_set());
+	TEST_EQUAL(c.count(), 4095);
+	TEST_CHECK(c.storage_type() == storage::inverted);
+	TEST_CHECK(!c[piece_index_t(100)]);
+	TEST_CHECK(c[piece_index_t(99)]);
+	TEST_EQUAL(c.find_next_set(piece_index_t(100)), piece_index_t(101));
+
+	c.set_bit(piece_index_t(100));
+	TEST_CHECK(c.all_set());
+	TEST_EQUAL(c.heap_size(), 0);
+
+	c.clear_all();
+	TEST_CHECK(c.none_set());
+	TEST_CHECK(c.storage_type() == storage::sparse);
+	TEST_EQUAL(c.size(), 4096);
+	TEST_EQUAL(c.find_next_set(piece_index_t(0)), c.end_index());
+}
+
+TORRENT_TEST(compressed_bitfield_sparse_to_dense)
+{
+	// a list is allowed to hold 1024 / 32 = 32 pieces before it's larger
+	// than the bitfield
+	compressed_bitfield c(1024, false);
+	for (int i = 0; i < 32; ++i)
+		c.set_bit(piece_index_t(i * 2));
+	TEST_CHECK(c.storage_type() == storage::sparse);
+	TEST_EQUAL(c.count(), 32);
+
+	c.set_bit(piece_index_t(1000));
+	TEST_CHECK(c.storage_type() == storage::dense);
+	TEST_EQUAL(c.count(), 33);
+	TEST_CHECK(c[piece_index_t(1000)]);
+	TEST_CHECK(c[piece_index_t(62)]);
+	TEST_CHECK(!c[piece_index_t(63)]);
+
+	// it's turned back into a list once it's half the limit
+	for (int i = 0; i < 16; ++i)
+		c.clear_bit(piece_index_t(i * 2));
+	TEST_CHECK(c.storage_type() == storage::dense);
+	c.clear_bit(piece_index_t(32));
+	TEST_CHECK(c.storage_type() == storage::sparse);
+	TEST_EQUAL(c.count(), 16);
+	TEST_CHECK(c[piece_index_t(1000)]);
+	TEST_CHECK(!c[piece_index_t(0)]);
+}
+
+TORRENT_TEST(compressed_bitfield_dense_to_inverted)
+{
+	typed_bitfield<piece_index_t> b(1024, false);
+	for (int i = 0; i < 1000; ++i)
+		b.set_bit(piece_index_t(i));
+
+	compressed_bitfield c = b;
+	TEST_CHECK(c.storage_type() == storage::inverted);
+	check_equal(c, b);
+
+	// 34 missing pieces no longer fit in the list
+	for (int i = 0; i < 10; ++i)
+		b.clear_bit(piece_index_t(i));
+	c = b;
+	TEST_CHECK(c.storage_type() == storage::dense);
+	check_equal(c, b);
+
+	// a peer downloading the remaining pieces eventually becomes a seed,
+	// and on the way there, stops needing the bitfield
+	for (int i = 0; i < 1024; ++i)
+	{
+		b.set_bit(piece_index_t(i));
+		c.set_bit(piece_index_t(i));
+		if (c.size() - c.count() <= 16) TEST_CHECK(c.storage_type() == storage::inverted);
+	}
+	TEST_CHECK(c.all_set());
+	TEST_EQUAL(c.heap_size(), 0);
+	check_equal(c, b);
+}
+
+TORRENT_TEST(compressed_bitfield_list_cap)
+{
+	// in a torrent this large, the list could hold 32768 pieces before it's
+	// larger than the bitfield, but it's capped at 1024, to keep inserting
+	// into it cheap
+	compressed_bitfield c(1 << 20, false);
+	for (int i = 0; i < 1024; ++i)
+		c.set_bit(piece_index_t(i * 1000));
+	TEST_CHECK(c.storage_type() == storage::sparse);
+	c.set_bit(piece_index_t(1));
+	TEST_CHECK(c.storage_type() == storage::dense);
+	TEST_EQUAL(c.count(), 1025);
+
+	// it's turned back into a list at half the cap
+	for (int i = 0; i < 512; ++i)
+		c.clear_bit(piece_index_t(i * 1000));
+	TEST_CHECK(c.storage_type() == storage::dense);
+	c.clear_bit(piece_index_t(512 * 1000));
+	TEST_CHECK(c.storage_type() == storage::sparse);
+	TEST_EQUAL(c.count(), 512);
+	TEST_CHECK(c[piece_index_t(1)]);
+	TEST_CHECK(c[piece_index_t(513 * 1000)]);
+	TEST_CHECK(!c[piece_index_t(0)]);
+
+	// the same goes for the pieces missing from a near-seed
+	c.set_all();
+	for (int i = 0; i < 1025; ++i)
+		c.clear_bit(piece_index_t(i * 1000));
+	TEST_CHECK(c.storage_type() == storage::dense);
+	TEST_EQUAL(c.count(), (1 << 20) - 1025);
+}
+
+TORRENT_TEST(compressed_bitfield_resize)
+{
+	// without metadata, a peer's bitfield grows with every HAVE message
+	compressed_bitfield c;
+	c.resize(11, false);
+	c.set_bit(piece_index_t(10));
+	c.resize(101, false);
+	c.set_bit(piece_index_t(100));
+	TEST_EQUAL(c.size(), 101);
+	TEST_EQUAL(c.count(), 2);
+	TEST_CHECK(c[piece_index_t(10)]);
+	TEST_CHECK(c[piece_index_t(100)]);
+
+	c.resize(2000, true);
+	TEST_EQUAL(c.count(), 2 + 1899);
+	TEST_CHECK(c[piece_index_t(101)]);
+	TEST_CHECK(!c[piece_index_t(50)]);
+
+	c.resize(50);
+	TEST_EQUAL(c.count(), 1);
+	TEST_CHECK(c[piece_index_t(10)]);
+}
+
+TORRENT_TEST(compressed_bitfield_random)
+{
+	std::mt19937 rng(0x5eed);
+	for (int const size : {1, 31, 32, 33, 100, 1024, 5000})
+	{
+		typed_bitfield<piece_index_t> b(size, false);
+		compressed_bitfield c(size, false);
+		// bias the operations to walk the bitfield from empty to full and
+		// back, to cover every representation
+		for (int round = 0; round < 4; ++round)
+		{
+			int const set_percent = (round % 2 == 0) ? 90 : 10;
+			for (int i = 0; i < size * 3; ++i)
+			{
+				piece_index_t const idx(int(rng() % std::uint32_t(size)));
+				if (int(rng() % 100) < set_percent)
+				{
+					b.set_bit(idx);
+					c.set_bit(idx);
+				}
+				else
+				{
+					b.clear_bit(idx);
+					c.clear_bit(idx);
+				}
+				TEST_EQUAL(c.count(), b.count());
+				TEST_EQUAL(c[idx], b[idx]);
+			}
+			check_equal(c, b);
+			check_equal(compressed_bitfield(b), b);
+		}
+	}
+}
+
+namespace {
+
+// the have-bitfields of the peers in a swarm. Most peers are seeds or almost
+// done
+void test_swarm_memory(int const num_pieces, int const num_peers, bool const print)
+{
+	std::mt19937 rng(0x12345678);
+
+	std::int64_t plain = 0;
+	std::int64_t compressed = 0;
+	auto add = [&](compressed_bitfield const& c, char const* name, int n)
+	{
+		std::int64_t const bytes = std::int64_t(c.heap_size());
+		if (print)
+		{
+			std::printf("%-12s %4d peers: %8" PRId64 " bytes per peer (bitfield: %" PRId64 ")\n"
+				, name, n, bytes, bitfield_bytes(num_pieces));
+		}
+		plain += bitfield_bytes(num_pieces) * n;
+		compressed += bytes * n;
+	};
+
+	// 70% seeds
+	compressed_bitfield seed(num_pieces, true);
+	add(seed, "seed", num_peers * 7 / 10);
+
+	// 10% that miss a few hundred pieces
+	compressed_bitfield near_seed(num_pieces, true);
+	for (int i = 0; i < 500; ++i)
+		near_seed.clear_bit(piece_index_t(int(rng() % std::uint32_t(num_pieces))));
+	add(near_seed, "near-seed", num_peers / 10);
+
+	// 10% that just joined
+	compressed_bitfield joined(num_pieces, false);
+	for (int i = 0; i < 50; ++i)
+		joined.set_bit(piece_index_t(int(rng() % std::uint32_t(num_pieces))));
+	add(joined, "new peer", num_peers / 10);
+
+	// 10% half way done
+	typed_bitfield<piece_index_t> half(num_pieces, false);
+	for (auto const i : half.range())
+		if (rng() & 1) half.set_bit(i);
+	compressed_bitfield const downloading = half;
+	add(downloading, "downloading", num_peers / 10);
+
+	if (print)
+	{
+		std::printf("total: %" PRId64 " kiB (bitfields: %" PRId64 " kiB)\n"
+			, compressed / 1024, plain / 1024);
+	}
+
+	TEST_EQUAL(seed.heap_size(), 0);
+	TEST_CHECK(std::int64_t(near_seed.heap_size()) * 10 < bitfield_bytes(num_pieces));
+	TEST_CHECK(std::int64_t(joined.heap_size()) * 10 < bitfield_bytes(num_pieces));
+	TEST_CHECK(compressed * 5 < plain);
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(swarm_memory)
+{
+	test_swarm_memory(1 << 18, 100, false);
+}
+
+// a torrent with 4 million pieces
+TORRENT_BENCHMARK(benchmark_swarm_memory)
+{
+	test_swarm_memory(1 << 22, 1000, true);
+}
+
+namespace {
+
+template <typename Fun>
+std::int64_t time_us(Fun f)
+{
+	time_point const start = clock_type::now();
+	f();
+	return std::max(std::int64_t(1), total_microseconds(clock_type::now() - start));
+}
+
+} // anonymous namespace
+
+// the cost of the HAVE messages from a peer downloading every piece of a
+// torrent with 4 million pieces, and of the piece picker asking whether peers
+// have a piece, in rarest-first order
+TORRENT_BENCHMARK(benchmark_have_and_pick)
+{
+	int const num_pieces = 1 << 22;
+	std::mt19937 rng(0x4a7e);
+
+	std::vector<piece_index_t> order;
+	order.reserve(std::size_t(num_pieces));
+	for (int i = 0; i < num_pieces; ++i) order.emplace_back(i);
+	std::shuffle(order.begin(), order.end(), rng);
+
+	compressed_bitfield peer(num_pieces, false);
+	std::int64_t const have_us = time_us([&] {
+		for (piece_index_t const i : order) peer.set_bit(i);
+	});
+	TEST_CHECK(peer.all_set());
+	std::printf("HAVE: %d pieces: %" PRId64 " ms (%.1f ns per message)\n"
+		, num_pieces, have_us / 1000, have_us * 1000.0 / num_pieces);
+
+	compressed_bitfield joined(num_pieces, false);
+	for (int i = 0; i < 1000; ++i) joined.set_bit(order[std::size_t(i)]);
+	compressed_bitfield near_seed(num_pieces, true);
+	for (int i = 0; i < 1000; ++i) near_seed.clear_bit(order[std::size_t(i)]);
+	typed_bitfield<piece_index_t> half(num_pieces, false);
+	for (int i = 0; i < num_pieces / 2; ++i) half.set_bit(order[std::size_t(i)]);
+	compressed_bitfield const downloading = half;
+
+	auto pick = [&](compressed_bitfield const& c, char const* name)
+	{
+		int found = 0;
+		std::int64_t const us = time_us([&] {
+			for (piece_index_t const i : order) found += c[i];
+		});
+		std::printf("pick %-12s (%s): %" PRId64 " ms (%.1f ns per piece)\n", name
+			, c.storage_type() == storage::sparse ? "sparse"
+			: c.storage_type() == storage::inverted ? "inverted" : "dense"
+			, us / 1000, us * 1000.0 / num_pieces);
+		TEST_EQUAL(found, c.count());
+	};
+
+	pick(peer, "seed");
+	pick(joined, "new peer");
+	pick(near_seed, "near-seed");
+	pick(downloading, "downloading");
+}
@@ -0,0 +1,122 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/disk_buffer_pool.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/io_context.hpp"
+#include "libtorrent/disk_interface.hpp" // for default_block_size
+
+#include <cstring>
+#include <set>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+void test_allocate_free(bool const numa)
+{
+	io_context ios;
+	aux::disk_buffer_pool pool(ios);
+	settings_pack sett;
+	sett.set_bool(settings_pack::numa_disk_buffers, numa);
+	pool.set_settings(sett);
+
+	// more than fits in a single 2 MiB slab
+	int const num_buffers = 300;
+	std::vector<char*> buffers;
+	for (int i = 0; i < num_buffers; ++i)
+	{
+		char* buf = pool.allocate_buffer("test");
+		TEST_CHECK(buf != nullptr);
+		if (buf == nullptr) break;
+		std::memset(buf, i & 0xff, default_block_size);
+		buffers.push_back(buf);
+	}
+	TEST_EQUAL(pool.in_use(), num_buffers);
+
+	// no buffers may overlap
+	std::set<char*> const unique(buffers.begin(), buffers.end());
+	TEST_EQUAL(int(unique.size()), num_buffers);
+	for (int i = 0; i < int(buffers.size()); ++i)
+	{
+		TEST_EQUAL(buffers[std::size_t(i)][0], char(i & 0xff));
+		TEST_EQUAL(buffers[std::size_t(i)][default_block_size - 1], char(i & 0xff));
+	}
+
+	// free half of them one by one, and the rest at once
+	for (int i = 0; i < num_buffers / 2; ++i)
+		pool.free_buffer(buffers[std::size_t(i)]);
+	pool.free_multiple_buffers(span<char*>(buffers).subspan(num_buffers / 2));
+	TEST_EQUAL(pool.in_use(), 0);
+
+#if TORRENT_USE_NUMA
+	if (numa)
+		TEST_EQUAL(pool.local_node_frees() + pool.remote_node_frees(), num_buffers);
+	else
+#endif
+		TEST_EQUAL(pool.local_node_frees() + pool.remote_node_frees(), 0);
+}
+
+}
+
+TORRENT_TEST(allocate_free)
+{
+	test_allocate_free(false);
+}
+
+TORRENT_TEST(allocate_free_numa)
+{
+	test_allocate_free(true);
+}
+
+// buffers allocated from slabs must be returned to them, even if the setting
+// is turned off in the meantime
+TORRENT_TEST(disable_numa)
+{
+	io_context ios;
+	aux::disk_buffer_pool pool(ios);
+	settings_pack sett;
+	sett.set_bool(settings_pack::numa_disk_buffers, true);
+	pool.set_settings(sett);
+
+	char* a = pool.allocate_buffer("test");
+	TEST_CHECK(a != nullptr);
+
+	sett.set_bool(settings_pack::numa_disk_buffers, false);
+	pool.set_settings(sett);
+
+	char* b = pool.allocate_buffer("test");
+	TEST_CHECK(b != nullptr);
+	TEST_EQUAL(pool.in_use(), 2);
+
+	pool.free_buffer(a);
+	pool.free_buffer(b);
+	TEST_EQUAL(pool.in_use(), 0);
+}
+
+// once all buffers are freed, the pool allocates from the same memory again
+TORRENT_TEST(reuse_slab)
+{
+#if TORRENT_USE_NUMA
+	io_context ios;
+	aux::disk_buffer_pool pool(ios);
+	settings_pack sett;
+	sett.set_bool(settings_pack::numa_disk_buffers, true);
+	pool.set_settings(sett);
+
+	char* a = pool.allocate_buffer("test");
+	TEST_CHECK(a != nullptr);
+	pool.free_buffer(a);
+	char* b = pool.allocate_buffer("test");
+	TEST_CHECK(a == b);
+	pool.free_buffer(b);
+#endif
+}
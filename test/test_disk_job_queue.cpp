@@ -0,0 +1,116 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "test.hpp"
+
+#include <array>
+
+#include "libtorrent/aux_/disk_job_queue.hpp"
+#include "libtorrent/time.hpp"
+
+using namespace lt;
+
+namespace {
+
+// the jobs are identified by their index in the array
+template <std::size_t N>
+int pop(aux::disk_job_queue& q, std::array<aux::disk_job, N>& jobs)
+{
+	aux::disk_job* j = q.pop_front();
+	TEST_CHECK(j->next == nullptr);
+	return int(j - jobs.data());
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(disk_job_queue_fifo)
+{
+	std::array<aux::disk_job, 3> jobs;
+	aux::disk_job_queue q;
+	TEST_CHECK(q.empty());
+
+	for (auto& j : jobs) q.push_back(&j);
+	TEST_EQUAL(q.size(), 3);
+	TEST_EQUAL(q.num_deadline_jobs(), 0);
+
+	TEST_EQUAL(pop(q, jobs), 0);
+	TEST_EQUAL(pop(q, jobs), 1);
+	TEST_EQUAL(pop(q, jobs), 2);
+	TEST_CHECK(q.empty());
+}
+
+TORRENT_TEST(disk_job_queue_earliest_deadline_first)
+{
+	time_point const now = clock_type::now();
+	std::array<aux::disk_job, 5> jobs;
+	jobs[1].deadline = now + seconds(3);
+	jobs[2].deadline = now + seconds(1);
+	jobs[3].deadline = now + seconds(2);
+	// the same deadline as job 2, but queued later
+	jobs[4].deadline = now + seconds(1);
+
+	aux::disk_job_queue q;
+	for (auto& j : jobs) q.push_back(&j);
+	TEST_EQUAL(q.size(), 5);
+	TEST_EQUAL(q.num_deadline_jobs(), 4);
+
+	TEST_EQUAL(pop(q, jobs), 2);
+	TEST_EQUAL(pop(q, jobs), 4);
+	TEST_EQUAL(pop(q, jobs), 3);
+	TEST_EQUAL(pop(q, jobs), 1);
+	TEST_EQUAL(pop(q, jobs), 0);
+	TEST_CHECK(q.empty());
+}
+
+TORRENT_TEST(disk_job_queue_starvation)
+{
+	time_point const now = clock_type::now();
+	int const burst = aux::disk_job_queue::deadline_burst;
+	std::array<aux::disk_job, 2 * aux::disk_job_queue::deadline_burst + 2> jobs;
+
+	aux::disk_job_queue q;
+	q.push_back(&jobs[0]);
+	q.push_back(&jobs[1]);
+	for (int i = 2; i < int(jobs.size()); ++i)
+	{
+		jobs[std::size_t(i)].deadline = now + milliseconds(i);
+		q.push_back(&jobs[std::size_t(i)]);
+	}
+
+	// jobs without a deadline get a turn after every burst of jobs with one
+	for (int i = 0; i < burst; ++i)
+		TEST_EQUAL(pop(q, jobs), i + 2);
+	TEST_EQUAL(pop(q, jobs), 0);
+	for (int i = 0; i < burst; ++i)
+		TEST_EQUAL(pop(q, jobs), burst + i + 2);
+	TEST_EQUAL(pop(q, jobs), 1);
+	TEST_CHECK(q.empty());
+}
+
+TORRENT_TEST(disk_job_queue_append)
+{
+	time_point const now = clock_type::now();
+	std::array<aux::disk_job, 3> jobs;
+	jobs[2].deadline = now;
+
+	aux::tailqueue<aux::disk_job> blocked;
+	for (auto& j : jobs) blocked.push_back(&j);
+
+	aux::disk_job_queue q;
+	q.append(std::move(blocked));
+	TEST_EQUAL(q.size(), 3);
+
+	int visited = 0;
+	q.visit_jobs([&](aux::disk_job*) { ++visited; });
+	TEST_EQUAL(visited, 3);
+
+	TEST_EQUAL(pop(q, jobs), 2);
+	TEST_EQUAL(pop(q, jobs), 0);
+	TEST_EQUAL(pop(q, jobs), 1);
+}
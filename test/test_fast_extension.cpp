@@ -27,13 +27,22 @@ see LICENSE file.
 #include "libtorrent/aux_/path.hpp"
 #include "libtorrent/session.hpp"
 #include "libtorrent/session_params.hpp"
+#include "libtorrent/session_stats.hpp"
+#include "libtorrent/alert_types.hpp"
 
+#include <cinttypes> // for PRId64
 #include <cstring>
 #include <functional>
 #include <iostream>
 #include <fstream>
 #include <cstdarg>
 #include <cstdio> // for vsnprintf
+#include <thread>
+#include <vector>
+
+#if defined __GLIBC__
+#include <malloc.h> // for mallinfo2
+#endif
 
 using namespace lt;
 using namespace std::placeholders;
@@ -418,7 +427,8 @@ std::shared_ptr<torrent_info const> setup_peer(tcp::socket& s, io_context& ioc
 	, std::shared_ptr<lt::session>& ses, bool incoming = true
 	, bool const magnet_link = false, bool const dht = false
 	, torrent_flags_t const flags = torrent_flags_t{}
-	, torrent_handle* th = nullptr)
+	, torrent_handle* th = nullptr
+	, int const num_pieces = 13)
 {
 	std::ofstream out_file;
 	std::ofstream* file = nullptr;
@@ -436,7 +446,7 @@ std::shared_ptr<torrent_info const> setup_peer(tcp::socket& s, io_context& ioc
 		if (ec) log("remove(): %s", ec.message().c_str());
 	}
 
-	add_torrent_params p = ::create_torrent(file);
+	add_torrent_params p = ::create_torrent(file, "temporary", 16 * 1024, num_pieces);
 	out_file.close();
 	ih = p.ti->info_hashes();
 
@@ -914,6 +924,325 @@ TORRENT_TEST(dont_have)
 	print_session_log(*ses);
 }
 
+// this is a benchmark of handling a large number of HAVE messages arriving
+// back-to-back, like a peer announcing all pieces it just completed. Every
+// piece is announced, so the peer turns into a seed once all of them have
+// been handled
+namespace {
+
+// sends a HAVE message for every piece, and waits for the peer to turn into
+// a seed. Returns the number of microseconds it took
+std::int64_t have_flood(int const num_pieces)
+{
+	using namespace lt::aux;
+
+	info_hash_t ih;
+	torrent_handle th;
+	std::shared_ptr<lt::session> ses;
+	io_context ios;
+	tcp::socket s(ios);
+	setup_peer(s, ios, ih, ses, true, false, false, torrent_flags_t{}, &th, num_pieces);
+
+	char recv_buffer[1000];
+	do_handshake(s, ih, recv_buffer);
+	print_session_log(*ses);
+	send_have_none(s);
+
+	std::vector<char> msg(std::size_t(num_pieces) * 9);
+	char* ptr = msg.data();
+	for (int i = 0; i < num_pieces; ++i)
+	{
+		write_uint32(5, ptr);
+		write_uint8(4, ptr);
+		write_uint32(i, ptr);
+	}
+
+	log("==> %d x have", num_pieces);
+	time_point const start = clock_type::now();
+	error_code ec;
+	boost::asio::write(s, boost::asio::buffer(msg)
+		, boost::asio::transfer_all(), ec);
+	if (ec) TEST_ERROR(ec.message());
+
+	std::vector<peer_info> pi;
+	for (;;)
+	{
+		th.get_peer_info(pi);
+		if (pi.size() != 1 || (pi[0].flags & peer_info::seed)) break;
+		if (clock_type::now() - start > seconds(30)) break;
+		std::this_thread::sleep_for(lt::milliseconds(1));
+	}
+	std::int64_t const elapsed = total_microseconds(clock_type::now() - start);
+	print_session_log(*ses);
+
+	TEST_EQUAL(pi.size(), 1);
+	if (pi.size() != 1) return elapsed;
+	TEST_CHECK(pi[0].flags & peer_info::seed);
+	TEST_EQUAL(pi[0].pieces.count(), num_pieces);
+	return elapsed;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(have_flood)
+{
+	std::cout << "\n === test have_flood ===\n" << std::endl;
+	have_flood(4096);
+}
+
+TORRENT_BENCHMARK(benchmark_have_flood)
+{
+	int const num_pieces = 65536;
+	std::int64_t const elapsed = have_flood(num_pieces);
+	std::printf("handled %d HAVE messages in %" PRId64 " us (%.0f messages/s)\n"
+		, num_pieces, elapsed, num_pieces * 1000000.0 / double(std::max(std::int64_t(1), elapsed)));
+}
+
+namespace {
+
+struct connection_memory
+{
+	std::int64_t connections = 0;
+	std::int64_t objects = 0;
+	std::int64_t recv_buffers = 0;
+	std::int64_t send_buffers = 0;
+	std::int64_t queues = 0;
+	std::int64_t bitfields = 0;
+
+	std::int64_t total() const
+	{ return objects + recv_buffers + send_buffers + queues + bitfields; }
+};
+
+// the per-connection memory, as reported by the session stats counters
+connection_memory sample_connection_memory(lt::session& ses, char const* name)
+{
+	connection_memory ret;
+	ses.post_session_stats();
+	time_point const start = clock_type::now();
+	while (clock_type::now() - start < seconds(5))
+	{
+		ses.wait_for_alert(seconds(1));
+		std::vector<alert*> alerts;
+		ses.pop_alerts(&alerts);
+		for (alert* a : alerts)
+		{
+			auto const* ss = alert_cast<session_stats_alert>(a);
+			if (ss == nullptr) continue;
+			auto const c = ss->counters();
+			ret.connections = c[find_metric_idx("peer.num_peers_connected")];
+			ret.objects = c[find_metric_idx("peer.peer_object_bytes")];
+			ret.recv_buffers = c[find_metric_idx("peer.peer_recv_buffer_bytes")];
+			ret.send_buffers = c[find_metric_idx("peer.peer_send_buffer_bytes")];
+			ret.queues = c[find_metric_idx("peer.peer_queue_bytes")];
+			ret.bitfields = c[find_metric_idx("peer.peer_bitfield_bytes")];
+			std::printf("%s: %" PRId64 " connections, bytes: total: %" PRId64
+				" objects: %" PRId64 " recv-buffer: %" PRId64 " send-buffer: %" PRId64
+				" queues: %" PRId64 " bitfield: %" PRId64 "\n"
+				, name, ret.connections, ret.total(), ret.objects, ret.recv_buffers
+				, ret.send_buffers, ret.queues, ret.bitfields);
+			return ret;
+		}
+	}
+	TEST_ERROR("no session_stats_alert");
+	return ret;
+}
+
+} // anonymous namespace
+
+namespace {
+
+// the bytes allocated on the heap by the whole process, or -1 if it's not
+// known on this platform
+std::int64_t heap_in_use()
+{
+#if defined __GLIBC__ && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	return std::int64_t(mallinfo2().uordblks);
+#else
+	return -1;
+#endif
+}
+
+void write_all(tcp::socket& s, span<char const> buf)
+{
+	error_code ec;
+	boost::asio::write(s, boost::asio::buffer(buf.data(), std::size_t(buf.size()))
+		, boost::asio::transfer_all(), ec);
+	if (ec) TEST_ERROR(ec.message());
+}
+
+} // anonymous namespace
+
+// 1000 peers connect, each sends a burst of messages and then goes quiet. Once
+// the connections have been idle for 30 seconds, they're expected to release
+// the memory they needed while they were busy. This reports the heap growth
+// of the process per connection, while the peers are busy and once they're
+// idle, along with the session's own breakdown of the connection memory
+TORRENT_BENCHMARK(benchmark_idle_connection_memory)
+{
+	int const num_peers = 1000;
+
+	info_hash_t ih;
+	std::shared_ptr<lt::session> ses;
+	io_context ios;
+	{
+		tcp::socket s(ios);
+		setup_peer(s, ios, ih, ses, true, false, false, torrent_flags::seed_mode);
+	}
+	settings_pack pack;
+	// the local peer class counts every connection as 1.5
+	pack.set_int(settings_pack::connections_limit, num_peers * 2);
+	pack.set_int(settings_pack::unchoke_slots_limit, -1);
+	pack.set_int(settings_pack::listen_queue_size, num_peers);
+	pack.set_int(settings_pack::alert_mask, alert_category::error);
+	ses->apply_settings(pack);
+
+	// let the connection made by setup_peer() be torn down
+	std::this_thread::sleep_for(lt::seconds(2));
+	std::int64_t const heap_before = heap_in_use();
+
+	char handshake[] = "\x13" "BitTorrent protocol\0\0\0\0\0\x10\0\x04"
+		"                    " // space for info-hash
+		"-BM0000-            "; // peer-id
+	std::memcpy(handshake + 28, ih.v1.data(), 20);
+	char const have_none[] = "\0\0\0\x01\x0f";
+	char const interested[] = "\0\0\0\x01\x02";
+	char const not_interested[] = "\0\0\0\x01\x03";
+	std::vector<char> const burst(4096 * 4, 0);
+
+	std::vector<tcp::socket> peers;
+	peers.reserve(num_peers);
+	for (int i = 0; i < num_peers; ++i)
+	{
+		peers.emplace_back(ios);
+		tcp::socket& s = peers.back();
+		error_code ec;
+		s.connect(ep("127.0.0.1", ses->listen_port()), ec);
+		if (ec)
+		{
+			TEST_ERROR(ec.message());
+			return;
+		}
+		s.set_option(tcp::no_delay(true), ec);
+		std::snprintf(handshake + 56, 13, "%012d", i);
+		write_all(s, {handshake, sizeof(handshake) - 1});
+
+		char response[68];
+		boost::asio::read(s, boost::asio::buffer(response)
+			, boost::asio::transfer_all(), ec);
+		if (ec)
+		{
+			TEST_ERROR(ec.message());
+			return;
+		}
+
+		write_all(s, {have_none, sizeof(have_none) - 1});
+		write_all(s, {interested, sizeof(interested) - 1});
+	}
+
+	// every peer downloads one block, to have the session fill its request
+	// and send queues. The requests are all issued before the first piece is
+	// read, to not wait for the session once per peer
+	std::vector<char> msg(16 * 1024 + 13);
+	for (int i = 0; i < num_peers; ++i)
+	{
+		int len;
+		do len = read_message(peers[std::size_t(i)], msg);
+		while (len > 0 && msg[0] != 1); // unchoke
+		if (len <= 0) return;
+		send_request(peers[std::size_t(i)], peer_request{piece_index_t(i % 13), 0, 16 * 1024});
+	}
+	for (auto& s : peers)
+	{
+		int len;
+		do len = read_message(s, msg);
+		while (len > 0 && msg[0] != 7); // piece
+		if (len <= 0) return;
+
+		// a seed disconnects interested peers that stop requesting
+		write_all(s, {not_interested, sizeof(not_interested) - 1});
+
+		// a burst of keep-alives makes the session grow its receive buffer
+		write_all(s, burst);
+	}
+
+	std::this_thread::sleep_for(lt::seconds(2));
+	connection_memory const busy = sample_connection_memory(*ses, "busy connections");
+	std::int64_t const heap_busy = heap_in_use();
+
+	// wait for the connections to be considered idle. The receive buffer is
+	// shrunk once the next message arrives
+	std::this_thread::sleep_for(lt::seconds(35));
+	char const keepalive[] = "\0\0\0\0";
+	for (auto& s : peers) write_all(s, {keepalive, 4});
+	std::this_thread::sleep_for(lt::seconds(2));
+	connection_memory const idle = sample_connection_memory(*ses, "idle connections");
+	std::int64_t const heap_idle = heap_in_use();
+
+	if (heap_before >= 0)
+	{
+		std::printf("heap growth per connection: busy: %" PRId64 " idle: %" PRId64 "\n"
+			, (heap_busy - heap_before) / num_peers, (heap_idle - heap_before) / num_peers);
+	}
+
+	TEST_EQUAL(busy.connections, num_peers);
+	TEST_EQUAL(idle.connections, num_peers);
+	TEST_CHECK(idle.total() * 2 <= busy.total());
+}
+
+// an invalid HAVE in the same batch as valid ones disconnects the peer. The
+// valid HAVEs before it must not leave the piece availability out of balance
+TORRENT_TEST(invalid_have_in_batch)
+{
+	using namespace lt::aux;
+
+	std::cout << "\n === test invalid_have_in_batch ===\n" << std::endl;
+
+	info_hash_t ih;
+	torrent_handle th;
+	std::shared_ptr<lt::session> ses;
+	io_context ios;
+	tcp::socket s(ios);
+	setup_peer(s, ios, ih, ses, true, false, false, torrent_flags_t{}, &th);
+
+	char recv_buffer[1000];
+	do_handshake(s, ih, recv_buffer);
+	print_session_log(*ses);
+	send_have_none(s);
+
+	// HAVE(3) followed by HAVE(13), which is out of range for 13 pieces
+	char msg[18];
+	char* ptr = msg;
+	write_uint32(5, ptr);
+	write_uint8(4, ptr);
+	write_uint32(3, ptr);
+	write_uint32(5, ptr);
+	write_uint8(4, ptr);
+	write_uint32(13, ptr);
+
+	log("==> have [3, 13]");
+	error_code ec;
+	boost::asio::write(s, boost::asio::buffer(msg)
+		, boost::asio::transfer_all(), ec);
+	if (ec) TEST_ERROR(ec.message());
+
+	std::vector<peer_info> pi;
+	time_point const start = clock_type::now();
+	do
+	{
+		std::this_thread::sleep_for(lt::milliseconds(10));
+		th.get_peer_info(pi);
+	} while (!pi.empty() && clock_type::now() - start < seconds(10));
+	print_session_log(*ses);
+
+	// the peer was disconnected, and it no longer contributes to the
+	// availability of any piece
+	TEST_CHECK(pi.empty());
+	std::vector<int> avail;
+	th.piece_availability(avail);
+	TEST_EQUAL(int(avail.size()), 13);
+	for (int const a : avail) TEST_EQUAL(a, 0);
+}
+
 TORRENT_TEST(extension_handshake)
 {
 	using namespace lt::aux;
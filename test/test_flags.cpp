@@ -197,3 +197,11 @@ TORRENT_TEST(flag_disable_pex)
 	test_set_after_add(torrent_flags::disable_pex);
 	test_unset_after_add(torrent_flags::disable_pex);
 }
+
+TORRENT_TEST(flag_dormant)
+{
+	// a torrent can only be dormant if it's added paused, and the flag can't
+	// be set once the torrent is loaded
+	test_add_and_get_flags(torrent_flags::dormant | torrent_flags::paused);
+	test_unset_after_add(torrent_flags::dormant | torrent_flags::paused);
+}
@@ -13,6 +13,7 @@ see LICENSE file.
 #include "libtorrent/aux_/parse_url.hpp"
 #include "libtorrent/string_view.hpp"
 
+#include <string>
 #include <tuple>
 
 using namespace lt;
@@ -888,3 +889,61 @@ TORRENT_TEST(has_tracker_query_string)
 	TEST_CHECK(!has_tracker_query_string("info_hash1=abc"_sv));
 	TEST_CHECK(!has_tracker_query_string("&1port=abc"_sv));
 }
+
+// feeds a web seed response and a chunked tracker response to the parser,
+// one packet at a time
+TORRENT_BENCHMARK(benchmark_http_parser)
+{
+	// a typical web seed response, followed by a chunked tracker response
+	std::string const web_seed_response = "HTTP/1.1 206 Partial Content\r\n"
+		"Date: Mon, 19 Oct 2026 10:00:00 GMT\r\n"
+		"Server: Apache/2.4.41 (Ubuntu)\r\n"
+		"Last-Modified: Sun, 18 Oct 2026 08:00:00 GMT\r\n"
+		"ETag: \"4000-5b2e3f1a2c3d4\"\r\n"
+		"Accept-Ranges: bytes\r\n"
+		"Content-Length: 16384\r\n"
+		"Content-Range: bytes 16384-32767/1048576\r\n"
+		"Keep-Alive: timeout=5, max=100\r\n"
+		"Connection: Keep-Alive\r\n"
+		"Content-Type: application/octet-stream\r\n"
+		"\r\n" + std::string(16384, 'x');
+
+	std::string chunked_response = "HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/plain\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"\r\n";
+	for (int i = 0; i < 16; ++i)
+		chunked_response += "400\r\n" + std::string(0x400, 'x') + "\r\n";
+	chunked_response += "0\r\nX-Tail: foobar\r\n\r\n";
+
+	int const iterations = 50000;
+
+	for (std::string const& response : {web_seed_response, chunked_response})
+	{
+		aux::http_parser parser;
+		std::int64_t payload_bytes = 0;
+		auto const start = clock_type::now();
+		for (int i = 0; i < iterations; ++i)
+		{
+			parser.reset();
+			// feed the response one packet at a time
+			for (std::size_t end = 1400;; end += 1400)
+			{
+				bool error = false;
+				int payload;
+				std::tie(payload, std::ignore) = parser.incoming(
+					string_view(response).substr(0, end), error);
+				payload_bytes += payload;
+				TEST_CHECK(!error);
+				if (end >= response.size()) break;
+			}
+			TEST_CHECK(parser.finished());
+		}
+		auto const elapsed = clock_type::now() - start;
+		TEST_EQUAL(payload_bytes, std::int64_t(iterations) * 16384);
+
+		std::printf("%s: %d us (%d iterations)\n"
+			, parser.chunked_encoding() ? "chunked response" : "web seed response"
+			, int(total_microseconds(elapsed)), iterations);
+	}
+}
@@ -11,12 +11,15 @@ see LICENSE file.
 #include "libtorrent/ip_filter.hpp"
 #include "setup_transfer.hpp" // for addr()
 #include <utility>
+#include <random>
+#include <cinttypes> // for PRId64
 
 #include "test.hpp"
 #include "settings.hpp"
 #include "libtorrent/aux_/socket_io.hpp"
 #include "libtorrent/session.hpp"
 #include "libtorrent/session_params.hpp"
+#include "libtorrent/time.hpp"
 
 /*
 
@@ -235,3 +238,229 @@ TORRENT_TEST(port_filter)
 	TEST_CHECK(pf.access(65535) == 0);
 }
 
+
+namespace {
+
+std::vector<ip_range<address_v4>> random_rules_v4(std::mt19937& rng, int const count
+	, std::uint32_t const max_size)
+{
+	std::vector<ip_range<address_v4>> ret;
+	ret.reserve(std::size_t(count));
+	for (int i = 0; i < count; ++i)
+	{
+		std::uint32_t const first = std::uint32_t(rng());
+		std::uint32_t const size = std::uint32_t(rng()) % max_size;
+		std::uint32_t const last = first > 0xffffffff - size ? 0xffffffff : first + size;
+		ret.push_back({address_v4(first), address_v4(last), std::uint32_t(rng() % 3)});
+	}
+	return ret;
+}
+
+std::vector<ip_range<address_v6>> random_rules_v6(std::mt19937& rng, int const count)
+{
+	std::vector<ip_range<address_v6>> ret;
+	ret.reserve(std::size_t(count));
+	for (int i = 0; i < count; ++i)
+	{
+		// only vary the top bytes, to make ranges overlap
+		address_v6::bytes_type first{};
+		address_v6::bytes_type last{};
+		first[0] = std::uint8_t(rng() % 4);
+		first[1] = std::uint8_t(rng());
+		last = first;
+		last[1] = std::uint8_t(std::min(0xff, last[1] + int(rng() % 16)));
+		std::fill(last.begin() + 2, last.end(), std::uint8_t(0xff));
+		ret.push_back({address_v6(first), address_v6(last), std::uint32_t(rng() % 3)});
+	}
+	return ret;
+}
+
+template <typename Addr>
+void add_one_by_one(ip_filter& f, std::vector<ip_range<Addr>> const& rules)
+{
+	for (auto const& r : rules) f.add_rule(r.first, r.last, r.flags);
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(add_rules_v4)
+{
+	std::mt19937 rng(0x1a2b3c4d);
+	for (int round = 0; round < 20; ++round)
+	{
+		auto const base = random_rules_v4(rng, 50, 0x10000000);
+		auto const rules = random_rules_v4(rng, 200, round < 10 ? 0x100 : 0x10000000);
+
+		ip_filter expected;
+		add_one_by_one(expected, base);
+		add_one_by_one(expected, rules);
+
+		// rules added in bulk on top of rules added one at a time
+		ip_filter bulk;
+		add_one_by_one(bulk, base);
+		bulk.add_rules(rules);
+
+		TEST_CHECK(std::get<0>(bulk.export_filter()) == std::get<0>(expected.export_filter()));
+		test_rules_invariant(std::get<0>(bulk.export_filter()), bulk);
+
+		for (int i = 0; i < 1000; ++i)
+		{
+			address const a = address_v4(std::uint32_t(rng()));
+			TEST_EQUAL(bulk.access(a), expected.access(a));
+		}
+		for (auto const& r : rules)
+		{
+			TEST_EQUAL(bulk.access(r.first), expected.access(r.first));
+			TEST_EQUAL(bulk.access(r.last), expected.access(r.last));
+		}
+	}
+}
+
+TORRENT_TEST(add_rules_v6)
+{
+	std::mt19937 rng(0x5e6f7a8b);
+	for (int round = 0; round < 20; ++round)
+	{
+		auto const rules = random_rules_v6(rng, 100);
+
+		ip_filter expected;
+		add_one_by_one(expected, rules);
+
+		ip_filter bulk;
+		bulk.add_rules(rules);
+
+		TEST_CHECK(std::get<1>(bulk.export_filter()) == std::get<1>(expected.export_filter()));
+		test_rules_invariant(std::get<1>(bulk.export_filter()), bulk);
+		TEST_EQUAL(bulk.empty(), expected.empty());
+	}
+}
+
+TORRENT_TEST(add_rules_order)
+{
+	// later rules take precedence, regardless of their address
+	std::vector<ip_range<address_v4>> const rules =
+	{
+		{addr4("1.0.0.0"), addr4("9.0.0.0"), ip_filter::blocked}
+		, {addr4("2.0.0.0"), addr4("3.0.0.0"), 0}
+		, {addr4("0.0.0.0"), addr4("1.0.0.0"), 0}
+	};
+	ip_filter f;
+	f.add_rules(rules);
+
+	std::vector<ip_range<address_v4>> const expected =
+	{
+		{addr4("0.0.0.0"), addr4("1.0.0.0"), 0}
+		, {addr4("1.0.0.1"), addr4("1.255.255.255"), ip_filter::blocked}
+		, {addr4("2.0.0.0"), addr4("3.0.0.0"), 0}
+		, {addr4("3.0.0.1"), addr4("9.0.0.0"), ip_filter::blocked}
+		, {addr4("9.0.0.1"), addr4("255.255.255.255"), 0}
+	};
+	TEST_CHECK(std::get<0>(f.export_filter()) == expected);
+	TEST_EQUAL(f.access(addr4("255.255.255.255")), 0);
+	TEST_EQUAL(f.access(addr4("5.0.0.0")), ip_filter::blocked);
+}
+
+TORRENT_TEST(compile)
+{
+	ip_filter f;
+	f.compile();
+	TEST_CHECK(f.empty());
+	TEST_EQUAL(f.access(addr4("10.0.0.1")), 0);
+
+	f.add_rule(addr4("10.0.0.0"), addr4("10.255.255.255"), ip_filter::blocked);
+	f.add_rule(addr6("1::"), addr6("2::"), ip_filter::blocked);
+	auto const before = f.export_filter();
+
+	ip_filter compiled = f;
+	compiled.compile();
+	TEST_CHECK(!compiled.empty());
+	TEST_CHECK(compiled.export_filter() == before);
+	test_rules_invariant(std::get<0>(compiled.export_filter()), compiled);
+	test_rules_invariant(std::get<1>(compiled.export_filter()), compiled);
+	TEST_EQUAL(compiled.access(addr4("9.255.255.255")), 0);
+	TEST_EQUAL(compiled.access(addr4("10.1.2.3")), ip_filter::blocked);
+	TEST_EQUAL(compiled.access(addr4("11.0.0.0")), 0);
+	TEST_EQUAL(compiled.access(addr6("1::1")), ip_filter::blocked);
+
+	// adding rules to a compiled filter still works
+	f.add_rule(addr4("10.1.0.0"), addr4("10.1.255.255"), 0);
+	compiled.add_rule(addr4("10.1.0.0"), addr4("10.1.255.255"), 0);
+	TEST_CHECK(compiled.export_filter() == f.export_filter());
+	TEST_EQUAL(compiled.access(addr4("10.1.2.3")), 0);
+}
+
+TORRENT_TEST(ban_ip_keeps_filter_compiled)
+{
+	// this is what session_impl::ban_ip() does to the session's filter
+	aux::filter_impl<address_v4::bytes_type> f;
+	f.add_rules({{addr4("10.0.0.0").to_bytes(), addr4("10.255.255.255").to_bytes()
+		, ip_filter::blocked}});
+	TEST_CHECK(f.compiled());
+
+	f.add_rule(addr4("1.2.3.4").to_bytes(), addr4("1.2.3.4").to_bytes(), ip_filter::blocked);
+	f.add_rule(addr4("10.1.2.3").to_bytes(), addr4("10.1.2.3").to_bytes(), 0);
+	TEST_CHECK(f.compiled());
+	TEST_EQUAL(f.access(addr4("1.2.3.4").to_bytes()), ip_filter::blocked);
+	TEST_EQUAL(f.access(addr4("1.2.3.5").to_bytes()), 0);
+	TEST_EQUAL(f.access(addr4("10.1.2.3").to_bytes()), 0);
+	TEST_EQUAL(f.access(addr4("10.1.2.4").to_bytes()), ip_filter::blocked);
+
+	// the banned addresses are part of the exported filter, and survive
+	// compiling it again
+	ip_filter ref;
+	ref.add_rule(addr4("10.0.0.0"), addr4("10.255.255.255"), ip_filter::blocked);
+	ref.add_rule(addr4("1.2.3.4"), addr4("1.2.3.4"), ip_filter::blocked);
+	ref.add_rule(addr4("10.1.2.3"), addr4("10.1.2.3"), 0);
+	auto const expected = std::get<0>(ref.export_filter());
+	TEST_CHECK(f.export_filter<address_v4>() == expected);
+
+	f.compile();
+	TEST_CHECK(f.compiled());
+	TEST_CHECK(f.export_filter<address_v4>() == expected);
+	TEST_EQUAL(f.access(addr4("1.2.3.4").to_bytes()), ip_filter::blocked);
+
+	// a range turns it back into a tree, keeping the banned addresses
+	f.add_rule(addr4("1.2.3.5").to_bytes(), addr4("1.2.3.6").to_bytes(), ip_filter::blocked);
+	ref.add_rule(addr4("1.2.3.5"), addr4("1.2.3.6"), ip_filter::blocked);
+	TEST_CHECK(!f.compiled());
+	TEST_CHECK(f.export_filter<address_v4>() == std::get<0>(ref.export_filter()));
+}
+
+TORRENT_BENCHMARK(benchmark_large_filter)
+{
+	int const num_rules = 1000000;
+	int const num_lookups = 1000000;
+	std::mt19937 rng(0x9c8d7e6f);
+	auto const rules = random_rules_v4(rng, num_rules, 0x1000);
+
+	time_point start = clock_type::now();
+	ip_filter tree;
+	add_one_by_one(tree, rules);
+	std::printf("add_rule %d rules: %" PRId64 " ms\n", num_rules
+		, total_milliseconds(clock_type::now() - start));
+
+	start = clock_type::now();
+	ip_filter bulk;
+	bulk.add_rules(rules);
+	std::printf("add_rules %d rules: %" PRId64 " ms\n", num_rules
+		, total_milliseconds(clock_type::now() - start));
+
+	std::vector<address> addresses;
+	addresses.reserve(std::size_t(num_lookups));
+	for (int i = 0; i < num_lookups; ++i)
+		addresses.push_back(address_v4(std::uint32_t(rng())));
+
+	auto lookups = [&](ip_filter const& f, char const* name)
+	{
+		std::uint32_t blocked = 0;
+		time_point const begin = clock_type::now();
+		for (auto const& a : addresses) blocked += f.access(a);
+		std::int64_t const us = std::max(std::int64_t(1)
+			, total_microseconds(clock_type::now() - begin));
+		std::printf("%s: %d lookups: %" PRId64 " ms (%" PRId64 " lookups/s)\n", name
+			, num_lookups, us / 1000, std::int64_t(num_lookups) * 1000000 / us);
+		return blocked;
+	};
+
+	TEST_EQUAL(lookups(tree, "tree"), lookups(bulk, "compiled"));
+}
@@ -11,11 +11,13 @@ see LICENSE file.
 */
 
 #include <iostream>
+#include <cinttypes>
 
 #include "libtorrent/aux_/merkle.hpp"
 #include "libtorrent/aux_/merkle_tree.hpp"
 #include "libtorrent/aux_/random.hpp"
 #include "libtorrent/bitfield.hpp"
+#include "libtorrent/time.hpp"
 
 #include "test.hpp"
 #include "test_utils.hpp"
@@ -911,6 +913,290 @@ TORRENT_TEST(add_hashes_partial_proofs)
 	TEST_CHECK(t.verified_leafs() == none_set(num_blocks));
 }
 
+namespace {
+
+span<char const> piece_layer(span<sha256_hash const> tree, int const first, int const count)
+{
+	return {reinterpret_cast<char const*>(tree.data() + first)
+		, count * int(sha256_hash::size())};
+}
+
+// returns a tree in piece_layer mode, i.e. the piece layer is loaded up-front
+// and block hashes are verified against it as they are added
+aux::merkle_tree piece_layer_tree(int const blocks_per_piece)
+{
+	TORRENT_ASSERT(blocks_per_piece == 4);
+	aux::merkle_tree t(num_blocks, blocks_per_piece, f[0].data());
+	int const num_pieces = (num_blocks + 3) / 4;
+	TEST_CHECK(t.load_piece_layer(piece_layer(f, 127, num_pieces)));
+	return t;
+}
+
+// returns a tree with the same hashes, but in full tree mode
+aux::merkle_tree full_piece_layer_tree(int const blocks_per_piece)
+{
+	TORRENT_ASSERT(blocks_per_piece == 4);
+	aux::merkle_tree t(num_blocks, blocks_per_piece, f[0].data());
+	auto const result = t.add_hashes(127, pdiff(1), range(f, 127, 128), span<sha256_hash const>());
+	TEST_CHECK(result);
+	return t;
+}
+
+void test_same_tree(aux::merkle_tree const& t1, aux::merkle_tree const& t2)
+{
+	TEST_CHECK(t1.build_vector() == t2.build_vector());
+	TEST_CHECK(t1.verified_leafs() == t2.verified_leafs());
+	TEST_EQUAL(t1.is_complete(), t2.is_complete());
+	for (int i = 0; i < int(t1.size()); ++i)
+	{
+		TEST_EQUAL(t1.has_node(i), t2.has_node(i));
+		TEST_EQUAL(t1[i], t2[i]);
+		TEST_CHECK(t1.compare_node(i, t2[i]));
+	}
+}
+}
+
+TORRENT_TEST(merkle_subtree_root)
+{
+	std::vector<sha256_hash> leafs;
+	for (int i = 0; i < 33; ++i)
+	{
+		for (int num_leafs = merkle_num_leafs(std::max(1, i)); num_leafs <= 64; num_leafs *= 2)
+		{
+			aux::vector<sha256_hash> tree(merkle_num_nodes(num_leafs));
+			std::copy(leafs.begin(), leafs.end(), tree.end() - num_leafs);
+			merkle_fill_tree(tree, num_leafs);
+			TEST_EQUAL(merkle_subtree_root(leafs, num_leafs), tree[0]);
+		}
+		leafs.push_back(rand_sha256());
+	}
+}
+
+TORRENT_TEST(merkle_verify_subtrees)
+{
+	int const blocks_per_piece = 4;
+	int const num_pieces = (num_blocks + 3) / 4;
+	std::vector<sha256_hash> blocks(f.begin() + 511, f.begin() + 511 + num_blocks);
+
+	// piece 1 is missing a block, piece 2 has an invalid one
+	blocks[5].clear();
+	blocks[9] = rand_sha256();
+
+	bitfield verified(num_blocks);
+	merkle_verify_subtrees(blocks, range(f, 127, num_pieces), blocks_per_piece, verified);
+
+	bitfield expected = set_range(none_set(num_blocks), 0, 4);
+	expected = set_range(expected, 12, num_blocks - 12);
+	TEST_CHECK(verified == expected);
+
+	// the incomplete piece is left as is, the invalid one is cleared
+	for (int i = 4; i < 8; ++i)
+		TEST_EQUAL(blocks[std::size_t(i)].is_all_zeros(), i == 5);
+	for (int i = 8; i < 12; ++i)
+		TEST_CHECK(blocks[std::size_t(i)].is_all_zeros());
+}
+
+TORRENT_TEST(set_block_piece_layer)
+{
+	int const blocks_per_piece = 4;
+	auto t = piece_layer_tree(blocks_per_piece);
+	auto ref = full_piece_layer_tree(blocks_per_piece);
+
+	for (int block = 0; block < num_blocks; ++block)
+	{
+		auto const result = t.set_block(block, f[511 + block]);
+		auto const ref_result = ref.set_block(block, f[511 + block]);
+		TEST_CHECK(std::get<0>(result) == std::get<0>(ref_result));
+		if ((block % blocks_per_piece) == blocks_per_piece - 1 || block == num_blocks - 1)
+		{
+			TEST_CHECK(std::get<0>(result) == aux::merkle_tree::set_block_result::ok);
+			TEST_EQUAL(std::get<1>(result), block - (block % blocks_per_piece));
+			TEST_EQUAL(std::get<2>(result), blocks_per_piece);
+			TEST_CHECK(t.verified_leafs() == set_range(none_set(num_blocks), 0, block + 1));
+		}
+		else
+		{
+			TEST_CHECK(std::get<0>(result) == aux::merkle_tree::set_block_result::unknown);
+			TEST_CHECK(t.verified_leafs() == set_range(none_set(num_blocks), 0, block - (block % blocks_per_piece)));
+		}
+
+		if (block == 37) test_same_tree(t, ref);
+	}
+	TEST_CHECK(t.is_complete());
+	test_same_tree(t, ref);
+}
+
+TORRENT_TEST(set_block_invalid_piece_layer)
+{
+	int const blocks_per_piece = 4;
+	auto t = piece_layer_tree(blocks_per_piece);
+	auto ref = full_piece_layer_tree(blocks_per_piece);
+
+	for (int block = 0; block < num_blocks; ++block)
+	{
+		// every third piece has an invalid block
+		sha256_hash const h = ((block / blocks_per_piece) % 3) == 1 && (block % blocks_per_piece) == 2
+			? rand_sha256() : f[511 + block];
+		auto const result = t.set_block(block, h);
+		auto const ref_result = ref.set_block(block, h);
+		TEST_CHECK(std::get<0>(result) == std::get<0>(ref_result));
+		if (std::get<0>(result) != aux::merkle_tree::set_block_result::unknown)
+		{
+			TEST_EQUAL(std::get<1>(result), std::get<1>(ref_result));
+			TEST_EQUAL(std::get<2>(result), std::get<2>(ref_result));
+		}
+	}
+	TEST_CHECK(!t.is_complete());
+	test_same_tree(t, ref);
+
+	// the blocks that were cleared can be set again, this time the correct ones
+	for (int block = 0; block < num_blocks; ++block)
+	{
+		if (((block / blocks_per_piece) % 3) != 1) continue;
+		t.set_block(block, f[511 + block]);
+	}
+	TEST_CHECK(t.is_complete());
+	TEST_CHECK(t.verified_leafs() == all_set(num_blocks));
+}
+
+TORRENT_TEST(add_hashes_piece_layer)
+{
+	int const blocks_per_piece = 4;
+	auto t = piece_layer_tree(blocks_per_piece);
+	auto ref = full_piece_layer_tree(blocks_per_piece);
+
+	// we have some blocks of piece 5, one of which is invalid
+	for (auto* tree : {&t, &ref})
+	{
+		tree->set_block(20, f[511 + 20]);
+		tree->set_block(21, rand_sha256());
+	}
+
+	auto const result = t.add_hashes(511 + 20, pdiff(1), range(f, 511 + 20, 4)
+		, build_proof(f, 127 + 5));
+	auto const ref_result = ref.add_hashes(511 + 20, pdiff(1), range(f, 511 + 20, 4)
+		, build_proof(f, 127 + 5));
+
+	TEST_CHECK(result);
+	TEST_CHECK(ref_result);
+	if (!result || !ref_result) return;
+
+	TEST_CHECK(result->passed == std::vector<piece_index_t>{piece_index_t{6}});
+	TEST_CHECK(result->passed == ref_result->passed);
+	TEST_EQUAL(result->failed.size(), 1);
+	TEST_CHECK(result->failed == ref_result->failed);
+	TEST_CHECK(t.verified_leafs() == set_range(none_set(num_blocks), 20, 4));
+	test_same_tree(t, ref);
+
+	// hashes that don't match the piece layer are rejected
+	TEST_CHECK(!t.add_hashes(511 + 24, pdiff(1), corrupt(range(f, 511 + 24, 4))
+		, build_proof(f, 127 + 6)));
+	TEST_CHECK(t.verified_leafs() == set_range(none_set(num_blocks), 20, 4));
+}
+
+TORRENT_TEST(roundtrip_piece_layer_blocks)
+{
+	int const blocks_per_piece = 4;
+	auto t = piece_layer_tree(blocks_per_piece);
+
+	// some verified pieces and some partial ones
+	for (int block = 0; block < num_blocks; ++block)
+	{
+		if ((block % 7) == 3) continue;
+		t.set_block(block, f[511 + block]);
+	}
+	test_roundtrip(t, num_blocks, blocks_per_piece);
+
+	auto const [tree, mask] = t.build_sparse_vector();
+	aux::merkle_tree t2(num_blocks, blocks_per_piece, f[0].data());
+	t2.load_sparse_tree(tree, mask, empty_verified);
+	TEST_CHECK(t2.verified_leafs() == t.verified_leafs());
+
+	// only the piece layer and the block hashes are saved
+	int const num_pieces = (num_blocks + 3) / 4;
+	TEST_EQUAL(int(tree.size()), num_pieces + num_blocks - (num_blocks + 3) / 7);
+
+	// a block hash that doesn't match its piece is not considered verified
+	// once loaded
+	auto bad_tree = tree;
+	bad_tree.back() = rand_sha256();
+	aux::merkle_tree t3(num_blocks, blocks_per_piece, f[0].data());
+	t3.load_sparse_tree(bad_tree, mask, empty_verified);
+	TEST_CHECK(!t3.verified_leafs().get_bit(num_blocks - 1));
+	TEST_CHECK(t3.verified_leafs().get_bit(4));
+}
+
+// verifies the block hashes of a file whose piece layer is known up-front, one
+// block at a time. The tree is saved and restored half way through
+namespace {
+
+void test_large_tree_set_block(int const blocks, bool const print_timing)
+{
+	// 4 MiB pieces
+	int const blocks_per_piece = 256;
+	int const pieces = blocks / blocks_per_piece;
+
+	auto const large = build_tree(blocks);
+	int const first_block = merkle_first_leaf(blocks);
+	int const first_piece = merkle_first_leaf(pieces);
+
+	aux::merkle_tree t(blocks, blocks_per_piece, large[0].data());
+	TEST_CHECK(t.load_piece_layer(piece_layer(large, first_piece, pieces)));
+
+	auto set_blocks = [&](aux::merkle_tree& tree, int const begin, int const end)
+	{
+		for (int b = begin; b < end; ++b)
+		{
+			auto const result = tree.set_block(b, large[first_block + b]);
+			bool const piece_done = ((b + 1) % blocks_per_piece) == 0;
+			TEST_CHECK(std::get<0>(result) == (piece_done
+				? aux::merkle_tree::set_block_result::ok
+				: aux::merkle_tree::set_block_result::unknown));
+		}
+	};
+
+	auto report = [print_timing](char const* what, int const n, time_point const start)
+	{
+		if (!print_timing) return;
+		std::printf("%s %d block hashes: %" PRId64 " ms\n", what, n
+			, total_milliseconds(clock_type::now() - start));
+	};
+
+	time_point start = clock_type::now();
+	set_blocks(t, 0, blocks / 2);
+	report("set", blocks / 2, start);
+
+	start = clock_type::now();
+	auto const [tree, mask] = t.build_sparse_vector();
+	aux::merkle_tree t2(blocks, blocks_per_piece, large[0].data());
+	t2.load_sparse_tree(tree, mask, bitfield(blocks));
+	report("save and load", blocks / 2, start);
+
+	// only the piece layer and the block hashes are saved
+	TEST_EQUAL(int(tree.size()), pieces + blocks / 2);
+	TEST_CHECK(t2.verified_leafs() == t.verified_leafs());
+
+	start = clock_type::now();
+	set_blocks(t2, blocks / 2, blocks);
+	report("set", blocks / 2, start);
+
+	TEST_CHECK(t2.is_complete());
+	TEST_CHECK(t2.get_piece_layer() == aux::vector<sha256_hash>(range(large, first_piece, pieces).begin()
+		, range(large, first_piece, pieces).end()));
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(large_tree_set_block)
+{
+	test_large_tree_set_block(4096, false);
+}
+
+TORRENT_BENCHMARK(benchmark_large_tree_set_block)
+{
+	test_large_tree_set_block(1 << 18, true);
+}
+
 // TODO: add test for load_piece_layer()
 // TODO: add test for add_hashes() with an odd number of blocks
 // TODO: add test for set_block() (setting the last block) with an odd number of blocks
@@ -12,11 +12,13 @@ see LICENSE file.
 
 #include <algorithm>
 #include <iostream>
+#include <cinttypes>
 
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/aux_/pe_crypto.hpp"
 #include "libtorrent/aux_/random.hpp"
 #include "libtorrent/span.hpp"
+#include "libtorrent/time.hpp"
 
 #include "test.hpp"
 
@@ -122,6 +124,71 @@ TORRENT_TEST(rc4)
 	test_enc_handler(rc41, rc42);
 }
 
+TORRENT_TEST(rc4_known_answer)
+{
+	using namespace lt;
+
+	// RC4 with a 20 byte key and the first 1024 bytes of the key stream
+	// discarded
+	std::array<char, 20> key;
+	for (int i = 0; i < 20; ++i) key[std::size_t(i)] = char(i + 1);
+
+	aux::rc4_handler rc4;
+	rc4.set_outgoing_key(key);
+
+	// split the buffer to make sure the key stream carries over from one
+	// buffer to the next, and that buffers not divisible by 8 work
+	std::array<char, 19> buf{};
+	std::array<span<char>, 2> bufs{{span<char>(buf).first(11), span<char>(buf).subspan(11)}};
+	rc4.encrypt(bufs);
+
+	char const expected[] = "\xd0\xef\x0c\x6b\x23\xf1\x28\x21\x9c\x35\x2c"
+		"\x15\x88\x1d\x52\xc1\x21\x8b\x80";
+	TEST_CHECK(std::equal(buf.begin(), buf.end(), expected));
+}
+
+TORRENT_BENCHMARK(benchmark_rc4)
+{
+	using namespace lt;
+
+	sha1_hash const key = hasher("test1_key", 8).final();
+	aux::rc4_handler rc4;
+	rc4.set_outgoing_key(key);
+
+	std::vector<char> buf(1024 * 1024);
+	int const rounds = 64;
+	time_point const start = clock_type::now();
+	for (int i = 0; i < rounds; ++i)
+	{
+		span<char> vec(buf);
+		rc4.encrypt(vec);
+	}
+	std::int64_t const elapsed = std::max(std::int64_t(1)
+		, total_microseconds(clock_type::now() - start));
+	std::printf("RC4: %d MiB in %" PRId64 " us (%.1f MiB/s)\n"
+		, rounds, elapsed, rounds * 1000000.0 / double(elapsed));
+}
+
+TORRENT_BENCHMARK(benchmark_diffie_hellman)
+{
+	using namespace lt;
+
+	// this is the work done by both sides of an encrypted handshake
+	int const rounds = 50;
+	time_point const start = clock_type::now();
+	for (int i = 0; i < rounds; ++i)
+	{
+		aux::dh_key_exchange DH1, DH2;
+		DH1.compute_secret(DH2.get_local_key());
+		DH2.compute_secret(DH1.get_local_key());
+		TEST_EQUAL(DH1.get_secret(), DH2.get_secret());
+	}
+	std::int64_t const elapsed = std::max(std::int64_t(1)
+		, total_microseconds(clock_type::now() - start));
+	std::printf("DH: %d handshakes in %" PRId64 " us (%.1f handshakes/s)\n"
+		, rounds, elapsed, rounds * 1000000.0 / double(elapsed));
+}
+
 #else
 TORRENT_TEST(disabled)
 {
@@ -18,12 +18,18 @@ see LICENSE file.
 #include "libtorrent/peer_info.hpp"
 #include "libtorrent/aux_/random.hpp"
 #include "libtorrent/aux_/socket_io.hpp"
+#include "libtorrent/aux_/io_bytes.hpp"
+#include "libtorrent/time.hpp"
 
 #include "test.hpp"
 #include "setup_transfer.hpp"
 #include <vector>
 #include <memory> // for shared_ptr
+#include <random>
+#include <set>
 #include <cstdarg>
+#include <cinttypes>
+#include <cstdio>
 
 using namespace lt;
 using namespace lt::aux;
@@ -169,8 +175,7 @@ void mock_peer_connection::disconnect(error_code const&
 
 bool has_peer(peer_list const& p, tcp::endpoint const& ep)
 {
-	auto const its = p.find_peers(ep.address());
-	return its.first != its.second;
+	return !p.find_peers(ep.address()).empty();
 }
 
 torrent_state init_state()
@@ -1106,6 +1111,80 @@ TORRENT_TEST(new_peer_size_limit)
 		, 5);
 }
 
+TORRENT_TEST(add_peers)
+{
+	torrent_state st = init_state();
+	peer_list p(allocator);
+
+	torrent_peer* existing = add_peer(p, st, ep("10.0.0.1", 8080));
+	TEST_CHECK(existing);
+
+	std::vector<tcp::endpoint> const peers = {
+		ep("10.0.0.1", 8081)
+		, ep("10.0.0.2", 8080)
+		// port 0 is invalid
+		, ep("10.0.0.3", 0)
+		, ep("10.0.0.4", 8080)
+		// the same peer twice in one batch
+		, ep("10.0.0.2", 8082)
+	};
+	std::vector<pex_flags_t> const flags = {
+		{}, pex_utp, {}, pex_seed, {}
+	};
+	std::vector<add_peer_result> result;
+	p.add_peers(peers, peer_info::pex, pex_holepunch, flags, &st, result);
+
+	std::vector<add_peer_result> const expected = {
+		add_peer_result::updated
+		, add_peer_result::added
+		, add_peer_result::rejected
+		, add_peer_result::added
+		, add_peer_result::updated
+	};
+	TEST_CHECK(result == expected);
+	TEST_EQUAL(p.num_peers(), 3);
+	TEST_EQUAL(p.num_connect_candidates(), 3);
+
+	// the later entry in the batch wins, just like with add_peer()
+	TEST_EQUAL(existing->port, 8081);
+	auto const peer2 = p.find_peers(addr("10.0.0.2"));
+	TEST_EQUAL(peer2.size(), 1);
+	TEST_EQUAL(peer2.front()->port, 8082);
+	TEST_CHECK(peer2.front()->supports_utp);
+	TEST_CHECK(peer2.front()->supports_holepunch);
+	TEST_CHECK(peer2.front()->peer_source() & peer_info::pex);
+	auto const peer4 = p.find_peers(addr("10.0.0.4"));
+	TEST_EQUAL(peer4.size(), 1);
+	TEST_CHECK(peer4.front()->maybe_upload_only);
+	TEST_CHECK(!p.find_peers(addr("10.0.0.1")).front()->maybe_upload_only);
+}
+
+TORRENT_TEST(add_peers_size_limit)
+{
+	torrent_state st = init_state();
+	st.max_peerlist_size = 5;
+	peer_list p(allocator);
+
+	std::vector<tcp::endpoint> peers;
+	for (int i = 0; i < 8; ++i)
+		peers.push_back(ep(("10.0.0." + std::to_string(i + 1)).c_str(), 8080));
+
+	std::vector<add_peer_result> result;
+	p.add_peers(peers, {}, {}, {}, &st, result);
+	TEST_EQUAL(int(result.size()), 8);
+	TEST_EQUAL(p.num_peers(), 5);
+
+	// none of the peers are erase candidates, so the ones that don't fit are
+	// rejected
+	for (int i = 0; i < 8; ++i)
+	{
+		TEST_CHECK(result[std::size_t(i)] == (i < 5
+			? add_peer_result::added : add_peer_result::rejected));
+		TEST_EQUAL(has_peer(p, peers[std::size_t(i)]), i < 5);
+	}
+	TEST_CHECK(st.erased.empty());
+}
+
 TORRENT_TEST(peer_info_comparison)
 {
 	peer_address_compare cmp;
@@ -1216,6 +1295,175 @@ TORRENT_TEST(clear_peers)
 	TEST_EQUAL(p.num_seeds(), 0);
 }
 
+// this is primarily a benchmark of adding, finding and erasing peers in a very
+// large peer list
+namespace {
+
+void test_large_peer_list(int const num_peers, bool const print_timing)
+{
+	torrent_state st = init_state();
+	st.max_peerlist_size = 0;
+	peer_list p(allocator);
+
+	auto report = [print_timing](char const* what, int const n, time_point const start)
+	{
+		if (!print_timing) return;
+		std::printf("%s %d peers: %" PRId64 " ms\n", what, n
+			, total_milliseconds(clock_type::now() - start));
+	};
+
+	// every other peer is IPv6
+	std::vector<tcp::endpoint> eps;
+	eps.reserve(std::size_t(num_peers));
+	for (int i = 0; i < num_peers; ++i)
+	{
+		if (i & 1)
+		{
+			address_v6::bytes_type b{{0x20, 0x01, 0x0d, 0xb8}};
+			auto* ptr = b.data() + 12;
+			aux::write_uint32(i, ptr);
+			eps.emplace_back(address_v6(b), std::uint16_t(6881));
+		}
+		else
+		{
+			eps.emplace_back(address_v4(0x0b000000u + std::uint32_t(i)), std::uint16_t(6881));
+		}
+	}
+
+	time_point start = clock_type::now();
+	for (auto const& e : eps)
+		TEST_CHECK(p.add_peer(e, {}, {}, &st) != nullptr);
+	report("add", num_peers, start);
+	TEST_EQUAL(p.num_peers(), num_peers);
+	TEST_EQUAL(p.num_connect_candidates(), num_peers);
+
+	// the same peers added to another list, in batches the size of a tracker
+	// response
+	{
+		peer_list batched(allocator);
+		std::vector<add_peer_result> result;
+		int const batch_size = 200;
+		start = clock_type::now();
+		for (int i = 0; i < num_peers; i += batch_size)
+		{
+			span<tcp::endpoint const> const batch = span<tcp::endpoint const>(eps)
+				.subspan(i, std::min(batch_size, num_peers - i));
+			batched.add_peers(batch, {}, {}, {}, &st, result);
+		}
+		report("add (in batches of 200)", num_peers, start);
+		TEST_EQUAL(batched.num_peers(), num_peers);
+		TEST_EQUAL(batched.num_connect_candidates(), num_peers);
+	}
+
+	// adding them again should find the existing entries
+	start = clock_type::now();
+	for (auto const& e : eps)
+	{
+		TEST_CHECK(p.add_peer(e, {}, {}, &st) != nullptr);
+		TEST_CHECK(!st.first_time_seen);
+	}
+	report("update", num_peers, start);
+	TEST_EQUAL(p.num_peers(), num_peers);
+
+	// erase every eighth peer, which moves peers around in the list
+	start = clock_type::now();
+	for (int i = 0; i < num_peers; i += 8)
+	{
+		auto const peers = p.find_peers(eps[std::size_t(i)].address());
+		TEST_EQUAL(peers.size(), 1);
+		p.erase_peer(peers.front(), &st);
+	}
+	report("erase", num_peers / 8, start);
+	TEST_EQUAL(int(st.erased.size()), num_peers / 8);
+	st.erased.clear();
+	TEST_EQUAL(p.num_peers(), num_peers - num_peers / 8);
+	TEST_EQUAL(p.num_connect_candidates(), num_peers - num_peers / 8);
+
+	for (int i = 0; i < num_peers; ++i)
+		TEST_EQUAL(has_peer(p, eps[std::size_t(i)]), (i % 8) != 0);
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(large_peer_list)
+{
+#ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
+	test_large_peer_list(2000, false);
+#else
+	test_large_peer_list(100000, false);
+#endif
+}
+
+TORRENT_BENCHMARK(benchmark_large_peer_list)
+{
+	test_large_peer_list(1000000, true);
+}
+
+// erasing peers must not make the round-robin scan for connect candidates
+// skip or revisit any peer in its current lap
+TORRENT_TEST(erase_peer_round_robin)
+{
+	torrent_state st = init_state();
+	st.max_peerlist_size = 0;
+	peer_list p(allocator);
+
+	std::vector<tcp::endpoint> eps;
+	for (int i = 0; i < 1000; ++i)
+	{
+		eps.emplace_back(address_v4(0x0b000000u + std::uint32_t(i)), std::uint16_t(6881));
+		TEST_CHECK(p.add_peer(eps.back(), {}, {}, &st) != nullptr);
+	}
+
+	// a search for connect candidates visits 300 peers
+	TEST_CHECK(p.connect_one_peer(0, &st) != nullptr);
+	TEST_EQUAL(p.round_robin(), 300);
+
+	std::set<torrent_peer const*> visited(p.begin(), p.begin() + p.round_robin());
+	std::set<torrent_peer const*> unvisited(p.begin() + p.round_robin(), p.end());
+
+	auto check_cursor = [&]
+	{
+		std::set<torrent_peer const*> const before(p.begin(), p.begin() + p.round_robin());
+		std::set<torrent_peer const*> const after(p.begin() + p.round_robin(), p.end());
+		TEST_CHECK(before == visited);
+		TEST_CHECK(after == unvisited);
+	};
+
+	auto erase_at = [&](int const pos)
+	{
+		torrent_peer* const pe = *(p.begin() + pos);
+		visited.erase(pe);
+		unvisited.erase(pe);
+		p.erase_peer(pe, &st);
+		check_cursor();
+	};
+
+	// right before the cursor, at the cursor, the first and the last peer
+	erase_at(p.round_robin() - 1);
+	erase_at(p.round_robin());
+	erase_at(0);
+	erase_at(p.num_peers() - 1);
+
+	std::mt19937 rng(0x1234);
+	while (p.num_peers() > 700)
+		erase_at(int(rng() % std::uint32_t(p.num_peers())));
+
+	TEST_EQUAL(int(st.erased.size()), 300);
+	TEST_EQUAL(int(visited.size() + unvisited.size()), 700);
+
+	// the index still finds every remaining peer, and none of the erased ones
+	int found = 0;
+	for (auto const& ep : eps)
+	{
+		auto const peers = p.find_peers(ep.address());
+		TEST_CHECK(peers.size() <= 1);
+		if (peers.empty()) continue;
+		TEST_CHECK(visited.count(peers.front()) + unvisited.count(peers.front()) == 1);
+		++found;
+	}
+	TEST_EQUAL(found, 700);
+}
+
 // TODO: test erasing peers
 // TODO: test update_peer_port with allow_multiple_connections_per_ip and without
 // TODO: test add i2p peers
@@ -0,0 +1,154 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "test.hpp"
+
+#include "libtorrent/aux_/pex_encoder.hpp"
+#include "libtorrent/aux_/socket_io.hpp"
+#include "libtorrent/bdecode.hpp"
+#include "libtorrent/time.hpp"
+
+#include <cstdio>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+aux::pex_peer peer(int const i, pex_flags_t const flags = {})
+{
+	return {tcp::endpoint(make_address_v4(std::uint32_t(0x0a000000 + i))
+		, std::uint16_t(6881)), flags};
+}
+
+aux::pex_peer peer6(int const i)
+{
+	address_v6::bytes_type b{};
+	b[0] = 0x20;
+	b[1] = 0x01;
+	b[15] = std::uint8_t(i);
+	return {tcp::endpoint(address_v6(b), std::uint16_t(6881)), pex_flags_t{}};
+}
+
+std::vector<tcp::endpoint> endpoints(bdecode_node const& msg, char const* key, int const len)
+{
+	std::vector<tcp::endpoint> ret;
+	bdecode_node const n = msg.dict_find_string(key);
+	TEST_CHECK(n);
+	if (!n) return ret;
+	char const* in = n.string_ptr();
+	for (int i = 0; i < n.string_length() / len; ++i)
+	{
+		ret.push_back(len == 6
+			? aux::read_v4_endpoint<tcp::endpoint>(in)
+			: aux::read_v6_endpoint<tcp::endpoint>(in));
+	}
+	return ret;
+}
+
+bdecode_node decode(aux::pex_encoder::message const& m)
+{
+	TEST_CHECK(m);
+	bdecode_node ret = bdecode(*m);
+	TEST_CHECK(ret.type() == bdecode_node::dict_t);
+	return ret;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(pex_encoder_added_dropped)
+{
+	aux::pex_encoder enc;
+
+	std::vector<aux::pex_peer> peers{peer(1, pex_seed), peer(2), peer6(3)};
+	enc.update(peers, 100);
+	TEST_EQUAL(enc.num_added(), 3);
+	TEST_EQUAL(enc.num_dropped(), 0);
+
+	bdecode_node m = decode(enc.msg());
+	TEST_CHECK((endpoints(m, "added", 6) == std::vector<tcp::endpoint>{peers[0].ep, peers[1].ep}));
+	TEST_CHECK((endpoints(m, "added6", 18) == std::vector<tcp::endpoint>{peers[2].ep}));
+	TEST_EQUAL(m.dict_find_string_value("added.f"), string_view("\x02\x00", 2));
+	TEST_EQUAL(m.dict_find_string_value("added6.f").size(), 1);
+	TEST_CHECK(endpoints(m, "dropped", 6).empty());
+	TEST_CHECK(endpoints(m, "dropped6", 18).empty());
+
+	// peer 2 and 3 disconnect, peer 4 connects
+	peers = {peer(4), peer(1, pex_seed)};
+	enc.update(peers, 100);
+	TEST_EQUAL(enc.num_added(), 1);
+	TEST_EQUAL(enc.num_dropped(), 2);
+
+	m = decode(enc.msg());
+	TEST_CHECK((endpoints(m, "added", 6) == std::vector<tcp::endpoint>{peer(4).ep}));
+	TEST_CHECK((endpoints(m, "dropped", 6) == std::vector<tcp::endpoint>{peer(2).ep}));
+	TEST_CHECK((endpoints(m, "dropped6", 18) == std::vector<tcp::endpoint>{peer6(3).ep}));
+
+	// no change
+	enc.update(peers, 100);
+	TEST_EQUAL(enc.num_added(), 0);
+	TEST_EQUAL(enc.num_dropped(), 0);
+}
+
+TORRENT_TEST(pex_encoder_max_added)
+{
+	aux::pex_encoder enc;
+
+	std::vector<aux::pex_peer> peers;
+	for (int i = 0; i < 5; ++i) peers.push_back(peer(i));
+
+	enc.update(peers, 3);
+	TEST_EQUAL(enc.num_added(), 3);
+	TEST_CHECK((endpoints(decode(enc.msg()), "added", 6)
+		== std::vector<tcp::endpoint>{peers[0].ep, peers[1].ep, peers[2].ep}));
+
+	// the peers that didn't fit are added next time, and the ones left out
+	// are not reported as dropped
+	enc.update(peers, 3);
+	TEST_EQUAL(enc.num_added(), 2);
+	TEST_EQUAL(enc.num_dropped(), 0);
+	TEST_CHECK((endpoints(decode(enc.msg()), "added", 6)
+		== std::vector<tcp::endpoint>{peers[3].ep, peers[4].ep}));
+}
+
+TORRENT_TEST(pex_encoder_full_message)
+{
+	std::vector<aux::pex_peer> peers{peer(1), peer(2), peer(3)};
+	auto const msg = aux::pex_encoder::full_message(peers, 2);
+	bdecode_node const m = decode(msg);
+	TEST_CHECK((endpoints(m, "added", 6) == std::vector<tcp::endpoint>{peers[0].ep, peers[1].ep}));
+	TEST_CHECK(endpoints(m, "dropped", 6).empty());
+}
+
+TORRENT_BENCHMARK(benchmark_pex_encoder)
+{
+	// a torrent with 5000 connections, where 10% of them are replaced every
+	// minute
+	int const num_peers = 5000;
+	int const iterations = 500;
+
+	std::vector<aux::pex_peer> peers;
+	for (int i = 0; i < num_peers; ++i) peers.push_back(peer(i));
+
+	aux::pex_encoder enc;
+	std::int64_t total_size = 0;
+	auto const start = clock_type::now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		for (int k = 0; k < num_peers / 10; ++k)
+			peers[std::size_t((i * 499 + k * 7) % num_peers)] = peer(num_peers + i * num_peers + k);
+		enc.update(peers, 100);
+		total_size += std::int64_t(enc.msg()->size());
+	}
+	auto const elapsed = clock_type::now() - start;
+	TEST_CHECK(total_size > 0);
+
+	std::printf("pex_encoder::update() with %d peers: %d us per message\n"
+		, num_peers, int(total_microseconds(elapsed) / iterations));
+}
@@ -22,6 +22,8 @@ see LICENSE file.
 #include <functional>
 #include <algorithm>
 #include <vector>
+#include <array>
+#include <string>
 #include <set>
 #include <map>
 #include <iostream>
@@ -1683,6 +1685,69 @@ TORRENT_TEST(bitfield_optimization)
 	TEST_CHECK(verify_availability(p, "1132123201220322"));
 }
 
+TORRENT_TEST(inc_refcount_batch)
+{
+	auto p = setup_picker("2122222211221222", "                ", "", "");
+	// make sure it's not dirty
+	pick_pieces(p, "****************", 1, blocks_per_piece, nullptr);
+
+	// a small batch is applied incrementally
+	std::array<piece_index_t, 3> const few{{1_piece, 9_piece, 12_piece}};
+	p->inc_refcount(few, &tmp0);
+	print_availability(p);
+	TEST_CHECK(verify_availability(p, "2222222212222222"));
+	auto picked = pick_pieces(p, "****************", 1, 0, nullptr, options, empty_vector);
+	TEST_CHECK(picked.size() >= 1 && picked[0].piece_index == 8_piece);
+
+	// a large batch just updates the counters and rebuilds the piece list
+	std::vector<piece_index_t> many;
+	for (int i = 0; i < 16; ++i)
+		if (i != 8) many.push_back(piece_index_t(i));
+	p->inc_refcount(many, &tmp1);
+	print_availability(p);
+	TEST_CHECK(verify_availability(p, "3333333313333333"));
+	picked = pick_pieces(p, "****************", 1, 0, nullptr, options, empty_vector);
+	TEST_CHECK(picked.size() >= 1 && picked[0].piece_index == 8_piece);
+}
+
+TORRENT_TEST(inc_refcount_compressed)
+{
+	// with 64 pieces, a peer with two pieces, or all but two, is stored as a
+	// list of pieces rather than as a bitfield
+	std::string const all(64, '*');
+	auto p = setup_picker(std::string(64, '0').c_str(), std::string(64, ' ').c_str(), "", "");
+	pick_pieces(p, all.c_str(), 1, blocks_per_piece, nullptr);
+
+	compressed_bitfield few(64, false);
+	few.set_bit(3_piece);
+	few.set_bit(40_piece);
+	TEST_CHECK(few.storage_type() == compressed_bitfield::storage::sparse);
+	p->inc_refcount(few, &tmp0);
+
+	compressed_bitfield most(64, true);
+	most.clear_bit(3_piece);
+	most.clear_bit(41_piece);
+	TEST_CHECK(most.storage_type() == compressed_bitfield::storage::inverted);
+	p->inc_refcount(most, &tmp1);
+
+	std::string expected(64, '1');
+	expected[40] = '2';
+	expected[41] = '0';
+	print_availability(p);
+	TEST_CHECK(verify_availability(p, expected.c_str()));
+
+	// the peer with few pieces can only be picked from for those pieces
+	std::vector<piece_block> picked;
+	p->pick_pieces(few, picked, 8, 0, nullptr, options, empty_vector, 20, pc);
+	TEST_CHECK(!picked.empty());
+	for (auto const& b : picked)
+		TEST_CHECK(b.piece_index == 3_piece || b.piece_index == 40_piece);
+
+	p->dec_refcount(few, &tmp0);
+	p->dec_refcount(most, &tmp1);
+	TEST_CHECK(verify_availability(p, std::string(64, '0').c_str()));
+}
+
 TORRENT_TEST(seed_optimization)
 {
 	// test seed optimization
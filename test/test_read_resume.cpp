@@ -237,6 +237,7 @@ void test_roundtrip(add_torrent_params input)
 		b.resize(b.num_bytes() * 8);
 
 	auto b = write_resume_data_buf(input);
+	TEST_CHECK(b == bencode(write_resume_data(input)));
 	error_code ec;
 	auto const output = read_resume_data(b, ec);
 
@@ -339,6 +340,112 @@ TORRENT_TEST(round_trip_trackers)
 	test_roundtrip(atp);
 }
 
+TORRENT_TEST(round_trip_tracker_tiers)
+{
+	add_torrent_params atp;
+	atp.trackers = {"http://a.com/announce", "http://b.com/announce"
+		, "http://c.com/announce", "http://d.com/announce"};
+	atp.tracker_tiers = {0, 0, 1, 2};
+	test_roundtrip(atp);
+}
+
+TORRENT_TEST(tracker_tiers_gaps)
+{
+	add_torrent_params atp;
+	atp.trackers = {"http://a.com/announce", "http://b.com/announce"};
+	atp.tracker_tiers = {2, 0};
+
+	auto const b = write_resume_data_buf(atp);
+	TEST_CHECK(b == bencode(write_resume_data(atp)));
+
+	// tiers without any trackers are dropped when reading it back
+	error_code ec;
+	auto const output = read_resume_data(b, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK((output.trackers == std::vector<std::string>{
+		"http://b.com/announce", "http://a.com/announce"}));
+	TEST_CHECK((output.tracker_tiers == std::vector<int>{0, 1}));
+}
+
+TORRENT_TEST(round_trip_peers)
+{
+	add_torrent_params atp;
+	atp.peers = {
+		tcp::endpoint(make_address("10.0.0.1"), 6881)
+		, tcp::endpoint(make_address("2001::1"), 6882)
+		, tcp::endpoint(make_address("10.0.0.2"), 6883)};
+	atp.banned_peers = {tcp::endpoint(make_address("2001::2"), 6884)};
+	test_roundtrip(atp);
+
+	error_code ec;
+	auto const output = read_resume_data(write_resume_data_buf(atp), ec);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(output.peers.size(), 3);
+	TEST_EQUAL(output.banned_peers.size(), 1);
+}
+
+TORRENT_TEST(round_trip_renamed_files)
+{
+	add_torrent_params atp;
+	atp.renamed_files[1_file] = "foo";
+	atp.renamed_files[4_file] = "bar";
+	test_roundtrip(atp);
+}
+
+namespace {
+
+add_torrent_params large_resume_data()
+{
+	add_torrent_params atp = generate_torrent();
+	for (int i = 0; i < 50; ++i)
+	{
+		atp.peers.emplace_back(make_address_v4(std::uint32_t(0x0a000000 + i)), std::uint16_t(6881 + i));
+		atp.unfinished_pieces[piece_index_t(i)] = bits();
+	}
+	atp.trackers = {"http://a.com/announce", "http://b.com/announce"};
+	atp.url_seeds = {"http://c.com/"};
+	atp.have_pieces = bits<piece_index_t>();
+	atp.file_priorities = vec<download_priority_t>();
+	return atp;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(write_resume_data_buf_matches_entry)
+{
+	add_torrent_params const atp = large_resume_data();
+	std::vector<char> buf;
+	write_resume_data_buf(atp, buf);
+	TEST_CHECK(buf == bencode(write_resume_data(atp)));
+}
+
+TORRENT_BENCHMARK(benchmark_write_resume_data_buf)
+{
+	add_torrent_params const atp = large_resume_data();
+	int const iterations = 2000;
+
+	auto start = clock_type::now();
+	std::size_t size = 0;
+	for (int i = 0; i < iterations; ++i)
+		size += bencode(write_resume_data(atp)).size();
+	auto const entry_time = clock_type::now() - start;
+
+	start = clock_type::now();
+	std::vector<char> buf;
+	std::size_t size2 = 0;
+	for (int i = 0; i < iterations; ++i)
+	{
+		buf.clear();
+		write_resume_data_buf(atp, buf);
+		size2 += buf.size();
+	}
+	auto const stream_time = clock_type::now() - start;
+
+	std::printf("write_resume_data() + bencode(): %d us, write_resume_data_buf(): %d us (%d iterations)\n"
+		, int(total_microseconds(entry_time)), int(total_microseconds(stream_time)), iterations);
+	TEST_EQUAL(size, size2);
+}
+
 TORRENT_TEST(round_trip_name)
 {
 	add_torrent_params atp;
@@ -368,6 +475,7 @@ TORRENT_TEST(round_trip_flags)
 		torrent_flags::disable_dht,
 		torrent_flags::disable_lsd,
 		torrent_flags::disable_pex,
+		torrent_flags::dormant,
 #if TORRENT_USE_I2P
 		torrent_flags::i2p_torrent,
 #endif
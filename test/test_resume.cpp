@@ -1649,6 +1649,99 @@ TORRENT_TEST(paused)
 	// and trackers for instance
 }
 
+TORRENT_TEST(dormant)
+{
+	lt::session ses(settings());
+	torrent_handle h = test_resume_flags(ses
+		, torrent_flags::paused | torrent_flags::dormant);
+
+	// the resume data says we have all pieces. The torrent isn't loaded, but
+	// it should still report that
+	torrent_status const s = h.status(torrent_handle::query_pieces);
+	TEST_CHECK(s.flags & torrent_flags::dormant);
+	TEST_EQUAL(s.state, torrent_status::seeding);
+	TEST_CHECK(s.pieces.size() > 0);
+	TEST_CHECK(s.pieces.all_set());
+	TEST_EQUAL(s.num_pieces, s.pieces.size());
+	TEST_EQUAL(s.connections_limit, 1345);
+
+	h.save_resume_data();
+
+	save_resume_data_alert const* a = alert_cast<save_resume_data_alert>(
+		wait_for_alert(ses, save_resume_data_alert::alert_type, "dormant"));
+
+	TEST_CHECK(a);
+	if (a == nullptr) return;
+
+	TEST_CHECK(a->params.flags & torrent_flags::dormant);
+	TEST_EQUAL(a->params.have_pieces.size(), s.pieces.size());
+	TEST_CHECK(a->params.have_pieces.all_set());
+}
+
+TORRENT_TEST(dormant_resume)
+{
+	lt::session ses(settings());
+	torrent_handle h = test_resume_flags(ses
+		, torrent_flags::paused | torrent_flags::dormant);
+
+	h.resume();
+	torrent_status const s = h.status();
+	TEST_CHECK(!(s.flags & torrent_flags::dormant));
+	TEST_CHECK(!(s.flags & torrent_flags::paused));
+}
+
+// a dormant torrent has not created its storage yet. Moving it must still
+// move the files
+TORRENT_TEST(dormant_move_storage)
+{
+	lt::session ses(settings());
+	torrent_handle h = test_resume_flags(ses
+		, torrent_flags::seed_mode | torrent_flags::paused | torrent_flags::dormant);
+	TEST_CHECK(h.flags() & torrent_flags::dormant);
+	TEST_CHECK(exists(combine_path("test_resume", "tmp1")));
+
+	error_code ec;
+	create_directory("dormant_moved", ec);
+	h.move_storage("dormant_moved");
+
+	alert const* a = wait_for_alert(ses, storage_moved_alert::alert_type
+		, "dormant_move_storage");
+	TEST_CHECK(a);
+
+	TEST_CHECK(exists(combine_path("dormant_moved", combine_path("test_resume", "tmp1"))));
+	TEST_CHECK(!exists(combine_path("test_resume", "tmp1")));
+	TEST_CHECK(!(h.flags() & torrent_flags::dormant));
+}
+
+// removing a dormant torrent with delete_files must delete its files, even
+// though it has not created its storage yet
+TORRENT_TEST(dormant_remove_delete_files)
+{
+	lt::session ses(settings());
+	torrent_handle h = test_resume_flags(ses
+		, torrent_flags::seed_mode | torrent_flags::paused | torrent_flags::dormant);
+	TEST_CHECK(h.flags() & torrent_flags::dormant);
+	TEST_CHECK(exists(combine_path("test_resume", "tmp1")));
+
+	ses.remove_torrent(h, session::delete_files);
+
+	alert const* a = wait_for_alert(ses, torrent_deleted_alert::alert_type
+		, "dormant_remove_delete_files");
+	TEST_CHECK(a);
+
+	TEST_CHECK(!exists(combine_path("test_resume", "tmp1")));
+	TEST_CHECK(!exists(combine_path("test_resume", "tmp2")));
+	TEST_CHECK(!exists(combine_path("test_resume", "tmp3")));
+}
+
+TORRENT_TEST(dormant_not_paused)
+{
+	// the dormant flag only applies to torrents added in paused state
+	lt::session ses(settings());
+	torrent_handle h = test_resume_flags(ses, torrent_flags::dormant);
+	TEST_CHECK(!(h.flags() & torrent_flags::dormant));
+}
+
 TORRENT_TEST(no_metadata)
 {
 	lt::session ses(settings());
@@ -0,0 +1,434 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "test.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "libtorrent/resume_journal.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/aux_/path.hpp"
+
+using namespace lt;
+
+namespace {
+
+add_torrent_params make_params(int const i)
+{
+	add_torrent_params atp;
+	std::string const ih = "torrent-" + std::to_string(i);
+	atp.info_hashes.v1 = hasher(ih.data(), int(ih.size())).final();
+	atp.name = ih;
+	atp.save_path = "save_path";
+	atp.trackers = {"http://tracker.com/announce"};
+	atp.tracker_tiers = {0};
+	atp.have_pieces.resize(64, false);
+	atp.flags = torrent_flags::auto_managed;
+	return atp;
+}
+
+void check_params(add_torrent_params const& lhs, add_torrent_params const& rhs)
+{
+	TEST_EQUAL(lhs.info_hashes, rhs.info_hashes);
+	TEST_EQUAL(lhs.name, rhs.name);
+	TEST_EQUAL(lhs.save_path, rhs.save_path);
+	TEST_CHECK(lhs.trackers == rhs.trackers);
+	TEST_CHECK(lhs.have_pieces == rhs.have_pieces);
+	TEST_CHECK(lhs.verified_pieces == rhs.verified_pieces);
+	TEST_EQUAL(lhs.unfinished_pieces.size(), rhs.unfinished_pieces.size());
+	TEST_EQUAL(lhs.total_uploaded, rhs.total_uploaded);
+	TEST_EQUAL(lhs.total_downloaded, rhs.total_downloaded);
+	TEST_EQUAL(lhs.active_time, rhs.active_time);
+	TEST_EQUAL(lhs.num_complete, rhs.num_complete);
+	TEST_CHECK((lhs.flags & torrent_flags::paused) == (rhs.flags & torrent_flags::paused));
+	TEST_CHECK((lhs.flags & torrent_flags::auto_managed) == (rhs.flags & torrent_flags::auto_managed));
+}
+
+std::vector<add_torrent_params> reopen(std::string const& path)
+{
+	resume_journal j(path);
+	error_code ec;
+	auto ret = j.open(ec);
+	TEST_CHECK(!ec);
+	return ret;
+}
+
+std::vector<char> read_file(std::string const& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+void write_file(std::string const& path, char const* buf, std::size_t const size)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(buf, std::streamsize(size));
+}
+
+std::string fresh_journal(char const* name)
+{
+	error_code ec;
+	lt::remove(name, ec);
+	return name;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(journal_empty)
+{
+	std::string const path = fresh_journal("empty.journal");
+	TEST_CHECK(reopen(path).empty());
+	error_code ec;
+	TEST_CHECK(lt::exists(path, ec));
+	TEST_CHECK(reopen(path).empty());
+}
+
+TORRENT_TEST(journal_round_trip)
+{
+	std::string const path = fresh_journal("round_trip.journal");
+
+	add_torrent_params a = make_params(1);
+	add_torrent_params b = make_params(2);
+	{
+		resume_journal j(path);
+		error_code ec;
+		TEST_CHECK(j.open(ec).empty());
+		TEST_CHECK(!ec);
+
+		j.append(a, ec);
+		TEST_CHECK(!ec);
+		std::int64_t const full_size = j.size();
+
+		a.have_pieces.set_bit(3_piece);
+		a.have_pieces.set_bit(40_piece);
+		a.verified_pieces.resize(64, false);
+		a.verified_pieces.set_bit(3_piece);
+		a.unfinished_pieces[5_piece].resize(16, false);
+		a.unfinished_pieces[5_piece].set_bit(2);
+		a.total_uploaded = 1337;
+		a.total_downloaded = 1338;
+		a.active_time = 1339;
+		a.num_complete = 10;
+		a.flags |= torrent_flags::paused;
+		j.append(a, ec);
+		TEST_CHECK(!ec);
+
+		// only the progress changed, so the second record is a delta, and a
+		// lot smaller than the first
+		TEST_CHECK(j.size() - full_size < full_size / 2);
+
+		j.append(b, ec);
+		TEST_CHECK(!ec);
+		j.flush(ec);
+		TEST_CHECK(!ec);
+	}
+
+	auto const ret = reopen(path);
+	TEST_EQUAL(ret.size(), 2);
+	if (ret.size() != 2) return;
+	bool const a_first = ret[0].info_hashes == a.info_hashes;
+	check_params(ret[a_first ? 0 : 1], a);
+	check_params(ret[a_first ? 1 : 0], b);
+	TEST_EQUAL(ret[a_first ? 0 : 1].unfinished_pieces.count(5_piece), 1);
+}
+
+TORRENT_TEST(journal_lost_piece)
+{
+	std::string const path = fresh_journal("lost_piece.journal");
+
+	add_torrent_params a = make_params(1);
+	{
+		resume_journal j(path);
+		error_code ec;
+		j.open(ec);
+		a.have_pieces.set_bit(1_piece);
+		a.have_pieces.set_bit(2_piece);
+		j.append(a, ec);
+		// a piece failed its hash check and is no longer had
+		a.have_pieces.clear_bit(1_piece);
+		a.have_pieces.set_bit(63_piece);
+		j.append(a, ec);
+		TEST_CHECK(!ec);
+	}
+
+	auto const ret = reopen(path);
+	TEST_EQUAL(ret.size(), 1);
+	if (ret.size() != 1) return;
+	check_params(ret[0], a);
+}
+
+TORRENT_TEST(journal_full_record_on_change)
+{
+	std::string const path = fresh_journal("full_record.journal");
+
+	add_torrent_params a = make_params(1);
+	{
+		resume_journal j(path);
+		error_code ec;
+		j.open(ec);
+		j.append(a, ec);
+		a.trackers.push_back("http://tracker2.com/announce");
+		a.tracker_tiers.push_back(1);
+		a.save_path = "new_save_path";
+		j.append(a, ec);
+		TEST_CHECK(!ec);
+	}
+
+	auto const ret = reopen(path);
+	TEST_EQUAL(ret.size(), 1);
+	if (ret.size() != 1) return;
+	check_params(ret[0], a);
+}
+
+TORRENT_TEST(journal_delta_after_reopen)
+{
+	std::string const path = fresh_journal("delta_reopen.journal");
+
+	add_torrent_params a = make_params(1);
+	std::int64_t full_size = 0;
+	{
+		resume_journal j(path);
+		error_code ec;
+		j.open(ec);
+		std::int64_t const size = j.size();
+		j.append(a, ec);
+		TEST_CHECK(!ec);
+		full_size = j.size() - size;
+	}
+
+	// the torrents replayed when opening the journal are known to it. Saving
+	// one of them again only needs a delta record
+	resume_journal j(path);
+	error_code ec;
+	TEST_EQUAL(j.open(ec).size(), 1);
+	TEST_CHECK(!ec);
+	std::int64_t const size = j.size();
+	a.have_pieces.set_bit(9_piece);
+	j.append(a, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(j.size() - size < full_size / 2);
+	j.flush(ec);
+	TEST_CHECK(!ec);
+
+	auto const ret = reopen(path);
+	TEST_EQUAL(ret.size(), 1);
+	if (ret.size() != 1) return;
+	check_params(ret[0], a);
+}
+
+TORRENT_TEST(journal_remove)
+{
+	std::string const path = fresh_journal("remove.journal");
+
+	add_torrent_params const a = make_params(1);
+	add_torrent_params const b = make_params(2);
+	{
+		resume_journal j(path);
+		error_code ec;
+		j.open(ec);
+		j.append(a, ec);
+		j.append(b, ec);
+		j.remove(a.info_hashes, ec);
+		TEST_CHECK(!ec);
+	}
+
+	auto const ret = reopen(path);
+	TEST_EQUAL(ret.size(), 1);
+	if (ret.size() != 1) return;
+	check_params(ret[0], b);
+}
+
+TORRENT_TEST(journal_truncated)
+{
+	std::string const path = fresh_journal("truncated.journal");
+
+	add_torrent_params a = make_params(1);
+	add_torrent_params prev;
+	std::int64_t prev_size = 0;
+	{
+		resume_journal j(path);
+		error_code ec;
+		j.open(ec);
+		j.append(a, ec);
+		a.have_pieces.set_bit(7_piece);
+		a.total_uploaded = 100;
+		j.append(a, ec);
+		prev = a;
+		prev_size = j.size();
+
+		a.have_pieces.set_bit(8_piece);
+		a.total_uploaded = 200;
+		j.append(a, ec);
+		TEST_CHECK(!ec);
+	}
+
+	std::vector<char> const journal = read_file(path);
+	TEST_CHECK(std::int64_t(journal.size()) > prev_size);
+
+	// simulate a crash at every point while writing the last record. The
+	// journal must come back with the state from the record before it
+	std::string const cut_path = "truncated-cut.journal";
+	for (std::size_t cut = std::size_t(prev_size); cut < journal.size(); ++cut)
+	{
+		write_file(cut_path, journal.data(), cut);
+		auto const ret = reopen(cut_path);
+		TEST_EQUAL(ret.size(), 1);
+		if (ret.size() != 1) return;
+		check_params(ret[0], prev);
+	}
+
+	// the partial record was removed when the journal was opened, records
+	// appended after that must not be lost
+	{
+		write_file(cut_path, journal.data(), journal.size() - 1);
+		resume_journal j(cut_path);
+		error_code ec;
+		j.open(ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(j.size() <= prev_size);
+		j.append(a, ec);
+		TEST_CHECK(!ec);
+	}
+	auto const ret = reopen(cut_path);
+	TEST_EQUAL(ret.size(), 1);
+	if (ret.size() != 1) return;
+	check_params(ret[0], a);
+
+	// a corrupt byte in the last record has the same effect as truncating it
+	std::vector<char> corrupt = journal;
+	corrupt.back() ^= 0x55;
+	write_file(cut_path, corrupt.data(), corrupt.size());
+	auto const ret2 = reopen(cut_path);
+	TEST_EQUAL(ret2.size(), 1);
+	if (ret2.size() != 1) return;
+	check_params(ret2[0], prev);
+}
+
+TORRENT_TEST(journal_compact)
+{
+	std::string const path = fresh_journal("compact.journal");
+
+	std::vector<add_torrent_params> atps;
+	for (int i = 0; i < 10; ++i) atps.push_back(make_params(i));
+
+	resume_journal j(path);
+	error_code ec;
+	j.open(ec);
+	for (int round = 0; round < 20; ++round)
+	{
+		for (auto& atp : atps)
+		{
+			atp.name = "name-" + std::to_string(round);
+			atp.have_pieces.set_bit(piece_index_t(round));
+			atp.total_downloaded += 16 * 1024;
+			j.append(atp, ec);
+			TEST_CHECK(!ec);
+		}
+	}
+	std::int64_t const before = j.size();
+	j.compact(ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(j.size() < before / 10);
+	TEST_EQUAL(std::int64_t(read_file(path).size()), j.size());
+	TEST_CHECK(!lt::exists(path + ".tmp", ec));
+
+	// records appended after compacting are kept
+	atps[0].total_uploaded = 1;
+	j.append(atps[0], ec);
+	TEST_CHECK(!ec);
+	j.flush(ec);
+	TEST_CHECK(!ec);
+
+	auto const ret = reopen(path);
+	TEST_EQUAL(ret.size(), atps.size());
+	for (auto const& atp : atps)
+	{
+		auto const it = std::find_if(ret.begin(), ret.end()
+			, [&](add_torrent_params const& p) { return p.info_hashes == atp.info_hashes; });
+		TEST_CHECK(it != ret.end());
+		if (it == ret.end()) continue;
+		check_params(*it, atp);
+	}
+}
+
+TORRENT_TEST(journal_background_compaction)
+{
+	std::string const path = fresh_journal("background.journal");
+
+	std::vector<add_torrent_params> atps;
+	for (int i = 0; i < 4; ++i)
+	{
+		atps.push_back(make_params(i));
+		atps.back().comment.assign(4000, 'a');
+	}
+
+	std::int64_t written = 0;
+	{
+		resume_journal j(path);
+		error_code ec;
+		j.open(ec);
+		// every record is a full one, this grows the journal past the
+		// threshold for compacting it a few times over
+		std::int64_t record_size = 0;
+		for (int round = 0; round < 300; ++round)
+		{
+			for (auto& atp : atps)
+			{
+				atp.name = "name-" + std::to_string(round);
+				if (record_size == 0)
+				{
+					std::int64_t const size = j.size();
+					j.append(atp, ec);
+					record_size = j.size() - size;
+				}
+				else
+				{
+					j.append(atp, ec);
+				}
+				TEST_CHECK(!ec);
+				written += record_size;
+			}
+		}
+		j.flush(ec);
+		TEST_CHECK(!ec);
+	}
+	TEST_CHECK(std::int64_t(read_file(path).size()) < written);
+
+	auto const ret = reopen(path);
+	TEST_EQUAL(ret.size(), atps.size());
+	for (auto const& atp : atps)
+	{
+		auto const it = std::find_if(ret.begin(), ret.end()
+			, [&](add_torrent_params const& p) { return p.info_hashes == atp.info_hashes; });
+		TEST_CHECK(it != ret.end());
+		if (it == ret.end()) continue;
+		check_params(*it, atp);
+	}
+}
+
+TORRENT_TEST(journal_not_a_journal)
+{
+	std::string const path = fresh_journal("not_a.journal");
+	std::string const content = "d4:spam4:eggse";
+	write_file(path, content.data(), content.size());
+
+	resume_journal j(path);
+	error_code ec;
+	TEST_CHECK(j.open(ec).empty());
+	TEST_EQUAL(ec, error_code(errors::invalid_file_tag));
+
+	// the file is left untouched
+	std::vector<char> const after = read_file(path);
+	TEST_CHECK(std::string(after.begin(), after.end()) == content);
+}
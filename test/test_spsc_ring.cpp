@@ -0,0 +1,157 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/spsc_ring.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.hpp"
+
+using namespace lt;
+using lt::aux::spsc_ring;
+
+TORRENT_TEST(capacity)
+{
+	TEST_EQUAL(spsc_ring(1).capacity(), 1);
+	TEST_EQUAL(spsc_ring(16).capacity(), 16);
+	TEST_EQUAL(spsc_ring(17).capacity(), 32);
+	TEST_EQUAL(spsc_ring(1000).capacity(), 1024);
+
+	spsc_ring r(100);
+	TEST_EQUAL(r.size(), 0);
+	TEST_EQUAL(r.space(), 128);
+}
+
+TORRENT_TEST(write_read)
+{
+	spsc_ring r(8);
+	std::array<char, 10> out{};
+
+	TEST_EQUAL(r.write({"abcde", 5}), 5);
+	TEST_EQUAL(r.size(), 5);
+	TEST_EQUAL(r.space(), 3);
+
+	// only what fits is written
+	TEST_EQUAL(r.write({"fghij", 5}), 3);
+	TEST_EQUAL(r.size(), 8);
+	TEST_EQUAL(r.space(), 0);
+	TEST_EQUAL(r.write({"x", 1}), 0);
+
+	TEST_EQUAL(r.read({out.data(), 4}), 4);
+	TEST_CHECK(std::string(out.data(), 4) == "abcd");
+
+	// only what's there is read
+	TEST_EQUAL(r.read(out), 4);
+	TEST_CHECK(std::string(out.data(), 4) == "efgh");
+	TEST_EQUAL(r.size(), 0);
+	TEST_EQUAL(r.read(out), 0);
+}
+
+TORRENT_TEST(wrap_around)
+{
+	spsc_ring r(8);
+	std::array<char, 8> out{};
+
+	TEST_EQUAL(r.write({"abcdef", 6}), 6);
+	TEST_EQUAL(r.read({out.data(), 5}), 5);
+
+	// the free space wraps around the end of the buffer
+	auto const w = r.write_regions();
+	TEST_EQUAL(w[0].size(), 2);
+	TEST_EQUAL(w[1].size(), 5);
+	TEST_EQUAL(r.write({"ghijklm", 7}), 7);
+	TEST_EQUAL(r.space(), 0);
+
+	// and so do the bytes to read
+	auto const rd = r.read_regions();
+	TEST_EQUAL(rd[0].size(), 3);
+	TEST_EQUAL(rd[1].size(), 5);
+	TEST_CHECK(std::string(rd[0].data(), 3) == "fgh");
+	TEST_CHECK(std::string(rd[1].data(), 5) == "ijklm");
+
+	// a partial commit only releases part of the bytes
+	r.commit_read(2);
+	TEST_EQUAL(r.size(), 6);
+	TEST_EQUAL(r.read(out), 6);
+	TEST_CHECK(std::string(out.data(), 6) == "hijklm");
+}
+
+TORRENT_TEST(in_place)
+{
+	spsc_ring r(4);
+	auto w = r.write_regions();
+	TEST_EQUAL(w[0].size(), 4);
+	TEST_EQUAL(w[1].size(), 0);
+	w[0][0] = 'a';
+	w[0][1] = 'b';
+
+	// nothing is visible to the reader until it's committed
+	TEST_EQUAL(r.size(), 0);
+	r.commit_write(2);
+	TEST_EQUAL(r.size(), 2);
+
+	auto const rd = r.read_regions();
+	TEST_EQUAL(rd[0].size(), 2);
+	TEST_CHECK(std::string(rd[0].data(), 2) == "ab");
+	r.commit_read(2);
+	TEST_EQUAL(r.size(), 0);
+	TEST_EQUAL(r.space(), 4);
+}
+
+// one thread writes a sequence of bytes in chunks of varying sizes while
+// another one reads them. The reader must see every byte, in order
+TORRENT_TEST(threads)
+{
+	spsc_ring r(64);
+	int const total = 1000000;
+
+	std::thread producer([&]
+	{
+		std::vector<char> buf(37);
+		int written = 0;
+		while (written < total)
+		{
+			int const n = std::min(int(buf.size()), total - written);
+			for (int i = 0; i < n; ++i)
+				buf[std::size_t(i)] = char((written + i) & 0xff);
+			int sent = 0;
+			while (sent < n)
+			{
+				int const ret = r.write({buf.data() + sent, n - sent});
+				if (ret == 0) std::this_thread::yield();
+				sent += ret;
+			}
+			written += n;
+		}
+	});
+
+	int received = 0;
+	int errors = 0;
+	std::vector<char> buf(23);
+	while (received < total)
+	{
+		int const ret = r.read(buf);
+		if (ret == 0) std::this_thread::yield();
+		for (int i = 0; i < ret; ++i)
+		{
+			if (buf[std::size_t(i)] != char((received + i) & 0xff)) ++errors;
+		}
+		received += ret;
+	}
+	producer.join();
+
+	TEST_EQUAL(received, total);
+	TEST_EQUAL(errors, 0);
+	TEST_EQUAL(r.size(), 0);
+}
@@ -17,6 +17,7 @@ see LICENSE file.
 #include "libtorrent/hex.hpp"
 #include "libtorrent/aux_/string_util.hpp"
 #include "libtorrent/aux_/string_ptr.hpp"
+#include "libtorrent/aux_/platform_util.hpp" // for parse_cpu_list
 #include <iostream>
 #include <cstring> // for strcmp
 #include "libtorrent/aux_/escape_string.hpp" // for trim
@@ -564,3 +565,22 @@ TORRENT_TEST(strip_string)
 	TEST_EQUAL(strip_string("   a     b   "), "a     b");
 	TEST_EQUAL(strip_string(" \t \t ab\t\t\t"), "ab");
 }
+
+TORRENT_TEST(parse_cpu_list)
+{
+	std::vector<int> cpus;
+	TEST_CHECK(parse_cpu_list("", cpus));
+	TEST_CHECK(cpus.empty());
+
+	TEST_CHECK(parse_cpu_list("3", cpus));
+	TEST_CHECK((cpus == std::vector<int>{3}));
+
+	TEST_CHECK(parse_cpu_list("0-3,8, 10-11", cpus));
+	TEST_CHECK((cpus == std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+
+	TEST_CHECK(!parse_cpu_list("3-1", cpus));
+	TEST_CHECK(!parse_cpu_list("1-", cpus));
+	TEST_CHECK(!parse_cpu_list("-1", cpus));
+	TEST_CHECK(!parse_cpu_list("a", cpus));
+	TEST_CHECK(!parse_cpu_list("1,,2", cpus));
+}
@@ -663,6 +663,31 @@ TORRENT_TEST(test_move_storage_no_metadata)
 	TEST_EQUAL(h.status().save_path, complete("save_path_1"));
 }
 
+TORRENT_TEST(metadata_bytes_counter)
+{
+	lt::session ses(settings());
+
+	static std::array<const int, 2> const file_sizes{{100000, 100000}};
+	auto files = create_random_files(".", file_sizes);
+	add_torrent_params p = make_torrent(std::move(files), 0x8000);
+	int const metadata_size = p.ti->metadata_size();
+	TEST_CHECK(metadata_size > 0);
+
+	p.save_path = ".";
+	torrent_handle h = ses.add_torrent(std::move(p));
+
+	// a magnet link doesn't have any metadata yet
+	add_torrent_params magnet = parse_magnet_uri("magnet:?xt=urn:btih:abababababababababababababababababababab");
+	magnet.save_path = "save_path";
+	torrent_handle magnet_h = ses.add_torrent(std::move(magnet));
+
+	TEST_EQUAL(get_counters(ses)["ses.torrent_metadata_bytes"], metadata_size);
+
+	ses.remove_torrent(h);
+	ses.remove_torrent(magnet_h);
+	TEST_EQUAL(get_counters(ses)["ses.torrent_metadata_bytes"], 0);
+}
+
 TORRENT_TEST(test_have_piece_no_metadata)
 {
 	lt::session ses(settings());
@@ -0,0 +1,197 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/udp_socket.hpp"
+#include "libtorrent/aux_/alert_manager.hpp"
+#include "libtorrent/aux_/resolver.hpp"
+#include "libtorrent/aux_/proxy_settings.hpp"
+#include "libtorrent/aux_/session_interface.hpp" // for listen_socket_handle
+#include "libtorrent/io_context.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/time.hpp"
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "test.hpp"
+
+using namespace lt;
+
+namespace {
+
+using read_fun = int (aux::udp_socket::*)(span<aux::udp_socket::packet>, error_code&);
+
+struct fixture
+{
+	fixture()
+		: sock(ios, aux::listen_socket_handle{})
+		, sender(ios)
+	{
+		error_code ec;
+		sock.open(udp::v4(), ec);
+		TEST_CHECK(!ec);
+		sock.bind(udp::endpoint(make_address_v4("127.0.0.1"), 0), ec);
+		TEST_CHECK(!ec);
+		target = udp::endpoint(make_address_v4("127.0.0.1"), std::uint16_t(sock.local_port()));
+
+		sender.open(udp::v4(), ec);
+		TEST_CHECK(!ec);
+		sender.bind(udp::endpoint(make_address_v4("127.0.0.1"), 0), ec);
+		TEST_CHECK(!ec);
+	}
+
+	// sends ``num`` datagrams and gives them some time to arrive, so they're
+	// all queued up in the receive socket before the test reads them
+	void send(int const num)
+	{
+		for (int i = 0; i < num; ++i)
+		{
+			std::string const msg = "packet-" + std::to_string(i);
+			error_code ec;
+			sender.send_to(boost::asio::buffer(msg), target, 0, ec);
+			TEST_CHECK(!ec);
+		}
+		std::this_thread::sleep_for(lt::milliseconds(50));
+	}
+
+	io_context ios;
+	aux::udp_socket sock;
+	udp::socket sender;
+	udp::endpoint target;
+};
+
+void check_packets(span<aux::udp_socket::packet const> pkts, int const first
+	, udp::endpoint const& from)
+{
+	for (int i = 0; i < int(pkts.size()); ++i)
+	{
+		auto const& p = pkts[i];
+		std::string const msg = "packet-" + std::to_string(first + i);
+		TEST_CHECK(!p.error);
+		TEST_EQUAL(std::string(p.data.data(), std::size_t(p.data.size())), msg);
+		TEST_EQUAL(p.from, from);
+		TEST_CHECK(p.hostname.empty());
+	}
+}
+
+void test_read(read_fun read)
+{
+	fixture f;
+	udp::endpoint const from = f.sender.local_endpoint();
+	std::array<aux::udp_socket::packet, aux::udp_socket::read_batch_size> pkts;
+	error_code ec;
+
+	// all the queued packets are returned by a single read
+	f.send(5);
+	int ret = (f.sock.*read)(pkts, ec);
+	TEST_EQUAL(ret, 5);
+	check_packets(span<aux::udp_socket::packet const>(pkts).first(ret), 0, from);
+
+	// the socket is drained
+	ret = (f.sock.*read)(pkts, ec);
+	TEST_EQUAL(ret, 0);
+	TEST_CHECK(ec == boost::asio::error::would_block
+		|| ec == boost::asio::error::try_again);
+
+	// a read never returns more than a batch
+	int const extra = 3;
+	f.send(aux::udp_socket::read_batch_size + extra);
+	ret = (f.sock.*read)(pkts, ec);
+	TEST_EQUAL(ret, aux::udp_socket::read_batch_size);
+	check_packets(span<aux::udp_socket::packet const>(pkts).first(ret), 0, from);
+	ret = (f.sock.*read)(pkts, ec);
+	TEST_EQUAL(ret, extra);
+	check_packets(span<aux::udp_socket::packet const>(pkts).first(ret)
+		, aux::udp_socket::read_batch_size, from);
+
+	// nor more than fits in the span passed in
+	f.send(4);
+	ret = (f.sock.*read)(span<aux::udp_socket::packet>(pkts).first(2), ec);
+	TEST_EQUAL(ret, 2);
+	check_packets(span<aux::udp_socket::packet const>(pkts).first(ret), 0, from);
+	ret = (f.sock.*read)(pkts, ec);
+	TEST_EQUAL(ret, 2);
+	check_packets(span<aux::udp_socket::packet const>(pkts).first(ret), 2, from);
+}
+
+void test_filter(read_fun read)
+{
+	fixture f;
+	std::array<aux::udp_socket::packet, aux::udp_socket::read_batch_size> pkts;
+	aux::alert_manager alerts(100, alert_category_t::all());
+	aux::resolver res(f.ios);
+	error_code ec;
+
+	// when everything goes through the proxy, packets that don't come from
+	// it are dropped
+	aux::proxy_settings ps;
+	ps.type = settings_pack::http;
+	ps.hostname = "127.0.0.1";
+	ps.port = 8080;
+	ps.proxy_peer_connections = true;
+	ps.proxy_tracker_connections = true;
+	f.sock.set_proxy_settings(ps, alerts, res, false);
+
+	f.send(3);
+	int ret = (f.sock.*read)(pkts, ec);
+	TEST_EQUAL(ret, 0);
+
+	// the packets were consumed, not left in the socket
+	ret = (f.sock.*read)(pkts, ec);
+	TEST_EQUAL(ret, 0);
+
+	// peer connections don't go through the proxy, so we may receive
+	// packets directly
+	ps.proxy_peer_connections = false;
+	f.sock.set_proxy_settings(ps, alerts, res, false);
+
+	f.send(3);
+	ret = (f.sock.*read)(pkts, ec);
+	TEST_EQUAL(ret, 3);
+	check_packets(span<aux::udp_socket::packet const>(pkts).first(ret), 0
+		, f.sender.local_endpoint());
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(read_batch)
+{
+	test_read(&aux::udp_socket::read);
+}
+
+TORRENT_TEST(read_batch_receive_from)
+{
+	test_read(&aux::udp_socket::read_receive_from);
+}
+
+#if TORRENT_HAS_RECVMMSG && !defined TORRENT_BUILD_SIMULATOR
+TORRENT_TEST(read_batch_recvmmsg)
+{
+	test_read(&aux::udp_socket::read_recvmmsg);
+}
+#endif
+
+TORRENT_TEST(filter_packet)
+{
+	test_filter(&aux::udp_socket::read);
+}
+
+TORRENT_TEST(filter_packet_receive_from)
+{
+	test_filter(&aux::udp_socket::read_receive_from);
+}
+
+#if TORRENT_HAS_RECVMMSG && !defined TORRENT_BUILD_SIMULATOR
+TORRENT_TEST(filter_packet_recvmmsg)
+{
+	test_filter(&aux::udp_socket::read_recvmmsg);
+}
+#endif
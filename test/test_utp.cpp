@@ -16,8 +16,21 @@ see LICENSE file.
 #include "libtorrent/time.hpp"
 #include "libtorrent/aux_/path.hpp"
 #include "libtorrent/aux_/utp_stream.hpp"
+#include "libtorrent/aux_/utp_socket_manager.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/udp_socket.hpp"
+#include "libtorrent/aux_/deadline_timer.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include <algorithm>
+#include <array>
+#include <deque>
 #include <tuple>
 #include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cinttypes>
+#include <cstdio>
 
 #include "test.hpp"
 #include "setup_transfer.hpp"
@@ -33,7 +46,7 @@ using namespace lt;
 
 namespace {
 
-void test_transfer()
+void test_transfer(bool const utp_thread)
 {
 #ifdef TORRENT_UTP_LOG_ENABLE
 	lt::set_utp_stream_logging(true);
@@ -63,6 +76,7 @@ void test_transfer()
 	pack.set_bool(settings_pack::announce_to_all_tiers, true);
 	pack.set_bool(settings_pack::prefer_udp_trackers, false);
 	pack.set_int(settings_pack::min_reconnect_time, 1);
+	pack.set_bool(settings_pack::utp_io_thread, utp_thread);
 	pack.set_str(settings_pack::listen_interfaces, test_listen_interface());
 	lt::session ses1(pack);
 
@@ -126,7 +140,17 @@ void test_transfer()
 
 TORRENT_TEST(utp)
 {
-	test_transfer();
+	test_transfer(false);
+
+	error_code ec;
+	remove_all("tmp1_utp", ec);
+	remove_all("tmp2_utp", ec);
+}
+
+// the same transfer, with uTP running on a thread of its own
+TORRENT_TEST(utp_io_thread)
+{
+	test_transfer(true);
 
 	error_code ec;
 	remove_all("tmp1_utp", ec);
@@ -144,3 +168,464 @@ TORRENT_TEST(compare_less_wrap)
 	TEST_CHECK(compare_less_wrap(0xfff0, 0x000f, 0xffff)); // wrap
 	TEST_CHECK(!compare_less_wrap(0xfff0, 0xff00, 0xffff));
 }
+
+TORRENT_TEST(utp_pacing_rate)
+{
+	using lt::aux::utp_pacer;
+
+	// one cwnd per RTT
+	TEST_EQUAL(utp_pacer::rate(100000, 100, false), 1000000);
+	TEST_EQUAL(utp_pacer::rate(100000, 10, false), 10000000);
+	// twice that in slow-start
+	TEST_EQUAL(utp_pacer::rate(100000, 100, true), 2000000);
+	// never zero
+	TEST_EQUAL(utp_pacer::rate(0, 100, false), 1);
+}
+
+TORRENT_TEST(utp_pacing_interval)
+{
+	lt::aux::utp_pacer p;
+	int const mtu = 1400;
+	// 1 MB/s. One millisecond of that is less than two packets, so the burst
+	// is capped at two packets
+	std::int64_t const rate = 1000000;
+	time_point const start = clock_type::now();
+
+	// the credit starts out full
+	TEST_CHECK(p.delay(mtu, start, rate, mtu) == time_duration(0));
+	TEST_CHECK(p.delay(mtu, start, rate, mtu) == time_duration(0));
+
+	// the third packet has to wait for its full size worth of credit, 1400
+	// bytes at 1 MB/s, plus the rounding microsecond
+	TEST_CHECK(p.delay(mtu, start, rate, mtu) == microseconds(1401));
+
+	// half way there
+	TEST_CHECK(p.delay(mtu, start + microseconds(700), rate, mtu) == microseconds(701));
+
+	// and once that time has passed, it can be sent
+	TEST_CHECK(p.delay(mtu, start + microseconds(1401), rate, mtu) == time_duration(0));
+
+	// after being idle, the credit is capped at one burst
+	time_point const later = start + seconds(10);
+	TEST_CHECK(p.delay(mtu, later, rate, mtu) == time_duration(0));
+	TEST_CHECK(p.delay(mtu, later, rate, mtu) == time_duration(0));
+	TEST_CHECK(p.delay(mtu, later, rate, mtu) > time_duration(0));
+
+	// at higher rates, the burst is one millisecond worth of data
+	lt::aux::utp_pacer fast;
+	std::int64_t const fast_rate = 100000000;
+	int sent = 0;
+	while (fast.delay(mtu, start, fast_rate, mtu) == time_duration(0))
+		++sent;
+	TEST_EQUAL(sent, int(fast_rate / 1000 / mtu));
+}
+
+namespace {
+
+lt::aux::utp_header make_header(std::uint8_t const type
+	, std::uint8_t const extension, std::uint16_t const ack_nr)
+{
+	lt::aux::utp_header h{};
+	h.type_ver = std::uint8_t((type << 4) | 1);
+	h.extension = extension;
+	h.ack_nr = ack_nr;
+	return h;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(utp_coalesce_acks)
+{
+	using namespace lt::aux;
+
+	auto const ack = make_header(ST_STATE, utp_no_extension, 100);
+	auto const sack = make_header(ST_STATE, utp_sack, 101);
+
+	// with nothing held, pure ACKs are held back
+	TEST_CHECK(coalesce_ack(ack, nullptr) == utp_ack_action::hold);
+	TEST_CHECK(coalesce_ack(sack, nullptr) == utp_ack_action::hold);
+
+	// a newer ACK for the same socket supersedes the held one, also across
+	// the sequence number wrap-around
+	TEST_CHECK(coalesce_ack(sack, &ack) == utp_ack_action::replace);
+	auto const before_wrap = make_header(ST_STATE, utp_no_extension, 0xfffe);
+	auto const after_wrap = make_header(ST_STATE, utp_no_extension, 1);
+	TEST_CHECK(coalesce_ack(after_wrap, &before_wrap) == utp_ack_action::replace);
+
+	// duplicate and older ACKs don't, they are needed for fast-retransmit
+	TEST_CHECK(coalesce_ack(ack, &ack) == utp_ack_action::hold);
+	TEST_CHECK(coalesce_ack(ack, &sack) == utp_ack_action::hold);
+
+	// anything but a pure ACK is delivered in order
+	for (std::uint8_t const type : {ST_DATA, ST_FIN, ST_RESET, ST_SYN})
+	{
+		TEST_CHECK(coalesce_ack(make_header(type, utp_no_extension, 102), nullptr)
+			== utp_ack_action::deliver);
+		TEST_CHECK(coalesce_ack(make_header(type, utp_no_extension, 102), &ack)
+			== utp_ack_action::deliver);
+	}
+	TEST_CHECK(coalesce_ack(make_header(ST_STATE, utp_close_reason, 102), &ack)
+		== utp_ack_action::deliver);
+}
+
+namespace {
+
+struct socket_manager_fixture
+{
+	lt::io_context ios;
+	lt::aux::session_settings sett;
+	lt::counters cnt;
+	int num_sent = 0;
+	lt::aux::utp_socket_manager sm{
+		[this](std::weak_ptr<lt::aux::utp_socket_interface>, udp::endpoint const&
+			, span<char const>, error_code&, lt::aux::udp_send_flags_t)
+		{ ++num_sent; }
+		, [](lt::aux::socket_type const&) {}
+		, ios, sett, cnt, nullptr};
+
+	std::vector<std::unique_ptr<lt::aux::utp_stream>> streams;
+	std::vector<std::uint16_t> ids;
+
+	void add_sockets(int const num)
+	{
+		for (int i = 0; i < num; ++i)
+		{
+			streams.emplace_back(new lt::aux::utp_stream(ios));
+			auto& s = *streams.back();
+			s.set_impl(sm.new_utp_socket(&s));
+			ids.push_back(s.get_impl()->receive_id());
+		}
+	}
+
+	// a data packet from an endpoint none of the sockets are connected to,
+	// with the connection ID of socket ``i``. It takes the slow path of
+	// looking up the connection ID and matching the endpoint, and misses
+	bool stray_packet(int const i)
+	{
+		udp::endpoint const remote(addr4("10.0.0.1"), 6881);
+		lt::aux::utp_header h{};
+		h.type_ver = (lt::aux::ST_DATA << 4) | 1;
+		h.connection_id = ids[std::size_t(i) % ids.size()];
+		return sm.incoming_packet({}, remote
+			, {reinterpret_cast<char const*>(&h), int(sizeof(h))});
+	}
+};
+
+} // anonymous namespace
+
+// sockets are only ticked once their timeout expires, and closed sockets are
+// deleted on the next tick
+TORRENT_TEST(many_sockets)
+{
+	int const num_sockets = 500;
+	int const num_connected = 50;
+
+	socket_manager_fixture f;
+	time_point const start = clock_type::now();
+	f.add_sockets(num_sockets);
+	TEST_EQUAL(f.sm.num_sockets(), num_sockets);
+
+	int num_timed_out = 0;
+	for (int i = 0; i < num_connected; ++i)
+	{
+		f.streams[std::size_t(i)]->async_connect(tcp::endpoint(addr4("127.0.0.1")
+			, std::uint16_t(1000 + i)), [&](error_code const& ec)
+			{ if (ec == boost::asio::error::timed_out) ++num_timed_out; });
+	}
+	TEST_EQUAL(f.num_sent, num_connected);
+
+	for (int i = 0; i < num_sockets; ++i)
+		TEST_CHECK(!f.stray_packet(i));
+
+	// the earliest timeout is 3 seconds after the sockets were created.
+	// Ticking up until then should not visit any socket
+	int visited = 0;
+	for (time_point t = start; t < start + milliseconds(2900); t += milliseconds(10))
+		visited += f.sm.tick(t);
+	TEST_EQUAL(visited, 0);
+	TEST_EQUAL(f.num_sent, num_connected);
+
+	// closing the sockets that never connected removes them from the timer
+	// wheel, and deletes them on the next tick
+	f.streams.resize(std::size_t(num_connected));
+	TEST_EQUAL(f.sm.tick(start + milliseconds(2900)), num_sockets - num_connected);
+	TEST_EQUAL(f.sm.num_sockets(), num_connected);
+
+	// the SYNs were never answered, these sockets should time out. Entering
+	// the error state files a socket again, to see whether it can be deleted,
+	// so each of them is visited twice
+	TEST_EQUAL(f.sm.tick(start + seconds(4)), 2 * num_connected);
+	f.ios.restart();
+	f.ios.run();
+	TEST_EQUAL(num_timed_out, num_connected);
+
+	f.streams.clear();
+	f.sm.tick(start + seconds(5));
+	TEST_EQUAL(f.sm.num_sockets(), 0);
+}
+
+// measures the cost of looking up incoming packets and of ticking the socket
+// manager, with a large number of sockets
+TORRENT_BENCHMARK(benchmark_many_sockets)
+{
+	int const num_sockets = 30000;
+	int const num_lookups = 200000;
+
+	socket_manager_fixture f;
+	time_point const start = clock_type::now();
+	f.add_sockets(num_sockets);
+
+	int hits = 0;
+	time_point const lookup_start = clock_type::now();
+	for (int i = 0; i < num_lookups; ++i)
+		hits += f.stray_packet(i);
+	std::int64_t const lookup_time = total_microseconds(clock_type::now() - lookup_start);
+	TEST_EQUAL(hits, 0);
+
+	int num_ticks = 0;
+	int visited = 0;
+	time_point const tick_start = clock_type::now();
+	for (time_point t = start; t < start + milliseconds(2900); t += milliseconds(10))
+	{
+		visited += f.sm.tick(t);
+		++num_ticks;
+	}
+	std::int64_t const tick_time = total_microseconds(clock_type::now() - tick_start);
+	TEST_EQUAL(visited, 0);
+
+	std::printf("%d sockets, %d lookups: %" PRId64 " us, %d ticks: %" PRId64 " us\n"
+		, num_sockets, num_lookups, lookup_time, num_ticks, tick_time);
+
+	f.streams.clear();
+	f.sm.tick(start + milliseconds(2900));
+	TEST_EQUAL(f.sm.num_sockets(), 0);
+}
+
+namespace {
+
+// forwards UDP packets between a client and ``target``, emulating a link with
+// a bottleneck of ``rate`` bytes per second, a drop-tail queue of ``queue``
+// bytes in front of it and a propagation delay of ``delay``, in each
+// direction. The client is whoever sends to endpoint() other than the target
+struct link_emulator
+{
+	link_emulator(udp::endpoint const& target, std::int64_t const rate
+		, std::int64_t const queue, time_duration const delay)
+		: m_target(target)
+		, m_rate(rate)
+		, m_queue(queue)
+		, m_delay(delay)
+	{
+		m_socket.open(udp::v4());
+		m_socket.bind(udp::endpoint(addr4("127.0.0.1"), 0));
+		m_socket.set_option(boost::asio::socket_base::receive_buffer_size(4 * 1024 * 1024));
+		receive();
+		m_thread = std::thread([this] { m_ios.run(); });
+	}
+
+	~link_emulator()
+	{
+		post(m_ios, [this] { m_ios.stop(); });
+		m_thread.join();
+	}
+
+	link_emulator(link_emulator const&) = delete;
+	link_emulator& operator=(link_emulator const&) = delete;
+
+	udp::endpoint endpoint() const { return m_socket.local_endpoint(); }
+
+	// the number of packets dropped because the queue was full
+	int dropped() const { return m_dropped; }
+
+private:
+
+	struct packet
+	{
+		time_point deliver;
+		udp::endpoint to;
+		std::vector<char> buf;
+	};
+
+	struct direction
+	{
+		// the time the bottleneck is done sending what's queued
+		time_point link_free{};
+		std::deque<packet> packets;
+	};
+
+	void receive()
+	{
+		m_socket.async_receive_from(boost::asio::buffer(m_buf), m_from
+			, [this](error_code const& ec, std::size_t const len)
+		{
+			if (ec) return;
+			on_receive(len);
+			receive();
+		});
+	}
+
+	void on_receive(std::size_t const len)
+	{
+		bool const upstream = m_from != m_target;
+		if (upstream) m_client = m_from;
+		direction& d = m_dir[upstream ? 0 : 1];
+
+		time_point const now = clock_type::now();
+		std::int64_t const backlog = d.link_free > now
+			? total_microseconds(d.link_free - now) * m_rate / 1000000 : 0;
+		if (backlog + std::int64_t(len) > m_queue)
+		{
+			++m_dropped;
+			return;
+		}
+
+		d.link_free = std::max(d.link_free, now)
+			+ microseconds(std::int64_t(len) * 1000000 / m_rate);
+		d.packets.push_back({d.link_free + m_delay, upstream ? m_target : m_client
+			, std::vector<char>(m_buf.begin(), m_buf.begin() + std::ptrdiff_t(len))});
+		arm_timer();
+	}
+
+	void arm_timer()
+	{
+		time_point next = time_point::max();
+		for (auto const& d : m_dir)
+			if (!d.packets.empty()) next = std::min(next, d.packets.front().deliver);
+		if (next == time_point::max() || next >= m_timer_expiry) return;
+
+		m_timer_expiry = next;
+		m_timer.expires_at(next);
+		m_timer.async_wait([this](error_code const& ec)
+		{
+			if (ec) return;
+			m_timer_expiry = time_point::max();
+			time_point const now = clock_type::now();
+			for (auto& d : m_dir)
+			{
+				while (!d.packets.empty() && d.packets.front().deliver <= now)
+				{
+					error_code ignore;
+					m_socket.send_to(boost::asio::buffer(d.packets.front().buf)
+						, d.packets.front().to, 0, ignore);
+					d.packets.pop_front();
+				}
+			}
+			arm_timer();
+		});
+	}
+
+	io_context m_ios;
+	udp::socket m_socket{m_ios};
+	aux::deadline_timer m_timer{m_ios};
+	time_point m_timer_expiry = time_point::max();
+	udp::endpoint const m_target;
+	udp::endpoint m_client;
+	udp::endpoint m_from;
+	std::array<char, 1500> m_buf;
+	std::int64_t const m_rate;
+	std::int64_t const m_queue;
+	time_duration const m_delay;
+	// 0 is from the client to the target, 1 is the way back
+	std::array<direction, 2> m_dir;
+	int m_dropped = 0;
+	std::thread m_thread;
+};
+
+struct goodput_result
+{
+	std::int64_t bytes = 0;
+	std::int64_t ms = 0;
+	int dropped = 0;
+};
+
+// downloads a torrent over a single uTP connection through a link_emulator
+goodput_result utp_goodput(std::function<void(settings_pack&)> const& config)
+{
+	error_code ec;
+	remove_all("tmp1_utp_bdp", ec);
+	remove_all("tmp2_utp_bdp", ec);
+	create_directory("tmp1_utp_bdp", ec);
+
+	session_proxy p1;
+	session_proxy p2;
+
+	settings_pack pack = settings();
+	pack.set_bool(settings_pack::enable_lsd, false);
+	pack.set_bool(settings_pack::enable_natpmp, false);
+	pack.set_bool(settings_pack::enable_upnp, false);
+	pack.set_bool(settings_pack::enable_dht, false);
+	pack.set_int(settings_pack::out_enc_policy, settings_pack::pe_disabled);
+	pack.set_int(settings_pack::in_enc_policy, settings_pack::pe_disabled);
+	pack.set_bool(settings_pack::enable_outgoing_tcp, false);
+	pack.set_bool(settings_pack::enable_incoming_tcp, false);
+	pack.set_int(settings_pack::alert_mask, alert_category::error);
+	pack.set_str(settings_pack::listen_interfaces, "127.0.0.1:0");
+	config(pack);
+	lt::session seed(pack);
+	lt::session downloader(pack);
+
+	std::ofstream file("tmp1_utp_bdp/temporary");
+	add_torrent_params atp = ::create_torrent(&file, "temporary", 256 * 1024, 128, false);
+	file.close();
+	atp.flags &= ~torrent_flags::paused;
+	atp.flags &= ~torrent_flags::auto_managed;
+
+	atp.save_path = "tmp1_utp_bdp";
+	atp.flags |= torrent_flags::seed_mode;
+	seed.add_torrent(atp);
+
+	atp.save_path = "tmp2_utp_bdp";
+	atp.flags &= ~torrent_flags::seed_mode;
+	torrent_handle const h = downloader.add_torrent(atp);
+
+	// 10 MB/s with a 100 ms round-trip time is a bandwidth-delay product of
+	// 1 MB, the size of the default receive window. The queue holds 20 ms
+	// worth of packets
+	link_emulator link(udp::endpoint(addr4("127.0.0.1"), std::uint16_t(seed.listen_port()))
+		, 10000000, 200000, milliseconds(50));
+
+	goodput_result ret;
+	time_point const start = clock_type::now();
+	h.connect_peer(tcp::endpoint(addr4("127.0.0.1"), link.endpoint().port()));
+	while (clock_type::now() - start < seconds(60))
+	{
+		if (h.status().is_seeding) break;
+		std::this_thread::sleep_for(milliseconds(10));
+	}
+	ret.ms = total_milliseconds(clock_type::now() - start);
+	ret.bytes = h.status().total_payload_download;
+	ret.dropped = link.dropped();
+	TEST_CHECK(h.status().is_seeding);
+
+	p1 = seed.abort();
+	p2 = downloader.abort();
+	return ret;
+}
+
+} // anonymous namespace
+
+// a single uTP connection over a link with a high bandwidth-delay product.
+// This reports the goodput, payload bytes per second until the download
+// completes, with pacing and ACK coalescing off and on
+TORRENT_BENCHMARK(benchmark_utp_high_bdp)
+{
+	for (int const max_window : {1024 * 1024, 4 * 1024 * 1024})
+	{
+		for (int const flags : {0, 1, 2, 3})
+		{
+			bool const pacing = flags & 1;
+			bool const coalesce = flags & 2;
+			goodput_result const r = utp_goodput([&](settings_pack& pack)
+			{
+				pack.set_bool(settings_pack::utp_pacing, pacing);
+				pack.set_bool(settings_pack::utp_coalesce_acks, coalesce);
+				pack.set_int(settings_pack::utp_max_window, max_window);
+			});
+			std::printf("max-window: %d kiB pacing: %d coalesce-acks: %d "
+				"downloaded: %" PRId64 " bytes in %" PRId64 " ms goodput: %" PRId64
+				" kB/s dropped: %d\n"
+				, max_window / 1024, pacing, coalesce, r.bytes, r.ms
+				, r.bytes / std::max(std::int64_t(1), r.ms), r.dropped);
+		}
+	}
+}
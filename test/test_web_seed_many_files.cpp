@@ -0,0 +1,322 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "test.hpp"
+#include "setup_transfer.hpp"
+#include "settings.hpp"
+#include "make_torrent.hpp"
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/torrent_status.hpp"
+#include "libtorrent/io_context.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/aux_/deadline_timer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+// the piece size used by make_test_torrent()
+int const piece_size = 32768;
+
+// a minimal HTTP/1.1 server for the files of a torrent made by
+// make_test_torrent(), where every file has the same size. Responses are sent
+// in order, each after a short delay, to give the client a chance to send its
+// next request before the current one is answered. After
+// requests_per_connection responses on a connection, the server sends
+// "Connection: close" and closes it
+struct pipeline_server
+{
+	pipeline_server(int const file_size, int const requests_per_connection)
+		: m_file_size(file_size)
+		, m_requests_per_connection(requests_per_connection)
+	{
+		m_acceptor.open(tcp::v4());
+		m_acceptor.bind(tcp::endpoint(make_address_v4("127.0.0.1"), 0));
+		m_acceptor.listen();
+		accept();
+		m_thread = std::thread([this] { m_ioc.run(); });
+	}
+
+	~pipeline_server() { stop(); }
+
+	void stop()
+	{
+		m_ioc.stop();
+		if (m_thread.joinable()) m_thread.join();
+	}
+
+	int port() const { return m_acceptor.local_endpoint().port(); }
+
+	// the number of requests that had already been received in full when the
+	// response to the previous request on the same connection was sent
+	int num_pipelined() const { std::lock_guard<std::mutex> l(m_mutex); return m_pipelined; }
+	int num_requests() const { std::lock_guard<std::mutex> l(m_mutex); return m_requests; }
+	int num_connections() const { std::lock_guard<std::mutex> l(m_mutex); return m_connections; }
+
+	// the time from closing a connection to accepting the next one, for
+	// every time the server closed a connection
+	std::vector<time_duration> reconnect_delays() const
+	{ std::lock_guard<std::mutex> l(m_mutex); return m_reconnect_delays; }
+
+private:
+
+	struct connection
+	{
+		explicit connection(io_context& ioc) : sock(ioc), timer(ioc) {}
+		tcp::socket sock;
+		aux::deadline_timer timer;
+		std::string buffer;
+		std::string response;
+		int responses = 0;
+	};
+
+	void accept()
+	{
+		auto c = std::make_shared<connection>(m_ioc);
+		m_acceptor.async_accept(c->sock, [this, c](error_code const& ec)
+		{
+			if (ec) return;
+			{
+				std::lock_guard<std::mutex> l(m_mutex);
+				++m_connections;
+				if (m_last_close != time_point())
+				{
+					m_reconnect_delays.push_back(clock_type::now() - m_last_close);
+					m_last_close = time_point();
+				}
+			}
+			read_request(c);
+			accept();
+		});
+	}
+
+	void read_request(std::shared_ptr<connection> c)
+	{
+		std::size_t const end = c->buffer.find("\r\n\r\n");
+		if (end != std::string::npos)
+		{
+			std::string const request = c->buffer.substr(0, end + 4);
+			c->buffer.erase(0, end + 4);
+			c->timer.expires_after(milliseconds(20));
+			c->timer.async_wait([this, c, request](error_code const& ec)
+			{
+				if (ec) return;
+				respond(c, request);
+			});
+			return;
+		}
+
+		std::size_t const size = c->buffer.size();
+		c->buffer.resize(size + 1500);
+		c->sock.async_read_some(boost::asio::buffer(&c->buffer[size], 1500)
+			, [this, c, size](error_code const& ec, std::size_t const bytes)
+		{
+			c->buffer.resize(size + bytes);
+			if (ec) return;
+			read_request(c);
+		});
+	}
+
+	void respond(std::shared_ptr<connection> c, std::string const& request)
+	{
+		// GET /<url path>/test_file-<n> HTTP/1.1
+		// Range: bytes=<first>-<last>
+		std::size_t const name = request.find("test_file-");
+		std::size_t const range = request.find("Range: bytes=");
+		TEST_CHECK(name != std::string::npos);
+		TEST_CHECK(range != std::string::npos);
+		if (name == std::string::npos || range == std::string::npos) return;
+		int const file = std::atoi(request.c_str() + name + 10);
+		char const* r = request.c_str() + range + 13;
+		char* dash = nullptr;
+		int const first = int(std::strtol(r, &dash, 10));
+		int const last = int(std::strtol(dash + 1, nullptr, 10));
+
+		bool const close = ++c->responses == m_requests_per_connection;
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			++m_requests;
+			if (c->buffer.find("\r\n\r\n") != std::string::npos) ++m_pipelined;
+		}
+
+		char header[300];
+		std::snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\n"
+			"Content-Range: bytes %d-%d/%d\r\n"
+			"Content-Length: %d\r\n"
+			"%s\r\n", first, last, m_file_size, last - first + 1
+			, close ? "Connection: close\r\n" : "");
+		c->response = header;
+
+		// every byte of a piece is the piece index
+		std::int64_t const offset = std::int64_t(file) * m_file_size;
+		for (int i = first; i <= last; ++i)
+			c->response += char(((offset + i) / piece_size) & 0xff);
+
+		boost::asio::async_write(c->sock, boost::asio::buffer(c->response)
+			, [this, c, close](error_code const& ec, std::size_t)
+		{
+			if (ec) return;
+			if (close)
+			{
+				error_code ignore;
+				c->sock.close(ignore);
+				std::lock_guard<std::mutex> l(m_mutex);
+				m_last_close = clock_type::now();
+				return;
+			}
+			read_request(c);
+		});
+	}
+
+	io_context m_ioc;
+	tcp::acceptor m_acceptor{m_ioc};
+	std::thread m_thread;
+
+	int const m_file_size;
+	int const m_requests_per_connection;
+
+	mutable std::mutex m_mutex;
+	int m_pipelined = 0;
+	int m_requests = 0;
+	int m_connections = 0;
+	time_point m_last_close;
+	std::vector<time_duration> m_reconnect_delays;
+};
+
+} // anonymous namespace
+
+// the web seed connection keeps the next range requested while the current
+// one is received, and reconnects right away when the server closes the
+// connection after telling us it would
+TORRENT_TEST(web_seed_pipeline_and_reconnect)
+{
+	// one piece per file, and so one request per piece
+	int const num_files = 30;
+	int const file_size = piece_size;
+	int const requests_per_connection = 4;
+
+	pipeline_server server(file_size, requests_per_connection);
+
+	char url[512];
+	std::snprintf(url, sizeof(url), "http://127.0.0.1:%d/web_seed_pipeline", server.port());
+
+	torrent_args args;
+	std::string const file = std::to_string(file_size);
+	for (int i = 0; i < num_files; ++i) args.file(file.c_str());
+	args.name("torrent_dir").url_seed(url);
+	add_torrent_params atp = make_test_torrent(args);
+
+	{
+		settings_pack pack = settings();
+		pack.set_int(settings_pack::alert_mask, alert_category::error);
+		lt::session ses(pack);
+
+		atp.save_path = "tmp_web_seed_pipeline";
+		atp.flags &= ~torrent_flags::paused;
+		atp.flags &= ~torrent_flags::auto_managed;
+		torrent_handle h = ses.add_torrent(atp);
+
+		time_point const start = clock_type::now();
+		torrent_status st = h.status();
+		while (!st.is_seeding && clock_type::now() - start < seconds(30))
+		{
+			std::this_thread::sleep_for(lt::milliseconds(50));
+			st = h.status();
+		}
+
+		TEST_CHECK(st.is_seeding);
+		TEST_CHECK(st.errc == error_code());
+
+		ses.remove_torrent(h, session::delete_files);
+	}
+	server.stop();
+
+	std::printf("requests: %d pipelined: %d connections: %d\n"
+		, server.num_requests(), server.num_pipelined(), server.num_connections());
+
+	TEST_CHECK(server.num_requests() >= num_files);
+	TEST_CHECK(server.num_pipelined() > 0);
+
+	// the server closed the connection after every 4th request, and the web
+	// seed reconnected each time
+	TEST_CHECK(server.num_connections() >= num_files / requests_per_connection);
+
+	// the web seed reconnects right away rather than waiting for the next
+	// second tick. Allow for a few slow reconnects on a busy machine
+	auto const delays = server.reconnect_delays();
+	TEST_CHECK(!delays.empty());
+	auto const slow = std::count_if(delays.begin(), delays.end()
+		, [](time_duration const d) { return d > milliseconds(250); });
+	TEST_CHECK(slow * 2 <= int(delays.size()));
+}
+
+// downloads a torrent made up of many small files from a web seed. Every
+// file is a separate HTTP request, so this measures how well requests are
+// pipelined on the web seed connection
+TORRENT_BENCHMARK(benchmark_web_seed_many_small_files)
+{
+	int const num_files = 10000;
+	int const file_size = 1000;
+
+	std::string const save_path = "web_seed_many_files";
+	int const port = start_web_server(false, false, true);
+
+	char url[512];
+	std::snprintf(url, sizeof(url), "http://127.0.0.1:%d/%s", port, save_path.c_str());
+
+	torrent_args args;
+	std::string const file = std::to_string(file_size);
+	for (int i = 0; i < num_files; ++i) args.file(file.c_str());
+	args.name("torrent_dir").url_seed(url);
+
+	add_torrent_params atp = make_test_torrent(args);
+	generate_files(*atp.ti, save_path);
+
+	{
+		settings_pack pack = settings();
+		pack.set_int(settings_pack::alert_mask, alert_category::error);
+		lt::session ses(pack);
+
+		atp.save_path = "tmp_web_seed_many_files";
+		atp.flags &= ~torrent_flags::paused;
+		atp.flags &= ~torrent_flags::auto_managed;
+		torrent_handle h = ses.add_torrent(atp);
+
+		time_point const start = clock_type::now();
+		torrent_status st = h.status();
+		while (!st.is_seeding && clock_type::now() - start < seconds(300))
+		{
+			std::this_thread::sleep_for(lt::milliseconds(100));
+			st = h.status();
+		}
+		time_point const end = clock_type::now();
+
+		TEST_CHECK(st.is_seeding);
+		TEST_CHECK(st.errc == error_code());
+
+		int const ms = std::max(1, int(total_milliseconds(end - start)));
+		std::printf("downloaded %d files (%d kB) in %d ms (%d files/s)\n"
+			, num_files, num_files * file_size / 1000, ms
+			, int(std::int64_t(num_files) * 1000 / ms));
+
+		ses.remove_torrent(h, session::delete_files);
+	}
+
+	stop_web_server();
+}
@@ -0,0 +1,548 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/session_params.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/session_stats.hpp"
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/load_torrent.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/version.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// This tool runs a swarm of sessions in a single process, all connected over
+// loopback, and reports throughput, CPU time per downloaded byte, piece
+// latencies and the session stats counters as JSON. The torrent content and
+// the order peers are connected in only depend on the command line, to make
+// runs comparable across libtorrent versions.
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct config
+{
+	int num_sessions = 4;
+	int num_seeds = 1;
+	int num_torrents = 1;
+	// torrent size, in MiB
+	int torrent_size = 64;
+	// in kiB
+	int piece_size = 1024;
+	bool utp = false;
+	bool encryption = false;
+	int time_limit = 300;
+	std::uint64_t random_seed = 0;
+	std::string work_dir = "swarm_benchmark";
+	std::string output = "swarm_benchmark.json";
+};
+
+// xorshift64*, used to generate the torrent content
+struct generator
+{
+	explicit generator(std::uint64_t const seed) : m_state(seed * 2 + 1) {}
+
+	std::uint64_t operator()()
+	{
+		m_state ^= m_state >> 12;
+		m_state ^= m_state << 25;
+		m_state ^= m_state >> 27;
+		return m_state * 0x2545f4914f6cdd1dULL;
+	}
+private:
+	std::uint64_t m_state;
+};
+
+std::vector<char> generate_torrent(config const& cfg, int const idx
+	, std::string const& save_path)
+{
+	std::int64_t const total_size = std::int64_t(cfg.torrent_size) * 1024 * 1024;
+	std::string const name = "torrent-" + std::to_string(idx);
+
+	std::ofstream output(fs::path(save_path) / name, std::ios_base::binary);
+	generator rand(cfg.random_seed * 1000003 + std::uint64_t(idx));
+	std::array<std::uint64_t, 0x4000> buffer;
+	for (std::int64_t left = total_size; left > 0;)
+	{
+		for (auto& v : buffer) v = rand();
+		auto const len = std::min(std::int64_t(sizeof(buffer)), left);
+		output.write(reinterpret_cast<char const*>(buffer.data()), std::streamsize(len));
+		left -= len;
+	}
+	output.close();
+
+	std::vector<lt::create_file_entry> files;
+	files.emplace_back(name, total_size);
+	lt::create_torrent t(std::move(files), cfg.piece_size * 1024);
+	lt::set_piece_hashes(t, save_path);
+
+	std::vector<char> ret;
+	lt::bencode(std::back_inserter(ret), t.generate());
+	return ret;
+}
+
+lt::session_params session_settings(config const& cfg)
+{
+	lt::session_params params;
+	auto& s = params.settings;
+	s.set_bool(lt::settings_pack::enable_dht, false);
+	s.set_bool(lt::settings_pack::enable_upnp, false);
+	s.set_bool(lt::settings_pack::enable_natpmp, false);
+	s.set_bool(lt::settings_pack::enable_lsd, false);
+	s.set_str(lt::settings_pack::listen_interfaces, "127.0.0.1:0");
+	// every session has the same IP
+	s.set_bool(lt::settings_pack::allow_multiple_connections_per_ip, true);
+	s.set_bool(lt::settings_pack::enable_outgoing_utp, cfg.utp);
+	s.set_bool(lt::settings_pack::enable_incoming_utp, cfg.utp);
+	s.set_bool(lt::settings_pack::enable_outgoing_tcp, !cfg.utp);
+	s.set_bool(lt::settings_pack::enable_incoming_tcp, !cfg.utp);
+	auto const policy = cfg.encryption
+		? lt::settings_pack::pe_forced : lt::settings_pack::pe_disabled;
+	s.set_int(lt::settings_pack::out_enc_policy, policy);
+	s.set_int(lt::settings_pack::in_enc_policy, policy);
+	s.set_int(lt::settings_pack::allowed_enc_level, lt::settings_pack::pe_rc4);
+	s.set_int(lt::settings_pack::connections_limit, 10000);
+	s.set_int(lt::settings_pack::alert_queue_size, 1000000);
+	s.set_int(lt::settings_pack::alert_mask, lt::alert_category::error
+		| lt::alert_category::status
+		| lt::alert_category::piece_progress
+		| lt::alert_category::block_progress);
+	return params;
+}
+
+// the state of one torrent in a downloading session
+struct download
+{
+	// when the first block of each piece was requested
+	std::vector<lt::time_point> piece_requested;
+	lt::time_point finished;
+	bool done = false;
+};
+
+struct node
+{
+	std::unique_ptr<lt::session> ses;
+	std::map<lt::torrent_handle, int> torrent_index;
+	std::vector<download> downloads;
+	std::vector<std::int64_t> counters;
+	bool seed = false;
+};
+
+struct results
+{
+	double duration = 0;
+	double cpu_time = 0;
+	std::int64_t payload_bytes = 0;
+	int completed = 0;
+	std::vector<std::int64_t> piece_latency;
+	std::vector<std::int64_t> completion_time;
+};
+
+void print_usage()
+{
+	std::cerr << "USAGE: swarm_benchmark <options>\n\n"
+		"OPTIONS:\n"
+		"   -n <val>\n"
+		"      the number of sessions in the swarm (default: 4)\n"
+		"   -s <val>\n"
+		"      the number of sessions that start out as seeds (default: 1)\n"
+		"   -t <val>\n"
+		"      the number of torrents every session has (default: 1)\n"
+		"   -z <val>\n"
+		"      the size of each torrent, in MiB (default: 64)\n"
+		"   -p <val>\n"
+		"      the piece size, in kiB. Must be a power of 2 (default: 1024)\n"
+		"   -T <val>\n"
+		"      give up after this many seconds (default: 300)\n"
+		"   -r <val>\n"
+		"      the seed for generating the torrent content (default: 0)\n"
+		"   -d <path>\n"
+		"      the directory to store the torrent content in (default: swarm_benchmark)\n"
+		"   -o <path>\n"
+		"      the file to write the JSON report to (default: swarm_benchmark.json)\n"
+		"   utp\n"
+		"      connect peers over uTP instead of TCP\n"
+		"   encryption\n"
+		"      require RC4 encrypted peer connections\n"
+		;
+}
+
+// fills in per-session counters from the session_stats_alert
+void collect_counters(std::vector<node>& nodes)
+{
+	for (auto& n : nodes) n.ses->post_session_stats();
+
+	for (auto& n : nodes)
+	{
+		auto const start = lt::clock_type::now();
+		while (n.counters.empty() && lt::clock_type::now() - start < lt::seconds(10))
+		{
+			n.ses->wait_for_alert(lt::seconds(1));
+			std::vector<lt::alert*> alerts;
+			n.ses->pop_alerts(&alerts);
+			for (lt::alert const* a : alerts)
+			{
+				auto const* ss = lt::alert_cast<lt::session_stats_alert>(a);
+				if (ss == nullptr) continue;
+				auto const c = ss->counters();
+				n.counters.assign(c.begin(), c.end());
+			}
+		}
+	}
+}
+
+void print_samples(std::FILE* f, char const* name, std::vector<std::int64_t> samples)
+{
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&](int const p) -> std::int64_t
+	{
+		if (samples.empty()) return 0;
+		return samples[(samples.size() - 1) * std::size_t(p) / 100];
+	};
+
+	std::fprintf(f, "    \"%s\": {\n", name);
+	std::fprintf(f, "      \"samples\": %d,\n", int(samples.size()));
+	std::fprintf(f, "      \"p50\": %" PRId64 ",\n", percentile(50));
+	std::fprintf(f, "      \"p90\": %" PRId64 ",\n", percentile(90));
+	std::fprintf(f, "      \"p99\": %" PRId64 ",\n", percentile(99));
+	std::fprintf(f, "      \"max\": %" PRId64 ",\n", percentile(100));
+
+	// power-of-two buckets. Each entry is the number of samples less than or
+	// equal to the bucket limit and greater than the previous one
+	std::fprintf(f, "      \"histogram\": [");
+	std::int64_t limit = 1;
+	auto it = samples.begin();
+	bool first = true;
+	while (it != samples.end())
+	{
+		auto const end = std::upper_bound(it, samples.end(), limit);
+		std::fprintf(f, "%s{\"le\": %" PRId64 ", \"count\": %d}"
+			, first ? "" : ", ", limit, int(end - it));
+		first = false;
+		it = end;
+		limit *= 2;
+	}
+	std::fprintf(f, "]\n    }");
+}
+
+void print_counters(std::FILE* f, char const* name, std::vector<node> const& nodes
+	, bool const seed)
+{
+	std::vector<lt::stats_metric> const metrics = lt::session_stats_metrics();
+	std::fprintf(f, "    \"%s\": {", name);
+	bool first = true;
+	for (auto const& m : metrics)
+	{
+		std::int64_t sum = 0;
+		for (auto const& n : nodes)
+		{
+			if (n.seed != seed) continue;
+			if (m.value_index < int(n.counters.size())) sum += n.counters[std::size_t(m.value_index)];
+		}
+		std::fprintf(f, "%s\n      \"%s\": %" PRId64, first ? "" : ",", m.name, sum);
+		first = false;
+	}
+	std::fprintf(f, "\n    }");
+}
+
+void write_report(std::FILE* f, config const& cfg, results const& r
+	, std::vector<node> const& nodes)
+{
+	std::int64_t const torrent_bytes = std::int64_t(cfg.torrent_size) * 1024 * 1024;
+	std::fprintf(f, "{\n  \"config\": {\n");
+	std::fprintf(f, "    \"sessions\": %d,\n", cfg.num_sessions);
+	std::fprintf(f, "    \"seeds\": %d,\n", cfg.num_seeds);
+	std::fprintf(f, "    \"torrents\": %d,\n", cfg.num_torrents);
+	std::fprintf(f, "    \"torrent_size\": %" PRId64 ",\n", torrent_bytes);
+	std::fprintf(f, "    \"piece_size\": %d,\n", cfg.piece_size * 1024);
+	std::fprintf(f, "    \"transport\": \"%s\",\n", cfg.utp ? "utp" : "tcp");
+	std::fprintf(f, "    \"encryption\": %s,\n", cfg.encryption ? "true" : "false");
+	std::fprintf(f, "    \"random_seed\": %" PRIu64 ",\n", cfg.random_seed);
+	std::fprintf(f, "    \"libtorrent_version\": \"%s\"\n", lt::version());
+	std::fprintf(f, "  },\n  \"results\": {\n");
+	int const expected = (cfg.num_sessions - cfg.num_seeds) * cfg.num_torrents;
+	std::fprintf(f, "    \"downloads\": %d,\n", expected);
+	std::fprintf(f, "    \"completed\": %d,\n", r.completed);
+	std::fprintf(f, "    \"duration_s\": %.3f,\n", r.duration);
+	std::fprintf(f, "    \"payload_bytes\": %" PRId64 ",\n", r.payload_bytes);
+	std::fprintf(f, "    \"throughput_bytes_per_s\": %.0f,\n"
+		, r.duration > 0 ? double(r.payload_bytes) / r.duration : 0.);
+	std::fprintf(f, "    \"cpu_time_s\": %.3f,\n", r.cpu_time);
+	std::fprintf(f, "    \"cpu_ns_per_byte\": %.3f,\n"
+		, r.payload_bytes > 0 ? r.cpu_time * 1e9 / double(r.payload_bytes) : 0.);
+	// the time from requesting the first block of a piece, until the piece
+	// passed the hash check
+	print_samples(f, "piece_latency_us", r.piece_latency);
+	std::fprintf(f, ",\n");
+	print_samples(f, "completion_time_ms", r.completion_time);
+	std::fprintf(f, "\n  },\n  \"counters\": {\n");
+	print_counters(f, "seeds", nodes, true);
+	std::fprintf(f, ",\n");
+	print_counters(f, "leechers", nodes, false);
+	std::fprintf(f, "\n  }\n}\n");
+}
+
+int run(config const& cfg)
+{
+	std::string const seed_path = (fs::path(cfg.work_dir) / "seed").string();
+	std::error_code ec;
+	fs::create_directories(seed_path, ec);
+	if (ec)
+	{
+		std::cerr << "failed to create directory \"" << seed_path << "\": " << ec.message() << '\n';
+		return 1;
+	}
+
+	std::cout << "generating " << cfg.num_torrents << " torrents\n";
+	std::vector<std::vector<char>> torrents;
+	for (int i = 0; i < cfg.num_torrents; ++i)
+		torrents.push_back(generate_torrent(cfg, i, seed_path));
+
+	std::vector<node> nodes(std::size_t(cfg.num_sessions));
+	std::vector<lt::tcp::endpoint> endpoints;
+	for (int i = 0; i < cfg.num_sessions; ++i)
+	{
+		node& n = nodes[std::size_t(i)];
+		n.seed = i < cfg.num_seeds;
+		n.ses = std::make_unique<lt::session>(session_settings(cfg));
+		endpoints.emplace_back(lt::make_address_v4("127.0.0.1"), n.ses->listen_port());
+
+		std::string save_path = seed_path;
+		if (!n.seed)
+		{
+			save_path = (fs::path(cfg.work_dir) / ("leech-" + std::to_string(i))).string();
+			fs::remove_all(save_path, ec);
+		}
+
+		for (int t = 0; t < cfg.num_torrents; ++t)
+		{
+			lt::add_torrent_params atp = lt::load_torrent_buffer(torrents[std::size_t(t)]);
+			atp.save_path = save_path;
+			atp.flags &= ~(lt::torrent_flags::paused | lt::torrent_flags::auto_managed);
+			if (n.seed) atp.flags |= lt::torrent_flags::seed_mode;
+			else
+			{
+				download d;
+				d.piece_requested.resize(std::size_t(atp.ti->num_pieces()));
+				n.downloads.push_back(std::move(d));
+			}
+			n.torrent_index[n.ses->add_torrent(std::move(atp))] = t;
+		}
+	}
+
+	// every downloader connects to all seeds and to the downloaders before
+	// it. That way every pair of sessions is connected exactly once
+	std::cout << "connecting " << cfg.num_sessions << " sessions\n";
+	auto const start = lt::clock_type::now();
+	std::clock_t const start_cpu = std::clock();
+	for (int i = cfg.num_seeds; i < cfg.num_sessions; ++i)
+	{
+		for (auto const& t : nodes[std::size_t(i)].torrent_index)
+		{
+			for (int k = 0; k < i; ++k)
+				t.first.connect_peer(endpoints[std::size_t(k)]);
+		}
+	}
+
+	results r;
+	int const expected = (cfg.num_sessions - cfg.num_seeds) * cfg.num_torrents;
+	std::vector<lt::alert*> alerts;
+	while (r.completed < expected
+		&& lt::clock_type::now() - start < lt::seconds(cfg.time_limit))
+	{
+		bool idle = true;
+		for (auto& n : nodes)
+		{
+			n.ses->pop_alerts(&alerts);
+			if (!alerts.empty()) idle = false;
+			for (lt::alert const* a : alerts)
+			{
+				if (auto const* e = lt::alert_cast<lt::torrent_error_alert>(a))
+				{
+					std::cerr << e->message() << '\n';
+					continue;
+				}
+				if (n.seed) continue;
+
+				auto const* ta = dynamic_cast<lt::torrent_alert const*>(a);
+				if (ta == nullptr) continue;
+				auto const it = n.torrent_index.find(ta->handle);
+				if (it == n.torrent_index.end()) continue;
+				download& d = n.downloads[std::size_t(it->second)];
+
+				if (auto const* bd = lt::alert_cast<lt::block_downloading_alert>(a))
+				{
+					auto& t = d.piece_requested[std::size_t(static_cast<int>(bd->piece_index))];
+					if (t == lt::time_point{}) t = bd->timestamp();
+				}
+				else if (auto const* pf = lt::alert_cast<lt::piece_finished_alert>(a))
+				{
+					auto const t = d.piece_requested[std::size_t(static_cast<int>(pf->piece_index))];
+					if (t != lt::time_point{})
+						r.piece_latency.push_back(lt::total_microseconds(pf->timestamp() - t));
+				}
+				else if (auto const* tf = lt::alert_cast<lt::torrent_finished_alert>(a))
+				{
+					if (d.done) continue;
+					d.done = true;
+					d.finished = tf->timestamp();
+					r.completion_time.push_back(lt::total_milliseconds(d.finished - start));
+					++r.completed;
+				}
+			}
+		}
+		if (idle) std::this_thread::sleep_for(lt::milliseconds(5));
+	}
+
+	r.duration = double(lt::total_microseconds(lt::clock_type::now() - start)) / 1e6;
+	r.cpu_time = double(std::clock() - start_cpu) / CLOCKS_PER_SEC;
+
+	collect_counters(nodes);
+	int const payload_idx = lt::find_metric_idx("net.recv_payload_bytes");
+	for (auto const& n : nodes)
+	{
+		if (n.seed || payload_idx < 0 || payload_idx >= int(n.counters.size())) continue;
+		r.payload_bytes += n.counters[std::size_t(payload_idx)];
+	}
+
+	std::cout << "completed " << r.completed << " of " << expected << " downloads in "
+		<< r.duration << " s, " << (r.duration > 0 ? double(r.payload_bytes) / r.duration / 1e6 : 0.)
+		<< " MB/s, " << (r.payload_bytes > 0 ? r.cpu_time * 1e9 / double(r.payload_bytes) : 0.)
+		<< " CPU ns/byte\n";
+
+	std::FILE* f = std::fopen(cfg.output.c_str(), "w");
+	if (f == nullptr)
+	{
+		std::cerr << "failed to open \"" << cfg.output << "\": " << std::strerror(errno) << '\n';
+		return 1;
+	}
+	write_report(f, cfg, r, nodes);
+	std::fclose(f);
+
+	// destruct all sessions in parallel
+	std::vector<lt::session_proxy> proxies;
+	for (auto& n : nodes) proxies.push_back(n.ses->abort());
+	nodes.clear();
+
+	return r.completed == expected ? 0 : 1;
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[]) try
+{
+	config cfg;
+
+	argv += 1;
+	argc -= 1;
+	while (argc > 0)
+	{
+		lt::string_view opt(argv[0]);
+
+		if (opt == "-h" || opt == "--help")
+		{
+			print_usage();
+			return 0;
+		}
+
+		if (opt.size() == 2 && opt[0] == '-')
+		{
+			if (argc < 2)
+			{
+				std::cerr << "missing value associated with \"" << opt << "\"\n";
+				print_usage();
+				return 1;
+			}
+			if (opt == "-n")
+				cfg.num_sessions = std::atoi(argv[1]);
+			else if (opt == "-s")
+				cfg.num_seeds = std::atoi(argv[1]);
+			else if (opt == "-t")
+				cfg.num_torrents = std::atoi(argv[1]);
+			else if (opt == "-z")
+				cfg.torrent_size = std::atoi(argv[1]);
+			else if (opt == "-p")
+				cfg.piece_size = std::atoi(argv[1]);
+			else if (opt == "-T")
+				cfg.time_limit = std::atoi(argv[1]);
+			else if (opt == "-r")
+				cfg.random_seed = std::strtoull(argv[1], nullptr, 10);
+			else if (opt == "-d")
+				cfg.work_dir = argv[1];
+			else if (opt == "-o")
+				cfg.output = argv[1];
+			else
+			{
+				std::cerr << "unknown option \"" << opt << "\"\n";
+				print_usage();
+				return 1;
+			}
+
+			argv += 1;
+			argc -= 1;
+		}
+		else if (opt == "utp")
+			cfg.utp = true;
+		else if (opt == "encryption")
+			cfg.encryption = true;
+		else
+		{
+			std::cerr << "unknown option \"" << opt << "\"\n";
+			print_usage();
+			return 1;
+		}
+
+		argv += 1;
+		argc -= 1;
+	}
+
+	if (cfg.num_seeds < 1 || cfg.num_seeds >= cfg.num_sessions)
+	{
+		std::cerr << "there must be at least one seed and one downloader\n";
+		return 1;
+	}
+	if (cfg.num_torrents < 1 || cfg.torrent_size < 1)
+	{
+		std::cerr << "invalid torrent count or size\n";
+		return 1;
+	}
+	if (cfg.piece_size < 16 || (cfg.piece_size & (cfg.piece_size - 1)) != 0)
+	{
+		std::cerr << "piece size must be a power of 2, and at least 16 kiB\n";
+		return 1;
+	}
+
+	return run(cfg);
+}
+catch (std::exception const& e)
+{
+	std::cerr << "failed: " << e.what() << '\n';
+	return 1;
+}